@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+/**
+ * In-process binding to the deepquor engine (libdeepquorjni.so, built by
+ * "make jni", which in turn loads libdeepquor.so).
+ *
+ * Moves cross as the engine's one-byte move encoding:
+ *  - bit 0 set: wall drop.  bit 1 set for a row (horizontal) wall, clear
+ *    for a column wall; bits 2-4 are the row/column number and bits 5-7
+ *    the position within it.
+ *  - bit 0 clear: pawn move; ((move & 0xff) >> 1) - 80 is the change in
+ *    square number (x + 9*y; white starts at y=0 heading for y=8).
+ *
+ * Positions cross as POSITION_BYTES bytes, which the library reports
+ * since it depends on the board size it was built for.  On a 9x9 board:
+ *  [0-7]  row walls, one byte per row, bit n = wall at position n
+ *  [8-15] column walls, likewise
+ *  [16]   white pawn square (x + 9*y)
+ *  [17]   black pawn square
+ *  [18]   walls left: white in the low 4 bits, black in the high 4
+ * (Smaller boards have one byte of each kind of wall per wall line.)
+ *
+ * An engine is not thread-safe, apart from cancelSearch(); calls made
+ * while an asynchronous search is running wait for it to finish first.
+ */
+public class DeepQuorEngine
+{
+  public static final int WHITE = 0, BLACK = 1;
+  public static final int POSITION_BYTES;
+
+  /**
+   * Receives news of an asynchronous search, on the engine's thread.
+   * Don't call back into the engine from here; pass results on to
+   * another thread instead.
+   */
+  public interface SearchListener {
+    /** Called every quarter second or so; return false to stop early. */
+    boolean progress(int elapsedMs, int positionsEvaluated, byte bestMove,
+                     int bestScore, int bestComplexity);
+
+    /** Called once with the chosen move. */
+    void done(byte move);
+  }
+
+  static {
+    System.loadLibrary("deepquorjni");
+    POSITION_BYTES = nativePositionBytes();
+  }
+
+  private long handle;
+
+  /** A new game from the standard starting position, white to move. */
+  public DeepQuorEngine() {
+    this(null, WHITE);
+  }
+
+  /**
+   * A game from position (null for the starting position).  Throws
+   * IllegalArgumentException if it isn't one that could be played from:
+   * pawns off the board or on one square, more walls left than a player
+   * starts with, walls overlapping or crossing, or a pawn walled in.
+   */
+  public DeepQuorEngine(byte[] position, int playerToMove) {
+    if ((position != null) && (position.length != POSITION_BYTES))
+      throw new IllegalArgumentException("position must be "
+                                         + POSITION_BYTES + " bytes");
+    handle = nativeCreate(position, playerToMove);
+    if (handle == 0)
+      throw new OutOfMemoryError("can't create engine");
+  }
+
+  /** Frees the engine; it can't be used afterwards. */
+  public synchronized void dispose() {
+    if (handle != 0) {
+      nativeDestroy(handle);
+      handle = 0;
+    }
+  }
+
+  protected void finalize() {
+    dispose();
+  }
+
+  /**
+   * Plays move for player.  Throws IllegalArgumentException, leaving the
+   * game as it was, if it isn't player's turn or move isn't legal.
+   */
+  public synchronized void applyMove(byte move, int player) {
+    nativeApplyMove(handle, move, player);
+  }
+
+  /** Takes back the last move; false if there's none to take back. */
+  public synchronized boolean undoMove() {
+    return nativeUndoMove(handle);
+  }
+
+  /** Finds a move for player, thinking for up to maxTimeMs. */
+  public synchronized byte search(int player, int maxTimeMs) {
+    return nativeSearch(handle, player, maxTimeMs, null, false);
+  }
+
+  /**
+   * Starts finding a move for player on the engine's own thread, and
+   * returns at once.  Swing users should hand the listener's results to
+   * SwingUtilities.invokeLater().
+   */
+  public synchronized void searchAsync(int player, int maxTimeMs,
+                                       SearchListener listener) {
+    nativeSearch(handle, player, maxTimeMs, listener, true);
+  }
+
+  /** Asks a running search to return its best move so far. */
+  public void cancelSearch() {
+    nativeCancel(handle);
+  }
+
+  /** Blocks until any asynchronous search has finished. */
+  public synchronized void waitForSearch() {
+    nativeWait(handle);
+  }
+
+  public synchronized byte[] getPosition() {
+    return nativeGetPosition(handle);
+  }
+
+  public synchronized int getPlayerToMove() {
+    return nativeGetPlayerToMove(handle);
+  }
+
+  /** Every legal move for the player to move. */
+  public synchronized byte[] getLegalMoves() {
+    return nativeGetLegalMoves(handle);
+  }
+
+  private static native int     nativePositionBytes();
+  private static native long    nativeCreate(byte[] position, int player);
+  private static native void    nativeDestroy(long handle);
+  private static native void    nativeApplyMove(long handle, byte move,
+                                                int player);
+  private static native boolean nativeUndoMove(long handle);
+  private static native byte    nativeSearch(long handle, int player,
+                                             int maxTimeMs,
+                                             SearchListener listener,
+                                             boolean async);
+  private static native void    nativeCancel(long handle);
+  private static native void    nativeWait(long handle);
+  private static native byte[]  nativeGetPosition(long handle);
+  private static native int     nativeGetPlayerToMove(long handle);
+  private static native byte[]  nativeGetLegalMoves(long handle);
+}
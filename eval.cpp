@@ -12,6 +12,7 @@
 #include "qposhash.h"
 #include "qmovstack.h"
 #include "qdijkstra.h"
+#include "qevalnet.h"
 #include "qsearcher.h"
 #include "getmoves.h"
 #include "parameters.h"
@@ -36,6 +37,11 @@ static const gint16 qScore_TURN=TURN_SCORE;// Bonus for a whole move ahead
  *   largely varying available paths to the finish.
  */
 
+#if (QBOARD_WALLS > 10) && \
+    (defined(WALL_SCORE_FUDGE) || defined(WALL_COMPLEXITY_FUDGE))
+#error The wall fudge tables in parameters.h stop at 10 walls
+#endif
+
 #ifdef WALL_SCORE_FUDGE
 static gint16 wallScoreFudge[][11] = WALL_SCORE_FUDGE;
 inline static gint16 WALL_SCORE(guint8 p, guint8 o)
@@ -84,12 +90,18 @@ inline guint16 scoreSpread(gint8 *sortedFinishDistances)
 
 
 qPositionEvaluation const *ratePositionByComputation
-(qPosition pos, qPlayer player2move, qPositionInfo *posInfo)
+(qPosition               pos,
+ qPlayer                 player2move,
+ qPositionInfo          *posInfo,
+ const qEvalNet         *net,
+ const qEvalAccumulator *acc)
 /****************************************************************************
  *
  * Examine position and populate *posInfo with score/complexity/computations
  *  of position's evaluation.
  * Fills in posInfo->evaluation[player2move] (and possibly other player too)
+ * If net is given, its verdict is added to the scores; acc (if given) is
+ *  its sums for pos, which saves working them out here.
  * Returns:
  *  NULL - illegal position
  *  non-NULL - legal position & evaluation completed
@@ -114,6 +126,7 @@ qPositionEvaluation const *ratePositionByComputation
 #endif
     posInfo->setScore(player, qScore_PLY + 
 		      WALL_SCORE(pos.numWallsLeft(player), pos.numWallsLeft(player.otherPlayer())));
+    posInfo->setDepth(player, 0);
     posInfo->setComplexity(player,
       BASE_COMPLEXITY +
       WALL_COMPLEXITY(pos.numWallsLeft(player),
@@ -183,6 +196,15 @@ qPositionEvaluation const *ratePositionByComputation
   {
     gint16 tmp = qScore_TURN * (distance[1] - distance[0]);
 
+    if (net && !net->isZero()) {
+      qEvalAccumulator posAcc;
+      if (!acc) {
+	net->refresh(&pos, &posAcc);
+	acc = &posAcc;
+      }
+      tmp += net->evaluate(acc, distance[0], distance[1]);
+    }
+
 #ifdef USE_FINISH_SPREAD_SCORE
     // Add in a factor for the spread in moves to all avail. end squares,
     // This is only a factor if the opponent actually has walls.
@@ -270,6 +292,12 @@ inline void coalesceScores(const qPositionEvaluation &bestEval,
     newEval.complexity = static_cast<guint16>(newVal);
 }
 
+// One ply on top of depth d of analysis
+inline guint8 deeperBy1(guint8 d)
+{
+  return (d < qDepth_max) ? d+1 : qDepth_max;
+}
+
 qPositionInfo    *ratePositionFromNeighbors
 (const qPosition *pos,
  qPlayer          player2move,
@@ -334,6 +362,7 @@ qPositionInfo    *ratePositionFromNeighbors
   // 2. Combine evals into current positions eval.
   //    Take into accont minmax of last two plies???
   *newEval = *bestMove;
+  newEval->depth = deeperBy1(bestMove->depth);
 
   // If we have a winning move, we're done (do this comparison in above loop???)
   if (bestMove->score == qScore_lost) {
@@ -346,6 +375,9 @@ qPositionInfo    *ratePositionFromNeighbors
     return posInfo;
   }
 
+  // We've only looked as deep as the shallowest move still in contention
+  guint8 depth = bestMove->depth;
+
   scoreList.pop_front();
   newEval->complexity = (newEval->complexity+1)/2; // half for each ply???
 
@@ -359,7 +391,10 @@ qPositionInfo    *ratePositionFromNeighbors
       continue;
 
     coalesceScores(*bestMove, *currMove, *newEval);
+    if (currMove->depth < depth)
+      depth = currMove->depth;
   }
+  newEval->depth = deeperBy1(depth);
 
   newEval->score = -newEval->score;
   /*
@@ -9,6 +9,12 @@
 #include "getmoves.h"
 #include "qmovstack.h"
 #include "qdijkstra.h"
+#include "qwallimpact.h"
+#include "parameters.h"
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
 
 IDSTR("$Id: getmoves.cpp,v 1.7 2006/07/29 06:48:51 bmiller Exp $");
 
@@ -118,15 +124,23 @@ qMoveList *getPossiblePawnMoves
   return returnList;
 }
 
-qMoveList *getPlayableMoves(const qPosition  *pos,
-		            qMoveStack       *movStack,
-		            qMoveList        *moveList)
+qMoveList *getPlayableMoves(const qPosition   *pos,
+		            qMoveStack        *movStack,
+		            qMoveList         *moveList,
+		            const qWallImpact *impact)
 {
   if (!pos || !movStack || !moveList)
     return NULL;
 
   qPlayer player2move = movStack->getPlayer2Move();
 
+  // Only a wall cutting every shortest route of a player can leave that
+  // player none, so most walls need no search to show they're legal.
+  if (!impact && pos->numWallsLeft(player2move)) {
+    qWallImpact ownImpact(pos);
+    return getPlayableMoves(pos, movStack, moveList, &ownImpact);
+  }
+
   // Push legal player moves onto the beginning of the list;
   if (!getPossiblePawnMoves(pos, player2move, moveList))
     return NULL;
@@ -135,10 +149,6 @@ qMoveList *getPlayableMoves(const qPosition  *pos,
   if (pos->numWallsLeft(player2move)) {
     qMoveList tmpList;  // Creates empty list
     qMove mv;
-    qDijkstraArg dijArg;
-    dijArg.pos = NULL;
-    dijArg.player = player2move;
-    dijArg.getAllRoutes = FALSE;
 
     movStack->getPossibleWallMoves(&tmpList);
 
@@ -148,24 +158,8 @@ qMoveList *getPlayableMoves(const qPosition  *pos,
       mv = tmpList.front();
       tmpList.pop_front();
 
-      qPosition testpos = *pos;
-      testpos.applyMove(player2move, mv);
-      /* Optimization???:  create some kind of graph or structure that can be
-       * used to quickly test each wall position for legality?
-       * One way or another, this inner section of loop is going to need to
-       * be optimized.  We can view the board as a directed graph, snip some
-       * nodes, and then determine if it's still connected.  Examine
-       * http://en.wikipedia.org/wiki/Connected_graph for ideas.  We should
-       * probably create graphs paralleling the board, one for each player,
-       * with the end squares all coalesced into one combined node with 9
-       * edges.
-       */
-      dijArg.pos = &testpos;
-      if ( qDijkstra(&dijArg) ) {
-        dijArg.player.changePlayer();
-        if ( qDijkstra(&dijArg) )
-	  moveList->push_back(mv);  // Both players could still reach the fin
-      }
+      if (impact->isLegal(mv))
+	moveList->push_back(mv);  // Both players could still reach the fin
     }
 
   }
@@ -200,7 +194,90 @@ qMoveList *getCandidateMoves(const qPosition  *pos,
   return moveList;
 }
 
-bool pruneUselessMoves(const qPosition  *pos,
-                       qMoveList        *moveList)
-{return true;/*???*/};
+bool pruneUselessMoves(const qPosition   *pos,
+                       qMoveList         *moveList,
+                       const qWallImpact *impact)
+{
+  if (!pos || !moveList)
+    return FALSE;
+
+  qMoveListIterator i;
+  bool              keptUseless = FALSE;
+
+  if (!impact) {
+    if (std::find_if(moveList->begin(), moveList->end(),
+		     std::mem_fn(&qMove::isWallMove)) == moveList->end())
+      return TRUE; // Nothing to judge, so no need for the BFS passes
+
+    qWallImpact ownImpact(pos);
+    return pruneUselessMoves(pos, moveList, &ownImpact);
+  }
+
+  for (i = moveList->begin(); i != moveList->end(); ) {
+    if (i->isWallMove() && impact->isUseless(*i, USELESS_WALL_SLACK)) {
+      if (keptUseless) {
+	i = moveList->erase(i);
+	continue;
+      }
+      keptUseless = TRUE;
+    }
+    ++i;
+  }
+  return TRUE;
+}
+
+// Higher sorts first
+static inline bool wallOrderCmp
+(const std::pair<gint32, qMove> &a, const std::pair<gint32, qMove> &b)
+{
+  return a.first > b.first;
+}
+
+// How good a wall looks for whoever drops it: what it costs the opponent
+// less what it costs the dropper.  A wall cutting every shortest route of
+// a player counts its exact lengthening of the route; others the share of
+// routes cut (less than one move's worth).
+static gint32 wallOrderKey
+(const qWallImpact *impact, qPlayer p, qMove wall)
+{
+  gint8 moves = impact->getImpact(p, wall);
+
+  if (moves < 0)
+    return 0;  // Illegal; sorts with the harmless walls
+  if (moves > 0)
+    return moves * QWALLIMPACT_ALL;
+  return impact->getCutShare(p, wall) / 2;
+}
+
+void orderWallMoves(const qPosition   *pos,
+                    qPlayer            player2move,
+                    qMoveList         *moveList,
+                    const qWallImpact *impact)
+{
+  if (!pos || !moveList)
+    return;
+
+  qPlayer     opponent = player2move.otherPlayer();
+  std::vector< std::pair<gint32, qMove> > walls;
+  qMoveListIterator i, firstWall;
+
+  // Pawn moves keep their order, ahead of the walls
+  firstWall = std::stable_partition(moveList->begin(), moveList->end(),
+				    std::mem_fn(&qMove::isPawnMove));
+  if (firstWall == moveList->end())
+    return;
+
+  if (!impact) {
+    qWallImpact ownImpact(pos);
+    orderWallMoves(pos, player2move, moveList, &ownImpact);
+    return;
+  }
+  for (i = firstWall; i != moveList->end(); ++i)
+    walls.push_back(std::make_pair(wallOrderKey(impact, opponent, *i) -
+				   wallOrderKey(impact, player2move, *i),
+				   *i));
+  std::stable_sort(walls.begin(), walls.end(), wallOrderCmp);
+  for (i = firstWall; i != moveList->end(); ++i)
+    *i = walls[i - firstWall].second;
+}
 
@@ -15,15 +15,22 @@
 #include "qmovstack.h"
 #include <deque>
 
+class qWallImpact;
+
 // Populates list of all legally playable moves in a given position,
 // inserting moves at the end of the list.  Tries to append pawn moves closer
 // to the beginning than wall drops.
 // Returns listToPopulate on success, NULL on failure
 // Note: uses the moveStack to accelerate finding possible moves.
 // See the moveStack class for more info.
+//
+// This, pruneUselessMoves() and orderWallMoves() all judge walls by a
+// qWallImpact of pos.  When expanding a position with more than one of
+// them, build it once and pass it to each; otherwise each builds its own.
 qMoveList *getPlayableMoves(const qPosition   *pos,
 			    qMoveStack        *movStack,
-			    qMoveList         *listToPopulate);
+			    qMoveList         *listToPopulate,
+			    const qWallImpact *impact = NULL);
 
 // Same as getPlayableMoves, but this doesn't bother to verify the legality
 // of returned moves.  Thus, it's guaranteed to return a list including every
@@ -44,13 +51,22 @@ qMoveList *getPossiblePawnMoves
  qMoveList       *returnList);
 
 
-// !!! A very good optimization would be if we found a way to throw out all
-// useless moves.  Actually we should keep the first useless wall move we see
-// and throw out all others, thus preserving the ability to play a
+// Throws out useless wall moves: those touching no route of either player
+// within USELESS_WALL_SLACK moves of the shortest (see qWallImpact).  The
+// first useless wall is kept, preserving the ability to play a
 // "throw-away" move.
 // Examining the "offensive" and "defensive" wall strategies used by
 // hardquor might be useful here.
-bool pruneUselessMoves(const qPosition  *pos,
-		       qMoveList        *moveList);
+bool pruneUselessMoves(const qPosition   *pos,
+		       qMoveList         *moveList,
+		       const qWallImpact *impact = NULL);
+
+// Moves pawn moves to the front of moveList, in their existing order, and
+// sorts the wall moves after them, most damaging to player2move's opponent
+// (& least to player2move) first.
+void orderWallMoves(const qPosition   *pos,
+		    qPlayer            player2move,
+		    qMoveList         *moveList,
+		    const qWallImpact *impact = NULL);
 
 #endif // INCLUDE_getmoves_h
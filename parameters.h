@@ -26,12 +26,30 @@
 #define TURN_SCORE   64 /* Choosing multiples of 2 optimizes arithmetic */
 #define PLY_SCORE    32
 #define MOVESTACKSIZ 200 /* Must be big enough to hold entire game */
-#define POSITION_HASH_BUCKETS 49152 /* Make this variable??? */
+
+/* qGrowHash starts with POSITION_HASH_BUCKETS buckets (a power of 2) and
+ * doubles them past POSITION_HASH_MAX_LOAD elts per bucket, moving
+ * POSITION_HASH_REHASH_STEP old buckets per operation (see qposhash.h).
+ */
+#define POSITION_HASH_BUCKETS     4096
+#define POSITION_HASH_MAX_LOAD    2
+#define POSITION_HASH_REHASH_STEP 4
+#if (POSITION_HASH_BUCKETS & (POSITION_HASH_BUCKETS - 1))
+#error POSITION_HASH_BUCKETS must be a power of 2
+#endif
+
 #define HEAP_INITIAL_BLOCK_SIZE 32
 #define HEAP_BLOCK_SIZE       1024
 
 #define COMPTREE_INITIAL_SIZE 32768
 #define COMPTREE_GROW_SIZE    4096
+// Past COMPTREE_PRUNE_PERCENT of this many nodes, searches prune subtrees
+// that no longer contend; once at the limit, they stop.  A prune that
+// doesn't get below COMPTREE_PRUNE_TARGET_PERCENT puts the next one off
+// until the tree has grown halfway to the limit.
+#define COMPTREE_MAX_NODES     2097152 /* ~100 bytes each */
+#define COMPTREE_PRUNE_PERCENT 90
+#define COMPTREE_PRUNE_TARGET_PERCENT 75
 
 #define BASE_COMPLEXITY   36 /* Before applying any modifiers */
 
@@ -99,6 +117,86 @@
 // Used in qsearcher.cpp
 #define MAXTIME_PER_THINK_SERVICE 4000
 #define SUGTIME_PER_THINK_SERVICE 3000
+#define SEARCH_PROGRESS_MS        250 /* Between progress callbacks */
+
+/* Evaluations get persisted to a qEvalJournal if they're settled to within
+ * EVAL_JOURNAL_MAX_COMPLEXITY, proven won/lost, or took at least
+ * EVAL_JOURNAL_MIN_EFFORT new positions to back up.  Up to
+ * EVAL_JOURNAL_QUEUE of them wait in memory for the writer thread, which
+ * syncs to disk every EVAL_JOURNAL_SYNC_MS.
+ */
+#define EVAL_JOURNAL_MAX_COMPLEXITY 24
+#define EVAL_JOURNAL_MIN_EFFORT     2000
+#define EVAL_JOURNAL_QUEUE          4096
+#define EVAL_JOURNAL_SYNC_MS        1000
+
+/* pruneUselessMoves() keeps only one of the walls that touch no route
+ * within USELESS_WALL_SLACK moves of either player's shortest.  With 0,
+ * that's every wall off the shortest routes--most of them, in open play.
+ */
+#define USELESS_WALL_SLACK 2
+
+/* After more than WALL_TABLE_REBUILD_MOVES walls, qSearcher rebuilds the
+ * move stack's wall move table in the background (see qWallTableBuilder),
+ * so each wall's blocked-move list stops carrying walls no longer possible.
+ */
+#define WALL_TABLE_REBUILD_MOVES 5
+
+/* Shape of a qEvalNet (see qevalnet.h): its hidden units (a multiple of 8,
+ * for SSE2), the value each is clipped to, the right shift that brings its
+ * output down to score units, the most it may move a score either way, and
+ * how many buckets distances to goal fall into (the last takes the rest).
+ * Weight files only load into a net of the same shape.
+ */
+#define EVALNET_HIDDEN       16
+#define EVALNET_CLIP         127
+#define EVALNET_SHIFT        8
+#define EVALNET_MAX_ADJUST   (3*TURN_SCORE)
+#define EVALNET_DIST_BUCKETS 16
+#if (EVALNET_HIDDEN % 8)
+#error EVALNET_HIDDEN must be a multiple of 8
+#endif
+
+/* A qRootSplitter (see qrootsplit.h) hands each worker ROOTSPLIT_SLICE_MS
+ * of searching a round, shared among the moves it's given but at least
+ * ROOTSPLIT_MIN_JOB_MS per move, before gathering their evaluations &
+ * deciding which moves still deserve refining.
+ */
+#define ROOTSPLIT_SLICE_MS   500
+#define ROOTSPLIT_MIN_JOB_MS 50
+
+/* A qThreadSplitter (see qthreadsplit.h) searches on THREADSPLIT_LANES
+ * forks of the root's searcher, however many threads run them.  Each
+ * round it hands out up to THREADSPLIT_JOBS_PER_ROUND moves to refine,
+ * for THREADSPLIT_JOB_POSITIONS new positions apiece.  Changing any of
+ * these changes which moves it finds.
+ */
+#define THREADSPLIT_LANES          8
+#define THREADSPLIT_JOBS_PER_ROUND 16
+#define THREADSPLIT_JOB_POSITIONS  1000
+
+/* A qSearchScheduler (see qsched.h) runs searches in slices of up to
+ * SCHED_SLICE_MS, and none shorter than SCHED_MIN_SLICE_MS; a game whose
+ * remaining share of time is less than that gets its answer.  Answers are
+ * due SCHED_DEADLINE_MARGIN_MS before a game's deadline, leaving time to
+ * send them.
+ */
+#define SCHED_SLICE_MS           40
+#define SCHED_MIN_SLICE_MS       5
+#define SCHED_DEADLINE_MARGIN_MS 10
+
+/* qGameArchiveIndex::build() sorts postings in runs of up to this many
+ * per thread (16 bytes each) before spilling them to disk for merging.
+ */
+#define ARCHIVE_INDEX_RUN_POSTINGS (1<<22)
+
+/* A qEndgameSolver (see qendgame.h) gives up on a position after
+ * searching ENDGAME_MAX_NODES positions, or ENDGAME_MAX_PLIES deep, and
+ * remembers up to ENDGAME_CACHE_ENTRIES positions (some 24 bytes each).
+ */
+#define ENDGAME_MAX_NODES     500
+#define ENDGAME_MAX_PLIES     60
+#define ENDGAME_CACHE_ENTRIES (1<<15)
 
 /* Define the following if we support tracking the # of position
  * evaluations used to comprise the current position eval.
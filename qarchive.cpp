@@ -0,0 +1,568 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <queue>
+#include <string>
+#include "qarchive.h"
+#include "qio.h"
+#include "parameters.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+#define QARCHIVE_MAGIC   0x71676172 /* "qgar" */
+#define QARCHIVE_VERSION 1
+#define QINDEX_MAGIC     0x71676978 /* "qgix" */
+#define QINDEX_VERSION   1
+#define QINDEX_FANOUT    65536      /* Values of the key's top 16 bits */
+
+typedef struct _qArchiveHeader {
+  guint32 magic;
+  guint32 version;
+  guint32 boardSize;
+  guint32 numGames;
+  guint64 tableOffset; // Of numGames guint64 game offsets
+} qArchiveHeader;
+
+// Each game: numMoves (2 bytes), its qArchiveResult (1), then the moves
+#define QARCHIVE_GAME_HEADER 3
+
+typedef struct _qIndexHeader {
+  guint32 magic;
+  guint32 version;
+  guint32 postingSize;
+  guint32 numGames;
+  guint64 numPostings;
+  // Then guint64 fanout[QINDEX_FANOUT+1], then the postings
+} qIndexHeader;
+
+guint64 qArchiveKey
+(const qPosition *pos, qPlayer player2move)
+{
+  guint8  buf[QPOSITION_PACKED_BYTES + 1];
+  guint64 h = 0xcbf29ce484222325ULL;
+
+  // FNV-1a over the portable form, then a finalizer (MurmurHash3's) so
+  // the top bits, which the fanout uses, are as mixed as the rest
+  pos->pack(buf);
+  buf[QPOSITION_PACKED_BYTES] = player2move.getPlayerId();
+  for (unsigned i = 0; i < sizeof(buf); ++i) {
+    h ^= buf[i];
+    h *= 0x100000001b3ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static qArchiveResult resultOf
+(const qPosition *pos)
+{
+  if (pos->isWhiteWon())
+    return qArchive_whiteWon;
+  if (pos->isBlackWon())
+    return qArchive_blackWon;
+  return qArchive_unfinished;
+}
+
+static bool postingLess
+(const qArchivePosting &a, const qArchivePosting &b)
+{
+  if (a.key != b.key)
+    return (a.key < b.key);
+  if (a.game != b.game)
+    return (a.game < b.game);
+  return (a.ply < b.ply);
+}
+
+// mmap all of path read-only; returns NULL on failure
+static void *mapFile
+(const char *path, size_t *r_size)
+{
+  struct stat st;
+  void       *map;
+  int         fd;
+
+  if ((fd = ::open(path, O_RDONLY)) < 0)
+    return NULL;
+  if ((fstat(fd, &st) < 0) || (st.st_size == 0)) {
+    ::close(fd);
+    return NULL;
+  }
+  *r_size = st.st_size;
+  map = mmap(NULL, *r_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  return (map == MAP_FAILED) ? NULL : map;
+}
+
+
+/****************************
+ * class qGameArchiveWriter *
+ ****************************/
+qGameArchiveWriter::qGameArchiveWriter()
+  :f(NULL), size(0), failed(FALSE)
+{ ; }
+
+qGameArchiveWriter::~qGameArchiveWriter()
+{
+  close();
+}
+
+bool qGameArchiveWriter::open
+(const char *path)
+{
+  qArchiveHeader hdr = { QARCHIVE_MAGIC, QARCHIVE_VERSION, QBOARD_SIZE, 0, 0 };
+
+  close();
+  if (!(f = fopen(path, "wb")))
+    return FALSE;
+  offsets.clear();
+  size   = sizeof(hdr);
+  failed = (fwrite(&hdr, sizeof(hdr), 1, f) != 1);
+  return !failed;
+}
+
+bool qGameArchiveWriter::add
+(const qMove *moves, guint32 n)
+{
+  qPosition pos(&qInitialPosition);
+  qPlayer   player(qPlayer_white);
+  guint8    gameHdr[QARCHIVE_GAME_HEADER];
+  guint8    buf[256];
+  guint32   i, j;
+
+  if (!f || failed || (n > G_MAXUINT16))
+    return FALSE;
+
+  for (i = 0; i < n; ++i) {
+    pos.applyMove(player, moves[i]);
+    player.changePlayer();
+  }
+  gameHdr[0] = n & 0xff;
+  gameHdr[1] = n >> 8;
+  gameHdr[2] = resultOf(&pos);
+  offsets.push_back(size);
+  failed = (fwrite(gameHdr, sizeof(gameHdr), 1, f) != 1);
+  for (i = 0; (i < n) && !failed; i += j) {
+    for (j = 0; (j < sizeof(buf)) && (i + j < n); ++j)
+      buf[j] = moves[i + j].getEncoding();
+    failed = (fwrite(buf, j, 1, f) != 1);
+  }
+  size += sizeof(gameHdr) + n;
+  return !failed;
+}
+
+bool qGameArchiveWriter::close
+(void)
+{
+  qArchiveHeader hdr = { QARCHIVE_MAGIC, QARCHIVE_VERSION, QBOARD_SIZE,
+			 static_cast<guint32>(offsets.size()), size };
+  bool ok;
+
+  if (!f)
+    return FALSE;
+  ok = (!failed &&
+	(offsets.empty() ||
+	 (fwrite(&offsets[0], sizeof(guint64), offsets.size(), f) ==
+	  offsets.size())) &&
+	(fseek(f, 0, SEEK_SET) == 0) &&
+	(fwrite(&hdr, sizeof(hdr), 1, f) == 1));
+  ok = (fclose(f) == 0) && ok;
+  f  = NULL;
+  return ok;
+}
+
+
+/**********************
+ * class qGameArchive *
+ **********************/
+qGameArchive::qGameArchive()
+  :map(NULL), mapSize(0), offsets(NULL), numGames(0)
+{ ; }
+
+qGameArchive::~qGameArchive()
+{
+  close();
+}
+
+bool qGameArchive::open
+(const char *path)
+{
+  close();
+  if (!(map = mapFile(path, &mapSize)))
+    return FALSE;
+
+  const qArchiveHeader *hdr = static_cast<const qArchiveHeader*>(map);
+  if ((mapSize < sizeof(*hdr)) ||
+      (hdr->magic     != QARCHIVE_MAGIC) ||
+      (hdr->version   != QARCHIVE_VERSION) ||
+      (hdr->boardSize != QBOARD_SIZE) ||
+      (hdr->tableOffset < sizeof(*hdr)) ||
+      (hdr->tableOffset > mapSize) ||
+      (hdr->numGames > (mapSize - hdr->tableOffset) / sizeof(guint64))) {
+    close();
+    return FALSE;
+  }
+  numGames = hdr->numGames;
+  offsets  = reinterpret_cast<const guint64*>
+    (static_cast<const guint8*>(map) + hdr->tableOffset);
+
+  // Every game, moves & all, must lie between the header & the table,
+  // so getGame() & getResult() can't be sent outside the map
+  const guint8 *base = static_cast<const guint8*>(map);
+  for (guint32 i = 0; i < numGames; ++i) {
+    if ((offsets[i] < sizeof(*hdr)) ||
+	(offsets[i] > hdr->tableOffset - QARCHIVE_GAME_HEADER) ||
+	(offsets[i] + QARCHIVE_GAME_HEADER +
+	 (base[offsets[i]] | (base[offsets[i] + 1] << 8)) >
+	 hdr->tableOffset) ||
+	(base[offsets[i] + 2] > qArchive_blackWon)) {
+      close();
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+void qGameArchive::close
+(void)
+{
+  if (map)
+    munmap(map, mapSize);
+  map      = NULL;
+  mapSize  = 0;
+  offsets  = NULL;
+  numGames = 0;
+}
+
+guint32 qGameArchive::getGame
+(guint32 i, const guint8 **r_moves) const
+{
+  g_assert(i < numGames);
+  if (i >= numGames) {
+    *r_moves = NULL;
+    return 0;
+  }
+
+  // open() checked that the game lies within the map
+  const guint8 *game = static_cast<const guint8*>(map) + offsets[i];
+  *r_moves = game + QARCHIVE_GAME_HEADER;
+  return game[0] | (game[1] << 8);
+}
+
+qArchiveResult qGameArchive::getResult
+(guint32 i) const
+{
+  g_assert(i < numGames);
+  if (i >= numGames)
+    return qArchive_unfinished;
+  return static_cast<qArchiveResult>
+    (static_cast<const guint8*>(map)[offsets[i] + 2]);
+}
+
+bool qGameArchive::positionAt
+(guint32 i, guint32 ply, qPosition *r_pos) const
+{
+  const guint8 *moves;
+  qPlayer       player(qPlayer_white);
+
+  if ((i >= numGames) || (ply > getGame(i, &moves)))
+    return FALSE;
+  *r_pos = qInitialPosition;
+  for (guint32 n = 0; n < ply; ++n) {
+    if (!qWireIsLegal(r_pos, player, qMove(moves[n])))
+      return FALSE; // A damaged archive, or a bad game added to it
+    r_pos->applyMove(player, qMove(moves[n]));
+    player.changePlayer();
+  }
+  return TRUE;
+}
+
+
+/***************************
+ * class qGameArchiveIndex *
+ ***************************/
+qGameArchiveIndex::qGameArchiveIndex()
+  :map(NULL), mapSize(0), fanout(NULL), postings(NULL), numPostings(0),
+   numGames(0)
+{ ; }
+
+qGameArchiveIndex::~qGameArchiveIndex()
+{
+  close();
+}
+
+bool qGameArchiveIndex::open
+(const char *path)
+{
+  close();
+  if (!(map = mapFile(path, &mapSize)))
+    return FALSE;
+
+  const qIndexHeader *hdr  = static_cast<const qIndexHeader*>(map);
+  size_t              head = sizeof(*hdr) + (QINDEX_FANOUT+1)*sizeof(guint64);
+  if ((mapSize < head) ||
+      (hdr->magic       != QINDEX_MAGIC) ||
+      (hdr->version     != QINDEX_VERSION) ||
+      (hdr->postingSize != sizeof(qArchivePosting)) ||
+      (head + hdr->numPostings * sizeof(qArchivePosting) > mapSize)) {
+    close();
+    return FALSE;
+  }
+  numPostings = hdr->numPostings;
+  numGames    = hdr->numGames;
+  fanout      = reinterpret_cast<const guint64*>(hdr + 1);
+  postings    = reinterpret_cast<const qArchivePosting*>(fanout + QINDEX_FANOUT+1);
+  if (fanout[QINDEX_FANOUT] != numPostings) {
+    close();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void qGameArchiveIndex::close
+(void)
+{
+  if (map)
+    munmap(map, mapSize);
+  map         = NULL;
+  mapSize     = 0;
+  fanout      = NULL;
+  postings    = NULL;
+  numPostings = 0;
+  numGames    = 0;
+}
+
+guint32 qGameArchiveIndex::lookup
+(const qPosition        *pos,
+ qPlayer                 player2move,
+ const qArchivePosting **r_postings) const
+{
+  qArchivePosting target;
+  const qArchivePosting *first, *last, *end;
+
+  if (!map)
+    return 0;
+  memset(&target, 0, sizeof(target));
+  target.key = qArchiveKey(pos, player2move);
+  first = postings + fanout[target.key >> 48];
+  end   = postings + fanout[(target.key >> 48) + 1];
+
+  // Game & ply 0 sort first among postings with the key
+  first = std::lower_bound(first, end, target, postingLess);
+  for (last = first; (last < end) && (last->key == target.key); ++last)
+    ;
+  *r_postings = first;
+  return last - first;
+}
+
+
+// qGameArchiveIndex::build()'s threads each replay a stretch of games,
+// spilling sorted runs of postings to files named prefix.0, prefix.1, ...
+
+typedef struct _qIndexWorker {
+  const qGameArchive      *archive;
+  std::string              prefix;   // Of its run files
+  guint32                  firstGame, endGame;
+  std::vector<std::string> runs;
+  guint64                  numPostings;
+  bool                     failed;
+} qIndexWorker;
+
+static bool writeRun
+(qIndexWorker *w, std::vector<qArchivePosting> *buf)
+{
+  char  suffix[16];
+  FILE *f;
+  bool  ok;
+
+  std::sort(buf->begin(), buf->end(), postingLess);
+  snprintf(suffix, sizeof(suffix), ".%u", (unsigned)w->runs.size());
+  w->runs.push_back(w->prefix + suffix);
+  if (!(f = fopen(w->runs.back().c_str(), "wb")))
+    return FALSE;
+  ok = (fwrite(&(*buf)[0], sizeof(qArchivePosting), buf->size(), f) ==
+	buf->size());
+  ok = (fclose(f) == 0) && ok;
+  buf->clear();
+  return ok;
+}
+
+static void *indexWorkerMain
+(void *arg)
+{
+  qIndexWorker                *w = static_cast<qIndexWorker*>(arg);
+  std::vector<qArchivePosting> buf;
+  qArchivePosting              p;
+  const guint8                *moves;
+  guint32                      n, ply;
+
+  buf.reserve(ARCHIVE_INDEX_RUN_POSTINGS);
+  for (p.game = w->firstGame; (p.game < w->endGame) && !w->failed; ++p.game) {
+    qPosition pos(&qInitialPosition);
+    qPlayer   player(qPlayer_white);
+
+    n        = w->archive->getGame(p.game, &moves);
+    p.result = w->archive->getResult(p.game);
+    for (ply = 0; ply <= n; ++ply) {
+      // The game ends, as far as we're concerned, at an illegal move
+      bool legal = (ply < n) && qWireIsLegal(&pos, player, qMove(moves[ply]));
+
+      p.key  = qArchiveKey(&pos, player);
+      p.ply  = ply;
+      p.move = legal ? moves[ply] : 0;
+      buf.push_back(p);
+      ++w->numPostings;
+      if ((buf.size() >= ARCHIVE_INDEX_RUN_POSTINGS) && !writeRun(w, &buf))
+	w->failed = TRUE;
+      if (!legal)
+	break;
+      pos.applyMove(player, qMove(moves[ply]));
+      player.changePlayer();
+    }
+  }
+  if (!buf.empty() && !w->failed && !writeRun(w, &buf))
+    w->failed = TRUE;
+  return NULL;
+}
+
+// Where a run file's merge has got to
+typedef struct _qIndexRun {
+  const qArchivePosting *next, *end;
+} qIndexRun;
+
+// For the merge heap: the run whose next posting sorts last is "less"
+static bool runAfter
+(const qIndexRun &a, const qIndexRun &b)
+{
+  return postingLess(*b.next, *a.next);
+}
+
+bool qGameArchiveIndex::build
+(const qGameArchive *archive,
+ const char         *path,
+ int                 numThreads)
+{
+  std::vector<qIndexWorker> workers;
+  std::vector<pthread_t>    threads;
+  std::vector<void *>       maps;
+  std::vector<size_t>       mapSizes;
+  std::vector<qIndexRun>    heap;
+  std::vector<guint64>      counts(QINDEX_FANOUT + 1, 0);
+  std::string               tmpPath = std::string(path) + ".tmp";
+  qIndexHeader              hdr;
+  guint64                   total = 0;
+  bool                      ok = TRUE;
+  FILE                     *f = NULL;
+  size_t                    i, t;
+
+  if (numThreads < 1)
+    numThreads = 1;
+  workers.resize(numThreads);
+  threads.resize(numThreads);
+  for (t = 0; t < workers.size(); ++t) {
+    char suffix[16];
+
+    snprintf(suffix, sizeof(suffix), ".run%u", (unsigned)t);
+    workers[t].archive     = archive;
+    workers[t].prefix      = std::string(path) + suffix;
+    workers[t].firstGame   = (guint64)archive->getNumGames() * t / numThreads;
+    workers[t].endGame     = (guint64)archive->getNumGames() * (t+1) / numThreads;
+    workers[t].numPostings = 0;
+    workers[t].failed      = FALSE;
+    if (pthread_create(&threads[t], NULL, indexWorkerMain, &workers[t])) {
+      workers[t].failed = TRUE;
+      threads[t] = pthread_self();
+    }
+  }
+  for (t = 0; t < workers.size(); ++t) {
+    if (!pthread_equal(threads[t], pthread_self()))
+      pthread_join(threads[t], NULL);
+    ok = ok && !workers[t].failed;
+    total += workers[t].numPostings;
+  }
+
+  // Merge the runs into the index
+  for (t = 0; ok && (t < workers.size()); ++t)
+    for (i = 0; i < workers[t].runs.size(); ++i) {
+      size_t size;
+      void  *map = mapFile(workers[t].runs[i].c_str(), &size);
+      if (!map) {
+	ok = FALSE;
+	break;
+      }
+      maps.push_back(map);
+      mapSizes.push_back(size);
+      qIndexRun run = { static_cast<const qArchivePosting*>(map),
+			static_cast<const qArchivePosting*>(map) +
+			size / sizeof(qArchivePosting) };
+      heap.push_back(run);
+    }
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic       = QINDEX_MAGIC;
+  hdr.version     = QINDEX_VERSION;
+  hdr.postingSize = sizeof(qArchivePosting);
+  hdr.numGames    = archive->getNumGames();
+  hdr.numPostings = total;
+  if (ok && (f = fopen(tmpPath.c_str(), "wb"))) {
+    // Header & fanout go in first as placeholders, to be rewritten once
+    // the counts are in
+    ok = ((fwrite(&hdr, sizeof(hdr), 1, f) == 1) &&
+	  (fwrite(&counts[0], sizeof(guint64), counts.size(), f) ==
+	   counts.size()));
+
+    std::make_heap(heap.begin(), heap.end(), runAfter);
+    while (ok && !heap.empty()) {
+      std::pop_heap(heap.begin(), heap.end(), runAfter);
+      qIndexRun &run = heap.back();
+
+      counts[(run.next->key >> 48) + 1]++;
+      ok = (fwrite(run.next, sizeof(qArchivePosting), 1, f) == 1);
+      if (++run.next == run.end)
+	heap.pop_back();
+      else
+	std::push_heap(heap.begin(), heap.end(), runAfter);
+    }
+    for (i = 1; i < counts.size(); ++i)
+      counts[i] += counts[i-1];
+    ok = (ok &&
+	  (counts.back() == total) &&
+	  (fseek(f, 0, SEEK_SET) == 0) &&
+	  (fwrite(&hdr, sizeof(hdr), 1, f) == 1) &&
+	  (fwrite(&counts[0], sizeof(guint64), counts.size(), f) ==
+	   counts.size()) &&
+	  (fflush(f) == 0) &&
+	  (fsync(fileno(f)) == 0));
+    ok = (fclose(f) == 0) && ok;
+  } else
+    ok = FALSE;
+
+  for (i = 0; i < maps.size(); ++i)
+    munmap(maps[i], mapSizes[i]);
+  for (t = 0; t < workers.size(); ++t)
+    for (i = 0; i < workers[t].runs.size(); ++i)
+      unlink(workers[t].runs[i].c_str());
+
+  if (ok && (rename(tmpPath.c_str(), path) == 0))
+    return TRUE;
+  unlink(tmpPath.c_str());
+  return FALSE;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_archive_h
+#define INCLUDE_archive_h 1
+
+#include <stdio.h>
+#include <vector>
+#include "qtypes.h"
+#include "qposition.h"
+
+/* Archives of played games, indexed by the positions they reached.
+ *
+ * A game archive holds each game as its moves, one qMove::getEncoding()
+ * byte apiece, white moving first from qInitialPosition.  Games are
+ * appended in order; a table of where each one starts goes at the end
+ * when the writer closes, and a qGameArchive mmaps the lot.
+ *
+ * A qGameArchiveIndex maps positions to the games that reached them.  For
+ * every ply of every game it holds a posting: a 64-bit key for the
+ * position & player to move (see qArchiveKey()), the game & ply, the move
+ * played from there and how the game ended.  Postings are sorted by key
+ * (then game & ply), behind a table of where each value of the key's top
+ * 16 bits starts, so a lookup is a binary search of a small stretch of an
+ * mmapped file and never touches the archive.  Keys are hashes; a caller
+ * that can't live with a 1 in 2^64 collision can replay the game to the
+ * ply (qGameArchive::positionAt()) to be sure.
+ *
+ * Walking an index in order visits each distinct position once with all
+ * its postings together, which is what an opening book or a tuning corpus
+ * wants, without replaying the archive again.
+ *
+ * qGameArchiveIndex::build() replays an archive's games on several threads.
+ * Each sorts its postings in runs of up to ARCHIVE_INDEX_RUN_POSTINGS,
+ * spilled to temporary files beside the index, and the runs are merged
+ * into the index, so memory stays bounded however big the archive.
+ */
+
+typedef enum { qArchive_unfinished = 0,
+	       qArchive_whiteWon   = 1,
+	       qArchive_blackWon   = 2 } qArchiveResult;
+
+typedef struct _qArchivePosting {
+  guint64 key;
+  guint32 game;
+  guint16 ply;    // Moves made before the position
+  guint8  move;   // qMove encoding of the move made from it; 0 at the end
+  guint8  result; // A qArchiveResult
+} qArchivePosting;
+
+// Key for pos with player2move to move
+guint64 qArchiveKey(const qPosition *pos, qPlayer player2move);
+
+
+class qGameArchiveWriter {
+ public:
+  qGameArchiveWriter();
+  ~qGameArchiveWriter();
+
+  // Create (or truncate) path.  Returns FALSE on failure.
+  bool open(const char *path);
+
+  // Append a game of n moves.  They're played out to find the result,
+  // but not checked for legality.
+  bool add(const qMove *moves, guint32 n);
+
+  // Writes the game table & header; returns FALSE if anything failed
+  bool close(void);
+
+  guint32 getNumGames(void) const { return offsets.size(); };
+
+ private:
+  FILE                *f;
+  guint64              size;
+  std::vector<guint64> offsets;
+  bool                 failed;
+};
+
+
+class qGameArchive {
+ public:
+  qGameArchive();
+  ~qGameArchive();
+
+  // Returns FALSE if path can't be mapped or isn't an archive (for this
+  // board size), or if any game in it runs outside the file
+  bool open(const char *path);
+  void close(void);
+
+  guint32 getNumGames(void) const { return numGames; };
+
+  // Game i's move encodings (*r_moves) & how many there are
+  guint32 getGame(guint32 i, const guint8 **r_moves) const;
+  qArchiveResult getResult(guint32 i) const;
+
+  // The position in game i after ply moves.  Returns FALSE if there's no
+  // such ply, or a move before it isn't legal.
+  bool positionAt(guint32 i, guint32 ply, qPosition *r_pos) const;
+
+ private:
+  void          *map;
+  size_t         mapSize;
+  const guint64 *offsets;
+  guint32        numGames;
+};
+
+
+class qGameArchiveIndex {
+ public:
+  qGameArchiveIndex();
+  ~qGameArchiveIndex();
+
+  bool open(const char *path);
+  void close(void);
+
+  // The postings for pos with player2move to move: *r_postings points to
+  // the first of them.  Returns how many there are.
+  guint32 lookup(const qPosition        *pos,
+		 qPlayer                 player2move,
+		 const qArchivePosting **r_postings) const;
+
+  // All postings, in key order
+  guint64                getNumPostings(void) const { return numPostings; };
+  const qArchivePosting *getPosting(guint64 i) const { return &postings[i]; };
+
+  // Games in the archive it was built from
+  guint32 getNumGames(void) const { return numGames; };
+
+  // Index archive into path, replaying games on numThreads threads.  The
+  // index is written under a temporary name & renamed into place.  A
+  // game's postings stop at the position where it makes an illegal move.
+  // Returns FALSE on failure.
+  static bool build(const qGameArchive *archive,
+		    const char         *path,
+		    int                 numThreads);
+
+ private:
+  void                  *map;
+  size_t                 mapSize;
+  const guint64         *fanout;   // [k]: postings with top 16 key bits < k
+  const qArchivePosting *postings;
+  guint64                numPostings;
+  guint32                numGames;
+};
+
+#endif // INCLUDE_archive_h
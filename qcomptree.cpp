@@ -7,6 +7,8 @@
 
 
 #include "qcomptree.h"
+#include "qtrace.h"
+#include <algorithm>
 
 IDSTR("$Id: qcomptree.cpp,v 1.10 2006/08/10 07:40:02 bmiller Exp $");
 
@@ -20,11 +22,15 @@ const qComputationNode emptyNode; // Default constructor is empty node
  **************************/
 // Root node is always 1.  Makes life simple and good.
 qComputationTree::qComputationTree()
-:nodeHeap(COMPTREE_INITIAL_SIZE)
+:nodeHeap(COMPTREE_INITIAL_SIZE),
+ nodeLimit(COMPTREE_MAX_NODES),
+ pruneAt(COMPTREE_MAX_NODES / 100 * COMPTREE_PRUNE_PERCENT),
+ tracer(NULL),
+ currentNode(1)
 {
   nodeNum = 2;
   maxNode = nodeHeap.size() - 1;
-  qComputationNode rootNode = nodeHeap.at(1);
+  qComputationNode &rootNode = nodeHeap.at(1);
   rootNode.parentNodeIdx = qComputationTreeNode_invalid;
   rootNode.mv = moveNull;
   rootNode.eval = NULL;
@@ -37,13 +43,20 @@ qComputationTree::~qComputationTree()
 void qComputationTree::initializeTree()
 {
   nodeNum = 2; // lowest free node
+  freeNodes.clear();
+  pruneAt = getPruneMark();
   g_assert(maxNode > nodeNum);
-  qComputationNode rootNode = nodeHeap.at(1);
+  // By reference: a copy would leave the last search's children on the root
+  qComputationNode &rootNode = nodeHeap.at(1);
   rootNode.parentNodeIdx = qComputationTreeNode_invalid;
   rootNode.mv = moveNull;
   rootNode.eval = NULL;
   rootNode.childNodes.resize(0);
   rootNode.posInfo=NULL;
+  rootNode.visits = rootNode.expansions = rootNode.positions = 0;
+  currentNode = 1;
+  if (tracer)
+    tracer->treeInit(1);
 }
 
 qComputationTreeNodeId qComputationTree::addNodeChild
@@ -51,17 +64,28 @@ qComputationTreeNodeId qComputationTree::addNodeChild
  qMove                      mv,
  const qPositionEvaluation *eval)
 {
-  while (maxNode < nodeNum)
-    if (!growNodeHeap())
-      return qComputationTreeNode_invalid;
+  qComputationTreeNodeId newNodeId;
+
+  if (!freeNodes.empty()) {
+    newNodeId = freeNodes.back();
+    freeNodes.pop_back();
+  } else {
+    while (maxNode < nodeNum)
+      if (!growNodeHeap())
+	return qComputationTreeNode_invalid;
+    newNodeId = nodeNum++;
+  }
   qComputationNode &parentNode  = nodeHeap.at(node);
-  qComputationNode &newNode = nodeHeap[nodeNum];
+  qComputationNode &newNode = nodeHeap[newNodeId];
   g_assert(node < nodeNum);
   newNode.parentNodeIdx = node;
   newNode.childNodes.resize(0);
   newNode.mv   = mv;
   newNode.eval = eval;
   newNode.posInfo = NULL;
+  newNode.visits = newNode.expansions = newNode.positions = 0;
+  if (parentNode.childNodes.empty())
+    ++parentNode.expansions;
 
   // Insert in sorted order by - eval.score - eval.complexity (per qcomptree.h)
   gint32 score = static_cast<gint32>(eval->score) - eval->complexity;
@@ -74,9 +98,11 @@ qComputationTreeNodeId qComputationTree::addNodeChild
       break;
     itr++;
   }
-  parentNode.childNodes.insert(itr, nodeNum);
+  parentNode.childNodes.insert(itr, newNodeId);
 
-  return nodeNum++;
+  if (tracer)
+    tracer->treeAdd(node, mv, eval, newNodeId);
+  return newNodeId;
 }
 
 qComputationTreeNodeId qComputationTree::getRootNode() const
@@ -97,6 +123,9 @@ qComputationTreeNodeId qComputationTree::sortNodeChildList
 {
   qComputationTreeNodeList &childList = nodeHeap.at(node).childNodes;
 
+  if (tracer)
+    tracer->treeSort(node);
+
   // Bubblicious sort (OPTIMIZE???  Bubble may be ok since lists are nearly sorted)
   qComputationTreeNodeListIterator itr(childList.begin());
   if (itr==childList.end())
@@ -151,6 +180,20 @@ qComputationTreeNodeId qComputationTree::sortNodeChildList
   return childNodeWithBestEval;
 }
 
+void qComputationTree::walkDown
+(qComputationTreeNodeId child)
+{
+  g_assert(nodeHeap.at(child).parentNodeIdx == currentNode);
+  currentNode = child;
+}
+
+void qComputationTree::walkUp
+(void)
+{
+  g_assert(currentNode != 1);
+  currentNode = nodeHeap.at(currentNode).parentNodeIdx;
+}
+
 qComputationTreeNodeId qComputationTree::getBestScoringChild
 (qComputationTreeNodeId node) const
 // Return best (i.e. lowest, since we're interested in opponent) score
@@ -204,6 +247,9 @@ void qComputationTree::setNodeEval
 (qComputationTreeNodeId     node,
  const qPositionEvaluation *eval)
 {
+  if (tracer)
+    tracer->treeSetEval(node, eval);
+
   if (!eval) {
     // Illegal move.  Remove it from tree.
     g_assert(node > 1);
@@ -216,6 +262,10 @@ void qComputationTree::setNodeEval
       ++itr;
 
     parent.childNodes.erase(itr);
+
+    // The caller still walks back up through this node's parent link,
+    // which freeSubtree leaves alone
+    freeSubtree(node, TRUE);
     return;
   }
 
@@ -264,6 +314,87 @@ void qComputationTree::setNodeEval
   }
 }
 
+guint32 qComputationTree::freeSubtree
+(qComputationTreeNodeId node,
+ bool                   includeNode)
+{
+  std::vector<qComputationTreeNodeId> pending;
+  guint32 numFreed = 0;
+
+  pending.push_back(node);
+  while (!pending.empty()) {
+    qComputationTreeNodeId n = pending.back();
+    qComputationNode &freeing = nodeHeap.at(n);
+
+    pending.pop_back();
+    pending.insert(pending.end(),
+		   freeing.childNodes.begin(), freeing.childNodes.end());
+    freeing.childNodes.clear();
+
+    if ((n != node) || includeNode) {
+      freeing.posInfo = NULL;
+      freeNodes.push_back(n);
+      ++numFreed;
+    }
+  }
+  return numFreed;
+}
+
+guint32 qComputationTree::pruneNode
+(qComputationTreeNodeId node)
+{
+  qComputationTreeNodeId     bestId;
+  const qPositionEvaluation *bestEval, *curEval;
+  gint32                     scoreThresh;
+  guint32                    numFreed = 0;
+
+  if (!nodeHasChildList(node))
+    return 0;
+
+  // Same test for contention as qSearcher::iScanDeeper uses when picking
+  // a move to refine
+  bestId      = sortNodeChildList(node);
+  bestEval    = getNodeEval(bestId);
+  scoreThresh = static_cast<gint32>(bestEval->score) + bestEval->complexity;
+
+  qComputationTreeNodeListConstIterator itr;
+  for (itr  = nodeHeap.at(node).childNodes.begin();
+       itr != nodeHeap.at(node).childNodes.end();
+       ++itr) {
+    curEval = getNodeEval(*itr);
+    if ((*itr != bestId) &&
+	(curEval->score > scoreThresh + curEval->complexity))
+      numFreed += freeSubtree(*itr, FALSE);
+    else
+      numFreed += pruneNode(*itr);
+  }
+  return numFreed;
+}
+
+guint32 qComputationTree::pruneColdSubtrees()
+{
+  qTraceRecorder *t = tracer;
+  guint32         numFreed;
+
+  // Replaying the prune redoes its sorts; don't log them twice
+  if (t)
+    t->treePrune();
+  tracer   = NULL;
+  numFreed = pruneNode(getRootNode());
+  tracer   = t;
+
+  // Well clear of the limit, prune again at the usual mark.  If not, most
+  // of the tree still contends, and sorting it all again after the next
+  // dive would free as little; wait until it's grown halfway to the limit.
+  guint32 inUse = getNumNodes();
+
+  pruneAt = getPruneMark();
+  if ((inUse > nodeLimit / 100 * COMPTREE_PRUNE_TARGET_PERCENT) &&
+      (inUse < nodeLimit))
+    pruneAt = std::max(pruneAt, inUse + (nodeLimit - inUse) / 2);
+  return numFreed;
+}
+
 const qPositionEvaluation *qComputationTree::getNodeEval
 (qComputationTreeNodeId node) const
 {
@@ -276,6 +407,15 @@ qMove qComputationTree::getNodePrecedingMove
   return nodeHeap.at(node).mv;
 }
 
+void qComputationTree::noteNodeScanned
+(qComputationTreeNodeId node, guint32 positions)
+{
+  qComputationNode &n = nodeHeap.at(node);
+
+  ++n.visits;
+  n.positions += positions;
+}
+
 #ifdef DEBUG
 qComputationTreeNodeId qComputationTree::getNodeNthChild
 (qComputationTreeNodeId node, int n)
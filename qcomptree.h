@@ -17,6 +17,7 @@
 #include "qposinfo.h"
 #include "parameters.h"
 
+class qTraceRecorder;
 
 
 /* The idea behind a computation tree is to store whatever state helps
@@ -26,6 +27,19 @@
  * of positions.  It is kept for the life of a single call to iSearch,
  * then recycled from scratch for whatever position iSearch is next
  * called on.
+ *
+ * A long search in a complex position would grow the tree without bound,
+ * so it is kept under a node limit: once past COMPTREE_PRUNE_PERCENT of
+ * it, the searcher calls pruneColdSubtrees() between dives.  That frees
+ * everything below any move that no longer contends at its parent; the
+ * move's node itself stays (with its eval, which lives in the posHash),
+ * so the parent still backs it up and can re-expand it if it comes back
+ * into contention.  Freed nodes are recycled through a free list.
+ *
+ * Each prune sorts the whole tree, so if one frees too little to get
+ * back under COMPTREE_PRUNE_TARGET_PERCENT (most of the tree still
+ * contends), the next waits until the tree has grown halfway from where
+ * it is to the limit, rather than running again after every dive.
  */
 
 typedef guint32 qComputationTreeNodeId;
@@ -88,11 +102,21 @@ public:
   // And now the saved state used to accelerate things...
   qPositionInfo           *posInfo;
 
+  // Effort, for qTreeExporter: scans of the node (scanDeeper calls
+  // returning from it), times its child list was built (again, after a
+  // prune), and positions evaluated by its scans, below it included
+  guint32                  visits;
+  guint32                  expansions;
+  guint32                  positions;
+
 
   qComputationNode()
   :parentNodeIdx(qComputationTreeNode_invalid),
    childNodes(0),
-   posInfo(NULL)
+   posInfo(NULL),
+   visits(0),
+   expansions(0),
+   positions(0)
     {
        this->mv = moveNull;
        this->eval = NULL;
@@ -155,8 +179,22 @@ class qComputationTree {
  * All this would require changing the qComputationTree object to hold
  * a currentNodeId state, so that it becomes a "treewalking" object.
  * Calls such as "walkDown(node)" and "walkUp()" would need to be added.
+ *
+ * The walker is done, but skipping the sorts isn't sound.  Nodes point
+ * at evals in qPositionInfos that transpositions share, so a dive can
+ * change a sibling's score anywhere along the path without the tree
+ * hearing of it, and iScanDeeper's contender loop stops at the first
+ * child past the threshold, trusting the order.  Knowing that no eval
+ * changed would take a stamp bumped by every eval write, and every dive
+ * writes one at each node it passes, so nothing would ever be skipped.
  */
 
+  // The walker.  initializeTree() puts it at the root; the searcher walks
+  // down to a child as it pushes the child's move, and back up as it pops.
+  qComputationTreeNodeId getCurrentNode() const { return currentNode; };
+  void walkDown(qComputationTreeNodeId child);
+  void walkUp(void);
+
   // Because we usually want to find the move yielding the worst possible
   // eval for our opponent, this reverse sorts a node's child list by
   // eval.score + eval.complexity
@@ -179,6 +217,35 @@ class qComputationTree {
 
   qMove getNodePrecedingMove(qComputationTreeNodeId node) const;
 
+  // Count a scan of node that evaluated positions new positions, and read
+  // back what's been spent on it (see qComputationNode)
+  void    noteNodeScanned(qComputationTreeNodeId node, guint32 positions);
+  guint32 getNodeVisits(qComputationTreeNodeId node) const
+    { return nodeHeap.at(node).visits; };
+  guint32 getNodeExpansions(qComputationTreeNodeId node) const
+    { return nodeHeap.at(node).expansions; };
+  guint32 getNodePositions(qComputationTreeNodeId node) const
+    { return nodeHeap.at(node).positions; };
+
+  // Number of nodes in use (including the root), and number allocated
+  guint32 getNumNodes()     const { return nodeNum - 1 - freeNodes.size(); };
+  guint32 getNodeCapacity() const { return nodeHeap.size(); };
+
+  // Soft limit on nodes in use; see the comment at the top of this file
+  void    setNodeLimit(guint32 n)
+    { nodeLimit = n; pruneAt = getPruneMark(); };
+  guint32 getNodeLimit()     const { return nodeLimit; };
+  bool    isPruneDue()       const { return (getNumNodes() >= pruneAt); };
+  bool    isAtNodeLimit()    const { return (getNumNodes() >= nodeLimit); };
+
+  // Free the subtrees below every non-contending child, throughout the
+  // tree.  Only call this from the root (i.e. with nothing being evaluated
+  // on the move stack).  Returns the number of nodes freed.
+  guint32 pruneColdSubtrees();
+
+  // Log our operations to tracer (NULL to stop); see qtrace.h
+  void setTracer(qTraceRecorder *t) { tracer = t; };
+
 #ifdef DEBUG
   // examine the child list
   qComputationTreeNodeId getNodeNthChild(qComputationTreeNodeId node,
@@ -191,8 +258,14 @@ class qComputationTree {
   // grow them (or if we can get by without the graph)
   std::vector<qComputationNode> nodeHeap;
 
-  qComputationTreeNodeId nodeNum; // lowest free node
+  qComputationTreeNodeId nodeNum; // lowest never-used node
   qComputationTreeNodeId maxNode; // highest existing node; alloc more when used
+  std::vector<qComputationTreeNodeId> freeNodes; // Recycled nodes below nodeNum
+  guint32                nodeLimit;
+  guint32                pruneAt;     // Nodes in use that call for a prune
+  qTraceRecorder        *tracer;
+
+  qComputationTreeNodeId currentNode; // Where the walker is
 
   inline bool growNodeHeap()
     { 
@@ -203,6 +276,13 @@ class qComputationTree {
       return TRUE;
     };
   void resetBestChild(qComputationNode &n);
+
+  guint32 getPruneMark() const
+    { return nodeLimit / 100 * COMPTREE_PRUNE_PERCENT; };
+
+  // Return node's descendants (and node too, if includeNode) to freeNodes
+  guint32 freeSubtree(qComputationTreeNodeId node, bool includeNode);
+  guint32 pruneNode(qComputationTreeNodeId node);
 };
 
 extern const qComputationNode emptyNode;
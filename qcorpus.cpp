@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+
+#include "qcorpus.h"
+#include "getmoves.h"
+#include "qdijkstra.h"
+#include "qsearcher.h"
+#include <string.h>
+#include <vector>
+
+IDSTR("$Id$");
+
+
+/****/
+
+#define QCORPUS_MAGIC   0x71636f72 /* "qcor" */
+#define QCORPUS_VERSION 1
+
+// Games this long are abandoned (keeping what they've yielded so far);
+// well inside MOVESTACKSIZ.
+#define QCORPUS_MAX_PLIES 150
+
+// search() criteria for engine-guided games; time is the real limit
+#define QCORPUS_ENGINE_COMPLEXITY 20
+#define QCORPUS_ENGINE_DEPTH      4
+#define QCORPUS_ENGINE_BREADTH    1
+#define QCORPUS_ENGINE_SLOP       3
+
+typedef struct _qCorpusHeader {
+  guint32 magic;
+  guint32 version;
+  guint32 recordSize;
+  guint32 count;
+} qCorpusHeader;
+
+const qCorpusPhase qCorpusPhase_any =
+  { 0, 2*QBOARD_WALLS, 0, QBOARD_WALLS, 0, QBOARD_LAST-1 };
+
+bool qCorpusPhaseMatches
+(const qCorpusPhase *phase, const qPosition *pos, qPlayer player2move)
+{
+  guint8 placed, left, advance;
+
+  if (pos->isWhiteWon() || pos->isBlackWon())
+    return FALSE;
+
+  placed  = 2*QBOARD_WALLS - pos->numWhiteWallsLeft() - pos->numBlackWallsLeft();
+  left    = pos->numWallsLeft(player2move);
+  advance = player2move.isWhite() ? pos->getWhitePawn().y()
+                                  : QBOARD_LAST - pos->getBlackPawn().y();
+
+  return ((placed  >= phase->minWallsPlaced) &&
+	  (placed  <= phase->maxWallsPlaced) &&
+	  (left    >= phase->minWallsLeft)   &&
+	  (left    <= phase->maxWallsLeft)   &&
+	  (advance >= phase->minAdvance)     &&
+	  (advance <= phase->maxAdvance));
+}
+
+
+/***********************
+ * class qCorpusWriter *
+ ***********************/
+qCorpusWriter::qCorpusWriter()
+  :f(NULL), count(0), failed(FALSE)
+{ ; }
+
+qCorpusWriter::~qCorpusWriter()
+{
+  close();
+}
+
+bool qCorpusWriter::open
+(const char *path)
+{
+  qCorpusHeader hdr = { QCORPUS_MAGIC, QCORPUS_VERSION,
+			QCORPUS_RECORD_BYTES, 0 };
+
+  close();
+  if (!(f = fopen(path, "wb")))
+    return FALSE;
+  count  = 0;
+  failed = (fwrite(&hdr, sizeof(hdr), 1, f) != 1);
+  return !failed;
+}
+
+bool qCorpusWriter::close
+(void)
+{
+  qCorpusHeader hdr = { QCORPUS_MAGIC, QCORPUS_VERSION,
+			QCORPUS_RECORD_BYTES, count };
+  bool ok;
+
+  if (!f)
+    return FALSE;
+
+  ok = (!failed &&
+	(fseek(f, 0, SEEK_SET) == 0) &&
+	(fwrite(&hdr, sizeof(hdr), 1, f) == 1));
+  ok = (fclose(f) == 0) && ok;
+  f  = NULL;
+  return ok;
+}
+
+bool qCorpusWriter::add
+(const qPosition *pos, qPlayer player2move, guint32 plies)
+{
+  guint8 rec[QCORPUS_RECORD_BYTES];
+
+  if (!f || failed)
+    return FALSE;
+
+  pos->pack(rec);
+  rec[QPOSITION_PACKED_BYTES]     = player2move.getPlayerId();
+  rec[QPOSITION_PACKED_BYTES + 1] = (plies > 255) ? 255 : plies;
+
+  if (fwrite(rec, sizeof(rec), 1, f) != 1) {
+    failed = TRUE;
+    return FALSE;
+  }
+  ++count;
+  return TRUE;
+}
+
+
+/***********************
+ * class qCorpusReader *
+ ***********************/
+qCorpusReader::qCorpusReader()
+  :f(NULL), count(0)
+{ ; }
+
+qCorpusReader::~qCorpusReader()
+{
+  close();
+}
+
+bool qCorpusReader::open
+(const char *path)
+{
+  qCorpusHeader hdr;
+
+  close();
+  if (!(f = fopen(path, "rb")))
+    return FALSE;
+  if ((fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+      (hdr.magic      != QCORPUS_MAGIC) ||
+      (hdr.version    != QCORPUS_VERSION) ||
+      (hdr.recordSize != QCORPUS_RECORD_BYTES)) {
+    close();
+    return FALSE;
+  }
+  count = hdr.count;
+  return TRUE;
+}
+
+void qCorpusReader::close
+(void)
+{
+  if (f)
+    fclose(f);
+  f = NULL;
+}
+
+bool qCorpusReader::next
+(qPosition *r_pos, qPlayer *r_player2move, guint8 *r_plies)
+{
+  guint8 rec[QCORPUS_RECORD_BYTES];
+
+  if (!f || (fread(rec, sizeof(rec), 1, f) != 1))
+    return FALSE;
+
+  *r_pos = qPosition::unpack(rec);
+  *r_player2move = qPlayer(rec[QPOSITION_PACKED_BYTES] ? qPlayer::BlackPlayer
+			                                 : qPlayer::WhitePlayer);
+  if (r_plies)
+    *r_plies = rec[QPOSITION_PACKED_BYTES + 1];
+  return TRUE;
+}
+
+
+/**************************
+ * class qCorpusGenerator *
+ **************************/
+qCorpusGenerator::qCorpusGenerator
+(guint32 s)
+  :seed(s ? s : 1),
+   wallProb(0.3),
+   greedyProb(0.7),
+   engineMs(0),
+   randomOpening(4),
+   samplesPerGame(4),
+   numGames(0)
+{ ; }
+
+// xorshift32; not much, but ours, so corpora are the same everywhere
+guint32 qCorpusGenerator::random
+(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+qMove qCorpusGenerator::pickMove
+(const qPosition *pos, qPlayer player2move, qMoveStack *movStack)
+{
+  qMoveList           moves;
+  std::vector<qMove>  pawnMoves, wallMoves;
+  qMoveListIterator   i;
+
+  getPlayableMoves(pos, movStack, &moves);
+  for (i = moves.begin(); i != moves.end(); ++i)
+    (i->isPawnMove() ? pawnMoves : wallMoves).push_back(*i);
+  g_assert(!pawnMoves.empty());
+
+  if (!wallMoves.empty() && (uniform() < wallProb))
+    return wallMoves[random() % wallMoves.size()];
+
+  if (uniform() >= greedyProb)
+    return pawnMoves[random() % pawnMoves.size()];
+
+  // Greedy: the pawn move leaving the shortest path to goal (ties broken
+  // at random, so greedy games still differ)
+  qMove  best;
+  gint8  bestDist = -1;
+  guint32 ties = 0;
+  for (std::vector<qMove>::iterator m = pawnMoves.begin();
+       m != pawnMoves.end();
+       ++m) {
+    qPosition    newPos(pos);
+    qDijkstraArg dArg;
+
+    newPos.applyMove(player2move, *m);
+    dArg.pos          = &newPos;
+    dArg.player       = player2move;
+    dArg.getAllRoutes = FALSE;
+    qDijkstra(&dArg);
+
+    if ((bestDist < 0) || (dArg.dist[0] < bestDist)) {
+      best     = *m;
+      bestDist = dArg.dist[0];
+      ties     = 1;
+    } else if ((dArg.dist[0] == bestDist) && (random() % ++ties == 0))
+      best = *m;
+  }
+  return best;
+}
+
+typedef struct _qCorpusCandidate {
+  qPosition pos;
+  qPlayer   player2move;
+  guint8    plies;
+} qCorpusCandidate;
+
+guint32 qCorpusGenerator::generate
+(qCorpusWriter      *corpus,
+ const qCorpusPhase *phase,
+ guint32             count,
+ guint32             maxGames)
+{
+  guint32 added = 0;
+
+  while ((added < count) && (!maxGames || (numGames < maxGames))) {
+    std::vector<qCorpusCandidate> candidates;
+    qMoveStack  movStack(&qInitialPosition, qPlayer_white);
+    qSearcher  *engine = engineMs ? new qSearcher(&qInitialPosition,
+						   qPlayer_white) : NULL;
+    guint8      plies;
+
+    ++numGames;
+    for (plies = 0; plies < QCORPUS_MAX_PLIES; ++plies) {
+      const qPosition *pos    = movStack.getPos();
+      qPlayer          player = movStack.getPlayer2Move();
+      qMove            mv;
+
+      if (pos->isWhiteWon() || pos->isBlackWon())
+	break;
+
+      if (qCorpusPhaseMatches(phase, pos, player)) {
+	qCorpusCandidate c = { *pos, player, plies };
+	candidates.push_back(c);
+      }
+
+      if (engine && (plies >= randomOpening))
+	mv = engine->search(player,
+			    QCORPUS_ENGINE_COMPLEXITY,
+			    QCORPUS_ENGINE_DEPTH,
+			    QCORPUS_ENGINE_BREADTH,
+			    QCORPUS_ENGINE_SLOP,
+			    engineMs,
+			    engineMs);
+      else
+	mv = pickMove(pos, player, &movStack);
+
+      movStack.pushMove(player, mv);
+      if (engine)
+	engine->applyMove(mv, player);
+    }
+    delete engine;
+
+    // Take a random few, in the order they arose
+    guint32 n = candidates.size();
+    guint32 want = samplesPerGame;
+    if (want > count - added)
+      want = count - added;
+    for (guint32 c = 0; (c < n) && want; ++c) {
+      // Selection sampling: keep each with probability want/(n-c)
+      if (random() % (n - c) < want) {
+	if (!corpus->add(&candidates[c].pos, candidates[c].player2move,
+			 candidates[c].plies))
+	  return added;
+	++added;
+	--want;
+      }
+    }
+  }
+  return added;
+}
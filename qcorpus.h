@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_corpus_h
+#define INCLUDE_corpus_h 1
+
+#include <stdio.h>
+#include "qtypes.h"
+#include "qposition.h"
+#include "qmovstack.h"
+
+/* Position corpora, for benchmarking & tuning against many positions of a
+ * known kind rather than the handful we can think of by hand.
+ *
+ * A corpus file is a header followed by fixed-size records, each a
+ * qPosition::pack()'d position, the player to move and how many plies into
+ * its game it arose.  Records are written & read in order, so a corpus of
+ * any size can be streamed without holding it in memory.
+ *
+ * qCorpusGenerator fills corpora by playing games (at random, or guided by
+ * a shortest-path bias or by the engine itself), keeping positions that
+ * fall within a qCorpusPhase.  Every position comes from legal play, so
+ * each is reachable and has a path to goal for both pawns.
+ */
+#define QCORPUS_RECORD_BYTES (QPOSITION_PACKED_BYTES + 2)
+
+class qCorpusWriter {
+ public:
+  qCorpusWriter();
+  ~qCorpusWriter();
+
+  // Create (or truncate) path.  Returns FALSE on failure.
+  bool open(const char *path);
+
+  // Rewrites the header's record count; returns FALSE if anything failed
+  bool close(void);
+
+  bool add(const qPosition *pos, qPlayer player2move, guint32 plies);
+
+  guint32 getCount(void) const { return count; };
+
+ private:
+  FILE   *f;
+  guint32 count;
+  bool    failed;
+};
+
+class qCorpusReader {
+ public:
+  qCorpusReader();
+  ~qCorpusReader();
+
+  // Returns FALSE if path can't be read or isn't a corpus
+  bool open(const char *path);
+  void close(void);
+
+  // Fetch the next record; FALSE at the end of the corpus
+  bool next(qPosition *r_pos, qPlayer *r_player2move, guint8 *r_plies);
+
+  // Records in the corpus, as recorded when it was closed (0 if the
+  // writer never finished)
+  guint32 getCount(void) const { return count; };
+
+ private:
+  FILE   *f;
+  guint32 count;
+};
+
+/* Which positions a corpus wants.  All ranges are inclusive.
+ * "Advancement" is how many rows the player to move's pawn has come from
+ * its starting row.
+ */
+typedef struct _qCorpusPhase {
+  guint8 minWallsPlaced, maxWallsPlaced; // By both players together
+  guint8 minWallsLeft,   maxWallsLeft;   // For the player to move
+  guint8 minAdvance,     maxAdvance;
+} qCorpusPhase;
+
+// Every non-won position
+extern const qCorpusPhase qCorpusPhase_any;
+
+bool qCorpusPhaseMatches(const qCorpusPhase *phase, const qPosition *pos,
+			 qPlayer player2move);
+
+class qCorpusGenerator {
+ public:
+  // The same seed & settings generate the same corpus
+  qCorpusGenerator(guint32 seed = 1);
+
+  // Chance that a move is a wall drop, when any are playable
+  void setWallProbability(double p)   { wallProb = p; };
+
+  // Chance that a pawn move is the one that most shortens the mover's
+  // path, rather than any pawn move at all
+  void setGreedyProbability(double p) { greedyProb = p; };
+
+  // If nonzero, have the engine choose each move with this much time
+  // (after randomOpening random plies, so games don't all look alike).
+  // Much slower, but gives positions that look like real games.
+  void setEngineTime(gint32 ms)       { engineMs = ms; };
+  void setRandomOpening(guint8 plies) { randomOpening = plies; };
+
+  // Take at most this many positions from any one game, so a corpus
+  // isn't dominated by near-identical neighbours
+  void setSamplesPerGame(guint32 n)   { samplesPerGame = n ? n : 1; };
+
+  // Play games until count positions matching phase have been added to
+  // corpus, or maxGames games have been played (0 = no limit).
+  // Returns the number of positions added.
+  guint32 generate(qCorpusWriter      *corpus,
+		   const qCorpusPhase *phase,
+		   guint32             count,
+		   guint32             maxGames = 0);
+
+  guint32 getNumGames(void) const { return numGames; };
+
+ private:
+  guint32 seed;
+  double  wallProb;
+  double  greedyProb;
+  gint32  engineMs;
+  guint8  randomOpening;
+  guint32 samplesPerGame;
+  guint32 numGames;
+
+  guint32 random(void);
+  double  uniform(void) { return random() / 4294967296.0; };
+
+  qMove   pickMove(const qPosition *pos, qPlayer player2move,
+		   qMoveStack *movStack);
+};
+
+#endif // INCLUDE_corpus_h
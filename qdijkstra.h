@@ -19,7 +19,7 @@ typedef struct _qDijkstra {
   bool getAllRoutes;    // in: TRUE  == find every accessible finish
                         //     FALSE == stop after finding fastest route 
 
-  gint8 dist[10];  // out: number of moves required to reach finish square(s)
+  gint8 dist[QBOARD_SIZE+1]; // out: number of moves required to reach finish square(s)
                    // dist[0] is # moves to reach fastest possible finish
                    // dist[1] is # moves to reach next closest finish, etc.
                    // dist[N] == -1 indicates no more accessible finishes.
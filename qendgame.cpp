@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "qendgame.h"
+#include "qdijkstra.h"
+#include "qwallimpact.h"
+#include "getmoves.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+// Higher sorts first
+static inline bool wallCmp
+(const std::pair<gint32, qMove> &a, const std::pair<gint32, qMove> &b)
+{
+  return a.first > b.first;
+}
+
+// What wall costs p, as getmoves.cpp's wallOrderKey() counts it: moves
+// added to p's route if it cuts them all, else its share of the routes
+static gint32 wallCost
+(const qWallImpact *impact, qPlayer p, qMove wall, gint8 moves)
+{
+  if (moves > 0)
+    return moves * QWALLIMPACT_ALL;
+  return impact->getCutShare(p, wall) / 2;
+}
+
+
+/************************
+ * class qEndgameSolver *
+ ************************/
+qEndgameSolver::qEndgameSolver()
+  :nodes(0), outOfNodes(FALSE), lastNodes(0), totalNodes(0)
+{ ; }
+
+bool qEndgameSolver::solve
+(const qPosition     *pos,
+ qPlayer              player2move,
+ qPositionEvaluation *r_eval)
+{
+  guint8 packed[QPOSITION_PACKED_BYTES];
+  guint8 result, plies;
+
+  if (!applies(pos))
+    return FALSE;
+  if (cache.empty())
+    cache.resize(ENDGAME_CACHE_ENTRIES); // Zeroed, so unused
+
+  nodes      = 0;
+  outOfNodes = FALSE;
+  result     = iSolve(pos, player2move, ENDGAME_MAX_PLIES, &plies);
+  lastNodes   = nodes;
+  totalNodes += nodes;
+
+  if (result == UNKNOWN) {
+    // Don't spend the effort on it again
+    if (outOfNodes) {
+      entry *e;
+
+      pos->pack(packed);
+      e = probe(packed, player2move);
+      memcpy(e->packed, packed, sizeof(packed));
+      e->player = player2move.getPlayerId() + 1;
+      e->result = UNKNOWN;
+      e->depth  = 0xff;
+    }
+    return FALSE;
+  }
+  *r_eval       = (result == WON) ? *positionEval_won : *positionEval_lost;
+  r_eval->depth = plies;
+  return TRUE;
+}
+
+// The slot for packed (as qPosition::pack() leaves it) with player2move
+// to move; it may hold another position
+qEndgameSolver::entry *qEndgameSolver::probe
+(const guint8 *packed, qPlayer player2move)
+{
+  guint32 h = 2166136261U ^ player2move.getPlayerId(); // FNV-1a
+
+  for (int i = 0; i < QPOSITION_PACKED_BYTES; ++i) {
+    h ^= packed[i];
+    h *= 16777619U;
+  }
+  return &cache[h % cache.size()];
+}
+
+// WON, LOST or UNKNOWN for player2move at pos, searching at most depth
+// plies further, & if known how many plies to the end (*r_plies)
+guint8 qEndgameSolver::iSolve
+(const qPosition *pos,
+ qPlayer          player2move,
+ guint8           depth,
+ guint8          *r_plies)
+{
+  guint8    packed[QPOSITION_PACKED_BYTES];
+  guint8    result = LOST, plies = 0, childPlies;
+  qMoveList moves;
+  qMoveListIterator m;
+  entry    *e;
+
+  *r_plies = 0;
+  if (pos->isLost(player2move))
+    return LOST;
+  if (pos->isWon(player2move))
+    return WON;
+
+  pos->pack(packed);
+  e = probe(packed, player2move);
+  if ((e->player == player2move.getPlayerId() + 1) &&
+      !memcmp(e->packed, packed, sizeof(packed))) {
+    if (e->result != UNKNOWN) {
+      *r_plies = e->plies;
+      return e->result;
+    }
+    if (e->depth >= depth)
+      return UNKNOWN;
+  }
+  if (!depth)
+    return UNKNOWN;
+  if (++nodes > ENDGAME_MAX_NODES) {
+    outOfNodes = TRUE;
+    return UNKNOWN;
+  }
+
+  // One winning move will do; a loss takes every move losing, & lasts as
+  // long as the longest of them
+  getMoves(pos, player2move, &moves);
+  if (moves.empty())
+    return UNKNOWN; // Boxed in; leave it to the general search
+  for (m = moves.begin(); m != moves.end(); ++m) {
+    qPosition next(pos);
+    guint8    r;
+
+    next.applyMove(player2move, *m);
+    r = iSolve(&next, player2move.otherPlayer(), depth - 1, &childPlies);
+    if (outOfNodes)
+      return UNKNOWN;
+    if (r == LOST) {
+      result = WON;
+      plies  = childPlies + 1;
+      break;
+    }
+    if (r == UNKNOWN)
+      result = UNKNOWN;
+    else if (childPlies + 1 > plies)
+      plies = childPlies + 1;
+  }
+
+  // The slot may have been taken by a position further down
+  e = probe(packed, player2move);
+  memcpy(e->packed, packed, sizeof(packed));
+  e->player = player2move.getPlayerId() + 1;
+  e->result = result;
+  e->plies  = plies;
+  e->depth  = depth;
+  *r_plies  = plies;
+  return result;
+}
+
+// Every legal move for player2move at pos, the likeliest first (see
+// qendgame.h): pawn moves leaving the shortest route, walls cutting the
+// opponent's shortest routes (most damaging first), the other pawn moves,
+// then the other walls
+void qEndgameSolver::getMoves
+(const qPosition *pos,
+ qPlayer          player2move,
+ qMoveList       *r_moves) const
+{
+  qMoveList         pawnMoves, slowerPawnMoves;
+  qMoveListIterator m;
+  std::vector<gint8> dist;
+  gint8             best = -1;
+  size_t            i;
+
+  getPossiblePawnMoves(pos, player2move, &pawnMoves);
+  for (m = pawnMoves.begin(); m != pawnMoves.end(); ++m) {
+    qPosition    next(pos);
+    qDijkstraArg dArg;
+
+    next.applyMove(player2move, *m);
+    if (next.isWon(player2move))
+      dArg.dist[0] = 0;
+    else {
+      dArg.pos          = &next;
+      dArg.player       = player2move;
+      dArg.getAllRoutes = FALSE;
+      qDijkstra(&dArg);
+    }
+    dist.push_back(dArg.dist[0]);
+    if ((dArg.dist[0] >= 0) && ((best < 0) || (dArg.dist[0] < best)))
+      best = dArg.dist[0];
+  }
+  for (i = 0; i < pawnMoves.size(); ++i)
+    if (dist[i] == best)
+      r_moves->push_back(pawnMoves[i]);
+    else
+      slowerPawnMoves.push_back(pawnMoves[i]);
+  if (!pos->numWallsLeft(player2move)) {
+    r_moves->insert(r_moves->end(),
+		    slowerPawnMoves.begin(), slowerPawnMoves.end());
+    return;
+  }
+
+  qWallImpact impact(pos);
+  qPlayer     opponent = player2move.otherPlayer();
+  std::vector< std::pair<gint32, qMove> > walls;
+  qMoveList   otherWalls;
+  guint8      rc, x;
+  int         roc;
+
+  for (roc = COL; roc <= ROW; ++roc)
+    for (rc = 0; rc < QWALL_LINES; ++rc)
+      for (x = 0; x < QWALL_LINES; ++x) {
+	if (!pos->canPutWall(roc, rc, x))
+	  continue;
+
+	qMove wall((bool)roc, rc, x);
+	gint8 theirs, ours;
+
+	ours = impact.getImpact(player2move, wall);
+	if (!impact.getCutShare(opponent, wall)) {
+	  // Leaves the opponent a shortest route, so only ours can be cut
+	  if (ours >= 0)
+	    otherWalls.push_back(wall);
+	  continue;
+	}
+	theirs = impact.getImpact(opponent, wall);
+	if ((theirs < 0) || (ours < 0))
+	  continue; // Illegal
+	walls.push_back(std::make_pair(wallCost(&impact, opponent, wall, theirs) -
+				       wallCost(&impact, player2move, wall, ours),
+				       wall));
+      }
+  std::stable_sort(walls.begin(), walls.end(), wallCmp);
+  for (i = 0; i < walls.size(); ++i)
+    r_moves->push_back(walls[i].second);
+  r_moves->insert(r_moves->end(),
+		  slowerPawnMoves.begin(), slowerPawnMoves.end());
+  r_moves->insert(r_moves->end(), otherWalls.begin(), otherWalls.end());
+}
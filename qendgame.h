@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_endgame_h
+#define INCLUDE_endgame_h 1
+
+#include <vector>
+#include "qtypes.h"
+#include "qposition.h"
+#include "qposinfo.h"
+#include "qmovstack.h"
+#include "parameters.h"
+
+/* qEndgameSolver
+ * Solves positions where at most one player has walls left.
+ *
+ * A player out of walls can only race, and walls only ever lengthen its
+ * shortest route, so its best play is usually a shortest-route pawn move.
+ * The other side's walls mostly matter where they touch those routes.
+ * So the solver tries moves in this order:
+ *   - for either side, pawn moves leaving the shortest route to goal
+ *     (all of them, where several tie);
+ *   - for the side with walls, walls cutting at least one of the
+ *     opponent's shortest routes, most damaging first;
+ *   - then every other legal move: the remaining pawn moves (the pawns can
+ *     block each other, so a detour can pay), & the walls touching none of
+ *     the opponent's shortest routes.
+ * One winning move settles a position, and the likely ones usually win
+ * if anything does, so most won endgames solve in a few hundred
+ * positions.  A loss takes every legal move refuted, so a side with walls
+ * left is rarely shown to have lost within the node limit.  Either way a
+ * result is exact: a won or lost evaluation with complexity 0, which the
+ * general search never needs to look past.
+ *
+ * The search is bounded: it gives up past ENDGAME_MAX_PLIES deep or
+ * ENDGAME_MAX_NODES positions, leaving the position to the general
+ * search.  What it learns (including giving up) is kept in a cache of
+ * ENDGAME_CACHE_ENTRIES positions, allocated on first use, so positions
+ * reached again cost one probe.
+ *
+ * Each qSearcher has its own; it isn't safe to share between threads.
+ */
+
+class qEndgameSolver {
+ public:
+  qEndgameSolver();
+
+  // Does pos have at most one player with walls left?
+  static bool applies(const qPosition *pos)
+    { return (!pos->numWhiteWallsLeft() || !pos->numBlackWallsLeft()); };
+
+  // Try to solve pos with player2move to move.  If it's solved, *r_eval
+  // is positionEval_won or _lost with depth the plies to the end (in the
+  // line found), and we return TRUE.
+  bool solve(const qPosition     *pos,
+	     qPlayer              player2move,
+	     qPositionEvaluation *r_eval);
+
+  // Positions searched by the last solve() & all of them
+  guint32 getLastNodes(void) const  { return lastNodes; };
+  guint64 getTotalNodes(void) const { return totalNodes; };
+
+ private:
+  enum { UNKNOWN = 0, WON = 1, LOST = 2 };
+
+  typedef struct _entry {
+    guint8 packed[QPOSITION_PACKED_BYTES];
+    guint8 player;  // 0 if the entry's unused, else player2move's id + 1
+    guint8 result;
+    guint8 plies;   // To the end, if WON or LOST
+    guint8 depth;   // Plies searched, if UNKNOWN; 0xff if we gave up
+  } entry;
+
+  std::vector<entry> cache;
+  guint32            nodes;
+  bool               outOfNodes;
+  guint32            lastNodes;
+  guint64            totalNodes;
+
+  entry  *probe(const guint8 *packed, qPlayer player2move);
+  guint8  iSolve(const qPosition *pos, qPlayer player2move, guint8 depth,
+		 guint8 *r_plies);
+  void    getMoves(const qPosition *pos, qPlayer player2move,
+		   qMoveList *r_moves) const;
+};
+
+#endif // INCLUDE_endgame_h
@@ -0,0 +1,531 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+
+#include "qevaljournal.h"
+#include "parameters.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+IDSTR("$Id$");
+
+
+/****/
+
+#define QEVAL_JOURNAL_MAGIC  0x7165766a /* "qevj" */
+#define QEVAL_SNAPSHOT_MAGIC 0x71657673 /* "qevs" */
+#define QEVAL_VERSION        1
+
+typedef struct _qEvalFileHeader {
+  guint32 magic;
+  guint32 version;
+  guint32 recordSize;
+  guint32 numRecords; // Snapshots only; 0 in journals
+} qEvalFileHeader;
+
+static guint32 recordChecksum
+(const qEvalRecord *r)
+{
+  // FNV-1a over every word but the check itself
+  const guint32 *w = reinterpret_cast<const guint32*>(r);
+  guint32 h = 2166136261U;
+  unsigned int i;
+
+  for (i = 0; i < QEVAL_KEY_WORDS + 2; ++i) {
+    h ^= w[i];
+    h *= 16777619U;
+  }
+  return h ? h : 1;
+}
+
+// Read or write exactly len bytes, riding out signals & short transfers
+static bool readFully
+(int fd, void *buf, size_t len)
+{
+  char *p = static_cast<char*>(buf);
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return FALSE;
+    p   += n;
+    len -= n;
+  }
+  return TRUE;
+}
+
+static bool writeFully
+(int fd, const void *buf, size_t len)
+{
+  const char *p = static_cast<const char*>(buf);
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return FALSE;
+    p   += n;
+    len -= n;
+  }
+  return TRUE;
+}
+
+
+/***************
+ * qEvalRecord *
+ ***************/
+void qEvalRecordPack
+(qEvalRecord *r, const qPosition *pos, const qPositionInfo *posInfo)
+{
+  r->key[QEVAL_KEY_WORDS-1] = 0; // Zero the padding past the position's end
+  memcpy(r->key, pos, sizeof(*pos));
+  for (gint8 p = qPlayer::WhitePlayer; p <= qPlayer::BlackPlayer; ++p) {
+    qPositionEvaluation eval;
+    eval.score      = posInfo->getScore(qPlayer(p));
+    eval.complexity = posInfo->getComplexity(qPlayer(p));
+    r->data[p] = qPackEval(&eval);
+  }
+  r->check = recordChecksum(r);
+}
+
+bool qEvalRecordApply
+(const qEvalRecord *r, qPositionInfo *posInfo)
+{
+  bool copied = FALSE;
+
+  for (gint8 p = qPlayer::WhitePlayer; p <= qPlayer::BlackPlayer; ++p) {
+    qPlayer player(p);
+    qPositionEvaluation stored;
+
+    if (r->data[p] == qPackEval(positionEval_none))
+      continue;
+    qUnpackEval(r->data[p], &stored);
+    if (!posInfo->evalExists(player) ||
+	(stored.complexity < posInfo->getComplexity(player))) {
+      posInfo->set(player, &stored);
+      copied = TRUE;
+    }
+  }
+  return copied;
+}
+
+void qEvalRecordMerge
+(qEvalRecord *dst, const qEvalRecord *src)
+{
+  const guint32 none = qPackEval(positionEval_none);
+
+  for (int p = 0; p < 2; ++p) {
+    if (src->data[p] == none)
+      continue;
+    if ((dst->data[p] == none) ||
+	((src->data[p] & 0xffff) < (dst->data[p] & 0xffff)))
+      dst->data[p] = src->data[p];
+  }
+  dst->check = recordChecksum(dst);
+}
+
+bool qEvalRecordIsValid
+(const qEvalRecord *r)
+{
+  return (r->check == recordChecksum(r));
+}
+
+bool qEvalRecordKeyLess
+(const qEvalRecord &a, const qEvalRecord &b)
+{
+  for (unsigned int i = 0; i < QEVAL_KEY_WORDS; ++i)
+    if (a.key[i] != b.key[i])
+      return (a.key[i] < b.key[i]);
+  return FALSE;
+}
+
+
+/**********************
+ * class qEvalJournal *
+ **********************/
+qEvalJournal::qEvalJournal()
+  :fd(-1), running(FALSE), stopping(FALSE), queueHead(0), queueCount(0),
+   numWritten(0), numDropped(0)
+{
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&cond, NULL);
+}
+
+qEvalJournal::~qEvalJournal()
+{
+  close();
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&mutex);
+}
+
+bool qEvalJournal::open
+(const char *path)
+{
+  qEvalFileHeader hdr;
+  struct stat     st;
+
+  if (running || !path)
+    return FALSE;
+
+  if ((fd = ::open(path, O_RDWR|O_CREAT, 0644)) < 0)
+    return FALSE;
+
+  if ((fstat(fd, &st) < 0))
+    goto fail;
+
+  if (st.st_size < static_cast<off_t>(sizeof(hdr))) {
+    // New (or so new it never got a whole header): start it
+    hdr.magic      = QEVAL_JOURNAL_MAGIC;
+    hdr.version    = QEVAL_VERSION;
+    hdr.recordSize = sizeof(qEvalRecord);
+    hdr.numRecords = 0;
+    if ((ftruncate(fd, 0) < 0) ||
+	!writeFully(fd, &hdr, sizeof(hdr)) ||
+	(fdatasync(fd) < 0))
+      goto fail;
+  } else {
+    if (!readFully(fd, &hdr, sizeof(hdr)) ||
+	(hdr.magic      != QEVAL_JOURNAL_MAGIC) ||
+	(hdr.version    != QEVAL_VERSION) ||
+	(hdr.recordSize != sizeof(qEvalRecord)))
+      goto fail;
+
+    // Trim a record left half-written by a crash, so ours line up
+    off_t whole = sizeof(hdr) +
+      ((st.st_size - sizeof(hdr)) / sizeof(qEvalRecord)) * sizeof(qEvalRecord);
+    if ((whole != st.st_size) && (ftruncate(fd, whole) < 0))
+      goto fail;
+  }
+  if (lseek(fd, 0, SEEK_END) < 0)
+    goto fail;
+
+  queue.resize(EVAL_JOURNAL_QUEUE);
+  queueHead = queueCount = 0;
+  stopping  = FALSE;
+  if (pthread_create(&writerThread, NULL, &qEvalJournal::writerMain, this))
+    goto fail;
+  running = TRUE;
+  return TRUE;
+
+ fail:
+  ::close(fd);
+  fd = -1;
+  return FALSE;
+}
+
+void qEvalJournal::close()
+{
+  if (!running)
+    return;
+
+  pthread_mutex_lock(&mutex);
+  stopping = TRUE;
+  pthread_cond_signal(&cond);
+  pthread_mutex_unlock(&mutex);
+  pthread_join(writerThread, NULL);
+
+  ::close(fd);
+  fd      = -1;
+  running = FALSE;
+}
+
+bool qEvalJournal::isWorthKeeping
+(const qPositionInfo *posInfo, qPlayer player, guint32 effort)
+{
+  if (!posInfo->isPosLegal() || !posInfo->evalExists(player))
+    return FALSE;
+
+  gint16 score = posInfo->getScore(player);
+  return ((score == qScore_won) || (score == qScore_lost) ||
+	  (posInfo->getComplexity(player) <= EVAL_JOURNAL_MAX_COMPLEXITY) ||
+	  (effort >= EVAL_JOURNAL_MIN_EFFORT));
+}
+
+void qEvalJournal::submit
+(const qPosition *pos, const qPositionInfo *posInfo)
+{
+  qEvalRecord r;
+
+  if (!running)
+    return;
+
+  // Do the packing outside of the lock
+  qEvalRecordPack(&r, pos, posInfo);
+
+  pthread_mutex_lock(&mutex);
+  if (queueCount == queue.size())
+    ++numDropped;
+  else {
+    queue[(queueHead + queueCount) % queue.size()] = r;
+    if (queueCount++ == 0)
+      pthread_cond_signal(&cond);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+void *qEvalJournal::writerMain
+(void *arg)
+{
+  static_cast<qEvalJournal*>(arg)->writerLoop();
+  return NULL;
+}
+
+void qEvalJournal::writerLoop()
+{
+  std::vector<qEvalRecord> batch;
+  struct timeval lastSync;
+  bool  unsynced = FALSE;
+  bool  done     = FALSE;
+  bool  broken   = FALSE;              // Gave up on the file
+  off_t goodEnd  = lseek(fd, 0, SEEK_CUR); // End of the last whole record
+
+  batch.reserve(queue.size());
+  gettimeofday(&lastSync, NULL);
+
+  while (!done) {
+    struct timeval  now;
+    struct timespec deadline;
+
+    // Wake up by the time anything written needs syncing
+    if (!unsynced)
+      gettimeofday(&lastSync, NULL);
+    deadline.tv_sec  = lastSync.tv_sec + EVAL_JOURNAL_SYNC_MS / 1000;
+    deadline.tv_nsec = (lastSync.tv_usec +
+			(EVAL_JOURNAL_SYNC_MS % 1000) * 1000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    // Grab whatever's queued; the disk work happens with the lock dropped
+    pthread_mutex_lock(&mutex);
+    while (!queueCount && !stopping)
+      if (pthread_cond_timedwait(&cond, &mutex, &deadline) == ETIMEDOUT)
+	break;
+    while (queueCount) {
+      batch.push_back(queue[queueHead]);
+      queueHead = (queueHead + 1) % queue.size();
+      --queueCount;
+    }
+    done = stopping;
+    pthread_mutex_unlock(&mutex);
+
+    if (!batch.empty()) {
+      size_t len = batch.size() * sizeof(qEvalRecord);
+      bool   ok  = !broken && writeFully(fd, &batch[0], len);
+
+      if (ok)
+	goodEnd += len;
+      else if (!broken &&
+	       ((ftruncate(fd, goodEnd) < 0) ||
+		(lseek(fd, goodEnd, SEEK_SET) != goodEnd)))
+	// A short write left part of the batch behind, and we can't cut it
+	// off; anything appended after it would be misaligned, so stop
+	broken = TRUE;
+
+      pthread_mutex_lock(&mutex);
+      if (ok)
+	numWritten += batch.size();
+      else
+	numDropped += batch.size(); // Disk full or gone; keep searching
+      pthread_mutex_unlock(&mutex);
+      batch.clear();
+      if (ok)
+	unsynced = TRUE;
+    }
+
+    // Sync at most every EVAL_JOURNAL_SYNC_MS, and on the way out
+    gettimeofday(&now, NULL);
+    if (unsynced &&
+	(done ||
+	 ((now.tv_sec - lastSync.tv_sec) * 1000 +
+	  (now.tv_usec - lastSync.tv_usec) / 1000 >= EVAL_JOURNAL_SYNC_MS))) {
+      fdatasync(fd);
+      unsynced = FALSE;
+    }
+  }
+}
+
+
+/****************************
+ * class qEvalJournalReader *
+ ****************************/
+qEvalJournalReader::qEvalJournalReader()
+  :fd(-1), numBad(0)
+{ ; }
+
+qEvalJournalReader::~qEvalJournalReader()
+{
+  close();
+}
+
+bool qEvalJournalReader::open
+(const char *path)
+{
+  qEvalFileHeader hdr;
+
+  close();
+  if ((fd = ::open(path, O_RDONLY)) < 0)
+    return FALSE;
+  if (!readFully(fd, &hdr, sizeof(hdr)) ||
+      (hdr.magic      != QEVAL_JOURNAL_MAGIC) ||
+      (hdr.version    != QEVAL_VERSION) ||
+      (hdr.recordSize != sizeof(qEvalRecord))) {
+    close();
+    return FALSE;
+  }
+  numBad = 0;
+  return TRUE;
+}
+
+void qEvalJournalReader::close()
+{
+  if (fd >= 0)
+    ::close(fd);
+  fd = -1;
+}
+
+bool qEvalJournalReader::next
+(qEvalRecord *r_record)
+{
+  if (fd < 0)
+    return FALSE;
+
+  // A partial record at the end reads as end of journal
+  while (readFully(fd, r_record, sizeof(*r_record))) {
+    if (qEvalRecordIsValid(r_record))
+      return TRUE;
+    ++numBad;
+  }
+  return FALSE;
+}
+
+
+/***********************
+ * class qEvalSnapshot *
+ ***********************/
+qEvalSnapshot::qEvalSnapshot()
+  :map(NULL), mapSize(0), records(NULL), numRecords(0)
+{ ; }
+
+qEvalSnapshot::~qEvalSnapshot()
+{
+  close();
+}
+
+bool qEvalSnapshot::open
+(const char *path)
+{
+  struct stat st;
+  int fd;
+
+  close();
+  if ((fd = ::open(path, O_RDONLY)) < 0)
+    return FALSE;
+  if ((fstat(fd, &st) < 0) ||
+      (st.st_size < static_cast<off_t>(sizeof(qEvalFileHeader)))) {
+    ::close(fd);
+    return FALSE;
+  }
+  mapSize = st.st_size;
+  map = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    map = NULL;
+    return FALSE;
+  }
+
+  const qEvalFileHeader *hdr = static_cast<const qEvalFileHeader*>(map);
+  if ((mapSize < sizeof(*hdr)) ||
+      (hdr->magic      != QEVAL_SNAPSHOT_MAGIC) ||
+      (hdr->version    != QEVAL_VERSION) ||
+      (hdr->recordSize != sizeof(qEvalRecord)) ||
+      // (Divided, not multiplied, so a 32-bit size_t can't wrap)
+      (hdr->numRecords > (mapSize - sizeof(*hdr)) / sizeof(qEvalRecord))) {
+    close();
+    return FALSE;
+  }
+  numRecords = hdr->numRecords;
+  records    = reinterpret_cast<const qEvalRecord*>(hdr + 1);
+  return TRUE;
+}
+
+void qEvalSnapshot::close()
+{
+  if (map)
+    munmap(map, mapSize);
+  map        = NULL;
+  mapSize    = 0;
+  records    = NULL;
+  numRecords = 0;
+}
+
+bool qEvalSnapshot::probe
+(const qPosition *pos, qPositionInfo *posInfo) const
+{
+  qEvalRecord want;
+
+  if (!records || !pos || !posInfo)
+    return FALSE;
+
+  want.key[QEVAL_KEY_WORDS-1] = 0;
+  memcpy(want.key, pos, sizeof(*pos));
+
+  const qEvalRecord *end   = records + numRecords;
+  const qEvalRecord *found = std::lower_bound(records, end, want,
+					      &qEvalRecordKeyLess);
+  if ((found == end) || qEvalRecordKeyLess(want, *found))
+    return FALSE;
+  return qEvalRecordApply(found, posInfo);
+}
+
+bool qEvalSnapshot::write
+(const char *path, std::vector<qEvalRecord> *records)
+{
+  qEvalFileHeader hdr;
+  std::vector<qEvalRecord>::iterator in, out;
+
+  // Sort, then fold runs of the same position together
+  std::stable_sort(records->begin(), records->end(), &qEvalRecordKeyLess);
+  out = records->begin();
+  for (in = records->begin(); in != records->end(); ++in) {
+    if ((in != records->begin()) && !qEvalRecordKeyLess(*(out-1), *in))
+      qEvalRecordMerge(&*(out-1), &*in);
+    else
+      *out++ = *in;
+  }
+  records->erase(out, records->end());
+
+  std::string tmpPath = std::string(path) + ".tmp";
+  int fd = ::open(tmpPath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (fd < 0)
+    return FALSE;
+
+  hdr.magic      = QEVAL_SNAPSHOT_MAGIC;
+  hdr.version    = QEVAL_VERSION;
+  hdr.recordSize = sizeof(qEvalRecord);
+  hdr.numRecords = records->size();
+  if (!writeFully(fd, &hdr, sizeof(hdr)) ||
+      (!records->empty() &&
+       !writeFully(fd, &(*records)[0], records->size()*sizeof(qEvalRecord))) ||
+      (fsync(fd) < 0)) {
+    ::close(fd);
+    unlink(tmpPath.c_str());
+    return FALSE;
+  }
+  ::close(fd);
+  return (rename(tmpPath.c_str(), path) == 0);
+}
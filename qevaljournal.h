@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_evaljournal_h
+#define INCLUDE_evaljournal_h 1
+
+#include <pthread.h>
+#include <vector>
+#include "qtypes.h"
+#include "qposition.h"
+#include "qposinfo.h"
+
+/* Persisting evaluations across restarts.
+ *
+ * A qSearcher hands qEvalJournal any evaluation worth keeping as it is
+ * backed up (see isWorthKeeping()).  The journal only copies it into a
+ * bounded in-memory queue; a background thread appends the queue to disk
+ * and syncs it every EVAL_JOURNAL_SYNC_MS.  If the disk can't keep up, the
+ * queue fills and further evaluations are dropped (and counted) rather
+ * than making the searcher wait.
+ *
+ * A journal file is a header followed by fixed-size qEvalRecords, each
+ * carrying its own checksum.  A crash can at worst leave a partial or
+ * garbled record at the end; readers skip records that fail their
+ * checksum, and reopening a journal for append trims any partial record.
+ * A write that comes up short (say, on a full disk) is trimmed the same way
+ * straight away, so later batches still land on record boundaries; if
+ * even that fails, the journal drops everything from then on.
+ *
+ * Journals are folded by the qjcompact tool into a qEvalSnapshot: the same
+ * records, merged per position and sorted, which an engine mmaps and
+ * binary searches for positions new to its qPositionInfoHash.
+ */
+#define QEVAL_KEY_WORDS ((sizeof(qPosition)+3)/4)
+
+typedef struct _qEvalRecord {
+  guint32 key[QEVAL_KEY_WORDS]; // The qPosition, byte for byte
+  guint32 data[2];              // [player]: qPackEval()'d, or none
+  guint32 check;                // Checksum of the above; never 0
+} qEvalRecord;
+
+// Fill in r from pos & posInfo, including the checksum
+void qEvalRecordPack(qEvalRecord *r, const qPosition *pos,
+		     const qPositionInfo *posInfo);
+
+// Copy r's evaluations into posInfo where they're better settled (lower
+// complexity) than posInfo's own.  Returns TRUE if anything was copied.
+bool qEvalRecordApply(const qEvalRecord *r, qPositionInfo *posInfo);
+
+// Fold src (for the same position) into dst, keeping the better settled
+// evaluation for each player
+void qEvalRecordMerge(qEvalRecord *dst, const qEvalRecord *src);
+
+bool qEvalRecordIsValid(const qEvalRecord *r);
+
+// Sort order for snapshots
+bool qEvalRecordKeyLess(const qEvalRecord &a, const qEvalRecord &b);
+
+
+/* qEvalJournal
+ * Write side.  submit() may be called from any number of search threads.
+ */
+class qEvalJournal {
+ public:
+  qEvalJournal();
+  ~qEvalJournal(); // Flushes & closes
+
+  // Open (or create) the journal at path for appending, and start the
+  // writer thread.  Returns FALSE if the file can't be opened or isn't a
+  // journal.
+  bool open(const char *path);
+
+  // Write out everything queued, sync, and stop the writer thread
+  void close();
+
+  // Queue posInfo's evaluations for pos.  Never waits on I/O.
+  void submit(const qPosition *pos, const qPositionInfo *posInfo);
+
+  // Whether an evaluation of a position for player, that took effort new
+  // positions to produce, is worth persisting
+  static bool isWorthKeeping(const qPositionInfo *posInfo, qPlayer player,
+			     guint32 effort);
+
+  guint32 getNumWritten() const { return numWritten; };
+  guint32 getNumDropped() const { return numDropped; };
+
+ private:
+  int              fd;
+  bool             running;
+  bool             stopping;
+  pthread_t        writerThread;
+  pthread_mutex_t  mutex;
+  pthread_cond_t   cond;
+
+  std::vector<qEvalRecord> queue; // Ring buffer of EVAL_JOURNAL_QUEUE
+  guint32          queueHead;
+  guint32          queueCount;
+
+  guint32          numWritten;
+  guint32          numDropped;
+
+  static void *writerMain(void *journal);
+  void         writerLoop();
+};
+
+
+/* qEvalJournalReader
+ * Reads back the valid records of a journal, in the order written.
+ */
+class qEvalJournalReader {
+ public:
+  qEvalJournalReader();
+  ~qEvalJournalReader();
+
+  bool open(const char *path);
+  void close();
+
+  // Returns FALSE at the end of the journal
+  bool next(qEvalRecord *r_record);
+
+  guint32 getNumBad() const { return numBad; }; // Records skipped so far
+
+ private:
+  int     fd;
+  guint32 numBad;
+};
+
+
+/* qEvalSnapshot
+ * A compacted, sorted, read-only set of records, mmapped for lookup.
+ */
+class qEvalSnapshot {
+ public:
+  qEvalSnapshot();
+  ~qEvalSnapshot();
+
+  bool open(const char *path);
+  void close();
+  bool isOpen() const { return (records != NULL); };
+
+  // Copy any stored evaluation better settled than posInfo's into it.
+  // Returns TRUE if anything was copied.
+  bool probe(const qPosition *pos, qPositionInfo *posInfo) const;
+
+  guint32            getNumRecords() const { return numRecords; };
+  const qEvalRecord *getRecord(guint32 i) const { return &records[i]; };
+
+  // Sort & merge records, then write them to path as a snapshot.  The
+  // file is written under a temporary name and renamed into place, so a
+  // crash never leaves a half-written snapshot at path.
+  static bool write(const char *path, std::vector<qEvalRecord> *records);
+
+ private:
+  void              *map;
+  size_t             mapSize;
+  const qEvalRecord *records;
+  guint32            numRecords;
+};
+
+#endif // INCLUDE_evaljournal_h
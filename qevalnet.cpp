@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+
+#include "qevalnet.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+IDSTR("$Id$");
+
+
+/****/
+
+static inline guint32 pawnFeature
+(qPlayer p, qSquare sq)
+{
+  return qEvalFeature_pawn + p.getPlayerId()*QEVALNET_SQUARES + sq.squareNum;
+}
+
+static inline guint32 wallFeature
+(qMove wall)
+{
+  return (qEvalFeature_wall +
+	  (wall.wallMoveIsRow() ? ROW : COL)*QEVALNET_WALL_SLOTS +
+	  wall.wallRowOrColNo()*QWALL_LINES + wall.wallPosition());
+}
+
+static inline guint32 wallsLeftFeature
+(qPlayer p, guint8 n)
+{
+  return qEvalFeature_wallsLeft + p.getPlayerId()*(QBOARD_WALLS+1) + n;
+}
+
+static inline guint32 distFeature
+(qPlayer p, gint8 dist)
+{
+  if (dist < 0)
+    dist = 0;
+  else if (dist >= EVALNET_DIST_BUCKETS)
+    dist = EVALNET_DIST_BUCKETS - 1;
+  return qEvalFeature_dist + p.getPlayerId()*EVALNET_DIST_BUCKETS + dist;
+}
+
+static inline void addRow
+(gint16 *sum, const gint16 *row)
+{
+#ifdef __SSE2__
+  for (int i = 0; i < EVALNET_HIDDEN; i += 8) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sum + i));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(sum + i),
+		     _mm_add_epi16(s, r));
+  }
+#else
+  for (int i = 0; i < EVALNET_HIDDEN; ++i)
+    sum[i] += row[i];
+#endif
+}
+
+static inline void subRow
+(gint16 *sum, const gint16 *row)
+{
+#ifdef __SSE2__
+  for (int i = 0; i < EVALNET_HIDDEN; i += 8) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sum + i));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(sum + i),
+		     _mm_sub_epi16(s, r));
+  }
+#else
+  for (int i = 0; i < EVALNET_HIDDEN; ++i)
+    sum[i] -= row[i];
+#endif
+}
+
+qEvalNet::qEvalNet
+()
+  :b2(0), zero(TRUE)
+{
+  memset(w1, 0, sizeof(w1));
+  memset(b1, 0, sizeof(b1));
+  memset(w2, 0, sizeof(w2));
+}
+
+// Could any position's sums fall outside a gint16?  Each position has one
+// pawn square, walls-left count & distance bucket per player, and at most
+// every wall slot filled.
+bool qEvalNet::mightOverflow
+(void) const
+{
+  static const struct {
+    guint32 start, size;
+    bool    oneOf;
+  } groups[] = {
+    { qEvalFeature_pawn,      QEVALNET_SQUARES,     TRUE  },
+    { qEvalFeature_pawn + QEVALNET_SQUARES,
+                              QEVALNET_SQUARES,     TRUE  },
+    { qEvalFeature_wall,      2*QEVALNET_WALL_SLOTS, FALSE },
+    { qEvalFeature_wallsLeft, QBOARD_WALLS+1,       TRUE  },
+    { qEvalFeature_wallsLeft + QBOARD_WALLS+1,
+                              QBOARD_WALLS+1,       TRUE  },
+    { qEvalFeature_dist,      EVALNET_DIST_BUCKETS, TRUE  },
+    { qEvalFeature_dist + EVALNET_DIST_BUCKETS,
+                              EVALNET_DIST_BUCKETS, TRUE  }
+  };
+  unsigned int g;
+  guint32      f;
+  int          u;
+
+  for (u = 0; u < EVALNET_HIDDEN; ++u) {
+    gint32 bound = abs(b1[u]);
+
+    for (g = 0; g < sizeof(groups)/sizeof(groups[0]); ++g) {
+      gint32 most = 0;
+      for (f = groups[g].start; f < groups[g].start + groups[g].size; ++f) {
+	if (!groups[g].oneOf)
+	  most += abs(w1[f][u]);
+	else if (abs(w1[f][u]) > most)
+	  most = abs(w1[f][u]);
+      }
+      bound += most;
+    }
+    if (bound > G_MAXINT16)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+bool qEvalNet::load
+(const char *path)
+{
+  FILE     *f = fopen(path, "r");
+  qEvalNet *net;
+  char      magic[16];
+  int       features, hidden, buckets, v, u;
+  guint32   i;
+  bool      ok = FALSE;
+
+  if (!f)
+    return FALSE;
+
+  net = new qEvalNet;
+  if ((fscanf(f, "%15s %d %d %d", magic, &features, &hidden, &buckets) != 4) ||
+      strcmp(magic, "qevalnet") ||
+      (features != qEvalFeature_num) ||
+      (hidden != EVALNET_HIDDEN) ||
+      (buckets != EVALNET_DIST_BUCKETS))
+    goto done;
+
+  for (u = 0; u < EVALNET_HIDDEN; ++u) {
+    if ((fscanf(f, "%d", &v) != 1) || (v < -G_MAXINT16) || (v > G_MAXINT16))
+      goto done;
+    net->b1[u] = v;
+  }
+  for (i = 0; i < qEvalFeature_num; ++i)
+    for (u = 0; u < EVALNET_HIDDEN; ++u) {
+      if ((fscanf(f, "%d", &v) != 1) || (v < -G_MAXINT16) || (v > G_MAXINT16))
+	goto done;
+      net->w1[i][u] = v;
+    }
+  for (u = 0; u < EVALNET_HIDDEN; ++u) {
+    if ((fscanf(f, "%d", &v) != 1) || (v < -G_MAXINT16) || (v > G_MAXINT16))
+      goto done;
+    net->w2[u] = v;
+  }
+  if (fscanf(f, "%d", &v) != 1)
+    goto done;
+  net->b2 = v;
+
+  if (net->mightOverflow())
+    goto done;
+
+  // A net whose output weights & bias are all zero adds nothing
+  net->zero = (net->b2 == 0);
+  for (u = 0; u < EVALNET_HIDDEN; ++u)
+    if (net->w2[u])
+      net->zero = FALSE;
+
+  *this = *net;
+  ok = TRUE;
+
+ done:
+  delete net;
+  fclose(f);
+  return ok;
+}
+
+void qEvalNet::refresh
+(const qPosition *pos,
+ qEvalAccumulator *r_acc) const
+{
+  guint8 rc, at;
+  int    p;
+
+  memcpy(r_acc->sum, b1, sizeof(r_acc->sum));
+  for (p = qPlayer::WhitePlayer; p <= qPlayer::BlackPlayer; ++p) {
+    qPlayer player(p);
+    addRow(r_acc->sum, w1[pawnFeature(player, pos->getPawn(player))]);
+    addRow(r_acc->sum,
+	   w1[wallsLeftFeature(player, pos->numWallsLeft(player))]);
+  }
+  for (rc = 0; rc < QWALL_LINES; ++rc)
+    for (at = 0; at < QWALL_LINES; ++at) {
+      if (pos->wallAt(ROW, rc, at))
+	addRow(r_acc->sum, w1[wallFeature(qMove(ROW, rc, at))]);
+      if (pos->wallAt(COL, rc, at))
+	addRow(r_acc->sum, w1[wallFeature(qMove(COL, rc, at))]);
+    }
+}
+
+// Mirrors qPosition::applyMove()
+void qEvalNet::applyMove
+(qEvalAccumulator *acc,
+ const qPosition  *pos,
+ qPlayer           player,
+ qMove             mv) const
+{
+  if (mv.isWallMove()) {
+    guint8 n = pos->numWallsLeft(player);
+    if (n == 0)
+      return;
+    subRow(acc->sum, w1[wallsLeftFeature(player, n)]);
+    addRow(acc->sum, w1[wallsLeftFeature(player, n-1)]);
+    addRow(acc->sum, w1[wallFeature(mv)]);
+  } else {
+    qSquare from = pos->getPawn(player);
+    subRow(acc->sum, w1[pawnFeature(player, from)]);
+    addRow(acc->sum,
+	   w1[pawnFeature(player,
+			  from.applyDirection(mv.pawnMoveDirection()))]);
+  }
+}
+
+gint16 qEvalNet::evaluate
+(const qEvalAccumulator *acc,
+ gint8                   whiteDist,
+ gint8                   blackDist) const
+{
+  qEvalAccumulator h;
+  gint32           out = b2;
+
+  if (zero)
+    return 0;
+
+  h = *acc;
+  addRow(h.sum, w1[distFeature(qPlayer_white, whiteDist)]);
+  addRow(h.sum, w1[distFeature(qPlayer_black, blackDist)]);
+
+#ifdef __SSE2__
+  {
+    const __m128i lo = _mm_setzero_si128();
+    const __m128i hi = _mm_set1_epi16(EVALNET_CLIP);
+    __m128i       total = _mm_setzero_si128();
+
+    for (int i = 0; i < EVALNET_HIDDEN; i += 8) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h.sum+i));
+      __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(w2+i));
+      x = _mm_min_epi16(_mm_max_epi16(x, lo), hi);
+      total = _mm_add_epi32(total, _mm_madd_epi16(x, w));
+    }
+    total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0x4e));
+    total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0xb1));
+    out += _mm_cvtsi128_si32(total);
+  }
+#else
+  for (int i = 0; i < EVALNET_HIDDEN; ++i) {
+    gint32 x = h.sum[i];
+    if (x < 0)
+      x = 0;
+    else if (x > EVALNET_CLIP)
+      x = EVALNET_CLIP;
+    out += x * w2[i];
+  }
+#endif
+
+  // Divide rather than shift, so white & black round alike
+  out /= (1 << EVALNET_SHIFT);
+  if (out > EVALNET_MAX_ADJUST)
+    out = EVALNET_MAX_ADJUST;
+  else if (out < -EVALNET_MAX_ADJUST)
+    out = -EVALNET_MAX_ADJUST;
+  return out;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_evalnet_h
+#define INCLUDE_evalnet_h 1
+
+#include "qtypes.h"
+#include "qposition.h"
+#include "parameters.h"
+
+/* qEvalNet
+ * A small integer network scoring positions on top of the hand-coded
+ * terms in ratePositionByComputation().
+ *
+ * Its inputs are 0/1 board features: the square each pawn is on, which
+ * wall slots are filled, how many walls each player has left, and which
+ * bucket each player's distance to goal falls in.  They feed
+ * EVALNET_HIDDEN hidden units, each clipped to 0..EVALNET_CLIP, and the
+ * units' weighted sum (shifted down by EVALNET_SHIFT) is how much better
+ * off white is: it's added to white's score and taken from black's.
+ *
+ * A move changes only a few features (one pawn's square, or a wall slot &
+ * a walls-left count), so the hidden units' sums before clipping are kept
+ * in a qEvalAccumulator that qMoveStack brings up to date on each push by
+ * adding & subtracting just those features' weight rows.  Popping costs
+ * nothing, as each frame keeps its own.  Distances only come out of
+ * qDijkstra() at evaluation time, so evaluate() adds their rows to a copy.
+ * With SSE2 the rows are added 8 units at a time, and the output is taken
+ * with _mm_madd_epi16().
+ *
+ * Weights are trained offline and read with load().  A net nobody has
+ * loaded weights into adds nothing, and costs next to nothing.
+ */
+
+#define QEVALNET_SQUARES    (qSquare::maxSquareNum+1)
+#define QEVALNET_WALL_SLOTS (QWALL_LINES*QWALL_LINES)
+
+// Where each kind of feature starts.  Each is indexed by player (or for
+// walls, by RowOrCol) first.
+enum {
+  qEvalFeature_pawn      = 0,                    // [player][square]
+  qEvalFeature_wall      = qEvalFeature_pawn + 2*QEVALNET_SQUARES,
+                                                 // [RowOrCol][rc][position]
+  qEvalFeature_wallsLeft = qEvalFeature_wall + 2*QEVALNET_WALL_SLOTS,
+                                                 // [player][walls left]
+  qEvalFeature_dist      = qEvalFeature_wallsLeft + 2*(QBOARD_WALLS+1),
+                                                 // [player][distance bucket]
+  qEvalFeature_num       = qEvalFeature_dist + 2*EVALNET_DIST_BUCKETS
+};
+
+typedef struct _qEvalAccumulator {
+  gint16 sum[EVALNET_HIDDEN];
+} qEvalAccumulator;
+
+class qEvalNet {
+ public:
+  qEvalNet(); // All weights zero
+
+  /* Read weights from a text file of whitespace-separated integers:
+   *   qevalnet <features> <hidden units> <distance buckets>
+   *   <hidden unit biases>
+   *   <each feature's weight for each hidden unit, feature by feature>
+   *   <each hidden unit's output weight>
+   *   <output bias>
+   * Returns FALSE, leaving the net as it was, if the file can't be read,
+   * is of another shape, or has weights that could overflow a sum.
+   */
+  bool load(const char *path);
+
+  bool isZero(void) const { return zero; };
+
+  // Sums for pos, from scratch
+  void refresh(const qPosition *pos, qEvalAccumulator *r_acc) const;
+
+  // Bring acc from pos up to date with player making mv there
+  void applyMove(qEvalAccumulator *acc, const qPosition *pos,
+		 qPlayer player, qMove mv) const;
+
+  // How much better off white is, in score units, given the sums for a
+  // position and each player's distance to goal
+  gint16 evaluate(const qEvalAccumulator *acc,
+		  gint8 whiteDist, gint8 blackDist) const;
+
+ private:
+  gint16 w1[qEvalFeature_num][EVALNET_HIDDEN];
+  gint16 b1[EVALNET_HIDDEN];
+  gint16 w2[EVALNET_HIDDEN];
+  gint32 b2;
+  bool   zero;
+
+  bool mightOverflow(void) const;
+};
+
+#endif // INCLUDE_evalnet_h
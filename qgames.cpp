@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+/* qgames - build & query game archives (see qarchive.h)
+ *
+ * usage: qgames import archive
+ *   Read games from stdin, one per line, each its moves in WIRE_PROTOCOL
+ *   notation separated by commas (e.g. "E2,E8,D.5-2.5"), white first,
+ *   and write them to archive.  Lines with an illegal move are skipped.
+ *
+ * usage: qgames index [-j threads] archive index
+ *   Index archive's positions into index.
+ *
+ * usage: qgames lookup index archive [move]...
+ *   Play the moves from the starting position and list the games that
+ *   reached the result, what was played from it in each, and how the
+ *   games ended.  Each hit is checked against the archive.
+ *
+ * usage: qgames stats index
+ *   Count the index's postings, distinct positions, and the most played.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "qarchive.h"
+#include "qio.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+static const char *resultNames[] = { "unfinished", "white won", "black won" };
+
+static void usage()
+{
+  fprintf(stderr,
+	  "usage: qgames import archive\n"
+	  "       qgames index [-j threads] archive index\n"
+	  "       qgames lookup index archive [move]...\n"
+	  "       qgames stats index\n");
+}
+
+static int importGames
+(int argc, char **argv)
+{
+  qGameArchiveWriter writer;
+  qWireCommand       cmd;
+  std::vector<qMove> moves;
+  char               line[65536];
+  guint32            lineNo = 0, skipped = 0;
+
+  if (argc != 2) {
+    usage();
+    return 2;
+  }
+  if (!writer.open(argv[1])) {
+    fprintf(stderr, "qgames: can't create %s\n", argv[1]);
+    return 1;
+  }
+  while (fgets(line, sizeof(line), stdin)) {
+    qPosition pos(&qInitialPosition);
+    qPlayer   player(qPlayer_white);
+    size_t    i, len = strlen(line);
+
+    ++lineNo;
+    if (len && (line[len-1] == '\n'))
+      --len;
+    if (!qWireParse(line, len, &cmd) ||
+	((cmd.size() == 1) && cmd[0].empty()))
+      continue;
+    moves.clear();
+    for (i = 0; i < cmd.size(); ++i) {
+      qMove mv;
+      if (!qWireNotationToMove(&pos, player, cmd[i].c_str(), &mv) ||
+	  !qWireIsLegal(&pos, player, mv) ||
+	  pos.isWon(qPlayer_white) || pos.isWon(qPlayer_black))
+	break;
+      moves.push_back(mv);
+      pos.applyMove(player, mv);
+      player.changePlayer();
+    }
+    if (i < cmd.size()) {
+      fprintf(stderr, "qgames: line %u: bad move %u \"%s\"; skipped\n",
+	      lineNo, (unsigned)i + 1, cmd[i].c_str());
+      ++skipped;
+      continue;
+    }
+    if (!writer.add(moves.empty() ? NULL : &moves[0], moves.size()))
+      break;
+  }
+  printf("%u games, %u skipped\n", writer.getNumGames(), skipped);
+  if (!writer.close()) {
+    fprintf(stderr, "qgames: writing %s failed\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
+
+static int buildIndex
+(int argc, char **argv)
+{
+  qGameArchive archive;
+  int          numThreads = 1, c;
+
+  while ((c = getopt(argc, argv, "j:")) != -1) {
+    switch (c) {
+    case 'j': numThreads = atoi(optarg); break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if (optind + 2 != argc) {
+    usage();
+    return 2;
+  }
+  if (!archive.open(argv[optind])) {
+    fprintf(stderr, "qgames: can't read archive %s\n", argv[optind]);
+    return 1;
+  }
+  if (!qGameArchiveIndex::build(&archive, argv[optind+1], numThreads)) {
+    fprintf(stderr, "qgames: indexing into %s failed\n", argv[optind+1]);
+    return 1;
+  }
+  return 0;
+}
+
+static int lookup
+(int argc, char **argv)
+{
+  qGameArchiveIndex      idx;
+  qGameArchive           archive;
+  qPosition              pos(&qInitialPosition), check(&qInitialPosition);
+  qPlayer                player(qPlayer_white);
+  const qArchivePosting *postings;
+  guint32                n, i, wins[3] = { 0, 0, 0 };
+  char                   notation[QWIRE_MOVE_LEN];
+  int                    a;
+
+  if (argc < 3) {
+    usage();
+    return 2;
+  }
+  if (!idx.open(argv[1]) || !archive.open(argv[2]) ||
+      (idx.getNumGames() != archive.getNumGames())) {
+    fprintf(stderr, "qgames: can't read index %s with archive %s\n",
+	    argv[1], argv[2]);
+    return 1;
+  }
+  for (a = 3; a < argc; ++a) {
+    qMove mv;
+    if (!qWireNotationToMove(&pos, player, argv[a], &mv) ||
+	!qWireIsLegal(&pos, player, mv)) {
+      fprintf(stderr, "qgames: bad move \"%s\"\n", argv[a]);
+      return 1;
+    }
+    pos.applyMove(player, mv);
+    player.changePlayer();
+  }
+
+  n = idx.lookup(&pos, player, &postings);
+  for (i = 0; i < n; ++i) {
+    const qArchivePosting *p = &postings[i];
+
+    if (!archive.positionAt(p->game, p->ply, &check) || !(check == pos))
+      continue; // A key collision
+    strcpy(notation, "-");
+    if (p->move)
+      qWireMoveToNotation(&pos, player, qMove(p->move), notation);
+    printf("game %8u  ply %4u  played %-8s  %s\n",
+	   p->game, p->ply, notation, resultNames[p->result]);
+    wins[p->result]++;
+  }
+  printf("reached %u times: %u white won, %u black won, %u unfinished\n",
+	 wins[0] + wins[1] + wins[2], wins[qArchive_whiteWon],
+	 wins[qArchive_blackWon], wins[qArchive_unfinished]);
+  return 0;
+}
+
+static int stats
+(int argc, char **argv)
+{
+  qGameArchiveIndex idx;
+  guint64           i, start, numPositions = 0, maxCount = 0, maxAt = 0;
+
+  if (argc != 2) {
+    usage();
+    return 2;
+  }
+  if (!idx.open(argv[1])) {
+    fprintf(stderr, "qgames: can't read index %s\n", argv[1]);
+    return 1;
+  }
+  for (start = 0; start < idx.getNumPostings(); start = i) {
+    guint64 key = idx.getPosting(start)->key;
+    for (i = start + 1;
+	 (i < idx.getNumPostings()) && (idx.getPosting(i)->key == key); ++i)
+      ;
+    ++numPositions;
+    if (i - start > maxCount) {
+      maxCount = i - start;
+      maxAt    = start;
+    }
+  }
+  printf("%u games, %llu postings, %llu positions\n", idx.getNumGames(),
+	 (unsigned long long)idx.getNumPostings(),
+	 (unsigned long long)numPositions);
+  if (maxCount)
+    printf("most played: %llu times, first in game %u at ply %u\n",
+	   (unsigned long long)maxCount, idx.getPosting(maxAt)->game,
+	   idx.getPosting(maxAt)->ply);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+
+  // Let getopt see the subcommand's options
+  if (!strcmp(argv[1], "import"))
+    return importGames(argc - 1, argv + 1);
+  if (!strcmp(argv[1], "index"))
+    return buildIndex(argc - 1, argv + 1);
+  if (!strcmp(argv[1], "lookup"))
+    return lookup(argc - 1, argv + 1);
+  if (!strcmp(argv[1], "stats"))
+    return stats(argc - 1, argv + 1);
+
+  usage();
+  return 2;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+/* qgencorpus - build a benchmark corpus of positions
+ *
+ * usage: qgencorpus [options] corpus-file
+ *   -n count       positions wanted (default 1000)
+ *   -s seed        generator seed (default 1)
+ *   -g n           at most n positions from any one game (default 4)
+ *   -w prob        chance of a wall drop per move (default 0.3)
+ *   -p prob        chance a pawn move heads straight for goal (default 0.7)
+ *   -e ms          let the engine choose moves, with ms per move
+ *   -o plies       random plies before the engine takes over (default 4)
+ *   -P lo-hi       walls placed by both sides together
+ *   -L lo-hi       walls left for the player to move
+ *   -A lo-hi       rows the player to move's pawn has advanced
+ *
+ * e.g. "qgencorpus -n 5000 -P 8-14 -A 3-5 midgame.qc" for positions from
+ * the middle of games with plenty of walls down.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "qcorpus.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+static void usage()
+{
+  fprintf(stderr,
+	  "usage: qgencorpus [-n count] [-s seed] [-g per-game] [-w wall-prob]\n"
+	  "                  [-p greedy-prob] [-e engine-ms] [-o opening-plies]\n"
+	  "                  [-P placed-range] [-L left-range] [-A advance-range]\n"
+	  "                  corpus-file\n");
+}
+
+// "lo-hi" or just "n"
+static bool parseRange
+(const char *arg, guint8 *r_lo, guint8 *r_hi)
+{
+  int lo, hi;
+
+  if (sscanf(arg, "%d-%d", &lo, &hi) != 2) {
+    if (sscanf(arg, "%d", &lo) != 1)
+      return FALSE;
+    hi = lo;
+  }
+  if ((lo < 0) || (hi < lo) || (hi > 2*QBOARD_WALLS))
+    return FALSE;
+  *r_lo = lo;
+  *r_hi = hi;
+  return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+  qCorpusPhase     phase = qCorpusPhase_any;
+  qCorpusGenerator *gen;
+  qCorpusWriter    corpus;
+  guint32          count = 1000, seed = 1, added;
+  int              c;
+  bool             ok = TRUE;
+
+  // Settings go to the generator once the seed is known
+  guint32 perGame = 4, opening = 4;
+  double  wallProb = 0.3, greedyProb = 0.7;
+  gint32  engineMs = 0;
+
+  while ((c = getopt(argc, argv, "n:s:g:w:p:e:o:P:L:A:")) != -1) {
+    switch (c) {
+    case 'n': count      = strtoul(optarg, NULL, 10); break;
+    case 's': seed       = strtoul(optarg, NULL, 10); break;
+    case 'g': perGame    = strtoul(optarg, NULL, 10); break;
+    case 'w': wallProb   = atof(optarg);              break;
+    case 'p': greedyProb = atof(optarg);              break;
+    case 'e': engineMs   = atoi(optarg);              break;
+    case 'o': opening    = strtoul(optarg, NULL, 10); break;
+    case 'P':
+      ok = parseRange(optarg, &phase.minWallsPlaced, &phase.maxWallsPlaced);
+      break;
+    case 'L':
+      ok = parseRange(optarg, &phase.minWallsLeft, &phase.maxWallsLeft);
+      break;
+    case 'A':
+      ok = parseRange(optarg, &phase.minAdvance, &phase.maxAdvance);
+      break;
+    default:
+      ok = FALSE;
+    }
+    if (!ok) {
+      usage();
+      return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    usage();
+    return 2;
+  }
+
+  if (!corpus.open(argv[optind])) {
+    fprintf(stderr, "qgencorpus: can't create %s\n", argv[optind]);
+    return 1;
+  }
+
+  gen = new qCorpusGenerator(seed);
+  gen->setSamplesPerGame(perGame);
+  gen->setWallProbability(wallProb);
+  gen->setGreedyProbability(greedyProb);
+  gen->setEngineTime(engineMs);
+  gen->setRandomOpening(opening > 255 ? 255 : opening);
+
+  // Give up on phases that games never (or hardly ever) pass through
+  added = gen->generate(&corpus, &phase, count, 1000 + count * 100);
+
+  if (!corpus.close()) {
+    fprintf(stderr, "qgencorpus: error writing %s\n", argv[optind]);
+    return 1;
+  }
+  printf("%s: %u positions from %u games\n", argv[optind], added,
+	 gen->getNumGames());
+  delete gen;
+  return (added == count) ? 0 : 1;
+}
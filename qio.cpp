@@ -6,28 +6,221 @@
  */
 
 
-#include "qtypes.h"
+#include <stdio.h>
+#include <string.h>
+#include "qio.h"
+#include "qdijkstra.h"
+#include "getmoves.h"
 
 IDSTR("$Id: qio.cpp,v 1.1 2014/12/12 21:20:21 bmiller Exp $");
 
 
 /****/
-const qPlayer qPlayer_white(qPlayer::WhitePlayer);
-const qPlayer qPlayer_black(qPlayer::BlackPlayer);
 
-const qMove moveUp    = qMove(UP);
-const qMove moveDown  = qMove(DOWN);
-const qMove moveLeft  = qMove(LEFT);
-const qMove moveRight = qMove(RIGHT);
+bool qWireParse
+(const char *line, size_t len, qWireCommand *r_cmd)
+{
+  const char *end = line + len;
+  std::string field;
 
-const qMove moveUpUp       = qMove((qDirection)(UP+UP));
-const qMove moveDownDown   = qMove((qDirection)(DOWN+DOWN));
-const qMove moveLeftLeft   = qMove((qDirection)(LEFT+LEFT));
-const qMove moveRightRight = qMove((qDirection)(RIGHT+RIGHT));
+  r_cmd->clear();
+  if (len && (end[-1] == '\r')) // Be forgiving of telnet
+    --end;
+  if (line == end)
+    return FALSE;
 
-const qMove moveUL = qMove((qDirection)(UP+LEFT));
-const qMove moveUR = qMove((qDirection)(UP+RIGHT));
-const qMove moveDL = qMove((qDirection)(DOWN+LEFT));
-const qMove moveDR = qMove((qDirection)(DOWN+RIGHT));
+  for (;;) {
+    field.clear();
+    if ((line < end) && (*line == '"')) {
+      // Quoted: runs to the next lone quote; "" is a quote
+      for (++line; ; ++line) {
+	if (line == end)
+	  return FALSE;
+	if (*line == '"') {
+	  if ((line + 1 < end) && (line[1] == '"'))
+	    ++line;
+	  else
+	    break;
+	}
+	field += *line;
+      }
+      ++line;
+      if ((line < end) && (*line != ','))
+	return FALSE;
+    } else {
+      while ((line < end) && (*line != ','))
+	field += *line++;
+    }
+    r_cmd->push_back(field);
+    if (line == end)
+      return TRUE;
+    ++line; // ','
+  }
+}
 
-const qMove moveNull = qMove((guint8)0);
+void qWireFormat
+(const qWireCommand &cmd, std::string *out)
+{
+  qWireCommand::const_iterator f;
+  std::string::const_iterator  c;
+
+  for (f = cmd.begin(); f != cmd.end(); ++f) {
+    if (f != cmd.begin())
+      *out += ',';
+    if (f->find_first_of(",\"\r\n") == std::string::npos) {
+      *out += *f;
+      continue;
+    }
+    *out += '"';
+    for (c = f->begin(); c != f->end(); ++c) {
+      if (*c == '"')
+	*out += '"';
+      *out += *c;
+    }
+    *out += '"';
+  }
+  *out += '\n';
+}
+
+const char *qWirePlayerName
+(qPlayer p)
+{
+  return p.isWhite() ? "O" : "X";
+}
+
+bool qWireMoveToNotation
+(const qPosition *pos, qPlayer player, qMove mv, char *buf)
+{
+  if (!mv.exists())
+    return FALSE;
+
+  // Every coordinate is one letter or digit (QBOARD_SIZE is at most 9),
+  // so they go in as chars; "%d" would leave snprintf room for any int
+  if (mv.isPawnMove()) {
+    qSquare sq = pos->getPawn(player).newSquare(mv.pawnMoveDirection());
+    snprintf(buf, QWIRE_MOVE_LEN, "%c%c", 'A' + sq.x(), '1' + sq.y());
+  } else if (mv.wallMoveIsRow()) {
+    // Lies between rows rc & rc+1, across columns pos & pos+1
+    snprintf(buf, QWIRE_MOVE_LEN, "%c.5-%c.5",
+	     'A' + mv.wallPosition(), '1' + mv.wallRowOrColNo());
+  } else {
+    snprintf(buf, QWIRE_MOVE_LEN, "%c.5|%c.5",
+	     'A' + mv.wallRowOrColNo(), '1' + mv.wallPosition());
+  }
+  return TRUE;
+}
+
+bool qWireNotationToMove
+(const qPosition *pos, qPlayer player, const char *notation, qMove *r_mv)
+{
+  const char *s = notation;
+  int         col, row, n;
+  char        sep;
+
+  if ((*s >= 'a') && (*s <= 'z'))
+    col = *s++ - 'a';
+  else if ((*s >= 'A') && (*s <= 'Z'))
+    col = *s++ - 'A';
+  else
+    return FALSE;
+
+  if ((*s >= '1') && (*s <= '9')) {
+    // Pawn move, named by the square it ends on
+    if ((sscanf(s, "%d%n", &row, &n) != 1) || s[n] || (col > QBOARD_LAST) ||
+	(row < 1) || (row > QBOARD_SIZE))
+      return FALSE;
+    qSquare from = pos->getPawn(player);
+    gint8   dx   = col - from.x(), dy = (row - 1) - from.y();
+    if ((dx <= -3) || (dx >= 3) || (dy <= -3) || (dy >= 3) || !(dx || dy))
+      return FALSE;
+    *r_mv = qMove(dx, dy);
+    return TRUE;
+  }
+
+  // Wall, named by its center: col.5 sep row.5
+  if ((s[0] != '.') || (s[1] != '5'))
+    return FALSE;
+  sep = s[2];
+  s  += 3;
+  if (((sep != '-') && (sep != '|')) ||
+      (sscanf(s, "%d%n", &row, &n) != 1) || strcmp(s + n, ".5") ||
+      (col >= QWALL_LINES) || (row < 1) || (row > QWALL_LINES))
+    return FALSE;
+  if (sep == '-')
+    *r_mv = qMove(ROW, row - 1, col);
+  else
+    *r_mv = qMove(COL, col, row - 1);
+  return TRUE;
+}
+
+bool qWireIsLegal
+(const qPosition *pos, qPlayer player, qMove mv)
+{
+  if (!mv.exists())
+    return FALSE;
+
+  if (mv.isPawnMove()) {
+    qMoveList         pawnMoves;
+    qMoveListIterator i;
+
+    getPossiblePawnMoves(pos, player, &pawnMoves);
+    for (i = pawnMoves.begin(); i != pawnMoves.end(); ++i)
+      if (i->getEncoding() == mv.getEncoding())
+	return TRUE;
+    return FALSE;
+  }
+
+  if (!pos->numWallsLeft(player) ||
+      !pos->canPutWall(mv.wallMoveIsRow(), mv.wallRowOrColNo(),
+		       mv.wallPosition()))
+    return FALSE;
+
+  qPosition    newPos(pos);
+  qDijkstraArg dArg;
+
+  newPos.applyMove(player, mv);
+  dArg.pos          = &newPos;
+  dArg.getAllRoutes = FALSE;
+  dArg.player       = qPlayer_white;
+  if (!qDijkstra(&dArg))
+    return FALSE;
+  dArg.player       = qPlayer_black;
+  return (qDijkstra(&dArg) != 0);
+}
+
+bool qWireIsValidPosition
+(const guint8 *buf)
+{
+  const guint8 *rows = &buf[0], *cols = &buf[QWALL_LINES];
+  guint8        white = buf[2*QWALL_LINES], black = buf[2*QWALL_LINES + 1];
+  guint8        numwalls = buf[2*QWALL_LINES + 2];
+  int           rc, x;
+
+  if ((white > qSquare::maxSquareNum) || (black > qSquare::maxSquareNum) ||
+      (white == black) ||
+      ((numwalls & 0x0f) > QBOARD_WALLS) || ((numwalls >> 4) > QBOARD_WALLS))
+    return FALSE;
+
+  // The same clashes canPutWall() looks for: no slot past the end of a
+  // line, no two walls in neighbouring slots of one line (they'd
+  // overlap), and no row & column wall sharing a center
+  for (rc = 0; rc < QWALL_LINES; ++rc) {
+    if ((rows[rc] >> QWALL_LINES) || (cols[rc] >> QWALL_LINES) ||
+	(rows[rc] & (rows[rc] << 1)) || (cols[rc] & (cols[rc] << 1)))
+      return FALSE;
+    for (x = 0; x < QWALL_LINES; ++x)
+      if ((rows[rc] & (1<<x)) && (cols[x] & (1<<rc)))
+	return FALSE;
+  }
+
+  qPosition    pos = qPosition::unpack(buf);
+  qDijkstraArg dArg;
+
+  dArg.pos          = &pos;
+  dArg.getAllRoutes = FALSE;
+  dArg.player       = qPlayer_white;
+  if (!qDijkstra(&dArg))
+    return FALSE;
+  dArg.player       = qPlayer_black;
+  return (qDijkstra(&dArg) != 0);
+}
@@ -10,5 +10,62 @@
 #ifndef INCLUDE_qio_h
 #define INCLUDE_qio_h 1
 
+#include <string>
+#include <vector>
+#include "qtypes.h"
+#include "qposition.h"
+
+/* Encoding & decoding for the game protocol (see WIRE_PROTOCOL).
+ *
+ * Each command is one CSV record (RFC 4180) ended by '\n': the command
+ * name, then its arguments.  Moves use the primary notation: a pawn move
+ * is the square it ends on ("E2"), a wall the point at its center, with
+ * '-' between the coordinates for a horizontal wall (one lying along a
+ * row, "C.5-3.5") and '|' for a vertical one ("D.5|1.5").  Columns are
+ * letters from A and rows numbers from 1, both counted from white's
+ * lower left, so white starts on E1 & black on E9.
+ */
+
+#define QWIRE_PROTOVER "0.1"
+#define QWIRE_MOVE_LEN 8 /* Longest move notation, with its '\0' */
+
+typedef std::vector<std::string> qWireCommand;
+
+// Split line (without its '\n') into r_cmd's fields.  Returns FALSE if
+// the quoting is broken or there are no fields.
+bool qWireParse(const char *line, size_t len, qWireCommand *r_cmd);
+
+// Append cmd to out as a record, quoting fields that need it
+void qWireFormat(const qWireCommand &cmd, std::string *out);
+
+// "O" for white, "X" for black
+const char *qWirePlayerName(qPlayer p);
+
+// The notation for player's move mv from pos, into buf (at least
+// QWIRE_MOVE_LEN bytes).  Returns FALSE for a null move.
+bool qWireMoveToNotation(const qPosition *pos,
+			 qPlayer          player,
+			 qMove            mv,
+			 char            *buf);
+
+// The move notation names for player at pos.  Pawn moves must end within
+// reach of player's pawn; nothing else about legality is checked.
+// Returns FALSE if the notation can't be read.
+bool qWireNotationToMove(const qPosition *pos,
+			 qPlayer          player,
+			 const char      *notation,
+			 qMove           *r_mv);
+
+// Is mv one player may make at pos?  Walls must be available, fit among
+// those already placed, and leave both pawns a way to their goals.
+bool qWireIsLegal(const qPosition *pos, qPlayer player, qMove mv);
+
+// Could buf (see qPosition::pack()) be played from?  Both pawns must be on
+// the board, on different squares; walls left must not exceed
+// QBOARD_WALLS; every wall must fit among the others, with none
+// overlapping or crossing; and both pawns must have a way to their
+// goals.  Foreign bytes must pass this before qPosition::unpack() sees
+// them, as nothing downstream checks any of it.
+bool qWireIsValidPosition(const guint8 *buf);
 
 #endif // INCLUDE_qio_h
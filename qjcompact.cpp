@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+/* qjcompact - fold evaluation journals into a snapshot
+ *
+ * usage: qjcompact [-s old-snapshot] new-snapshot journal...
+ *
+ * Reads the old snapshot (if any) and every journal, keeps the best
+ * settled evaluation seen for each position & player, and writes the
+ * result as a sorted snapshot for qEvalSnapshot to mmap.  The journals are
+ * left alone; remove them once the new snapshot is in place.  Run it
+ * while engines are stopped (e.g. during a deploy), or against journals
+ * they have since rotated away from.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "qevaljournal.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+static void usage()
+{
+  fprintf(stderr, "usage: qjcompact [-s old-snapshot] new-snapshot journal...\n");
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<qEvalRecord> records;
+  const char *oldSnapshot = NULL;
+  const char *newSnapshot;
+  int argi = 1;
+
+  if ((argc > 2) && !strcmp(argv[1], "-s")) {
+    oldSnapshot = argv[2];
+    argi = 3;
+  }
+  if (argi >= argc) {
+    usage();
+    return 2;
+  }
+  newSnapshot = argv[argi++];
+
+  if (oldSnapshot) {
+    qEvalSnapshot snap;
+    if (!snap.open(oldSnapshot)) {
+      fprintf(stderr, "qjcompact: can't read snapshot %s\n", oldSnapshot);
+      return 1;
+    }
+    records.reserve(snap.getNumRecords());
+    for (guint32 i = 0; i < snap.getNumRecords(); ++i)
+      records.push_back(*snap.getRecord(i));
+    printf("%s: %u positions\n", oldSnapshot, snap.getNumRecords());
+  }
+
+  for (; argi < argc; ++argi) {
+    qEvalJournalReader reader;
+    qEvalRecord r;
+    guint32 n = 0;
+
+    if (!reader.open(argv[argi])) {
+      fprintf(stderr, "qjcompact: can't read journal %s\n", argv[argi]);
+      return 1;
+    }
+    while (reader.next(&r)) {
+      records.push_back(r);
+      ++n;
+    }
+    printf("%s: %u records, %u damaged\n", argv[argi], n, reader.getNumBad());
+  }
+
+  if (!qEvalSnapshot::write(newSnapshot, &records)) {
+    fprintf(stderr, "qjcompact: can't write snapshot %s\n", newSnapshot);
+    return 1;
+  }
+  printf("%s: %lu positions\n", newSnapshot,
+	 static_cast<unsigned long>(records.size()));
+  return 0;
+}
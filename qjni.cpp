@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+/* JNI binding behind DeepQuorEngine.java.  Built into its own
+ * libdeepquorjni.so ("make jni") so libdeepquor.so needn't depend on a JDK.
+ * See DeepQuorEngine.java for the move & position byte layouts.
+ */
+
+#include <jni.h>
+#include <pthread.h>
+#include "qtypes.h"
+#include "qposition.h"
+#include "qsearcher.h"
+#include "getmoves.h"
+#include "qio.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+#define QJNI_POSITION_BYTES QPOSITION_PACKED_BYTES
+
+// search() criteria other than time, as the GUI has no use for tuning them
+#define QJNI_MAX_COMPLEXITY 20
+#define QJNI_MIN_DEPTH      10
+#define QJNI_MIN_BREADTH    1
+#define QJNI_SLOP           3
+
+typedef struct _qJniEngine {
+  qSearcher      *searcher;
+  JavaVM         *vm;
+
+  // The asynchronous search, if any
+  bool            searching;
+  pthread_t       thread;
+  volatile bool   cancel;
+  jobject         listener;   // Global ref, or NULL
+  jmethodID       progressId;
+  jmethodID       doneId;
+  qPlayer         player;
+  gint32          maxTimeMs;
+} qJniEngine;
+
+static inline qJniEngine *toEngine(jlong handle)
+{
+  return reinterpret_cast<qJniEngine*>(handle);
+}
+
+// Wait out any asynchronous search before touching the searcher.  If the
+// search thread couldn't attach to the VM, it couldn't drop the listener
+// either, so we do.
+static void waitForSearch
+(qJniEngine *e)
+{
+  JNIEnv *env;
+
+  if (e->searching && !pthread_equal(e->thread, pthread_self())) {
+    pthread_join(e->thread, NULL);
+    e->searching = FALSE;
+    if (e->listener &&
+	(e->vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_4)
+	 == JNI_OK)) {
+      env->DeleteGlobalRef(e->listener);
+      e->listener = NULL;
+    }
+  }
+}
+
+static void throwIllegalArgument
+(JNIEnv *env, const char *msg)
+{
+  jclass cls = env->FindClass("java/lang/IllegalArgumentException");
+  if (cls)
+    env->ThrowNew(cls, msg);
+}
+
+static bool searchProgress
+(const qSearchProgress *progress, void *arg)
+{
+  qJniEngine *e = static_cast<qJniEngine*>(arg);
+  JNIEnv     *env;
+
+  if (e->cancel)
+    return FALSE;
+  if (!e->listener ||
+      (e->vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_4)
+       != JNI_OK))
+    return TRUE;
+
+  jboolean keepGoing =
+    env->CallBooleanMethod(e->listener, e->progressId,
+			   static_cast<jint>(progress->elapsedMs),
+			   static_cast<jint>(progress->positionsEvaluated),
+			   static_cast<jbyte>(progress->bestMove.getEncoding()),
+			   static_cast<jint>(progress->bestScore),
+			   static_cast<jint>(progress->bestComplexity));
+  if (env->ExceptionCheck()) {
+    env->ExceptionClear();
+    return FALSE;
+  }
+  return (keepGoing && !e->cancel);
+}
+
+static qMove runSearch
+(qJniEngine *e)
+{
+  return e->searcher->search(e->player,
+			     QJNI_MAX_COMPLEXITY,
+			     QJNI_MIN_DEPTH,
+			     QJNI_MIN_BREADTH,
+			     QJNI_SLOP,
+			     e->maxTimeMs,
+			     e->maxTimeMs * 3 / 4);
+}
+
+static void *searchThreadMain
+(void *arg)
+{
+  qJniEngine *e = static_cast<qJniEngine*>(arg);
+  JNIEnv     *env;
+
+  if (e->vm->AttachCurrentThread(reinterpret_cast<void**>(&env), NULL)
+      != JNI_OK) {
+    e->searcher->setProgressCallback(NULL, NULL);
+    return NULL; // waitForSearch() drops the listener
+  }
+
+  qMove mv = runSearch(e);
+  e->searcher->setProgressCallback(NULL, NULL);
+
+  env->CallVoidMethod(e->listener, e->doneId,
+		      static_cast<jbyte>(mv.getEncoding()));
+  if (env->ExceptionCheck())
+    env->ExceptionClear();
+  env->DeleteGlobalRef(e->listener);
+  e->listener = NULL;
+
+  e->vm->DetachCurrentThread();
+  return NULL;
+}
+
+
+/*******************************
+ * Natives for DeepQuorEngine  *
+ *******************************/
+extern "C" {
+
+JNIEXPORT jint JNICALL Java_DeepQuorEngine_nativePositionBytes
+(JNIEnv *, jclass)
+{
+  return QJNI_POSITION_BYTES;
+}
+
+JNIEXPORT jlong JNICALL Java_DeepQuorEngine_nativeCreate
+(JNIEnv *env, jclass, jbyteArray position, jint player)
+{
+  qPosition pos(&qInitialPosition);
+  qPlayer   p(player ? qPlayer::BlackPlayer : qPlayer::WhitePlayer);
+
+  if (position) {
+    jbyte buf[QJNI_POSITION_BYTES];
+    env->GetByteArrayRegion(position, 0, QJNI_POSITION_BYTES, buf);
+    if (env->ExceptionCheck())
+      return 0; // Too short; ArrayIndexOutOfBoundsException is pending
+    // Bad bytes would trip asserts (so take down the VM) or corrupt the
+    // move stack, so never hand them on
+    if (!qWireIsValidPosition(reinterpret_cast<guint8*>(buf))) {
+      throwIllegalArgument(env, "not a playable position");
+      return 0;
+    }
+    pos = qPosition::unpack(reinterpret_cast<guint8*>(buf));
+  }
+
+  qJniEngine *e = new qJniEngine;
+
+  env->GetJavaVM(&e->vm);
+  e->searching = FALSE;
+  e->cancel    = FALSE;
+  e->listener  = NULL;
+  e->searcher  = new qSearcher(&pos, p);
+  return reinterpret_cast<jlong>(e);
+}
+
+JNIEXPORT void JNICALL Java_DeepQuorEngine_nativeDestroy
+(JNIEnv *, jclass, jlong handle)
+{
+  qJniEngine *e = toEngine(handle);
+
+  e->cancel = TRUE;
+  waitForSearch(e);
+  delete e->searcher;
+  delete e;
+}
+
+JNIEXPORT void JNICALL Java_DeepQuorEngine_nativeApplyMove
+(JNIEnv *env, jclass, jlong handle, jbyte move, jint player)
+{
+  qJniEngine *e = toEngine(handle);
+  qMove       mv(static_cast<guint8>(move));
+  qPlayer     p(player ? qPlayer::BlackPlayer : qPlayer::WhitePlayer);
+  qMoveList   legal;
+  qMoveListIterator i;
+
+  waitForSearch(e);
+
+  // The move stack asserts (or, without DEBUG, quietly corrupts its wall
+  // lists) on a move that isn't playable, so never hand it one
+  if (p.getPlayerId() != e->searcher->getPlayer2Move().getPlayerId()) {
+    throwIllegalArgument(env, "not that player's turn");
+    return;
+  }
+  e->searcher->getLegalMoves(&legal);
+  for (i = legal.begin(); i != legal.end(); ++i)
+    if (i->getEncoding() == mv.getEncoding())
+      break;
+  if (i == legal.end()) {
+    throwIllegalArgument(env, "illegal move");
+    return;
+  }
+  e->searcher->applyMove(mv, p);
+}
+
+JNIEXPORT jboolean JNICALL Java_DeepQuorEngine_nativeUndoMove
+(JNIEnv *, jclass, jlong handle)
+{
+  qJniEngine *e = toEngine(handle);
+
+  waitForSearch(e);
+  return e->searcher->undoMove() ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jbyte JNICALL Java_DeepQuorEngine_nativeSearch
+(JNIEnv *env, jclass, jlong handle, jint player, jint maxTimeMs,
+ jobject listener, jboolean async)
+{
+  qJniEngine *e = toEngine(handle);
+
+  waitForSearch(e);
+  e->player    = qPlayer(player ? qPlayer::BlackPlayer : qPlayer::WhitePlayer);
+  e->maxTimeMs = maxTimeMs;
+  e->cancel    = FALSE;
+
+  if (listener) {
+    jclass cls = env->GetObjectClass(listener);
+    e->progressId = env->GetMethodID(cls, "progress", "(IIBII)Z");
+    e->doneId     = env->GetMethodID(cls, "done", "(B)V");
+    if (!e->progressId || !e->doneId)
+      return 0; // NoSuchMethodError is pending
+    e->listener = env->NewGlobalRef(listener);
+  }
+  e->searcher->setProgressCallback(&searchProgress, e);
+
+  if (async && e->listener) {
+    if (pthread_create(&e->thread, NULL, &searchThreadMain, e) == 0) {
+      e->searching = TRUE;
+      return 0;
+    }
+    // Couldn't start a thread; fall through and search right here
+  }
+
+  qMove mv = runSearch(e);
+  e->searcher->setProgressCallback(NULL, NULL);
+  if (e->listener) {
+    env->CallVoidMethod(e->listener, e->doneId,
+			static_cast<jbyte>(mv.getEncoding()));
+    env->DeleteGlobalRef(e->listener);
+    e->listener = NULL;
+  }
+  return static_cast<jbyte>(mv.getEncoding());
+}
+
+JNIEXPORT void JNICALL Java_DeepQuorEngine_nativeCancel
+(JNIEnv *, jclass, jlong handle)
+{
+  toEngine(handle)->cancel = TRUE;
+}
+
+JNIEXPORT void JNICALL Java_DeepQuorEngine_nativeWait
+(JNIEnv *, jclass, jlong handle)
+{
+  waitForSearch(toEngine(handle));
+}
+
+JNIEXPORT jbyteArray JNICALL Java_DeepQuorEngine_nativeGetPosition
+(JNIEnv *env, jclass, jlong handle)
+{
+  qJniEngine *e = toEngine(handle);
+  jbyte       buf[QJNI_POSITION_BYTES];
+
+  waitForSearch(e);
+  e->searcher->getPos()->pack(reinterpret_cast<guint8*>(buf));
+
+  jbyteArray r = env->NewByteArray(QJNI_POSITION_BYTES);
+  if (r)
+    env->SetByteArrayRegion(r, 0, QJNI_POSITION_BYTES, buf);
+  return r;
+}
+
+JNIEXPORT jint JNICALL Java_DeepQuorEngine_nativeGetPlayerToMove
+(JNIEnv *, jclass, jlong handle)
+{
+  qJniEngine *e = toEngine(handle);
+
+  waitForSearch(e);
+  return e->searcher->getPlayer2Move().getPlayerId();
+}
+
+JNIEXPORT jbyteArray JNICALL Java_DeepQuorEngine_nativeGetLegalMoves
+(JNIEnv *env, jclass, jlong handle)
+{
+  qJniEngine *e = toEngine(handle);
+  qMoveList   moves;
+  jbyte       buf[256];
+  int         n = 0;
+
+  waitForSearch(e);
+  e->searcher->getLegalMoves(&moves);
+  for (qMoveListIterator i = moves.begin();
+       (i != moves.end()) && (n < 256);
+       ++i)
+    buf[n++] = static_cast<jbyte>(i->getEncoding());
+
+  jbyteArray r = env->NewByteArray(n);
+  if (r)
+    env->SetByteArrayRegion(r, 0, n, buf);
+  return r;
+}
+
+} // extern "C"
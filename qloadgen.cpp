@@ -0,0 +1,716 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+/* qloadgen - load an engine server with simulated games (see WIRE_PROTOCOL)
+ *
+ * usage: qloadgen [-c games] [-n total] [-d secs] [-m plies] [-T ms]
+ *                 [-w percent] [-f script] [-s seed] [-x secs] [-o samples]
+ *                 host port
+ *   Keeps up to games (default 100) games going at once, each on its own
+ *   connection, starting another as each one ends, for secs (default 10)
+ *   or until total games have been started and played out.  Each game
+ *   says HELLO, PROTOVER, WHITE or BLACK (alternately) and NEW, then
+ *   plays until someone wins or plies (default 150) moves have been
+ *   made, and QUITs.  With -T it asks for ms a move first, as
+ *   "FEATURE,MOVETIME,ms".
+ *
+ *   Our moves are random: walls percent (default 20) of the time, and
+ *   otherwise pawn moves, mostly toward the goal.  A script gives the
+ *   opening moves instead: one game per line, in move notation separated
+ *   by spaces or commas, used in turn; a game goes on at random once its
+ *   line runs out or a move in it isn't legal.
+ *
+ *   The server's moves are checked, and a game fails on any it shouldn't
+ *   have made, a protocol error, a hang-up or a reply taking longer than
+ *   -x secs (default 60).  At the end it reports what became of the
+ *   games, throughput, and the distribution of the time from connect()
+ *   to connected, NEW to NEW,CONFIRMED and each MOVE of ours to the
+ *   server's answering MOVE.  -o writes every sample, as "kind,usecs"
+ *   lines.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "qio.h"
+#include "qdijkstra.h"
+#include "getmoves.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+#define QLOADGEN_NAME        "qloadgen"
+#define QLOADGEN_MAX_EVENTS  256
+#define QLOADGEN_TICK_MS     100  /* Longest we wait before checking timeouts */
+#define QLOADGEN_WALL_TRIES  16   /* Random wall slots tried before a pawn move */
+#define QLOADGEN_GREEDY_PCT  70   /* Pawn moves that head straight for goal */
+#define QLOADGEN_MAX_MVERROR 3    /* Our moves refused before we give up */
+
+typedef enum { LG_CONNECT, LG_NEW, LG_MOVE, LG_KINDS } qLoadGenKind;
+static const char *const kindNames[LG_KINDS] = { "connect", "new", "move" };
+
+typedef enum { LG_FAIL_CONNECT, LG_FAIL_TIMEOUT, LG_FAIL_PROTOCOL,
+	       LG_FAIL_HANGUP, LG_FAILS } qLoadGenFail;
+static const char *const failNames[LG_FAILS] =
+  { "connect", "timeout", "protocol", "hang-up" };
+
+typedef struct _qLoadGame {
+  int         fd;
+  bool        connected;
+  bool        started;    // NEW confirmed, or the server moved
+  bool        wantOut;    // Watching for room to write
+  qPlayer     us;
+  qPlayer     toMove;
+  qPosition   pos;
+  qPosition   beforeOurs; // To back up a refused move
+  guint32     plies;
+  guint32     mvErrors;
+  guint64     sentAt;     // When what we await was asked for, or 0
+  int         awaiting;   // Its qLoadGenKind
+  std::string in, out;
+  const std::vector<std::string> *script;
+  size_t      scriptPos;
+  _qLoadGame() : pos(&qInitialPosition), beforeOurs(&qInitialPosition) { ; };
+} qLoadGame;
+
+// What we were asked to do
+static guint32     maxGames = 100, totalGames = 0, maxPlies = 150;
+static guint32     moveTimeMs = 0, wallPct = 20, timeoutSecs = 60;
+static std::vector<std::vector<std::string> > scripts;
+
+// What happened
+static std::vector<guint32> samples[LG_KINDS];
+static guint32 gamesStarted, gamesFinished, gamesFailed[LG_FAILS];
+static guint32 movesSent, movesReceived, mvErrors;
+static guint32 featuresAccepted, featuresRejected;
+static int     epfd;
+
+static void usage()
+{
+  fprintf(stderr,
+	  "usage: qloadgen [-c games] [-n total] [-d secs] [-m plies] [-T ms]\n"
+	  "                [-w percent] [-f script] [-s seed] [-x secs] [-o samples]\n"
+	  "                host port\n");
+}
+
+static guint64 nowUs
+(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (guint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// xorshift32, as qCorpusGenerator does, so a seed replays the same games
+static guint32 seed = 1;
+static guint32 random32
+(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static bool readScripts
+(const char *path)
+{
+  FILE *fh = fopen(path, "r");
+  char  line[4096], *tok;
+
+  if (!fh)
+    return FALSE;
+  while (fgets(line, sizeof(line), fh)) {
+    std::vector<std::string> moves;
+    if (line[0] == '#')
+      continue;
+    for (tok = strtok(line, " \t,\r\n"); tok; tok = strtok(NULL, " \t,\r\n"))
+      moves.push_back(tok);
+    if (!moves.empty())
+      scripts.push_back(moves);
+  }
+  fclose(fh);
+  return !scripts.empty();
+}
+
+static qMove pickMove
+(qLoadGame *g)
+{
+  qMove mv;
+
+  // Scripted, while the script lasts & makes sense
+  if (g->script) {
+    if ((g->scriptPos < g->script->size()) &&
+	qWireNotationToMove(&g->pos, g->us,
+			    (*g->script)[g->scriptPos++].c_str(), &mv) &&
+	qWireIsLegal(&g->pos, g->us, mv))
+      return mv;
+    g->script = NULL;
+  }
+
+  if (g->pos.numWallsLeft(g->us) && (random32() % 100 < wallPct))
+    for (int i = 0; i < QLOADGEN_WALL_TRIES; ++i) {
+      mv = qMove((bool)(random32() & 1),
+		 random32() % QWALL_LINES,
+		 random32() % QWALL_LINES);
+      if (qWireIsLegal(&g->pos, g->us, mv))
+	return mv;
+    }
+
+  qMoveList pawnMoves;
+  getPossiblePawnMoves(&g->pos, g->us, &pawnMoves);
+  g_assert(!pawnMoves.empty());
+  if (random32() % 100 >= QLOADGEN_GREEDY_PCT)
+    return pawnMoves[random32() % pawnMoves.size()];
+
+  // The pawn move leaving the shortest path to goal, ties at random
+  gint8   bestDist = -1;
+  guint32 ties = 0;
+  for (qMoveListIterator m = pawnMoves.begin(); m != pawnMoves.end(); ++m) {
+    qPosition    newPos(&g->pos);
+    qDijkstraArg dArg;
+
+    newPos.applyMove(g->us, *m);
+    dArg.pos          = &newPos;
+    dArg.player       = g->us;
+    dArg.getAllRoutes = FALSE;
+    qDijkstra(&dArg);
+    if ((bestDist < 0) || (dArg.dist[0] < bestDist)) {
+      mv       = *m;
+      bestDist = dArg.dist[0];
+      ties     = 1;
+    } else if ((dArg.dist[0] == bestDist) && (random32() % ++ties == 0))
+      mv = *m;
+  }
+  return mv;
+}
+
+/*****
+ * Connections *
+ *****/
+
+static void watch
+(qLoadGame *g)
+{
+  struct epoll_event ev;
+
+  ev.events   = EPOLLIN | (g->wantOut ? EPOLLOUT : 0);
+  ev.data.ptr = g;
+  epoll_ctl(epfd, EPOLL_CTL_MOD, g->fd, &ev);
+}
+
+// Write what we can; returns FALSE if the connection is gone
+static bool flush
+(qLoadGame *g)
+{
+  ssize_t n;
+
+  while (!g->out.empty()) {
+    n = send(g->fd, g->out.data(), g->out.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+	continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+	break;
+      return FALSE;
+    }
+    g->out.erase(0, n);
+  }
+  if (g->wantOut != !g->out.empty()) {
+    g->wantOut = !g->out.empty();
+    watch(g);
+  }
+  return TRUE;
+}
+
+static void sendCmd
+(qLoadGame *g, const char *name, const char *arg1 = NULL,
+ const char *arg2 = NULL, const char *arg3 = NULL)
+{
+  qWireCommand cmd;
+
+  cmd.push_back(name);
+  if (arg1) cmd.push_back(arg1);
+  if (arg2) cmd.push_back(arg2);
+  if (arg3) cmd.push_back(arg3);
+  qWireFormat(cmd, &g->out);
+}
+
+static void await
+(qLoadGame *g, qLoadGenKind kind)
+{
+  g->awaiting = kind;
+  g->sentAt   = nowUs();
+}
+
+static void answered
+(qLoadGame *g, qLoadGenKind kind)
+{
+  if (g->sentAt && (g->awaiting == kind))
+    samples[kind].push_back(nowUs() - g->sentAt);
+  g->sentAt = 0;
+}
+
+static qLoadGame *startGame
+(const struct addrinfo *addr)
+{
+  qLoadGame         *g = new qLoadGame;
+  struct epoll_event ev;
+  int                one = 1;
+
+  g->fd = socket(addr->ai_family, SOCK_STREAM, 0);
+  if ((g->fd < 0) ||
+      (fcntl(g->fd, F_SETFL, O_NONBLOCK) < 0) ||
+      (setsockopt(g->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) ||
+      ((connect(g->fd, addr->ai_addr, addr->ai_addrlen) < 0) &&
+       (errno != EINPROGRESS))) {
+    if (g->fd >= 0)
+      close(g->fd);
+    delete g;
+    return NULL;
+  }
+
+  // Alternate colors
+  g->us        = qPlayer((gint8)(gamesStarted & 1));
+  g->toMove    = qPlayer_white;
+  g->connected = g->started = FALSE;
+  g->wantOut   = TRUE; // Until connected
+  g->plies     = g->mvErrors = 0;
+  g->script    = scripts.empty() ? NULL : &scripts[gamesStarted % scripts.size()];
+  g->scriptPos = 0;
+  ++gamesStarted;
+  await(g, LG_CONNECT);
+
+  ev.events   = EPOLLOUT;
+  ev.data.ptr = g;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, g->fd, &ev);
+  return g;
+}
+
+static void endGame
+(qLoadGame *g, int fail)
+{
+  if (fail < 0)
+    ++gamesFinished;
+  else
+    ++gamesFailed[fail];
+  if (g->connected) {
+    sendCmd(g, "QUIT");
+    flush(g);
+  }
+  close(g->fd); // Also takes it out of epfd
+  g->fd = -1;
+}
+
+static void sendMove
+(qLoadGame *g)
+{
+  char  notation[QWIRE_MOVE_LEN], walls[4];
+  qMove mv = pickMove(g);
+
+  g->beforeOurs = g->pos;
+  g->pos.applyMove(g->us, mv);
+  qWireMoveToNotation(&g->beforeOurs, g->us, mv, notation);
+  snprintf(walls, sizeof(walls), "%u", g->pos.numWallsLeft(g->us));
+  sendCmd(g, "MOVE", qWirePlayerName(g->us), notation, walls);
+  g->toMove.changePlayer();
+  ++g->plies;
+  ++movesSent;
+  await(g, LG_MOVE);
+}
+
+// After either side moves: TRUE if the game's over
+static bool gameOver
+(qLoadGame *g)
+{
+  return g->pos.isWhiteWon() || g->pos.isBlackWon() || (g->plies >= maxPlies);
+}
+
+static void startPlay
+(qLoadGame *g)
+{
+  g->started = TRUE;
+  if (g->toMove.isWhite() == g->us.isWhite())
+    sendMove(g);
+  // else the server moves first, untimed: it may come with NEW,CONFIRMED
+}
+
+// Returns -2 to go on, -1 if the game's over, or why it failed
+static int handleCmd
+(qLoadGame *g, const qWireCommand &cmd)
+{
+  const std::string &name = cmd[0];
+  const char        *arg1 = (cmd.size() > 1) ? cmd[1].c_str() : "";
+
+  if (name == "MOVE") {
+    qPlayer them = g->us.otherPlayer();
+    qMove   mv;
+
+    if ((cmd.size() < 3) || (cmd[1] != qWirePlayerName(them)) ||
+	(g->toMove.isWhite() != them.isWhite()) ||
+	!qWireNotationToMove(&g->pos, them, cmd[2].c_str(), &mv) ||
+	!qWireIsLegal(&g->pos, them, mv)) {
+      sendCmd(g, "MVERROR", "unexpected move",
+	      (cmd.size() > 2) ? cmd[2].c_str() : "");
+      return LG_FAIL_PROTOCOL;
+    }
+    answered(g, LG_MOVE);
+    if (!g->started) // Server started without confirming our NEW
+      g->started = TRUE;
+    g->pos.applyMove(them, mv);
+    g->toMove.changePlayer();
+    ++g->plies;
+    ++movesReceived;
+    if (gameOver(g))
+      return -1;
+    sendMove(g);
+    return gameOver(g) ? -1 : -2;
+  }
+
+  if (name == "NEW") {
+    if (strcmp(arg1, "CONFIRMED")) // The server asks too; fine by us
+      sendCmd(g, "NEW", "CONFIRMED");
+    if (!g->started) {
+      answered(g, LG_NEW);
+      startPlay(g);
+    }
+    return gameOver(g) ? -1 : -2;
+  }
+
+  if (name == "MVERROR") {
+    // Our last move was refused: back it up & try another
+    if (g->started && (g->toMove.isWhite() != g->us.isWhite()) &&
+	(++g->mvErrors <= QLOADGEN_MAX_MVERROR)) {
+      ++mvErrors;
+      g->pos = g->beforeOurs;
+      g->toMove.changePlayer();
+      --g->plies;
+      --movesSent;
+      g->script = NULL;
+      sendMove(g);
+      return -2;
+    }
+    return LG_FAIL_PROTOCOL;
+  }
+
+  if (name == "PROTOVER")
+    return strcmp(arg1, QWIRE_PROTOVER) ? LG_FAIL_PROTOCOL : -2;
+  if (name == "ACCEPTED") {
+    ++featuresAccepted;
+    return -2;
+  }
+  if (name == "REJECTED") {
+    ++featuresRejected;
+    return -2;
+  }
+  if (name == "FEATURE") {
+    sendCmd(g, "REJECTED", arg1);
+    return -2;
+  }
+  if (name == "PING") {
+    sendCmd(g, "PONG", arg1);
+    return -2;
+  }
+  if ((name == "HELLO") || (name == "WHITE") || (name == "BLACK") ||
+      (name == "GAMESTATE") || (name == "PONG"))
+    return -2;
+  if ((name == "QUIT") || (name == "ERROR") || (name == "CMDERROR"))
+    return LG_FAIL_PROTOCOL;
+
+  sendCmd(g, "CMDERROR", "unknown command", name.c_str());
+  return -2;
+}
+
+// Returns as handleCmd() does, for everything there is to read
+static int handleInput
+(qLoadGame *g)
+{
+  char         buf[4096];
+  ssize_t      n;
+  size_t       start, nl;
+  qWireCommand cmd;
+  int          rval;
+
+  for (;;) {
+    n = read(g->fd, buf, sizeof(buf));
+    if (n < 0) {
+      if (errno == EINTR)
+	continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+	break;
+      return LG_FAIL_HANGUP;
+    }
+    if (n == 0)
+      return LG_FAIL_HANGUP;
+    g->in.append(buf, n);
+  }
+
+  for (start = 0; (nl = g->in.find('\n', start)) != std::string::npos;
+       start = nl + 1) {
+    if (!qWireParse(g->in.data() + start, nl - start, &cmd)) {
+      if (nl == start) // Blank lines (or a '\0' separator) are nothing
+	continue;
+      g->in.erase(0, nl + 1);
+      return LG_FAIL_PROTOCOL;
+    }
+    if ((rval = handleCmd(g, cmd)) != -2) {
+      g->in.erase(0, nl + 1);
+      return rval;
+    }
+  }
+  g->in.erase(0, start);
+  return flush(g) ? -2 : LG_FAIL_HANGUP;
+}
+
+static int handleConnect
+(qLoadGame *g)
+{
+  int       err = 0;
+  socklen_t len = sizeof(err);
+  char      ms[12];
+
+  if ((getsockopt(g->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) || err)
+    return LG_FAIL_CONNECT;
+  g->connected = TRUE;
+  answered(g, LG_CONNECT);
+
+  sendCmd(g, "HELLO", QLOADGEN_NAME);
+  sendCmd(g, "PROTOVER", QWIRE_PROTOVER);
+  if (moveTimeMs) {
+    snprintf(ms, sizeof(ms), "%u", moveTimeMs);
+    sendCmd(g, "FEATURE", "MOVETIME", ms);
+  }
+  sendCmd(g, g->us.isWhite() ? "WHITE" : "BLACK", QLOADGEN_NAME);
+  sendCmd(g, "NEW");
+  await(g, LG_NEW);
+  return flush(g) ? -2 : LG_FAIL_HANGUP;
+}
+
+/*****
+ * Reporting *
+ *****/
+
+static double percentile
+(const std::vector<guint32> &v, double p)
+{
+  size_t i = (size_t)(p * v.size());
+  return v[(i < v.size()) ? i : v.size() - 1] / 1000.0;
+}
+
+static void report
+(double secs, guint32 unfinished)
+{
+  int k;
+
+  printf("%.1f s, up to %u games at once\n", secs, maxGames);
+  printf("games:   %u started  %u finished  %u unfinished  failed:",
+	 gamesStarted, gamesFinished, unfinished);
+  for (k = 0; k < LG_FAILS; ++k)
+    printf(" %u %s", gamesFailed[k], failNames[k]);
+  printf("\n");
+  printf("moves:   %u sent  %u answered  %u refused  %.1f/s answered\n",
+	 movesSent, movesReceived, mvErrors, movesReceived / secs);
+  printf("games/s: %.2f finished\n", gamesFinished / secs);
+  if (moveTimeMs)
+    printf("MOVETIME %u: %u accepted  %u rejected\n",
+	   moveTimeMs, featuresAccepted, featuresRejected);
+
+  printf("%-8s %8s %9s %9s %9s %9s %9s %9s  (ms)\n",
+	 "request", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+  for (k = 0; k < LG_KINDS; ++k) {
+    std::vector<guint32> &v = samples[k];
+    double sum = 0;
+
+    if (v.empty()) {
+      printf("%-8s %8u\n", kindNames[k], 0);
+      continue;
+    }
+    for (size_t i = 0; i < v.size(); ++i)
+      sum += v[i];
+    std::sort(v.begin(), v.end());
+    printf("%-8s %8lu %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+	   kindNames[k], (unsigned long)v.size(), sum / v.size() / 1000.0,
+	   percentile(v, 0.5), percentile(v, 0.9), percentile(v, 0.99),
+	   percentile(v, 0.999), v.back() / 1000.0);
+  }
+}
+
+static bool writeSamples
+(const char *path)
+{
+  FILE *fh = fopen(path, "w");
+
+  if (!fh)
+    return FALSE;
+  for (int k = 0; k < LG_KINDS; ++k)
+    for (size_t i = 0; i < samples[k].size(); ++i)
+      fprintf(fh, "%s,%u\n", kindNames[k], samples[k][i]);
+  return (fclose(fh) == 0);
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<qLoadGame *> games;
+  struct epoll_event       events[QLOADGEN_MAX_EVENTS];
+  struct addrinfo          hints, *addr;
+  struct rlimit            rl;
+  const char              *samplesPath = NULL;
+  guint64                  start, deadline, now, lastTick;
+  guint32                  secs = 10, unfinished = 0;
+  bool                     timed = FALSE;
+  int                      c, n, i, rval;
+
+  while ((c = getopt(argc, argv, "c:n:d:m:T:w:f:s:x:o:")) != -1) {
+    switch (c) {
+    case 'c': maxGames    = strtoul(optarg, NULL, 10); break;
+    case 'n': totalGames  = strtoul(optarg, NULL, 10); break;
+    case 'd': secs        = strtoul(optarg, NULL, 10);
+              timed       = TRUE;                      break;
+    case 'm': maxPlies    = strtoul(optarg, NULL, 10); break;
+    case 'T': moveTimeMs  = strtoul(optarg, NULL, 10); break;
+    case 'w': wallPct     = strtoul(optarg, NULL, 10); break;
+    case 's': seed        = strtoul(optarg, NULL, 10); break;
+    case 'x': timeoutSecs = strtoul(optarg, NULL, 10); break;
+    case 'o': samplesPath = optarg;                    break;
+    case 'f':
+      if (!readScripts(optarg)) {
+	fprintf(stderr, "qloadgen: no moves in %s\n", optarg);
+	return 1;
+      }
+      break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if ((optind + 2 != argc) || !maxGames || !maxPlies) {
+    usage();
+    return 2;
+  }
+  if (!seed)
+    seed = 1;
+  if (!totalGames) // Otherwise only if asked
+    timed = TRUE;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if ((rval = getaddrinfo(argv[optind], argv[optind + 1], &hints, &addr))) {
+    fprintf(stderr, "qloadgen: %s port %s: %s\n",
+	    argv[optind], argv[optind + 1], gai_strerror(rval));
+    return 1;
+  }
+
+  // A descriptor a game, & a few for us
+  if (!getrlimit(RLIMIT_NOFILE, &rl) && (rl.rlim_cur < maxGames + 16)) {
+    rl.rlim_cur = (rl.rlim_max < maxGames + 16) ? rl.rlim_max : maxGames + 16;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < maxGames + 16) {
+      maxGames = rl.rlim_cur - 16;
+      fprintf(stderr, "qloadgen: only %u games at once will fit\n", maxGames);
+    }
+  }
+
+  if ((epfd = epoll_create(maxGames + 1)) < 0) {
+    perror("qloadgen: epoll_create");
+    return 1;
+  }
+  games.assign(maxGames, (qLoadGame *)NULL);
+
+  start = lastTick = nowUs();
+  deadline = start + (guint64)secs * 1000000;
+  for (;;) {
+    now = nowUs();
+    int active = 0;
+
+    // Keep every slot busy while there are games left to start
+    for (i = 0; i < (int)maxGames; ++i) {
+      if (!games[i] && (!totalGames || (gamesStarted < totalGames))) {
+	games[i] = startGame(addr);
+	if (!games[i]) {
+	  ++gamesStarted;
+	  ++gamesFailed[LG_FAIL_CONNECT];
+	}
+      }
+      if (games[i])
+	++active;
+    }
+    if ((timed && (now >= deadline)) || !active)
+      break;
+
+    n = epoll_wait(epfd, events, QLOADGEN_MAX_EVENTS, QLOADGEN_TICK_MS);
+    for (i = 0; i < n; ++i) {
+      qLoadGame *g = (qLoadGame *)events[i].data.ptr;
+
+      if (g->fd < 0) // Ended earlier in this batch
+	continue;
+      rval = -2;
+      if (!g->connected) {
+	if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+	  rval = handleConnect(g);
+      } else {
+	if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+	  rval = handleInput(g);
+	if ((rval == -2) && (events[i].events & EPOLLOUT) && !flush(g))
+	  rval = LG_FAIL_HANGUP;
+      }
+      if (rval != -2)
+	endGame(g, rval);
+    }
+
+    // Fail whatever's waited too long, & free the ended games' slots
+    now = nowUs();
+    bool tick = (now - lastTick >= QLOADGEN_TICK_MS * 1000);
+    if (tick)
+      lastTick = now;
+    for (i = 0; i < (int)maxGames; ++i) {
+      qLoadGame *g = games[i];
+      if (g && tick && (g->fd >= 0) && g->sentAt &&
+	  (now - g->sentAt > (guint64)timeoutSecs * 1000000))
+	endGame(g, g->connected ? LG_FAIL_TIMEOUT : LG_FAIL_CONNECT);
+      if (g && (g->fd < 0)) {
+	delete g;
+	games[i] = NULL;
+      }
+    }
+  }
+
+  for (i = 0; i < (int)maxGames; ++i)
+    if (games[i]) {
+      if (games[i]->connected) {
+	sendCmd(games[i], "QUIT");
+	flush(games[i]);
+      }
+      close(games[i]->fd);
+      delete games[i];
+      ++unfinished;
+    }
+  close(epfd);
+  freeaddrinfo(addr);
+
+  report((nowUs() - start) / 1e6, unfinished);
+  if (samplesPath && !writeSamples(samplesPath)) {
+    fprintf(stderr, "qloadgen: can't write %s\n", samplesPath);
+    return 1;
+  }
+  return 0;
+}
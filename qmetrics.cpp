@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+
+#include "qmetrics.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+
+// How long a scraper gets to send its request, or take our reply
+#define QMETRICS_IO_TIMEOUT_SECS 2
+
+IDSTR("$Id$");
+
+
+/****/
+
+/* Each exported metric is a getter run against a qSearcherStats.  The
+ * process-wide series uses the same getter against the sum of every
+ * game's stats, which gives sensible answers for ratios too (e.g. the
+ * process's nodes/sec is total recent positions over total recent time).
+ */
+typedef double (*qMetricGetter)(const qSearcherStats*);
+
+typedef struct _qMetricDef {
+  const char    *name;
+  const char    *type; // "counter" or "gauge"
+  const char    *help;
+  qMetricGetter  get;
+} qMetricDef;
+
+static double getSearches(const qSearcherStats *s)   { return s->searches; }
+static double getThinks(const qSearcherStats *s)     { return s->thinks; }
+static double getOverruns(const qSearcherStats *s)   { return s->overruns; }
+static double getPositions(const qSearcherStats *s)
+  { return static_cast<double>(s->positionsEvaluated); }
+static double getBudgetMs(const qSearcherStats *s)
+  { return static_cast<double>(s->budgetMs); }
+static double getPonderTries(const qSearcherStats *s)
+  { return s->ponderPredictions; }
+static double getPonderHits(const qSearcherStats *s) { return s->ponderHits; }
+static double getHashRemoved(const qSearcherStats *s){ return s->hashRemoved; }
+static double getHashPositions(const qSearcherStats *s)
+  { return s->hashPositions; }
+static double getHashLoad(const qSearcherStats *s)
+  { return s->hashBuckets ?
+      static_cast<double>(s->hashPositions)/s->hashBuckets : 0; }
+static double getTreeNodes(const qSearcherStats *s)  { return s->treeNodes; }
+static double getTreeCapacity(const qSearcherStats *s)
+  { return s->treeCapacity; }
+static double getTreePruned(const qSearcherStats *s)
+  { return static_cast<double>(s->treeNodesPruned); }
+static double getEndgamesSolved(const qSearcherStats *s)
+  { return s->endgamesSolved; }
+static double getEndgameNodes(const qSearcherStats *s)
+  { return static_cast<double>(s->endgameNodes); }
+static double getNodesPerSec(const qSearcherStats *s)
+  { return s->lastElapsedMs ?
+      (1000.0*s->lastPositionsEvaluated)/s->lastElapsedMs : 0; }
+
+static const qMetricDef metricDefs[] = {
+  { "deepquor_searches_total", "counter",
+    "Calls to qSearcher::search()", &getSearches },
+  { "deepquor_thinks_total", "counter",
+    "Calls to qSearcher::think()", &getThinks },
+  { "deepquor_search_overruns_total", "counter",
+    "Searches that took longer than their max_time", &getOverruns },
+  { "deepquor_positions_evaluated_total", "counter",
+    "New positions examined by searching and thinking", &getPositions },
+  { "deepquor_search_budget_ms_total", "counter",
+    "Sum of max_time granted to search(), in ms", &getBudgetMs },
+  { "deepquor_ponder_predictions_total", "counter",
+    "Moves applied for a player think() had predicted for", &getPonderTries },
+  { "deepquor_ponder_hits_total", "counter",
+    "Applied moves that matched think()'s predicted move", &getPonderHits },
+  { "deepquor_hash_evictions_total", "counter",
+    "Positions removed from the position hash", &getHashRemoved },
+  { "deepquor_hash_positions", "gauge",
+    "Positions currently stored in the position hash", &getHashPositions },
+  { "deepquor_hash_load_factor", "gauge",
+    "Stored positions per hash bucket", &getHashLoad },
+  { "deepquor_tree_nodes", "gauge",
+    "Nodes in use in the computation tree", &getTreeNodes },
+  { "deepquor_tree_capacity", "gauge",
+    "Nodes allocated for the computation tree", &getTreeCapacity },
+  { "deepquor_tree_nodes_pruned_total", "counter",
+    "Computation tree nodes freed to stay within the node limit",
+    &getTreePruned },
+  { "deepquor_endgames_solved_total", "counter",
+    "Positions settled by the one-sided wall endgame solver",
+    &getEndgamesSolved },
+  { "deepquor_endgame_nodes_total", "counter",
+    "Positions searched by the endgame solver", &getEndgameNodes },
+  { "deepquor_nodes_per_second", "gauge",
+    "Positions/sec over the most recent search or think", &getNodesPerSec }
+};
+#define ARRAYSIZE(ARR) (sizeof(ARR)/sizeof((ARR)[0]))
+
+static void addStats
+(qSearcherStats *dst, const qSearcherStats *src)
+{
+  int i;
+
+  dst->searches               += src->searches;
+  dst->thinks                 += src->thinks;
+  dst->overruns               += src->overruns;
+  dst->positionsEvaluated     += src->positionsEvaluated;
+  dst->searchMs               += src->searchMs;
+  dst->budgetMs               += src->budgetMs;
+  for (i = 0; i <= QSTATS_LATENCY_BUCKETS; ++i)
+    dst->latencyHist[i]       += src->latencyHist[i];
+  dst->lastElapsedMs          += src->lastElapsedMs;
+  dst->lastPositionsEvaluated += src->lastPositionsEvaluated;
+  dst->ponderPredictions      += src->ponderPredictions;
+  dst->ponderHits             += src->ponderHits;
+  dst->treeNodesPruned        += src->treeNodesPruned;
+  dst->endgamesSolved         += src->endgamesSolved;
+  dst->endgameNodes           += src->endgameNodes;
+  dst->hashPositions          += src->hashPositions;
+  dst->hashBuckets            += src->hashBuckets;
+  dst->hashRemoved            += src->hashRemoved;
+  dst->treeNodes              += src->treeNodes;
+  dst->treeCapacity           += src->treeCapacity;
+}
+
+// Sized for the labels, so a long game name can't cut a sample short
+static void appendf
+(std::string *s, const char *fmt, const char *name, const char *labels,
+ double val)
+{
+  std::vector<char> buf(strlen(fmt) + strlen(name) + strlen(labels) + 32);
+  snprintf(&buf[0], buf.size(), fmt, name, labels, val);
+  s->append(&buf[0]);
+}
+
+// A label value as the exposition format quotes it: backslash, double
+// quote & newline escaped
+static std::string escapeLabel
+(const char *val)
+{
+  std::string r;
+
+  for (; *val; ++val)
+    switch (*val) {
+    case '\\': r += "\\\\"; break;
+    case '"':  r += "\\\""; break;
+    case '\n': r += "\\n";  break;
+    default:   r += *val;
+    }
+  return r;
+}
+
+
+/**************************
+ * class qMetricsRegistry *
+ **************************/
+qMetricsRegistry::qMetricsRegistry()
+  :listenFd(-1), listening(FALSE)
+{
+  memset(&retired, 0, sizeof(retired));
+  pthread_mutex_init(&mutex, NULL);
+}
+
+qMetricsRegistry::~qMetricsRegistry()
+{
+  stopListener();
+  pthread_mutex_destroy(&mutex);
+}
+
+void qMetricsRegistry::registerSearcher
+(const qSearcher *searcher, const char *gameName)
+{
+  qMetricsGame g;
+  g.searcher = searcher;
+  g.name     = escapeLabel(gameName ? gameName : "");
+
+  pthread_mutex_lock(&mutex);
+  games.push_back(g);
+  pthread_mutex_unlock(&mutex);
+}
+
+void qMetricsRegistry::unregisterSearcher
+(const qSearcher *searcher)
+{
+  std::list<qMetricsGame>::iterator itr;
+
+  pthread_mutex_lock(&mutex);
+  for (itr = games.begin(); itr != games.end(); ++itr) {
+    if (itr->searcher != searcher)
+      continue;
+
+    // Keep the counters; gauges describe live games only
+    qSearcherStats s;
+    searcher->getStats(&s);
+    s.lastElapsedMs = s.lastPositionsEvaluated = 0;
+    s.hashPositions = s.hashBuckets = 0;
+    s.treeNodes     = s.treeCapacity = 0;
+    addStats(&retired, &s);
+
+    games.erase(itr);
+    break;
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+void qMetricsRegistry::render
+(std::string *r_text)
+{
+  std::list<qMetricsGame>::const_iterator itr;
+  std::vector<qSearcherStats> gameStats;
+  std::vector<std::string>    gameLabels;
+  qSearcherStats total = retired;
+  unsigned int i, m;
+
+  pthread_mutex_lock(&mutex);
+  for (itr = games.begin(); itr != games.end(); ++itr) {
+    qSearcherStats s;
+    itr->searcher->getStats(&s);
+    addStats(&total, &s);
+    gameStats.push_back(s);
+    gameLabels.push_back("scope=\"game\",game=\"" + itr->name + "\"");
+  }
+  pthread_mutex_unlock(&mutex);
+
+  for (m = 0; m < ARRAYSIZE(metricDefs); ++m) {
+    const qMetricDef *d = &metricDefs[m];
+    r_text->append("# HELP ").append(d->name).append(" ")
+      .append(d->help).append("\n");
+    r_text->append("# TYPE ").append(d->name).append(" ")
+      .append(d->type).append("\n");
+    appendf(r_text, "%s{%s} %.15g\n", d->name, "scope=\"process\"",
+	    d->get(&total));
+    for (i = 0; i < gameStats.size(); ++i)
+      appendf(r_text, "%s{%s} %.15g\n", d->name, gameLabels[i].c_str(),
+	      d->get(&gameStats[i]));
+  }
+
+  // search() latency as a histogram, so averages & p99 can be derived
+  // (and compared against deepquor_search_budget_ms_total)
+  const char *h = "deepquor_search_latency_ms";
+  r_text->append("# HELP deepquor_search_latency_ms Time taken by search()\n");
+  r_text->append("# TYPE deepquor_search_latency_ms histogram\n");
+  for (i = 0; i <= gameStats.size(); ++i) {
+    const qSearcherStats *s = i ? &gameStats[i-1] : &total;
+    std::string labels = i ? gameLabels[i-1] : "scope=\"process\"";
+    guint64 cumulative = 0;
+    int b;
+    char le[64];
+
+    for (b = 0; b <= QSTATS_LATENCY_BUCKETS; ++b) {
+      cumulative += s->latencyHist[b];
+      if (b < QSTATS_LATENCY_BUCKETS)
+	snprintf(le, sizeof(le), ",le=\"%u\"", qStatsLatencyBucketMs[b]);
+      else
+	snprintf(le, sizeof(le), ",le=\"+Inf\"");
+      appendf(r_text, "%s_bucket{%s} %.15g\n", h, (labels + le).c_str(),
+	      static_cast<double>(cumulative));
+    }
+    appendf(r_text, "%s_sum{%s} %.15g\n", h, labels.c_str(),
+	    static_cast<double>(s->searchMs));
+    appendf(r_text, "%s_count{%s} %.15g\n", h, labels.c_str(),
+	    s->searches);
+  }
+}
+
+bool qMetricsRegistry::startListener
+(guint16 port)
+{
+  struct sockaddr_in addr;
+  int on = 1;
+
+  if (listening)
+    return FALSE;
+
+  if ((listenFd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    return FALSE;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  // Loopback only; anything wanting these numbers from off-host should
+  // go through whatever scrapes this box.
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if ((bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+      (listen(listenFd, 8) < 0) ||
+      pthread_create(&listenThread, NULL, &qMetricsRegistry::listenerMain,
+		     this)) {
+    close(listenFd);
+    listenFd = -1;
+    return FALSE;
+  }
+  listening = TRUE;
+  return TRUE;
+}
+
+void qMetricsRegistry::stopListener()
+{
+  if (!listening)
+    return;
+
+  // Knock the listener out of accept()
+  shutdown(listenFd, SHUT_RDWR);
+  close(listenFd);
+  pthread_join(listenThread, NULL);
+  listenFd  = -1;
+  listening = FALSE;
+}
+
+void *qMetricsRegistry::listenerMain
+(void *arg)
+{
+  qMetricsRegistry *registry = static_cast<qMetricsRegistry*>(arg);
+  int fd;
+
+  while ((fd = accept(registry->listenFd, NULL, NULL)) >= 0) {
+    registry->serveOne(fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+void qMetricsRegistry::serveOne
+(int fd)
+{
+  char        request[1024];
+  std::string body;
+  std::string response;
+  ssize_t     n;
+
+  // Don't let one client that connects and says nothing hold up every
+  // scrape after it
+  struct timeval timeout;
+  timeout.tv_sec  = QMETRICS_IO_TIMEOUT_SECS;
+  timeout.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // We answer anything with the metrics, so just drain the request header
+  n = read(fd, request, sizeof(request));
+  if (n <= 0)
+    return;
+
+  render(&body);
+
+  char header[160];
+  snprintf(header, sizeof(header),
+	   "HTTP/1.0 200 OK\r\n"
+	   "Content-Type: text/plain; version=0.0.4\r\n"
+	   "Content-Length: %lu\r\n\r\n",
+	   static_cast<unsigned long>(body.size()));
+  response = header;
+  response += body;
+
+  const char *p   = response.data();
+  size_t      len = response.size();
+  while (len > 0) {
+    // A scraper that hangs up mustn't take the engine down with SIGPIPE
+    n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n <= 0)
+      break;
+    p   += n;
+    len -= n;
+  }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_qmetrics_h
+#define INCLUDE_qmetrics_h 1
+
+#include <pthread.h>
+#include <list>
+#include <string>
+#include "qtypes.h"
+#include "qsearcher.h"
+
+/* qMetricsRegistry
+ * A long-running engine process keeps one of these, registers each game's
+ * qSearcher with it, and optionally has it answer HTTP scrapes on a
+ * loopback port.  Output is in the Prometheus text exposition format
+ * (version 0.0.4), with one series per game (scope="game") plus a process
+ * total (scope="process").
+ *
+ * Games that finish should be unregistered before their qSearcher is
+ * destroyed.  Their counters are folded into the process totals so those
+ * never go backwards.
+ *
+ * Registration and rendering are serialized by a mutex, and each
+ * searcher's figures are copied under its own lock (see
+ * qSearcher::getStats()), so games may be scraped mid-search.
+ */
+class qMetricsRegistry {
+ public:
+  qMetricsRegistry();
+  ~qMetricsRegistry(); // Stops the listener, if any
+
+  // gameName shows up as the "game" label (escaped as the format needs)
+  void registerSearcher(const qSearcher *searcher, const char *gameName);
+  void unregisterSearcher(const qSearcher *searcher);
+
+  // Appends the current metrics, in exposition format, to r_text
+  void render(std::string *r_text);
+
+  // Serve render() to any HTTP GET on 127.0.0.1:port from a background
+  // thread.  Returns FALSE if the port could not be bound.
+  bool startListener(guint16 port);
+  void stopListener();
+
+ private:
+  typedef struct _qMetricsGame {
+    const qSearcher *searcher;
+    std::string      name; // Escaped, ready to go in a label
+  } qMetricsGame;
+
+  std::list<qMetricsGame> games;
+  qSearcherStats          retired;    // Totals of unregistered games
+  pthread_mutex_t         mutex;
+
+  int                     listenFd;
+  bool                    listening;
+  pthread_t               listenThread;
+
+  static void *listenerMain(void *registry);
+  void         serveOne(int fd);
+};
+
+#endif // INCLUDE_qmetrics_h
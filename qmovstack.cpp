@@ -7,6 +7,7 @@
 
 
 #include "qmovstack.h"
+#include "qtrace.h"
 
 IDSTR("$Id: qmovstack.cpp,v 1.11 2006/07/31 06:25:50 bmiller Exp $");
 
@@ -19,7 +20,7 @@ IDSTR("$Id: qmovstack.cpp,v 1.11 2006/07/31 06:25:50 bmiller Exp $");
 
 qMoveStack::qMoveStack
 (const qPosition *pos, qPlayer player2move)
-  :sp(0)
+  :sp(0), wallTableSp(0), tracer(NULL), wallTable(NULL), evalNet(NULL)
 {
   moveStack[sp].resultingPos = *pos;
   // moveStack[sp].move = qMove();  Unnecessary
@@ -30,39 +31,39 @@ qMoveStack::qMoveStack
 }
 
 qMoveStack::~qMoveStack() {
+  delete wallTable;
   return;
 };
 
 
+/************************
+ * class qWallMoveTable *
+ ************************/
+
 /* Good optimizations:
  * !!! Prune "dead space" from the list of possible wall moves (well,
  *     everything after the first "dead" move).
  * !!! Keep separate lists for white and black???
  */
-void qMoveStack::initWallMoveTable()
+qWallMoveTable::qWallMoveTable
+(const qPosition *base)
+  :basePos(base)
 {
-  qPosition pos = moveStack[0].resultingPos;
   int rowColNo, posNo;
   int rowOrCol;
   qMove mv;
   qWallMoveInfo *thisMove;
 
-  // Can't revise the wallMoveTable with a bunch of state in the stack
-  if (sp != 0) {
-    g_assert(sp==0);
-    return;
-  }
-
   // 1st pass:  construct list of all possible wall moves.
   for (rowOrCol=1; rowOrCol >= 0; rowOrCol--)
-    for (rowColNo=7; rowColNo >= 0; rowColNo--)
-      for (posNo=7; posNo >= 0; posNo--)
+    for (rowColNo=QWALL_LINES-1; rowColNo >= 0; rowColNo--)
+      for (posNo=QWALL_LINES-1; posNo >= 0; posNo--)
 	{
 	  mv = qMove(rowOrCol, rowColNo, posNo); // how about mv.qMove(...)???
 	  thisMove = &allWallMoveArry[mv.getEncoding()];
 
 	  thisMove->move     = mv;
-	  thisMove->possible = pos.canPutWall(rowOrCol, rowColNo, posNo);
+	  thisMove->possible = basePos.canPutWall(rowOrCol, rowColNo, posNo);
 	  thisMove->eliminates.clear();
 	  if (thisMove->possible)
 	    possibleWallMoves.push(thisMove);
@@ -83,7 +84,7 @@ void qMoveStack::initWallMoveTable()
 	MAYBE_ELIMINATE(&allWallMoveArry[qMove(mv.wallMoveIsRow(),
 					       mv.wallRowOrColNo(),
 					       mv.wallPosition()-1).getEncoding()]);
-      if (mv.wallPosition()<7)
+      if (mv.wallPosition()<QWALL_LINES-1)
 	MAYBE_ELIMINATE(&allWallMoveArry[qMove(mv.wallMoveIsRow(),
 					       mv.wallRowOrColNo(),
 					       mv.wallPosition()+1).getEncoding()]);
@@ -93,6 +94,141 @@ void qMoveStack::initWallMoveTable()
     }
 }
 
+
+/********************
+ * class qMoveStack *
+ ********************/
+
+// Whether any frame holds a move under evaluation (see pushEval())
+bool qMoveStack::isEvaluating
+(void) const
+{
+  int i;
+
+  for (i = 0; i <= sp; ++i)
+    if (moveStack[i].posInfo &&
+	(moveStack[i].posInfo->getPositionFlag() > 0))
+      return TRUE;
+  return FALSE;
+}
+
+void qMoveStack::installWallMoveTable
+(qWallMoveTable *table)
+{
+  int i;
+
+  // Frames at & below the new base no longer have anything to restore
+  for (i = 0; i <= sp; ++i)
+    moveStack[i].wallMovesBlockedByMove.clearList();
+  delete wallTable;
+  wallTable   = table;
+  wallTableSp = sp;
+}
+
+void qMoveStack::initWallMoveTable()
+{
+  // Can't revise the wallMoveTable with moves under evaluation in the stack
+  // (their frames' blocked-move lists point into the old table)
+  if (isEvaluating()) {
+    g_assert(!"initWallMoveTable() during evaluation");
+    return;
+  }
+
+  installWallMoveTable(new qWallMoveTable(getPos()));
+}
+
+bool qMoveStack::setWallMoveTable
+(qWallMoveTable *table)
+{
+  if (!table || !(*table->getBasePos() == *getPos()) || isEvaluating())
+    return FALSE;
+
+  installWallMoveTable(table);
+  return TRUE;
+}
+
+void qMoveStack::setEvalNet
+(const qEvalNet *net)
+{
+  guint8 i;
+
+  evalNet = net;
+  if (net)
+    for (i = 0; i <= sp; ++i)
+      net->refresh(&moveStack[i].resultingPos, &moveStack[i].evalAcc);
+}
+
+
+/***************************
+ * class qWallTableBuilder *
+ ***************************/
+
+qWallTableBuilder::qWallTableBuilder()
+  :running(FALSE), done(FALSE), pos(&qInitialPosition), table(NULL)
+{
+  pthread_mutex_init(&mutex, NULL);
+}
+
+qWallTableBuilder::~qWallTableBuilder()
+{
+  if (running) {
+    pthread_join(builderThread, NULL);
+    delete table;
+  }
+  pthread_mutex_destroy(&mutex);
+}
+
+bool qWallTableBuilder::start
+(const qPosition *p)
+{
+  if (running)
+    return FALSE;
+
+  pos   = *p;
+  table = NULL;
+  done  = FALSE;
+  if (pthread_create(&builderThread, NULL, &qWallTableBuilder::builderMain,
+		     this))
+    return FALSE;
+  running = TRUE;
+  return TRUE;
+}
+
+qWallMoveTable *qWallTableBuilder::collect
+(bool wait)
+{
+  qWallMoveTable *t;
+  bool            finished;
+
+  if (!running)
+    return NULL;
+
+  pthread_mutex_lock(&mutex);
+  finished = done;
+  pthread_mutex_unlock(&mutex);
+  if (!finished && !wait)
+    return NULL;
+
+  pthread_join(builderThread, NULL);
+  running = FALSE;
+  t       = table;
+  table   = NULL;
+  return t;
+}
+
+void *qWallTableBuilder::builderMain
+(void *arg)
+{
+  qWallTableBuilder *b = static_cast<qWallTableBuilder*>(arg);
+  qWallMoveTable    *t = new qWallMoveTable(&b->pos);
+
+  pthread_mutex_lock(&b->mutex);
+  b->table = t;
+  b->done  = TRUE;
+  pthread_mutex_unlock(&b->mutex);
+  return NULL;
+}
+
 void qMoveStack::pushMove
 (qPlayer        playerMoving,
  qMove          mv,
@@ -101,6 +237,8 @@ void qMoveStack::pushMove
 #define ARRAYSIZE(ARR) (sizeof(ARR)/sizeof((ARR)[0]))
 
   g_assert(sp < ARRAYSIZE(moveStack));
+  if (tracer)
+    tracer->stackPush(playerMoving, mv);
   qMoveStackFrame *frame = &moveStack[++sp];
 
   // Record the move
@@ -114,20 +252,26 @@ void qMoveStack::pushMove
   else
     (frame->resultingPos = moveStack[sp-1].resultingPos).applyMove(playerMoving, mv);
 
+  if (evalNet) {
+    frame->evalAcc = moveStack[sp-1].evalAcc;
+    evalNet->applyMove(&frame->evalAcc, &moveStack[sp-1].resultingPos,
+		       playerMoving, mv);
+  }
+
   if (mv.isPawnMove())
     frame->wallMovesBlockedByMove.clearList();
   else {
     qWallMoveInfo *thisMove, *next;
     list<qWallMoveInfo*>::iterator blockedMove;
 
-    thisMove = &allWallMoveArry[mv.getEncoding()];
+    thisMove = &wallTable->allWallMoveArry[mv.getEncoding()];
     g_assert(thisMove->possible == TRUE);
 
     frame->wallMovesBlockedByMove.clearList();
 
     // Of course, remove the wall placement from possible moves
     thisMove->possible = FALSE;
-    possibleWallMoves.pop(thisMove);
+    wallTable->possibleWallMoves.pop(thisMove);
     frame->wallMovesBlockedByMove.push(thisMove);
 
     // Remove any other wall move options that are now blocked
@@ -137,7 +281,7 @@ void qMoveStack::pushMove
     {
       if ((*blockedMove)->possible) {
 	(*blockedMove)->possible = FALSE;
-	possibleWallMoves.pop(*blockedMove);
+	wallTable->possibleWallMoves.pop(*blockedMove);
         frame->wallMovesBlockedByMove.push(*blockedMove);
       }
     }
@@ -150,6 +294,21 @@ void qMoveStack::popMove
 (void)
 {
   qWallMoveInfo *blockedMove, *next;
+
+  g_assert(sp > 0);
+  if (sp == 0)
+    return;
+  if (tracer)
+    tracer->stackPop();
+
+  // The table doesn't know what the base move blocked; rebuild it from
+  // the frame we're returning to
+  if (sp <= wallTableSp) {
+    --sp;
+    initWallMoveTable();
+    return;
+  }
+
   qMoveStackFrame *frame = &moveStack[sp--];
 
   // Replace any wall moves that had been blocked by the popped move
@@ -158,7 +317,7 @@ void qMoveStack::popMove
       blockedMove->possible = TRUE;
       // !!! Optimization: we could insert the entire wallMovesBlockedByMove
       // list into possibleWallMoves in one segment.
-      possibleWallMoves.push(blockedMove);
+      wallTable->possibleWallMoves.push(blockedMove);
     }
 
   return;
@@ -272,7 +431,7 @@ bool qMoveStack::getPossibleWallMoves(qMoveList *moveList) const
   if (!moveList)
     return FALSE;
 
-  qWallMoveInfo *c = possibleWallMoves.getHead();
+  qWallMoveInfo *c = wallTable->possibleWallMoves.getHead();
 
   while (c) {
     g_assert(c->possible == TRUE);
@@ -339,12 +498,15 @@ qPositionInfo *qMoveStack::pushEval
       endPosInfo = posHash->getOrAddElt(&myPos);
 
       this->pushMove(whoMoved, move, &myPos);
+      this->setPosInfo(endPosInfo);
       return endPosInfo;
     }
     endPosInfo = posHash->getOrAddElt(endPos);
   }
 
+  // The new frame keeps the posInfo, so a push from it needn't look it up
   this->pushMove(whoMoved, move, endPos);
+  this->setPosInfo(endPosInfo);
   return endPosInfo;
 }
 
@@ -15,8 +15,12 @@
 #include "qposition.h"
 #include "qposhash.h"
 #include "parameters.h"
+#include "qevalnet.h"
 #include <deque>
 #include <list>
+#include <pthread.h>
+
+class qTraceRecorder;
 
 
 /* Idea:
@@ -34,7 +38,9 @@
  * move list.
  * Note that as the game progresses, we can boost performance slightly by
  * regenerating the list of each wall move's "blocked" moves.  This can be
- * done by re-initializing the move stack from the current position.
+ * done by re-initializing the move stack from the current position, or,
+ * without stalling the search, by building a qWallMoveTable off to the side
+ * (see qWallTableBuilder) and handing it to setWallMoveTable().
  *
  * Further optimization: ???
  * after we've created an initial lookahead tree (qcomptree), maintaining
@@ -94,6 +100,60 @@ struct _wallMoveInfo {
 };
 
 
+/* qWallMoveTable
+ * Every wall move's qWallMoveInfo, and the list of those possible, as of
+ * a base position.  Building one only reads the base, so it can be done
+ * on another thread while a qMoveStack goes on using its own.
+ */
+class qWallMoveTable {
+ public:
+  qWallMoveTable(const qPosition *base);
+
+  const qPosition *getBasePos(void) const { return &basePos; };
+
+ private:
+  friend class qMoveStack;
+
+  qPosition         basePos;
+  qWallMoveInfo     allWallMoveArry[256];  // max possible encoding fr/qMove
+  qWallMoveInfoList possibleWallMoves;
+
+  // Each info's eliminates list points into allWallMoveArry
+  qWallMoveTable(const qWallMoveTable&);
+  qWallMoveTable &operator=(const qWallMoveTable&);
+};
+
+/* qWallTableBuilder
+ * Builds a qWallMoveTable on its own thread, e.g. while the opponent is
+ * thinking about their move.
+ */
+class qWallTableBuilder {
+ public:
+  qWallTableBuilder();
+  ~qWallTableBuilder(); // Waits for any build in progress, & discards it
+
+  // Start building a table for pos.  Returns FALSE if a build is already
+  // under way (or finished but not collected), or the thread can't start.
+  bool start(const qPosition *pos);
+
+  bool isBusy(void) const { return running; };
+
+  // The finished table (now the caller's to delete), or NULL if there
+  // isn't one yet.  Only waits for a build in progress if told to.
+  qWallMoveTable *collect(bool wait = FALSE);
+
+ private:
+  bool             running;  // Between start() & collect()
+  bool             done;     // Set by the builder thread
+  pthread_t        builderThread;
+  pthread_mutex_t  mutex;
+  qPosition        pos;
+  qWallMoveTable  *table;
+
+  static void *builderMain(void *builder);
+};
+
+
 typedef std::deque<qMove> qMoveList; 
 typedef std::deque<qMove>::iterator qMoveListIterator;
 typedef std::deque<qMove>::reverse_iterator qMoveListReverseIterator;
@@ -107,6 +167,8 @@ typedef struct _qMoveStackFrame {
 
   qWallMoveInfoList wallMovesBlockedByMove;
 
+  qEvalAccumulator  evalAcc; // For resultingPos, if the stack has a net
+
   // !!! See comment in class qMoveStack:
   qPositionInfo    *posInfo; // Store qPositionInfo to avoid extra lookups
 } qMoveStackFrame;
@@ -128,14 +190,31 @@ class qMoveStack {
    * move table would become useless if it was newer than move being taken
    * back.  In that event, the wallMoveTable would have to be regenerated
    * from the "old" position.
+   * The table is built for the current position, which becomes its base;
+   * popMove() regenerates it from the saved frame below when a move at or
+   * before the base is taken back.  Must not be called with moves under
+   * evaluation on the stack.
    */
   void initWallMoveTable(void);
 
+  // Adopt a table built elsewhere (see qWallTableBuilder) in place of ours.
+  // Only takes it if it was built for the current position and no moves
+  // are under evaluation; otherwise returns FALSE and the caller keeps it.
+  bool setWallMoveTable(qWallMoveTable *table);
+
   void  pushMove(qPlayer        whoMoved,
 		 qMove          move,
 		 qPosition     *endPos =NULL); // Optional optimizer
   void  popMove(void);
   qMove peekLastMove(void) const   {return moveStack[sp].move;};
+  guint8 getNumMoves(void) const   {return sp;}; // Moves since construction
+
+  // Walk the stack's history: frame 0 is the position we were constructed
+  // with, and frame i>0 is the result of the i'th move
+  const qPosition* getFramePos(guint8 i) const
+    {g_assert(i <= sp); return &(moveStack[i].resultingPos);};
+  qMove   getFrameMove(guint8 i) const    {return moveStack[i].move;};
+  qPlayer getFramePlayer(guint8 i) const  {return moveStack[i].playerMoved;};
 
   const qPosition* getPos(void) const {return &(moveStack[sp].resultingPos);} ;
   const qPosition* getPrevPos(void) const
@@ -199,12 +278,29 @@ class qMoveStack {
   inline bool isWhiteMoveInEvalStack(qPositionInfo *posInfo) const;
   inline bool isBlackMoveInEvalStack(qPositionInfo *posInfo) const;
 
+  // Log pushes & pops to tracer (NULL to stop); see qtrace.h
+  void setTracer(qTraceRecorder *t) { tracer = t; };
+
+  // Keep each frame's sums for net (NULL to stop), which must outlive its
+  // use here; see qevalnet.h.  getEvalAcc() is NULL without a net.
+  void setEvalNet(const qEvalNet *net);
+  const qEvalAccumulator *getEvalAcc(void) const
+    { return evalNet ? &moveStack[sp].evalAcc : NULL; };
+
  private:
   qMoveStackFrame moveStack[MOVESTACKSIZ];
   guint8          sp;
+  guint8          wallTableSp; // Frame the wall move table was built from
+  qTraceRecorder *tracer;
+  qWallMoveTable *wallTable;
+  const qEvalNet *evalNet;
 
-  qWallMoveInfo     allWallMoveArry[256];  // max possible encoding fr/qMove
-  qWallMoveInfoList possibleWallMoves;
+  bool isEvaluating(void) const;
+  void installWallMoveTable(qWallMoveTable *table);
+
+  // We own wallTable
+  qMoveStack(const qMoveStack&);
+  qMoveStack &operator=(const qMoveStack&);
 };
 
 
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+
+#include "qnuma.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+IDSTR("$Id$");
+
+
+/****/
+
+// From <numaif.h>, which we'd rather not require
+#define QNUMA_MPOL_DEFAULT    0
+#define QNUMA_MPOL_PREFERRED  1
+#define QNUMA_MPOL_INTERLEAVE 3
+
+#define QNUMA_MAX_NODES 64 // Fits our node mask in one unsigned long long
+
+/* Parse a sysfs list such as "0-3,8,10-11" and call back for each member.
+ * Returns the number of members, or -1 if the file can't be read.
+ */
+static int readSysfsList
+(const char *path, void (*cb)(int, void*), void *arg)
+{
+  char  buf[4096];
+  char *p;
+  int   n = 0;
+  FILE *f = fopen(path, "r");
+
+  if (!f)
+    return -1;
+  if (!fgets(buf, sizeof(buf), f)) {
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+
+  for (p = buf; *p && *p != '\n'; ) {
+    char *end;
+    long  lo, hi;
+
+    lo = hi = strtol(p, &end, 10);
+    if (end == p)
+      break;
+    if (*end == '-')
+      hi = strtol(end + 1, &end, 10);
+    for (; lo <= hi; ++lo, ++n)
+      if (cb)
+	cb(lo, arg);
+    p = (*end == ',') ? end + 1 : end;
+  }
+  return n;
+}
+
+// Collects online node ids, in order
+typedef struct _qNumaNodes {
+  int num;
+  int ids[QNUMA_MAX_NODES];
+} qNumaNodes;
+
+static void addNode(int node, void *arg)
+{
+  qNumaNodes *nodes = static_cast<qNumaNodes*>(arg);
+  if ((node < QNUMA_MAX_NODES) && (nodes->num < QNUMA_MAX_NODES))
+    nodes->ids[nodes->num++] = node;
+}
+
+// The online nodes; node ids needn't be contiguous (e.g. "0,2" once node
+// 1 is offlined), so workers are spread over this list, not over 0..n-1
+static qNumaNodes     qNumaOnline;
+static pthread_once_t qNumaOnlineOnce = PTHREAD_ONCE_INIT;
+
+static void readOnlineNodes(void)
+{
+  qNumaOnline.num = 0;
+  readSysfsList("/sys/devices/system/node/online", &addNode, &qNumaOnline);
+  if (!qNumaOnline.num) {
+    qNumaOnline.num    = 1; // No NUMA information: all one node
+    qNumaOnline.ids[0] = 0;
+  }
+}
+
+static const qNumaNodes *onlineNodes()
+{
+  pthread_once(&qNumaOnlineOnce, &readOnlineNodes);
+  return &qNumaOnline;
+}
+
+static void addCpu(int cpu, void *arg)
+{
+  if (cpu < CPU_SETSIZE)
+    CPU_SET(cpu, static_cast<cpu_set_t*>(arg));
+}
+
+static bool setMemPolicy
+(int mode, unsigned long long nodemask)
+{
+#ifdef SYS_set_mempolicy
+  if (syscall(SYS_set_mempolicy, mode,
+	      mode == QNUMA_MPOL_DEFAULT ? NULL : &nodemask,
+	      mode == QNUMA_MPOL_DEFAULT ? 0 : QNUMA_MAX_NODES + 1) == 0)
+    return TRUE;
+#endif
+  return FALSE;
+}
+
+
+/***************
+ * class qNuma *
+ ***************/
+int qNuma::getNumNodes()
+{
+  return onlineNodes()->num;
+}
+
+int qNuma::nodeForWorker
+(int n)
+{
+  const qNumaNodes *nodes = onlineNodes();
+  return nodes->ids[(n < 0 ? 0 : n) % nodes->num];
+}
+
+bool qNuma::isNodeOnline
+(int node)
+{
+  const qNumaNodes *nodes = onlineNodes();
+
+  for (int i = 0; i < nodes->num; ++i)
+    if (nodes->ids[i] == node)
+      return TRUE;
+  return FALSE;
+}
+
+bool qNuma::getNodeCpus
+(int node, cpu_set_t *r_cpus)
+{
+  char path[80];
+
+  CPU_ZERO(r_cpus);
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+	   node);
+  if (readSysfsList(path, &addCpu, r_cpus) > 0)
+    return TRUE;
+
+  // No NUMA information: node 0 is everything we may run on
+  return ((node == 0) &&
+	  (sched_getaffinity(0, sizeof(*r_cpus), r_cpus) == 0));
+}
+
+bool qNuma::bindThreadToNode
+(int node)
+{
+  cpu_set_t cpus, allowed;
+
+  // A single-node host has nothing to choose between, and pinning could
+  // only undo whatever affinity we were started with (e.g. by taskset)
+  if (getNumNodes() == 1)
+    return isNodeOnline(node);
+
+  if (!isNodeOnline(node) || !getNodeCpus(node, &cpus) ||
+      (sched_getaffinity(0, sizeof(allowed), &allowed) != 0))
+    return FALSE;
+  CPU_AND(&cpus, &cpus, &allowed);
+  if (!CPU_COUNT(&cpus) ||
+      pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+    return FALSE;
+  return setMemPolicy(QNUMA_MPOL_PREFERRED, 1ULL << node);
+}
+
+bool qNuma::interleaveThreadMemory()
+{
+  const qNumaNodes  *nodes = onlineNodes();
+  unsigned long long mask = 0;
+
+  if (nodes->num == 1)
+    return TRUE;
+  for (int i = 0; i < nodes->num; ++i)
+    mask |= 1ULL << nodes->ids[i];
+  return setMemPolicy(QNUMA_MPOL_INTERLEAVE, mask);
+}
+
+bool qNuma::defaultThreadMemory()
+{
+  if (getNumNodes() == 1)
+    return TRUE;
+  return setMemPolicy(QNUMA_MPOL_DEFAULT, 0);
+}
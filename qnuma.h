@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_numa_h
+#define INCLUDE_numa_h 1
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <sched.h>
+#include "qtypes.h"
+
+/* qNuma
+ * Thread & memory placement for multi-socket hosts.  Everything here acts
+ * on the calling thread and goes straight to the kernel (sysfs, affinity
+ * and memory policy syscalls), so there's no libnuma dependency.  On a
+ * host without NUMA all of it quietly succeeds as a single node.
+ *
+ * How the searching code uses it:
+ *  - The thread that builds the main qSearcher's knowledge base calls
+ *    interleaveThreadMemory() first, so the posHash that every worker will
+ *    read is spread evenly over all nodes instead of piling up on one
+ *    (qsplit repro does this for its root).
+ *  - Each worker thread calls bindThreadToNode() for its node, and only
+ *    then calls qSearcher::fork().  The fork's move stack, computation
+ *    tree and copy-on-write hash are first touched by the worker, so the
+ *    kernel places them on the worker's own node.  qThreadSplitter's
+ *    threads do this for their lanes, qSearchScheduler's workers pin
+ *    themselves as they start, and qRootSplitter pins each worker process
+ *    it forks.
+ * nodeForWorker() spreads workers round-robin across the online nodes.
+ */
+class qNuma {
+ public:
+  // Number of online nodes (1 if unknown).  Node ids may have gaps, so
+  // this isn't a bound on them; use nodeForWorker() to pick one.
+  static int  getNumNodes();
+  static bool isNodeOnline(int node);
+
+  // CPUs belonging to node
+  static bool getNodeCpus(int node, cpu_set_t *r_cpus);
+
+  // Which node the n'th of several workers should run on
+  static int  nodeForWorker(int n);
+
+  // Run the calling thread only on node's CPUs (of those it may already
+  // run on), and allocate its new memory from node.  Does nothing on a
+  // single-node host.
+  static bool bindThreadToNode(int node);
+
+  // Spread the calling thread's new memory round-robin over all nodes
+  static bool interleaveThreadMemory();
+
+  // Back to the default policy (allocate on whichever node we're on)
+  static bool defaultThreadMemory();
+};
+
+#endif // INCLUDE_numa_h
@@ -9,6 +9,7 @@
 
 #include "qposhash.h"
 #include "parameters.h"
+#include <new>
 
 IDSTR("$Id: qposhash.cpp,v 1.8 2006/07/25 22:29:33 bmiller Exp $");
 
@@ -19,17 +20,12 @@ IDSTR("$Id: qposhash.cpp,v 1.8 2006/07/25 22:29:33 bmiller Exp $");
  * class qGrowHash     *
  ***********************/
 
-template <class keyType, class valType>
-const guint16 qGrowHash<keyType, valType>::NumBuckets = POSITION_HASH_BUCKETS;
-
 // default hash func
 template <class keyType, class valType>
-guint16 qGrowHash<keyType, valType>::defaultqGrowHashFunc
+guint32 qGrowHash<keyType, valType>::defaultqGrowHashFunc
 (const keyType *key)
 {
   /* Adapted this from http://www.azillionmonkeys.com/qed/hash.html */
-  // This code is for 32-bit, and I've simplified it by just lopping off
-  // 2 bytes before returning!!!
 
   // #include "pstdint.h" << original header, available at above URL
 #include <stdint.h>
@@ -90,7 +86,7 @@ guint16 qGrowHash<keyType, valType>::defaultqGrowHashFunc
   hash += hash >> 15;
   hash ^= hash << 10;
 
-  return hash % POSITION_HASH_BUCKETS;  // Use a cast to throw away extra bits???
+  return hash;
 }
 
 template <class keyType, class valType>
@@ -98,48 +94,181 @@ qGrowHash<keyType, valType>::qGrowHash
 (qGrowHash_eltInitFunc i,
  qGrowHash_hashFunc h)
 {
-  hashBuffer = new qGrowHashEltList[POSITION_HASH_BUCKETS];
+  guint32 b;
+
+  hashBuffer = static_cast<qGrowHashEltList*>
+    (operator new(POSITION_HASH_BUCKETS * sizeof(qGrowHashEltList)));
+  for (b = 0; b < POSITION_HASH_BUCKETS; ++b)
+    new (&hashBuffer[b]) qGrowHashEltList;
+  numBuckets = POSITION_HASH_BUCKETS;
+  oldBuffer = NULL;
+  oldNumBuckets = 0;
+  rehashIdx = 0;
   numElts = 0;
+  numRemoved = 0;
+  parent = NULL;
   hashCbFunc = h ? h : &qGrowHash::defaultqGrowHashFunc;
   initCbFunc = i;
+  traceCbFunc = NULL;
+  traceCbArg  = NULL;
 }
 
+// Bucket arrays are allocated raw, and during a doubling only the buckets
+// that have been moved (old) or moved into (new) are constructed.
 template <class keyType, class valType>
 qGrowHash<keyType, valType>::~qGrowHash
 ()
-{  delete [] hashBuffer; }
+{
+  guint32 b;
+
+  for (b = 0; b < numBuckets; ++b)
+    if (!oldBuffer || ((b & (oldNumBuckets - 1)) < rehashIdx))
+      hashBuffer[b].~qGrowHashEltList();
+  operator delete(hashBuffer);
+
+  if (oldBuffer) {
+    for (b = rehashIdx; b < oldNumBuckets; ++b)
+      oldBuffer[b].~qGrowHashEltList();
+    operator delete(oldBuffer);
+  }
+}
+
+template <class keyType, class valType>
+void qGrowHash<keyType, valType>::rehashStep
+(void)
+{
+  int i;
+
+  if (!oldBuffer) {
+    if (numElts <= numBuckets * POSITION_HASH_MAX_LOAD)
+      return;
+    // Constructing 2*numBuckets lists here would be the very pause we're
+    // avoiding; each pair is constructed as its old bucket moves.
+    void *bigger = operator new(2 * numBuckets * sizeof(qGrowHashEltList),
+				std::nothrow);
+    if (!bigger)
+      return; // Live with longer chains
+    oldBuffer     = hashBuffer;
+    oldNumBuckets = numBuckets;
+    rehashIdx     = 0;
+    hashBuffer    = static_cast<qGrowHashEltList*>(bigger);
+    numBuckets   *= 2;
+  }
+
+  for (i = 0; (i < POSITION_HASH_REHASH_STEP) && (rehashIdx < oldNumBuckets);
+       ++i, ++rehashIdx) {
+    qGrowHashEltList *from = &oldBuffer[rehashIdx];
+
+    new (&hashBuffer[rehashIdx]) qGrowHashEltList;
+    new (&hashBuffer[rehashIdx + oldNumBuckets]) qGrowHashEltList;
+    while (!from->empty()) {
+      qGrowHashEltList *to =
+	&hashBuffer[hashCbFunc(&unhackGrowHashEltType(from->front())->pos) &
+		    (numBuckets - 1)];
+      to->splice(to->end(), *from, from->begin());
+    }
+    from->~qGrowHashEltList();
+  }
+
+  if (rehashIdx >= oldNumBuckets) {
+    operator delete(oldBuffer);
+    oldBuffer = NULL;
+  }
+}
 
 template <class keyType, class valType>
 valType *qGrowHash<keyType, valType>::getElt
-(const keyType *pos) const
+(const keyType *pos)
 {
-  guint16 hashBucket = hashCbFunc(pos);
+  rehashStep();
+
+  qGrowHashEltList *bucket = bucketFor(hashCbFunc(pos));
 
   // Find the elt in the bucket
-  qGrowHashEltList::const_iterator iter;
-  for (iter = hashBuffer[hashBucket].begin();
-       iter != hashBuffer[hashBucket].end();
-       iter++) {
-    if ((unhackGrowHashEltType(*iter)->pos) == *pos)
-      return &(unhackGrowHashEltType(*iter)->posInfo);
+  valType *found = scanBucket(bucket, pos);
+  if (traceCbFunc)
+    traceCbFunc(traceCbArg, TraceGet, pos, (found != NULL));
+  if (found)
+    return found;
+
+  // Not ours yet; take a private copy of the parent's, if any
+  const valType *inherited;
+  if (parent && (inherited = parent->findElt(pos))) {
+    valType *copy = insertElt(bucket, pos);
+    if (copy)
+      *copy = *inherited;
+    return copy;
   }
   return NULL;
 }
+
+template <class keyType, class valType>
+valType *qGrowHash<keyType, valType>::findOrAddElt
+(const keyType *pos,
+ bool          *r_isNew)
+{
+  rehashStep();
+
+  qGrowHashEltList *bucket = bucketFor(hashCbFunc(pos));
+  valType          *found  = scanBucket(bucket, pos);
+
+  if (traceCbFunc)
+    traceCbFunc(traceCbArg, TraceGet, pos, (found != NULL));
+  if (r_isNew)
+    *r_isNew = FALSE;
+  if (found)
+    return found;
+
+  const valType *inherited = parent ? parent->findElt(pos) : NULL;
+  valType       *added     = insertElt(bucket, pos);
+
+  if (added) {
+    if (inherited)
+      *added = *inherited;
+    else if (r_isNew)
+      *r_isNew = TRUE;
+  }
+  return added;
+}
+
+template <class keyType, class valType>
+const valType *qGrowHash<keyType, valType>::findElt
+(const keyType *pos) const
+{
+  const qGrowHash *h;
+  const valType   *found;
+
+  for (h = this; h; h = h->parent)
+    if ((found = h->scanBucket(h->bucketFor(h->hashCbFunc(pos)), pos)))
+      return found;
+  return NULL;
+}
  
 template <class keyType, class valType>
 valType *qGrowHash<keyType, valType>::addElt
 (const keyType *pos)
+{
+  rehashStep();
+  return insertElt(bucketFor(hashCbFunc(pos)), pos);
+}
+
+template <class keyType, class valType>
+valType *qGrowHash<keyType, valType>::insertElt
+(qGrowHashEltList *bucket,
+ const keyType    *pos)
 {
   qGrowHashElt *newElt = posHeap.eltAlloc();
   if (!newElt)
     return FALSE;
+  if (traceCbFunc)
+    traceCbFunc(traceCbArg, TraceAdd, pos, FALSE);
 
   // clear newElt->evaluation[2] & newElt->flagPosException
   newElt->pos = *pos;
   if (initCbFunc)
     initCbFunc(&newElt->posInfo, &newElt->pos);
 
-  hashBuffer[this->hashCbFunc(pos)].push_front(hackifyGrowHashEltType(newElt));
+  bucket->push_front(hackifyGrowHashEltType(newElt));
   numElts++;
 
   return &(newElt->posInfo);
@@ -149,17 +278,21 @@ template <class keyType, class valType>
 bool qGrowHash<keyType, valType>::rmElt
 (const keyType *pos)
 {
-  guint16 hashBucket = this->hashCbFunc(pos);
+  rehashStep();
+
+  qGrowHashEltList *bucket = bucketFor(hashCbFunc(pos));
+
+  if (traceCbFunc)
+    traceCbFunc(traceCbArg, TraceRm, pos, TRUE);
 
   // Find the elt in the bucket
   qGrowHashEltList::iterator iter;
-  for (iter = hashBuffer[hashBucket].begin();
-       iter != hashBuffer[hashBucket].end();
-       iter++) {
+  for (iter = bucket->begin(); iter != bucket->end(); iter++) {
     if (unhackGrowHashEltType(*iter)->pos == *pos) {
-      (void)hashBuffer[hashBucket].erase(iter);
       posHeap.eltFree(unhackGrowHashEltType(*iter));
+      (void)bucket->erase(iter);
       numElts--;
+      numRemoved++;
       return TRUE;
     }
   }
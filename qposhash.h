@@ -66,15 +66,28 @@ using namespace std;
  * memory-efficient if individual elements are often removed.              *
  **************************************************************************/
 
+/* The bucket array starts at POSITION_HASH_BUCKETS and doubles whenever
+ * there are more than POSITION_HASH_MAX_LOAD elts per bucket.  Rather than
+ * move every elt at once, which would stall a search for as long as it
+ * takes, we keep the old array alongside the new one and move
+ * POSITION_HASH_REHASH_STEP of its buckets over on each get, add & rm.
+ * An old bucket's elts all go to one of two new buckets (b or b+oldSize),
+ * so until bucket b has moved, keys that would land in either look in
+ * old bucket b.  A doubling has finished well before the next is due.
+ */
 template <class keyType, class valType> class qGrowHash {
 public:
-  static const guint16   NumBuckets; // Useful for writing hash funcs
-  typedef guint16 (*qGrowHash_hashFunc)(const keyType*);
+  typedef guint32 (*qGrowHash_hashFunc)(const keyType*);
   typedef void    (*qGrowHash_eltInitFunc)(valType*, const keyType*);
 
+  // Operations reported to a trace func (see qtrace.h)
+  enum { TraceGet, TraceAdd, TraceRm };
+  typedef void    (*qGrowHash_traceFunc)(void *arg, int op, const keyType*,
+					 bool found);
+
   // constructor using specified hashFunc
-  // Note that the value used for hashing will actually be
-  // the hashFunc's return value modulo POSITION_HASH_BUCKETS
+  // Note that the value used for hashing will actually be the hashFunc's
+  // low bits (as many as there are buckets), so mix them well.
   // Default hashFunc does "pretty good" hashing based on sizeof(keyType)
   qGrowHash
     (qGrowHash_eltInitFunc initCallbackFunc=NULL,
@@ -88,18 +101,47 @@ public:
 
   ~qGrowHash();
 
+  /* Copy-on-write overlay: with a parent set, getElt() falls back to the
+   * parent (and its parents) for keys this hash doesn't have, and copies
+   * what it finds into this hash before returning it.  Callers are free
+   * to modify what getElt() returns, so even reads copy; but only keys
+   * actually touched are copied, and the parent is never modified.
+   * The parent must outlive this hash, and must not be modified while
+   * this hash may be reading it.  Only set a parent on an empty hash.
+   */
+  void     setParent(const qGrowHash *p) { g_assert(!numElts); parent = p; };
+
+  // Have func(arg, ...) told of every getElt, addElt & rmElt (NULL to stop)
+  void     setTraceFunc(qGrowHash_traceFunc func, void *arg)
+    { traceCbFunc = func; traceCbArg = arg; };
+
   // Locate an existing position
-  valType* getElt(const keyType *pos) const;
+  valType* getElt(const keyType *pos);
 
   // Acquires a new elt
   valType* addElt(const keyType *pos);
 
-  valType* getOrAddElt(const keyType *pos)
-  { valType *rval = getElt(pos); return rval ? rval : addElt(pos); };
+  /* Find pos, adding it if it isn't here, with one hash & one bucket scan
+   * (getElt() then addElt() would do both twice).  *r_isNew (if given) is
+   * set to whether the elt is fresh from initCbFunc, i.e. neither we nor
+   * a parent had it.  An elt's address is fixed until it's removed, so the
+   * pointer returned is a handle callers can keep (in a tree node or stack
+   * frame, say) rather than look the position up again.
+   * Traced as a get and, if it added, an add.
+   */
+  valType* findOrAddElt(const keyType *pos, bool *r_isNew = NULL);
+
+  valType* getOrAddElt(const keyType *pos) { return findOrAddElt(pos); };
 
   // free elt so getElt won't find it
   bool     rmElt(const keyType *pos);
 
+  // Occupancy figures, for monitoring how full the hash is getting
+  guint32  getNumElts()    const { return numElts; };
+  guint32  getNumBuckets() const { return numBuckets; };
+  bool     isRehashing()   const { return oldBuffer != NULL; };
+  guint32  getNumRemoved() const { return numRemoved; }; // lifetime rmElts
+
  private:
   /************************************************************************
    * private subclass qGrowHashElt                                        *
@@ -183,12 +225,48 @@ public:
   };
 
   guint32 numElts;
+  guint32 numRemoved;
+  const qGrowHash      *parent;     // Read-through for keys we don't have
   qGrowHashEltList     *hashBuffer; // Array of qGrowHashElt buckets
+  guint32               numBuckets; // Size of hashBuffer; a power of 2
+  qGrowHashEltList     *oldBuffer;  // Buckets being moved out, or NULL
+  guint32               oldNumBuckets;
+  guint32               rehashIdx;  // oldBuffer buckets below this are moved
   qGrowHashEltHeap      posHeap;    // We get unallocated Elts from here
   qGrowHash_hashFunc    hashCbFunc; // func for sorting keys into buckets
   qGrowHash_eltInitFunc initCbFunc; // func for initializing new elts
+  qGrowHash_traceFunc   traceCbFunc;
+  void                 *traceCbArg;
+
+  static guint32 defaultqGrowHashFunc(const keyType *);
+
+  // Find pos here or in a parent, without copying anything
+  const valType* findElt(const keyType *pos) const;
+
+  // The bucket where a key with hash h lives (old or new, mid-rehash)
+  qGrowHashEltList *bucketFor(guint32 h) const
+    {
+      if (oldBuffer && ((h & (oldNumBuckets - 1)) >= rehashIdx))
+	return &oldBuffer[h & (oldNumBuckets - 1)];
+      return &hashBuffer[h & (numBuckets - 1)];
+    };
+
+  // Move a few more old buckets over; start a doubling if we're too full
+  void rehashStep(void);
+
+  // Add pos to bucket, which must be where bucketFor() puts it
+  valType* insertElt(qGrowHashEltList *bucket, const keyType *pos);
+
+  // Scan bucket for pos
+  valType* scanBucket(const qGrowHashEltList *bucket, const keyType *pos) const
+    {
+      qGrowHashEltList::const_iterator iter;
+      for (iter = bucket->begin(); iter != bucket->end(); iter++)
+	if ((unhackGrowHashEltType(*iter)->pos) == *pos)
+	  return &(unhackGrowHashEltType(*iter)->posInfo);
+      return NULL;
+    };
 
-  static guint16 defaultqGrowHashFunc(const keyType *);
 };
 
 
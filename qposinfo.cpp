@@ -14,16 +14,16 @@ IDSTR("$Id: qposinfo.cpp,v 1.5 2006/07/18 06:55:33 bmiller Exp $");
 /****/
 
 const qPositionEvaluation positionEval_won_rec =
-  { qScore_won, 0, };
+  { qScore_won, 0, 0, };
 const qPositionEvaluation *positionEval_won = &positionEval_won_rec;
 
 const qPositionEvaluation positionEval_lost_rec =
-  { qScore_lost, 0, };
+  { qScore_lost, 0, 0, };
 const qPositionEvaluation *positionEval_lost = &positionEval_lost_rec;
 
 // Used, for example, in a line of thinking that repeats
 const qPositionEvaluation positionEval_even_rec =
-  { 0, 0 /* What should the complexity be? */, };
+  { 0, 0 /* What should the complexity be? */, 0, };
 const qPositionEvaluation *positionEval_even = &positionEval_even_rec;
 
 /* I've decided to have even_evaluation's complexity be 0 because, suppose
@@ -33,7 +33,7 @@ const qPositionEvaluation *positionEval_even = &positionEval_even_rec;
  */
 
 const qPositionEvaluation positionEval_none_rec =
-  { 0, qComplexity_max, };
+  { 0, qComplexity_max, 0, };
 const qPositionEvaluation *positionEval_none = &positionEval_none_rec;
 
 
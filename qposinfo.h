@@ -21,6 +21,7 @@
 typedef struct _qPositionEvaluation {
   gint16 score;         // Rating of how good position is
   guint16 complexity;   // Score's uncertainty: 0=sure, +/- range of score
+  guint8  depth;        // Plies of analysis behind it: 0=static eval
 #ifdef HAVE_NUM_COMPUTATIONS
   //! guint32 computations; // Number of direct calculations that contributed
 #endif
@@ -42,6 +43,21 @@ extern const qPositionEvaluation *positionEval_lost;
 // A position that has not been evaluated beyond checked for game over
 extern const qPositionEvaluation *positionEval_none;
 
+// Deepest depth we record; deeper analysis still counts as this much
+#define qDepth_max ((guint8)0xff)
+
+// Pack an evaluation into a word (score high, complexity low) and back,
+// for tables & files that keep evaluations outside of a qPositionInfoHash.
+// Depth doesn't fit; unpacked evaluations claim none (depth 0).
+inline guint32 qPackEval(const qPositionEvaluation *e)
+{ return (static_cast<guint32>(static_cast<guint16>(e->score))<<16) |
+    e->complexity; }
+
+inline void qUnpackEval(guint32 w, qPositionEvaluation *e)
+{ e->score      = static_cast<gint16>(w>>16);
+  e->complexity = static_cast<guint16>(w & 0xffff);
+  e->depth      = 0; }
+
 
 
 /* Note that in general we want to evalatute positions with increasing
@@ -103,6 +119,12 @@ class qPositionInfo {
   inline void         setComplexity(qPlayer p, guint16 val)
     { evaluation[p.getPlayerId()].complexity=val;};
 
+  inline guint8       getDepth(qPlayer p) const
+    { return evaluation[p.getPlayerId()].depth; };
+
+  inline void         setDepth(qPlayer p, guint8 val)
+    { evaluation[p.getPlayerId()].depth=val; };
+
 #ifdef HAVE_NUM_COMPUTATIONS
   inline guint8 getComputations(qPlayer p)
      { return evaluation[p.getPlayerId()].computations;};
@@ -10,6 +10,7 @@
 #include "qposition.h"
 #include "parameters.h"
 #include <stdio.h>
+#include <string.h>
 
 IDSTR("$Id: qposition.cpp,v 1.8 2014/12/12 21:20:21 bmiller Exp $");
 
@@ -17,18 +18,18 @@ IDSTR("$Id: qposition.cpp,v 1.8 2014/12/12 21:20:21 bmiller Exp $");
 /****/
 
 // Is this how to have a global that is initialized by the compiler???
-const guint8  blankRows[8] = {0,0,0,0,0,0,0,0};
+const guint8  blankRows[QWALL_LINES] = {0};
 const guint8 *blankCols = blankRows;
-const qSquare initialWhitePawnLocation = qSquare(4,0);
-const qSquare initialBlackPawnLocation = qSquare(4,8);
+const qSquare initialWhitePawnLocation = qSquare(QBOARD_SIZE/2,0);
+const qSquare initialBlackPawnLocation = qSquare(QBOARD_SIZE/2,QBOARD_LAST);
 
 const qPosition qInitialPosition =
 qPosition(blankRows,                // No walls in any row
 	  blankCols,                // No walls in any col
 	  initialWhitePawnLocation, // white pawn location
 	  initialBlackPawnLocation, // black pawn location
-	  10,                       // white walls
-	  10);                      // black walls
+	  QBOARD_WALLS,             // white walls
+	  QBOARD_WALLS);            // black walls
 
 void qPosition::applyMove
 (qPlayer player,
@@ -76,13 +77,13 @@ guint8 pos) const
     mask = 3;  // 11000000
   else
     { // pos > 0
-      if (pos <= 6)
+      if (pos < QWALL_LINES-1)
         mask = 7<<(pos-1); // 11100000, 01110000, 00111000, etc.
       else
-        {  // pos >= 7
-          if (pos > 7)
-            { g_assert(pos <= 7); return FALSE; }
-          mask = 192; // 00000011
+        {  // last slot in the row/col
+          if (pos > QWALL_LINES-1)
+            { g_assert(pos <= QWALL_LINES-1); return FALSE; }
+          mask = 3<<(pos-1); // 00000011 on a 9x9 board
         }
     }
   if (rowOrCol == ROW) {
@@ -110,28 +111,69 @@ guint8 pos) const
 // frequently would get distributed evenly.
 // We should probably do some testing to detect if there are lots of
 // collisions!!!
-guint16 qPosition::hashFunc
+guint32 qPosition::hashFunc
 (void) const
 {
   guint32 mixer;
 
   mixer = white_pawn_pos.squareNum | (black_pawn_pos.squareNum<<9);
 
-#define mixedRowNCol(n) ((((guint32)(row_walls[(3*(n))%8]))<<(2*(n))) ^ (((guint32)(col_walls[(5*(n)+2)%8]))<<(2*(n)+7)))
-  mixer ^= mixedRowNCol(0) ^
-    mixedRowNCol(1) ^
-    mixedRowNCol(2) ^
-    mixedRowNCol(3) ^
-    mixedRowNCol(4) ^
-    mixedRowNCol(5) ^
-    mixedRowNCol(6) ^
-    mixedRowNCol(7);
+#define mixedRowNCol(n) ((((guint32)(row_walls[(3*(n))%QWALL_LINES]))<<(2*(n))) ^ (((guint32)(col_walls[(5*(n)+2)%QWALL_LINES]))<<(2*(n)+7)))
+  for (int n = 0; n < QWALL_LINES; n++)
+    mixer ^= mixedRowNCol(n);
   mixer ^= (guint32)numwalls;
 
-  // Now superimpose the top 16 bytes on the lower 16 bytes, so the lower
-  // 16 bytes are well mixed.
+  // Now superimpose the top 16 bits on the lower 16 bits, so the lower
+  // 16 bits (which qGrowHash uses first) are well mixed.
   mixer ^= mixer>>16;
-  return (guint16)(mixer%POSITION_HASH_BUCKETS);
+  return mixer;
+}
+
+void qPosition::pack
+(guint8 *buf) const
+{
+  memcpy(&buf[0], row_walls, QWALL_LINES);
+  memcpy(&buf[QWALL_LINES], col_walls, QWALL_LINES);
+  buf[2*QWALL_LINES]     = white_pawn_pos.squareNum;
+  buf[2*QWALL_LINES + 1] = black_pawn_pos.squareNum;
+  buf[2*QWALL_LINES + 2] = numwalls;
+}
+
+qPosition qPosition::unpack
+(const guint8 *buf)
+{
+  return qPosition(&buf[0], &buf[QWALL_LINES],
+		   qSquare(buf[2*QWALL_LINES]), qSquare(buf[2*QWALL_LINES + 1]),
+		   buf[2*QWALL_LINES + 2] & 0x0f, buf[2*QWALL_LINES + 2] >> 4);
+}
+
+// The column legends & border above (or below) the board in dump().
+// The strings are laid out for 9x9; smaller boards print a prefix of each.
+static void dumpLegends
+(FILE *FH, bool above)
+{
+  const char *horzontal_legend = "          A   B   C   D   E   F   G   H   I";
+  const char *horzontal_leg2 =   "           A.5 B.5 C.5 D.5 E.5 F.5 G.5 H.5";
+  const char *horzontal_delim  = "            |   |   |   |   |   |   |   |";
+  int legendLen = 11 + 4*QBOARD_LAST;
+  int leg2Len   = 14 + 4*(QWALL_LINES-1);
+  int delimLen  = 13 + 4*(QWALL_LINES-1);
+  int i;
+
+  if (above) {
+    fprintf(FH, "%.*s\n", leg2Len, horzontal_leg2);
+    fprintf(FH, "%.*s\n", legendLen, horzontal_legend);
+    fprintf(FH, "%.*s\n", delimLen, horzontal_delim);
+  }
+  fputs("        +", FH);
+  for (i = 0; i < 4*QBOARD_SIZE-1; i++)
+    fputc('-', FH);
+  fputs("+\n", FH);
+  if (!above) {
+    fprintf(FH, "%.*s\n", delimLen, horzontal_delim);
+    fprintf(FH, "%.*s\n", legendLen, horzontal_legend);
+    fprintf(FH, "%.*s\n", leg2Len, horzontal_leg2);
+  }
 }
 
 void qPosition::dump
@@ -139,22 +181,13 @@ void qPosition::dump
 {
 	FILE *FH = stdout;
 
-        const char *horzontal_legend = "          A   B   C   D   E   F   G   H   I\n";
-        const char *horzontal_leg2 =   "           A.5 B.5 C.5 D.5 E.5 F.5 G.5 H.5\n";
-        const char *horzontal_delim  = "            |   |   |   |   |   |   |   |\n";
-        const char *horzontal_border = "        +-----------------------------------+\n";
-
-
-        fputs(horzontal_leg2, FH);
-        fputs(horzontal_legend, FH);
-        fputs(horzontal_delim, FH);
-        fputs(horzontal_border, FH);
+        dumpLegends(FH, TRUE);
 
 	int x, y;
-	for (y=8; y >= 0; )
+	for (y=QBOARD_LAST; y >= 0; )
 	{
           fprintf(FH, "     %d  |", y);
-          for (x=0; x<=8; x++)
+          for (x=0; x<=QBOARD_LAST; x++)
 	  {
 	    if (x == getWhitePawn().x() &&
 	        y == getWhitePawn().y())
@@ -164,7 +197,7 @@ void qPosition::dump
               fprintf(FH, " B ");
 	    else
               fprintf(FH, "   ");
-            if (x < 8) {
+            if (x < QBOARD_LAST) {
               if (isBlockedByWall(x, y, RIGHT))
                 fprintf(FH, "|");
               else
@@ -177,13 +210,13 @@ void qPosition::dump
           if (y >= 0) {
             fprintf(FH, "%d.5   --|", y);
 
-            for (x=0; x<=8; x++)
+            for (x=0; x<=QBOARD_LAST; x++)
             {
               if (isBlockedByWall(x, y, UP))
                 fprintf(FH, "---");
               else
                 fprintf(FH, "   ");
-              if (x < 8) {
+              if (x < QBOARD_LAST) {
                 if (wallAt(ROW, y, x))
                   fprintf(FH, "-");
                 else if (wallAt(COL, x, y))
@@ -196,10 +229,7 @@ void qPosition::dump
           }
 	}
 
-        fputs(horzontal_border, FH);
-        fputs(horzontal_delim, FH);
-        fputs(horzontal_legend, FH);
-        fputs(horzontal_leg2, FH);
+        dumpLegends(FH, FALSE);
 
 	// fprintf(FH, " White pawn: (%d, %d)\n", getWhitePawn().x(), getWhitePawn().y());
 	fprintf(FH, " White walls left: %d\n", numWhiteWallsLeft());
@@ -36,7 +36,7 @@ class qPosition {
     : white_pawn_pos(white_pawn_location), black_pawn_pos(black_pawn_location)
     {
       int i;
-      for (i=7; i>=0; i--)
+      for (i=QWALL_LINES-1; i>=0; i--)
 	{
 	  row_walls[i] = row_wall_positions ? row_wall_positions[i] : 0;
 	  col_walls[i] = col_wall_positions ? col_wall_positions[i] : 0;
@@ -49,10 +49,10 @@ class qPosition {
   qPosition(const qPosition *prev) { *this = *prev; };
 
   inline bool isWon(qPlayer p) const
-    { return((p.isWhite() ? (white_pawn_pos.y()==8) : black_pawn_pos.y()==0)); }
+    { return((p.isWhite() ? (white_pawn_pos.y()==QBOARD_LAST) : black_pawn_pos.y()==0)); }
   inline bool isLost(qPlayer p) const
-    { return((p.isWhite() ? (black_pawn_pos.y()==0) : white_pawn_pos.y()==8)); }
-  inline bool isWhiteWon() const { return (white_pawn_pos.y()==8); }
+    { return((p.isWhite() ? (black_pawn_pos.y()==0) : white_pawn_pos.y()==QBOARD_LAST)); }
+  inline bool isWhiteWon() const { return (white_pawn_pos.y()==QBOARD_LAST); }
   inline bool isBlackWon() const { return (black_pawn_pos.y()==0); }
 
   // Note that we rely on default memberwise copy for qPosition assignment a=b:
@@ -76,13 +76,13 @@ class qPosition {
     {
       switch(dir) {
       case UP:
-	return( (y>=8) ? TRUE : (row_walls[y]   & (x ? (3<<(x-1)) : 1) ));
+	return( (y>=QBOARD_LAST) ? TRUE : (row_walls[y]   & (x ? (3<<(x-1)) : 1) ));
       case DOWN:
 	return( (y==0) ? TRUE : (row_walls[y-1] & (x ? (3<<(x-1)) : 1) ));
       case LEFT:
 	return( (x==0) ? TRUE : (col_walls[x-1] & (y ? (3<<(y-1)) : 1) ));
       case RIGHT:
-	return( (x>=8) ? TRUE : (col_walls[x]   & (y ? (3<<(y-1)) : 1) ));
+	return( (x>=QBOARD_LAST) ? TRUE : (col_walls[x]   & (y ? (3<<(y-1)) : 1) ));
       }
       g_assert(0);
       return TRUE;
@@ -116,7 +116,7 @@ class qPosition {
    * testing.  I'll leave this comment triple-hooked until someone
    * does the performance testing and indicates the results here.  ???
    */
-  guint16 hashFunc() const;
+  guint32 hashFunc() const;
 
 #if 0 /* Don't need any of these (yet) */
   /* None of these would validate the legality of a move */
@@ -139,9 +139,22 @@ class qPosition {
 
   void dump(/* FILE *FH */) const; // Dumps the position to FH
 
+  /* Portable byte form, for files & foreign callers.  Unlike the in-memory
+   * layout, this doesn't depend on the compiler's packing:
+   *  [0-7]  row walls, one byte per row, bit n = wall at position n
+   *  [8-15] column walls, likewise
+   *  [16]   white pawn square (x + 9*y)
+   *  [17]   black pawn square
+   *  [18]   walls left: white in the low 4 bits, black in the high 4
+   * (Offsets are for 9x9; smaller boards have QWALL_LINES bytes of each.)
+   */
+#define QPOSITION_PACKED_BYTES (2*QWALL_LINES + 3)
+  void             pack(guint8 *buf) const;
+  static qPosition unpack(const guint8 *buf);
+
  private:
-  PACK_DECL(guint8 row_walls[8]);
-  PACK_DECL(guint8 col_walls[8]);
+  PACK_DECL(guint8 row_walls[QWALL_LINES]);
+  PACK_DECL(guint8 col_walls[QWALL_LINES]);
   PACK_DECL(qSquare white_pawn_pos); /* guint8 */
   PACK_DECL(qSquare black_pawn_pos); /* guint8 */
   PACK_DECL(guint8 numwalls); /* low 4 bits white, high 4 bits black */
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+#include <algorithm>
+#include "qrootmoves.h"
+#include "qsearcher.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+// As qComputationTree sorts children: the opponent's worst first
+static bool rootMoveLess
+(const qRootMoves::qRootMove &a, const qRootMoves::qRootMove &b)
+{
+  return a.eval.score < b.eval.score;
+}
+
+
+/********************
+ * class qRootMoves *
+ ********************/
+
+bool qRootMoves::rate
+(const qPosition *pos,
+ qPlayer          player2move,
+ const qMoveList &legalMoves,
+ qMove           *r_winner)
+{
+  qPlayer                opponent = player2move.otherPlayer();
+  qMoveList::const_iterator i;
+
+  moves.clear();
+  for (i = legalMoves.begin(); i != legalMoves.end(); ++i) {
+    qRootMove     m(*i, pos);
+    qPositionInfo posInfo;
+
+    m.pos.applyMove(player2move, *i);
+    if (m.pos.isWon(player2move)) {
+      *r_winner = *i;
+      return TRUE;
+    }
+    posInfo.initEval();
+    if (!ratePositionByComputation(m.pos, opponent, &posInfo))
+      continue;
+    m.eval = *posInfo.get(opponent);
+    moves.push_back(m);
+  }
+  return FALSE;
+}
+
+void qRootMoves::sort
+(void)
+{
+  std::stable_sort(moves.begin(), moves.end(), rootMoveLess);
+}
+
+bool qRootMoves::isDone
+(guint8 max_complexity,
+ guint8 min_depth,
+ guint8 slop) const
+{
+  const qPositionEvaluation *best = &moves[0].eval;
+  gint32                     scoreThresh = best->score + best->complexity;
+  bool                       worthRefining = FALSE;
+  unsigned int               n;
+
+  if ((best->score == qScore_lost) || (best->score == qScore_won))
+    return TRUE;
+  if ((best->complexity > max_complexity) ||
+      (best->complexity &&
+       (static_cast<guint32>(best->depth) + 1 < min_depth)))
+    return FALSE;
+
+  for (n = 1; n < moves.size(); ++n) {
+    const qPositionEvaluation *e = &moves[n].eval;
+    if (e->score >= scoreThresh + e->complexity)
+      break;
+    if (!slop || (e->complexity > slop))
+      worthRefining = TRUE;
+  }
+  return ((n <= 1) || !worthRefining);
+}
+
+bool qRootMoves::pickWanted
+(guint8            min_breadth,
+ guint8            slop,
+ std::vector<int> *r_wanted) const
+{
+  const qPositionEvaluation *best = &moves[0].eval;
+  gint32                     scoreThresh = best->score + best->complexity;
+  unsigned int               i, j;
+
+  r_wanted->clear();
+  if (min_breadth)
+    for (i = 0; i < moves.size(); ++i)
+      if (!moves[i].eval.depth && moves[i].eval.complexity)
+	r_wanted->push_back(i);
+  if (!r_wanted->empty())
+    return TRUE;
+
+  // Contenders, most complex first (as iScanDeeper picks what to refine)
+  for (i = 0; i < moves.size(); ++i) {
+    const qPositionEvaluation *e = &moves[i].eval;
+    if (e->score > scoreThresh + e->complexity)
+      break;
+    if (e->complexity && (e->complexity > slop))
+      r_wanted->push_back(i);
+  }
+  std::vector<int> &w = *r_wanted;
+  for (i = 1; i < w.size(); ++i)
+    for (j = i; (j > 0) &&
+	   (moves[w[j]].eval.complexity > moves[w[j-1]].eval.complexity); --j)
+      std::swap(w[j], w[j-1]);
+  return FALSE;
+}
+
+bool qRootMoves::assign
+(const std::vector<int>        &wanted,
+ std::vector<std::vector<int>*> &jobs)
+{
+  unsigned int i, k, fair, numLive = 0;
+
+  for (k = 0; k < jobs.size(); ++k)
+    if (jobs[k])
+      ++numLive;
+  if (!numLive)
+    return FALSE;
+
+  fair = (wanted.size() + numLive - 1) / numLive;
+  for (i = 0; i < wanted.size(); ++i) {
+    qRootMove *m = &moves[wanted[i]];
+    int        to = m->lastWorker;
+
+    if ((to < 0) || !jobs[to] || (jobs[to]->size() >= fair))
+      for (to = -1, k = 0; k < jobs.size(); ++k)
+	if (jobs[k] && ((to < 0) || (jobs[k]->size() < jobs[to]->size())))
+	  to = k;
+    jobs[to]->push_back(wanted[i]);
+    m->lastWorker = to;
+  }
+  return TRUE;
+}
+
+qMove qRootMoves::getBest
+(qPositionEvaluation *r_eval)
+{
+  sort();
+  *r_eval       = moves[0].eval;
+  r_eval->score = -r_eval->score;
+  if (r_eval->depth < qDepth_max)
+    ++r_eval->depth;
+  return moves[0].move;
+}
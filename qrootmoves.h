@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_rootmoves_h
+#define INCLUDE_rootmoves_h 1
+
+#include <vector>
+#include "qtypes.h"
+#include "qposition.h"
+#include "qposinfo.h"
+#include "qmovstack.h"
+
+/* The root's moves, as the splitters share them out.
+ *
+ * qRootSplitter and qThreadSplitter both rate every legal move at the
+ * root, keep the moves sorted as qComputationTree sorts a node's
+ * children (by the opponent's evaluation of the position each leads to),
+ * and each round hand the contenders still worth refining to their
+ * workers (processes or lanes), stopping on the same criteria as
+ * qSearcher::search().  qRootMoves is that shared part; the splitters
+ * differ only in how much work a round holds and how it gets done.
+ *
+ * A move contends while its score range overlaps the best move's.  Each
+ * remembers the worker that refined it last, so it can go back there (to
+ * a worker that still has what it learned) whenever that's fair.
+ */
+
+// One ply less of the search criteria, for the position after a move
+static inline guint8 qLessOnePly(guint8 n)
+{
+  return n ? n-1 : 0;
+}
+
+class qRootMoves {
+ public:
+  struct qRootMove {
+    qRootMove(qMove m, const qPosition *p)
+      : move(m), pos(p), lastWorker(-1) { ; };
+    qMove               move;
+    qPosition           pos;        // After move
+    qPositionEvaluation eval;       // Of pos, from the opponent's side
+    int                 lastWorker; // Who refined it last, or -1
+  };
+
+  // Start over with legalMoves, player2move's at pos, each rated with
+  // ratePositionByComputation().  If one wins outright, returns TRUE with
+  // it in *r_winner.
+  bool rate(const qPosition *pos,
+	    qPlayer          player2move,
+	    const qMoveList &legalMoves,
+	    qMove           *r_winner);
+
+  unsigned int size(void) const          { return moves.size(); };
+  qRootMove   &operator[](unsigned int i) { return moves[i]; };
+
+  // Opponent's worst first; ties stay in the order the moves were rated
+  void sort(void);
+
+  // Would qSearcher::search() stop here?  The moves must be sorted.
+  bool isDone(guint8 max_complexity, guint8 min_depth, guint8 slop) const;
+
+  // The moves most in need of refining, into *r_wanted: with min_breadth,
+  // those not yet searched at all (as search() looks at every move before
+  // diving into any), else the contenders more complex than slop, most
+  // complex first.  Returns whether it's the former.  The moves must be
+  // sorted.
+  bool pickWanted(guint8            min_breadth,
+		  guint8            slop,
+		  std::vector<int> *r_wanted) const;
+
+  // Share wanted among workers, appending to their job lists: each move
+  // goes back to whoever refined it last while that's fair, otherwise to
+  // whoever has least to do (the lowest numbered, of those).  A NULL list
+  // is a worker no longer with us.  Returns FALSE if there's nobody.
+  bool assign(const std::vector<int>        &wanted,
+	      std::vector<std::vector<int>*> &jobs);
+
+  // The best move, & its evaluation from the mover's side.  The moves
+  // must not be empty.
+  qMove getBest(qPositionEvaluation *r_eval);
+
+ private:
+  std::vector<qRootMove> moves;
+};
+
+#endif // INCLUDE_rootmoves_h
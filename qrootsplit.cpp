@@ -0,0 +1,466 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+
+#include "qrootsplit.h"
+#include "qsearcher.h"
+#include "getmoves.h"
+#include "qnuma.h"
+#include "qio.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+IDSTR("$Id$");
+
+
+/****/
+
+#define QROOTSPLIT_MAGIC 0x71727370 /* "qrsp" */
+
+// Coordinator to worker: refine what player2move playing move at pos
+// (the root) leads to, searching for up to ms with the given criteria
+typedef struct _qRootSplitJob {
+  guint32 magic;
+  guint8  quit;
+  guint8  player2move;
+  guint8  move;
+  guint8  maxComplexity;
+  guint8  minDepth;
+  guint8  minBreadth;
+  guint8  slop;
+  guint8  pos[QPOSITION_PACKED_BYTES];
+  gint32  ms;
+} qRootSplitJob;
+
+// Worker to coordinator, for each job in turn: the opponent's evaluation
+// of the position after the move
+typedef struct _qRootSplitReport {
+  guint32 magic;
+  guint8  haveEval;
+  guint8  depth;
+  gint16  score;
+  guint16 complexity;
+  guint32 positionsEvaluated;
+} qRootSplitReport;
+
+static bool sendAll
+(int fd, const void *buf, size_t len)
+{
+  const char *p = static_cast<const char *>(buf);
+  ssize_t     n;
+
+  while (len) {
+    // A worker that has gone away shouldn't take us with it by SIGPIPE
+    n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+	continue;
+      return FALSE;
+    }
+    p   += n;
+    len -= n;
+  }
+  return TRUE;
+}
+
+static bool recvAll
+(int fd, void *buf, size_t len)
+{
+  char   *p = static_cast<char *>(buf);
+  ssize_t n;
+
+  while (len) {
+    n = recv(fd, p, len, 0);
+    if (n < 0) {
+      if (errno == EINTR)
+	continue;
+      return FALSE;
+    }
+    if (n == 0)
+      return FALSE; // Hung up
+    p   += n;
+    len -= n;
+  }
+  return TRUE;
+}
+
+static guint32 nowMs
+(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/*******************
+ * Worker side     *
+ *******************/
+
+void qRootSplitServe
+(int fd)
+{
+  qSearcher       *searcher = NULL;
+  qRootSplitJob    job;
+  qRootSplitReport report;
+
+  while (recvAll(fd, &job, sizeof(job)) &&
+	 (job.magic == QROOTSPLIT_MAGIC) && !job.quit) {
+    // Anyone who can reach the socket can send us a job, & bad bytes
+    // would trip asserts or corrupt the move stack, so hang up on them
+    if ((job.player2move > qPlayer::BlackPlayer) ||
+	!qWireIsValidPosition(job.pos))
+      break;
+
+    qPosition           pos = qPosition::unpack(job.pos);
+    qPlayer             player(job.player2move);
+    qPlayer             opponent = player.otherPlayer();
+    qMove               move(job.move);
+    qPositionEvaluation eval;
+    qSearcherStats      stats;
+    qMoveList           legal;
+    qMoveListIterator   i;
+
+    // Keep what we know while the root stays the same
+    if (!searcher || !(*searcher->getPos() == pos) ||
+	(searcher->getPlayer2Move().getPlayerId() != player.getPlayerId())) {
+      delete searcher;
+      searcher = new qSearcher(&pos, player);
+    }
+
+    searcher->getLegalMoves(&legal);
+    for (i = legal.begin(); i != legal.end(); ++i)
+      if (i->getEncoding() == move.getEncoding())
+	break;
+    if (i == legal.end())
+      break;
+
+    searcher->applyMove(move, player);
+    searcher->search(opponent, job.maxComplexity, job.minDepth,
+		     job.minBreadth, job.slop, job.ms, job.ms);
+    searcher->getStats(&stats);
+
+    memset(&report, 0, sizeof(report));
+    report.magic              = QROOTSPLIT_MAGIC;
+    report.positionsEvaluated = stats.lastPositionsEvaluated;
+    if (searcher->getEvaluation(opponent, &eval)) {
+      report.haveEval   = TRUE;
+      report.score      = eval.score;
+      report.complexity = eval.complexity;
+      report.depth      = eval.depth;
+    }
+    searcher->undoMove();
+
+    if (!sendAll(fd, &report, sizeof(report)))
+      break;
+  }
+  delete searcher;
+}
+
+bool qRootSplitListen
+(const char *path)
+{
+  struct sockaddr_un addr;
+  struct stat        st;
+  int                fd, conn;
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+    return FALSE;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  // Clear away a socket left by an earlier worker, but nothing else
+  if ((stat(path, &st) == 0) && S_ISSOCK(st.st_mode))
+    unlink(path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return FALSE;
+  if ((bind(fd, reinterpret_cast<struct sockaddr *>(&addr),
+	    sizeof(addr)) < 0) ||
+      (listen(fd, 1) < 0)) {
+    close(fd);
+    return FALSE;
+  }
+
+  for (;;) {
+    conn = accept(fd, NULL, NULL);
+    if (conn < 0) {
+      if (errno == EINTR)
+	continue;
+      close(fd);
+      return FALSE;
+    }
+    qRootSplitServe(conn);
+    close(conn);
+  }
+}
+
+
+/***********************
+ * class qRootSplitter *
+ ***********************/
+
+qRootSplitter::qRootSplitter
+()
+  :numRounds(0), positionsEvaluated(0)
+{
+  bestEval = *positionEval_none;
+}
+
+qRootSplitter::~qRootSplitter
+()
+{
+  qRootSplitJob job;
+  unsigned int  i;
+
+  memset(&job, 0, sizeof(job));
+  job.magic = QROOTSPLIT_MAGIC;
+  job.quit  = TRUE;
+  for (i = 0; i < workers.size(); ++i)
+    if (workers[i].fd >= 0) {
+      sendAll(workers[i].fd, &job, sizeof(job));
+      close(workers[i].fd);
+    }
+  for (i = 0; i < workers.size(); ++i)
+    if (workers[i].pid > 0)
+      waitpid(workers[i].pid, NULL, 0);
+}
+
+void qRootSplitter::addWorker
+(int   fd,
+ pid_t pid)
+{
+  qRootSplitWorker w;
+
+  w.fd  = fd;
+  w.pid = pid;
+  workers.push_back(w);
+}
+
+void qRootSplitter::dropWorker
+(qRootSplitWorker *w)
+{
+  close(w->fd);
+  w->fd = -1;
+}
+
+int qRootSplitter::startWorkers
+(int n)
+{
+  int   started, sv[2];
+  pid_t pid;
+
+  for (started = 0; started < n; ++started) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+      break;
+    pid = ::fork();
+    if (pid < 0) {
+      close(sv[0]);
+      close(sv[1]);
+      break;
+    }
+    if (pid == 0) {
+      // Don't hold the other workers' sockets open after we're gone
+      for (unsigned int i = 0; i < workers.size(); ++i)
+	if (workers[i].fd >= 0)
+	  close(workers[i].fd);
+      close(sv[0]);
+      // One thread, so this places the whole worker and its searcher
+      qNuma::bindThreadToNode(qNuma::nodeForWorker(started));
+      qRootSplitServe(sv[1]);
+      _exit(0);
+    }
+    close(sv[1]);
+    addWorker(sv[0], pid);
+  }
+  return started;
+}
+
+bool qRootSplitter::connectWorker
+(const char *path)
+{
+  struct sockaddr_un addr;
+  int                fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+    return FALSE;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return FALSE;
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+	      sizeof(addr)) < 0) {
+    close(fd);
+    return FALSE;
+  }
+  addWorker(fd, 0);
+  return TRUE;
+}
+
+int qRootSplitter::getNumWorkers
+(void) const
+{
+  int          n = 0;
+  unsigned int i;
+
+  for (i = 0; i < workers.size(); ++i)
+    if (workers[i].fd >= 0)
+      ++n;
+  return n;
+}
+
+// Share the contenders most in need of refining among the workers (see
+// qRootMoves::pickWanted()).  Returns how long each of the workers'
+// searches gets (0 if nobody got any).
+gint32 qRootSplitter::assignWorkers
+(guint8 min_breadth,
+ guint8 slop,
+ gint32 sliceMs)
+{
+  std::vector<int>               wanted;
+  std::vector<std::vector<int>*> jobs;
+  unsigned int                   k, numLive = getNumWorkers();
+  gint32                         jobMs;
+
+  for (k = 0; k < workers.size(); ++k) {
+    workers[k].jobs.clear();
+    jobs.push_back((workers[k].fd >= 0) ? &workers[k].jobs : NULL);
+  }
+  if (!numLive)
+    return 0;
+
+  // Only as many as the slice has room for.  (A first look at every move
+  // needs little time each, so they all go at once.)
+  if (!moves.pickWanted(min_breadth, slop, &wanted)) {
+    if (sliceMs < ROOTSPLIT_MIN_JOB_MS)
+      sliceMs = ROOTSPLIT_MIN_JOB_MS;
+    if (wanted.size() > numLive * (sliceMs / ROOTSPLIT_MIN_JOB_MS))
+      wanted.resize(numLive * (sliceMs / ROOTSPLIT_MIN_JOB_MS));
+  }
+  if (wanted.empty() || !moves.assign(wanted, jobs))
+    return 0;
+
+  jobMs = (sliceMs * numLive) / wanted.size();
+  return jobMs ? jobMs : 1;
+}
+
+void qRootSplitter::runRound
+(const qPosition *pos,
+ qPlayer          player2move,
+ guint8           max_complexity,
+ guint8           min_depth,
+ guint8           min_breadth,
+ guint8           slop,
+ gint32           jobMs)
+{
+  qRootSplitJob    job;
+  qRootSplitReport report;
+  unsigned int     i, k;
+
+  memset(&job, 0, sizeof(job));
+  job.magic         = QROOTSPLIT_MAGIC;
+  job.player2move   = player2move.getPlayerId();
+  job.maxComplexity = max_complexity;
+  job.minDepth      = qLessOnePly(min_depth);
+  job.minBreadth    = qLessOnePly(min_breadth);
+  job.slop          = slop;
+  job.ms            = (jobMs < ROOTSPLIT_SLICE_MS) ? jobMs : ROOTSPLIT_SLICE_MS;
+  pos->pack(job.pos);
+
+  // Queue up everyone's jobs, so they all search at once...
+  for (k = 0; k < workers.size(); ++k) {
+    qRootSplitWorker *w = &workers[k];
+    for (i = 0; (w->fd >= 0) && (i < w->jobs.size()); ++i) {
+      job.move = moves[w->jobs[i]].move.getEncoding();
+      if (!sendAll(w->fd, &job, sizeof(job)))
+	dropWorker(w);
+    }
+  }
+
+  // ...and collect their reports in the same order
+  for (k = 0; k < workers.size(); ++k) {
+    qRootSplitWorker *w = &workers[k];
+    for (i = 0; (w->fd >= 0) && (i < w->jobs.size()); ++i) {
+      qRootMoves::qRootMove *m = &moves[w->jobs[i]];
+
+      if (!recvAll(w->fd, &report, sizeof(report)) ||
+	  (report.magic != QROOTSPLIT_MAGIC)) {
+	dropWorker(w);
+	break;
+      }
+      positionsEvaluated += report.positionsEvaluated;
+      if (report.haveEval) {
+	m->eval.score      = report.score;
+	m->eval.complexity = report.complexity;
+	m->eval.depth      = report.depth;
+      }
+    }
+    w->jobs.clear();
+  }
+}
+
+qMove qRootSplitter::search
+(const qPosition *pos,
+ qPlayer          player2move,
+ guint8           max_complexity,
+ guint8           min_depth,
+ guint8           min_breadth,
+ guint8           slop,
+ gint32           max_time)
+{
+  qMoveStack   moveStack(pos, player2move);
+  qMoveList    legalMoves;
+  qMove        winner;
+  guint32      startMs = nowMs(), elapsed;
+
+  numRounds          = 0;
+  positionsEvaluated = 0;
+  bestEval           = *positionEval_none;
+
+  // Rate every move's result to begin with, as expandRoot() would
+  getPlayableMoves(pos, &moveStack, &legalMoves);
+  if (moves.rate(pos, player2move, legalMoves, &winner)) {
+    bestEval = *positionEval_won;
+    return winner;
+  }
+  if (!moves.size())
+    return qMove();
+
+  for (;;) {
+    moves.sort();
+    if (moves.isDone(max_complexity, min_depth, slop))
+      break;
+
+    elapsed = nowMs() - startMs;
+    if (max_time && (elapsed >= static_cast<guint32>(max_time)))
+      break;
+    gint32 slice = ROOTSPLIT_SLICE_MS;
+    if (max_time && (max_time - static_cast<gint32>(elapsed) < slice))
+      slice = max_time - elapsed;
+
+    gint32 jobMs = assignWorkers(min_breadth, slop, slice);
+    if (!jobMs)
+      break; // Nothing left to refine, or nobody left to do it
+    runRound(pos, player2move, max_complexity, min_depth, min_breadth, slop,
+	     jobMs);
+    ++numRounds;
+  }
+
+  return moves.getBest(&bestEval);
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_rootsplit_h
+#define INCLUDE_rootsplit_h 1
+
+#include <sys/types.h>
+#include <vector>
+#include "qtypes.h"
+#include "qposition.h"
+#include "qposinfo.h"
+#include "qrootmoves.h"
+#include "parameters.h"
+
+/* Searching one position with several engine processes.
+ *
+ * A qRootSplitter is the coordinator.  It keeps the root's moves in a
+ * qRootMoves (see qrootmoves.h), and each round shares the contenders
+ * still worth refining among its workers, giving each worker about
+ * ROOTSPLIT_SLICE_MS of searching in all.  Then it gathers what they made
+ * of them, re-sorts, and goes on until the same criteria qSearcher::search()
+ * stops on are met or time runs out.
+ *
+ * Workers are separate processes, each with a qSearcher at the root and
+ * so its own qPositionInfoHash.  To refine a move a worker applies it,
+ * searches for the opponent, and takes it back (which keeps all it
+ * learned), so a move goes back to the worker that searched it last
+ * whenever that's fair.  Together the workers can use more memory than
+ * one process can address.  Nothing is shared: each worker talks to the
+ * coordinator over a UNIX-domain stream socket, in fixed-size binary
+ * messages in host byte order.  They can be forked locally
+ * (startWorkers()), or run on their own, e.g. one per container,
+ * listening on a socket the coordinator connects to (qRootSplitListen()
+ * & connectWorker()).  The qsplit tool ("make tools") does both.
+ *
+ * A worker that dies or hangs up is dropped, and its moves go to whoever
+ * is left.
+ */
+
+class qRootSplitter {
+ public:
+  qRootSplitter();
+  ~qRootSplitter(); // Tells the workers to quit, & reaps those we forked
+
+  // Fork n local workers, each on its own socketpair and pinned to a NUMA
+  // node in turn (see qnuma.h).  Only the forking thread lives on in a
+  // worker, so do this before starting any threads.  Returns how many
+  // started.
+  int  startWorkers(int n);
+
+  // Use a worker listening at path (see qRootSplitListen()).  Returns
+  // FALSE if it can't be reached.
+  bool connectWorker(const char *path);
+
+  int  getNumWorkers(void) const;
+
+  // Find the best move for player2move at pos, with the criteria of
+  // qSearcher::search().  Returns qMove() if there's no legal move.
+  qMove search(const qPosition *pos,
+	       qPlayer          player2move,
+	       guint8           max_complexity,
+	       guint8           min_depth,
+	       guint8           min_breadth,
+	       guint8           slop,
+	       gint32           max_time);
+
+  // Of the last search: the best move's evaluation (from the mover's
+  // side), how many rounds it took, and the positions the workers
+  // evaluated between them
+  const qPositionEvaluation *getBestEval(void) const { return &bestEval; };
+  guint32 getNumRounds(void) const             { return numRounds; };
+  guint64 getPositionsEvaluated(void) const    { return positionsEvaluated; };
+
+ private:
+  struct qRootSplitWorker {
+    int              fd;   // -1 once dropped
+    pid_t            pid;  // 0 if we didn't fork it
+    std::vector<int> jobs; // Moves it's searching this round, in order
+  };
+
+  std::vector<qRootSplitWorker> workers;
+  qRootMoves                    moves;
+  qPositionEvaluation           bestEval;
+  guint32                       numRounds;
+  guint64                       positionsEvaluated;
+
+  void    addWorker(int fd, pid_t pid);
+  void    dropWorker(qRootSplitWorker *w);
+  gint32  assignWorkers(guint8 min_breadth, guint8 slop, gint32 sliceMs);
+  void    runRound(const qPosition *pos, qPlayer player2move,
+		   guint8 max_complexity, guint8 min_depth,
+		   guint8 min_breadth, guint8 slop, gint32 jobMs);
+
+  // We own the workers' sockets
+  qRootSplitter(const qRootSplitter&);
+  qRootSplitter &operator=(const qRootSplitter&);
+};
+
+// Be a worker: serve coordinators' requests over fd until told to quit or
+// the coordinator hangs up.  A job with a bad player, an unplayable
+// position (see qWireIsValidPosition()) or an illegal move ends it too.
+void qRootSplitServe(int fd);
+
+// Be a worker listening at path, serving one coordinator at a time.
+// Returns FALSE if the socket can't be set up; otherwise never returns.
+bool qRootSplitListen(const char *path);
+
+#endif // INCLUDE_rootsplit_h
@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include "qsched.h"
+#include "qnuma.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+static guint64 nowUs
+(clockid_t clock = CLOCK_MONOTONIC)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (guint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/********************
+ * class qSchedGame *
+ ********************/
+qSchedGame::qSchedGame
+(qSearcher *s)
+  :searcher(s), pending(FALSE), running(FALSE), ready(FALSE), usedUs(0),
+   numSlices(0), cpuUs(0), numMoves(0), numLate(0), maxLateMs(0), numCut(0)
+{ ; }
+
+
+/**************************
+ * class qSearchScheduler *
+ **************************/
+qSearchScheduler::qSearchScheduler
+(int numWorkers)
+  :stopping(FALSE), nextWorker(0)
+{
+  pthread_t t;
+
+  memset(&stats, 0, sizeof(stats));
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&work, NULL);
+  pthread_cond_init(&answered, NULL);
+  for (int i = 0; i < numWorkers; ++i)
+    if (!pthread_create(&t, NULL, &qSearchScheduler::workerMain, this))
+      workers.push_back(t);
+}
+
+qSearchScheduler::~qSearchScheduler()
+{
+  std::vector<qSchedGame *>::iterator g;
+
+  pthread_mutex_lock(&mutex);
+  stopping = TRUE;
+  pthread_cond_broadcast(&work);
+  pthread_mutex_unlock(&mutex);
+  for (size_t i = 0; i < workers.size(); ++i)
+    pthread_join(workers[i], NULL);
+
+  // Whatever's left gets the best we have for it
+  pthread_mutex_lock(&mutex);
+  for (g = active.begin(); g != active.end(); ++g) {
+    (*g)->pending = FALSE;
+    (*g)->ready   = TRUE;
+  }
+  active.clear();
+  queue.clear();
+  pthread_cond_broadcast(&answered);
+  pthread_mutex_unlock(&mutex);
+
+  pthread_cond_destroy(&answered);
+  pthread_cond_destroy(&work);
+  pthread_mutex_destroy(&mutex);
+}
+
+bool qSearchScheduler::request
+(qSchedGame *game,
+ qPlayer     player2move,
+ guint8      max_complexity,
+ guint8      min_depth,
+ guint8      min_breadth,
+ guint8      slop,
+ gint32      max_time,
+ gint32      suggested_time,
+ gint32      deadline_ms)
+{
+  pthread_mutex_lock(&mutex);
+  if (game->pending || stopping) {
+    pthread_mutex_unlock(&mutex);
+    return FALSE;
+  }
+  game->pending       = TRUE;
+  game->ready         = FALSE;
+  game->player2move   = player2move;
+  game->maxComplexity = max_complexity;
+  game->minDepth      = min_depth;
+  game->minBreadth    = min_breadth;
+  game->slop          = slop;
+  game->budgetMs      = (max_time > 0) ? max_time : 0;
+  game->suggestedMs   = suggested_time;
+  game->deadlineUs    = nowUs() + (guint64)((deadline_ms > 0) ? deadline_ms : 0) * 1000;
+  game->usedUs        = 0;
+  game->numSlices     = 0;
+  game->move          = moveNull;
+  queue.push_back(game);
+  active.push_back(game);
+  stats.requests++;
+  pthread_cond_signal(&work);
+  pthread_mutex_unlock(&mutex);
+  return TRUE;
+}
+
+bool qSearchScheduler::poll
+(qSchedGame *game, qMove *r_mv)
+{
+  bool rval;
+
+  pthread_mutex_lock(&mutex);
+  rval = game->ready;
+  if (rval) {
+    *r_mv       = game->move;
+    game->ready = FALSE;
+  }
+  pthread_mutex_unlock(&mutex);
+  return rval;
+}
+
+qMove qSearchScheduler::wait
+(qSchedGame *game)
+{
+  qMove mv;
+
+  pthread_mutex_lock(&mutex);
+  while (game->pending)
+    pthread_cond_wait(&answered, &mutex);
+  if (game->ready) {
+    mv          = game->move;
+    game->ready = FALSE;
+  }
+  pthread_mutex_unlock(&mutex);
+  return mv;
+}
+
+void qSearchScheduler::cancel
+(qSchedGame *game)
+{
+  pthread_mutex_lock(&mutex);
+  while (game->running)
+    pthread_cond_wait(&answered, &mutex);
+  if (game->pending)
+    forget(game);
+  game->pending = game->ready = FALSE;
+  pthread_mutex_unlock(&mutex);
+}
+
+void qSearchScheduler::getStats
+(qSchedStats *r_stats)
+{
+  pthread_mutex_lock(&mutex);
+  *r_stats = stats;
+  pthread_mutex_unlock(&mutex);
+}
+
+bool qSearchScheduler::deadlineLess
+(const qSchedGame *a, const qSchedGame *b)
+{
+  return a->deadlineUs < b->deadlineUs;
+}
+
+// How far short the workers fall of finishing everything pending with
+// its remaining budget before it's due: the worst ratio of the time
+// needed by a deadline to the time there is, over all the deadlines.
+// 1 or less if there's room.  Called with the lock held.
+double qSearchScheduler::overload
+(guint64 now)
+{
+  std::vector<qSchedGame *> byDeadline(active);
+  std::vector<qSchedGame *>::iterator g;
+  guint64 demandUs = 0, dueUs, capacityUs;
+  double  worst = 0;
+
+  std::sort(byDeadline.begin(), byDeadline.end(), deadlineLess);
+  for (g = byDeadline.begin(); g != byDeadline.end(); ++g) {
+    demandUs  += (*g)->remainingUs();
+    dueUs      = (*g)->deadlineUs - SCHED_DEADLINE_MARGIN_MS * 1000;
+    if (dueUs <= now)
+      continue; // Answered on its next turn anyway
+    capacityUs = (dueUs - now) * workers.size();
+    if (demandUs > worst * capacityUs)
+      worst = (double)demandUs / capacityUs;
+  }
+  return worst;
+}
+
+// The earliest-due game still worth a slice, & how long a slice (NULL if
+// there's none).  Games whose budget, cut to fit any overload, or time
+// before their deadline are used up get answered along the way.  Called
+// with the lock held.
+qSchedGame *qSearchScheduler::pickGame
+(guint64 now, gint32 *r_sliceMs)
+{
+  double load = overload(now);
+
+  while (!queue.empty()) {
+    std::vector<qSchedGame *>::iterator first =
+      std::min_element(queue.begin(), queue.end(), deadlineLess);
+    qSchedGame *game = *first;
+    guint64     dueUs = game->deadlineUs - SCHED_DEADLINE_MARGIN_MS * 1000;
+    guint64     allowedUs = game->remainingUs();
+    bool        cut = FALSE;
+
+    if (load > 1) {
+      allowedUs = (guint64)(allowedUs / load);
+      cut = TRUE;
+    }
+    if (allowedUs > ((dueUs > now) ? dueUs - now : 0)) {
+      allowedUs = (dueUs > now) ? dueUs - now : 0;
+      cut = TRUE;
+    }
+
+    queue.erase(first);
+    if (game->numSlices && (allowedUs < SCHED_MIN_SLICE_MS * 1000)) {
+      answer(game, now,
+	     cut && (game->remainingUs() >= SCHED_MIN_SLICE_MS * 1000));
+      continue;
+    }
+
+    // Everyone gets at least one slice, so there's a move to give
+    *r_sliceMs = std::min<guint64>(SCHED_SLICE_MS, allowedUs / 1000);
+    if (*r_sliceMs < SCHED_MIN_SLICE_MS)
+      *r_sliceMs = SCHED_MIN_SLICE_MS;
+    if (load > 1)
+      stats.overloads++;
+    game->running = TRUE;
+    return game;
+  }
+  return NULL;
+}
+
+// Called with the lock held
+void qSearchScheduler::answer
+(qSchedGame *game, guint64 now, bool cut)
+{
+  forget(game);
+  game->pending = FALSE;
+  game->ready   = TRUE;
+  game->numMoves++;
+  stats.answered++;
+  if (now > game->deadlineUs) {
+    guint32 lateMs = (now - game->deadlineUs) / 1000;
+    game->numLate++;
+    stats.late++;
+    if (lateMs > game->maxLateMs)
+      game->maxLateMs = lateMs;
+  }
+  if (cut) {
+    game->numCut++;
+    stats.cut++;
+  }
+  pthread_cond_broadcast(&answered);
+}
+
+// Take game off the queue & the active list.  Called with the lock held.
+void qSearchScheduler::forget
+(qSchedGame *game)
+{
+  std::vector<qSchedGame *>::iterator g;
+
+  if ((g = std::find(queue.begin(), queue.end(), game)) != queue.end())
+    queue.erase(g);
+  if ((g = std::find(active.begin(), active.end(), game)) != active.end())
+    active.erase(g);
+}
+
+void *qSearchScheduler::workerMain
+(void *arg)
+{
+  static_cast<qSearchScheduler*>(arg)->workerLoop();
+  return NULL;
+}
+
+void qSearchScheduler::workerLoop
+(void)
+{
+  qSearcherStats searcherStats;
+  int            node;
+
+  // Spread the workers over the NUMA nodes, so what a game's searcher
+  // allocates during a slice comes from the node the slice runs on
+  pthread_mutex_lock(&mutex);
+  node = qNuma::nodeForWorker(nextWorker++);
+  pthread_mutex_unlock(&mutex);
+  qNuma::bindThreadToNode(node);
+
+  pthread_mutex_lock(&mutex);
+  while (!stopping) {
+    qSchedGame *game;
+    gint32      sliceMs, suggestedMs;
+    guint64     startUs, startCpuUs, elapsedUs, cpuUs;
+    qMove       mv;
+
+    if (!(game = pickGame(nowUs(), &sliceMs))) {
+      pthread_cond_wait(&work, &mutex);
+      continue;
+    }
+
+    // Past the request's suggested time, let search() relax its criteria
+    // right away, as it would have on its own
+    suggestedMs = sliceMs;
+    if (game->suggestedMs > 0) {
+      gint64 leftUs = game->suggestedMs * 1000LL - (gint64)game->usedUs;
+      if (leftUs < sliceMs * 1000LL)
+	suggestedMs = (leftUs > 1000) ? leftUs / 1000 : 1;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    startUs    = nowUs();
+    startCpuUs = nowUs(CLOCK_THREAD_CPUTIME_ID);
+    // The breadth-first pass only needs doing once; the hash keeps it
+    mv = game->searcher->search(game->player2move,
+				game->maxComplexity,
+				game->minDepth,
+				game->numSlices ? 0 : game->minBreadth,
+				game->slop,
+				sliceMs,
+				suggestedMs);
+    game->searcher->getStats(&searcherStats);
+    cpuUs      = nowUs(CLOCK_THREAD_CPUTIME_ID) - startCpuUs;
+    elapsedUs  = nowUs() - startUs;
+
+    pthread_mutex_lock(&mutex);
+    game->usedUs += elapsedUs;
+    game->cpuUs  += cpuUs;
+    game->numSlices++;
+    game->move    = mv;
+    game->running = FALSE;
+    stats.slices++;
+    stats.cpuUs  += cpuUs;
+
+    if (!searcherStats.lastCutShort || !game->remainingUs())
+      answer(game, nowUs(), FALSE);
+    else {
+      queue.push_back(game);
+      pthread_cond_broadcast(&answered); // For cancel()
+    }
+  }
+  pthread_mutex_unlock(&mutex);
+}
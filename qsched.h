@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_sched_h
+#define INCLUDE_sched_h 1
+
+#include <pthread.h>
+#include <vector>
+#include "qtypes.h"
+#include "qsearcher.h"
+#include "parameters.h"
+
+/* Sharing a fixed pool of search threads among many games.
+ *
+ * With a thread per game, every qSearcher competes for the cores, and
+ * once there are more games than cores each one's search() runs out its
+ * time having had only a fraction of a core: moves get worse, and answers
+ * come late whenever the host falls behind.  A qSearchScheduler instead
+ * runs each requested search as a series of slices of at most
+ * SCHED_SLICE_MS on one of its worker threads, each a search() of its own.
+ * Every slice starts from what the game's qPositionInfoHash learned in
+ * the ones before, and the last slice's move is the answer.  A search
+ * ends when a slice meets its criteria, its time budget is spent, or its
+ * deadline comes near (SCHED_DEADLINE_MARGIN_MS before).
+ *
+ * Slices go to the game whose deadline is earliest.  Before each, the
+ * scheduler checks, for each deadline in turn, whether the workers can
+ * finish the searches due by then with the budgets they still have.  If
+ * not, it cuts every remaining budget by the worst shortfall, so all the
+ * games play a little faster rather than some missing their deadlines.
+ *
+ * Each worker is pinned to a NUMA node in turn as it starts (see
+ * qnuma.h).
+ *
+ * A qSchedGame holds one game's searcher, its outstanding request, and
+ * what its searches have cost.  Only one thread at a time may use a
+ * game's searcher; while a request is outstanding, that's the scheduler.
+ */
+
+class qSearchScheduler;
+
+class qSchedGame {
+ public:
+  // searcher must outlive the qSchedGame
+  qSchedGame(qSearcher *searcher);
+
+  qSearcher *getSearcher(void) const { return searcher; };
+
+  // Over the game so far: thread CPU time its searches took, moves
+  // answered, those answered after their deadline & by how much at worst,
+  // and those cut short to spread an overload
+  guint64 getCpuUs(void) const      { return cpuUs; };
+  guint32 getNumMoves(void) const   { return numMoves; };
+  guint32 getNumLate(void) const    { return numLate; };
+  guint32 getMaxLateMs(void) const  { return maxLateMs; };
+  guint32 getNumCut(void) const     { return numCut; };
+
+ private:
+  friend class qSearchScheduler;
+
+  qSearcher *searcher;
+
+  // The outstanding request
+  bool     pending;   // Requested and not yet answered
+  bool     running;   // A worker has it
+  bool     ready;     // Answered and not yet collected
+  qPlayer  player2move;
+  guint8   maxComplexity, minDepth, minBreadth, slop;
+  gint32   budgetMs, suggestedMs;
+  guint64  deadlineUs;
+  guint64  usedUs;    // Of its budget so far
+  guint32  numSlices;
+  qMove    move;      // The last slice's answer
+
+  guint64  cpuUs;
+  guint32  numMoves, numLate, maxLateMs, numCut;
+
+  guint64  remainingUs(void) const
+    { return (usedUs < budgetMs*1000ULL) ? budgetMs*1000ULL - usedUs : 0; };
+};
+
+typedef struct _qSchedStats {
+  guint32 requests;
+  guint32 answered;
+  guint32 late;        // Answered after their deadlines
+  guint32 cut;         // Answered early because of overload
+  guint32 slices;
+  guint32 overloads;   // Slices handed out while budgets had to be cut
+  guint64 cpuUs;       // Thread CPU time of all slices
+} qSchedStats;
+
+class qSearchScheduler {
+ public:
+  // Start numWorkers search threads
+  qSearchScheduler(int numWorkers);
+  // Answers whatever's outstanding as it stands, & stops the threads
+  ~qSearchScheduler();
+
+  // Have game's searcher find a move for player2move with search()'s
+  // criteria, spending up to max_time ms searching (relaxing the criteria
+  // after suggested_time, as search() does), and answer within
+  // deadline_ms from now: e.g. what's left on the game's clock.  Returns
+  // FALSE if game already has a request outstanding.
+  bool request(qSchedGame *game,
+	       qPlayer     player2move,
+	       guint8      max_complexity,
+	       guint8      min_depth,
+	       guint8      min_breadth,
+	       guint8      slop,
+	       gint32      max_time,
+	       gint32      suggested_time,
+	       gint32      deadline_ms);
+
+  // Is game's answer in?  If so, take it (moveNull if the game never got
+  // a slice before the scheduler shut down).
+  bool poll(qSchedGame *game, qMove *r_mv);
+
+  // Wait for game's answer
+  qMove wait(qSchedGame *game);
+
+  // Withdraw game's request, waiting out a slice in progress, so the
+  // game & its searcher may be deleted
+  void cancel(qSchedGame *game);
+
+  void getStats(qSchedStats *r_stats);
+
+ private:
+  std::vector<pthread_t>    workers;
+  std::vector<qSchedGame *> queue;  // Pending and not running
+  std::vector<qSchedGame *> active; // Pending, running or not
+  pthread_mutex_t           mutex;
+  pthread_cond_t            work;     // Something's queued, or stopping
+  pthread_cond_t            answered; // A slice finished
+  bool                      stopping;
+  int                       nextWorker; // Index of the next to start
+  qSchedStats               stats;
+
+  static bool  deadlineLess(const qSchedGame *a, const qSchedGame *b);
+  static void *workerMain(void *scheduler);
+  void         workerLoop(void);
+  qSchedGame  *pickGame(guint64 now, gint32 *r_sliceMs);
+  double       overload(guint64 now);
+  void         answer(qSchedGame *game, guint64 now, bool cut);
+  void         forget(qSchedGame *game);
+
+  // We own the threads
+  qSearchScheduler(const qSearchScheduler&);
+  qSearchScheduler &operator=(const qSearchScheduler&);
+};
+
+#endif // INCLUDE_sched_h
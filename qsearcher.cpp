@@ -8,7 +8,9 @@
 
 #include "qsearcher.h"
 #include "getmoves.h"
+#include "qwallimpact.h"
 #include <memory>
+#include <string.h>
 #include <sys/time.h>
 
 IDSTR("$Id: qsearcher.cpp,v 1.20 2014/12/12 21:20:21 bmiller Exp $");
@@ -28,6 +30,11 @@ private:
 };
 
 
+// Upper bounds (inclusive) of the search() latency histogram buckets.
+// Anything slower lands in the final +Inf bucket.
+const guint32 qStatsLatencyBucketMs[QSTATS_LATENCY_BUCKETS] =
+  { 10, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000 };
+
 // Used by qPositionInfoHash
 void my_posHashEltInitFunc
 (qPositionInfo *posInfo, const qPosition *pos)
@@ -79,15 +86,62 @@ public:
 qSearcher::qSearcher
 (const qPosition *pos,
  qPlayer          player2move)
-:moveStack(pos, player2move),
+:posHash(&my_posHashEltInitFunc),
+ sharedTable(NULL),
+ evalJournal(NULL),
+ evalSnapshot(NULL),
+ evalNet(NULL),
+ moveStack(pos, player2move),
  computationTree(),
- currentTreeNode(0),
  wallMovesSinceTableUpdate(0),
- posHash(&my_posHashEltInitFunc)
-{ ; }
+ progressFunc(NULL),
+ progressArg(NULL),
+ treeExporter(NULL),
+ treeExportEvery(0)
+{
+  memset(&stats, 0, sizeof(stats));
+  pthread_mutex_init(&statsMutex, NULL);
+}
+
+qSearcher::qSearcher
+(const qSearcher *parent)
+:posHash(&my_posHashEltInitFunc),
+ sharedTable(parent->sharedTable),
+ evalJournal(parent->evalJournal),
+ evalSnapshot(parent->evalSnapshot),
+ evalNet(parent->evalNet),
+ moveStack(parent->moveStack.getFramePos(0),
+	   parent->moveStack.getFramePlayer(0).otherPlayer()),
+ computationTree(),
+ wallMovesSinceTableUpdate(parent->wallMovesSinceTableUpdate),
+ progressFunc(NULL),
+ progressArg(NULL),
+ treeExporter(NULL),
+ treeExportEvery(0)
+{
+  guint8 i;
+
+  memset(&stats, 0, sizeof(stats));
+  pthread_mutex_init(&statsMutex, NULL);
+  posHash.setParent(&parent->posHash);
+  moveStack.setEvalNet(evalNet);
+
+  // Replay the parent's game so takebacks work in the fork too
+  for (i = 1; i <= parent->moveStack.getNumMoves(); ++i)
+    moveStack.pushMove(parent->moveStack.getFramePlayer(i),
+		       parent->moveStack.getFrameMove(i));
+}
 
 qSearcher::~qSearcher()
-{ ; }
+{
+  pthread_mutex_destroy(&statsMutex);
+}
+
+qSearcher *qSearcher::fork
+(void) const
+{
+  return new qSearcher(this);
+}
 
 void
 qSearcher::think
@@ -96,15 +150,6 @@ qSearcher::think
 {
   qMove move;
 
-#if 0  // Keep a move count, and if enough moves have passed, do this???
-  if (wallMovesSinceTableUpdate > 5)
-    {
-      moveStack.initWallMoveTable();
-      wallMovesSinceTableUpdate = 0;
-      return;
-    }
-#endif
-
   // call iSearch
   move = iSearch(player2move,
 		 qComplexity_max,
@@ -114,6 +159,12 @@ qSearcher::think
 		 MAXTIME_PER_THINK_SERVICE,  // Just to avoid endless hangs
 		 SUGTIME_PER_THINK_SERVICE);
 
+  // Remember what we expect, so applyMove() can tell if pondering paid off
+  pthread_mutex_lock(&statsMutex);
+  stats.thinks++;
+  pthread_mutex_unlock(&statsMutex);
+  ponderMove   = move;
+  ponderPlayer = player2move;
 
   return;
 }
@@ -129,11 +180,14 @@ qSearcher::search
  gint32 suggested_time)
 {
   qMove move;
+  milliSecondTimer msTimer;
 
   // No longer relevant code; this class uses a service func for bg thinking:
   // Stop bg searcher
   // bgStop();
 
+  msTimer.reset();
+
   // call iSearch
   move = iSearch(player2move,
 		 max_complexity,
@@ -143,6 +197,24 @@ qSearcher::search
 		 max_time,
 		 suggested_time);
 
+  // Account for how long it took versus what we were allowed
+  {
+    guint32 elapsed = msTimer.getElapsed();
+    int     bucket;
+
+    for (bucket = 0; bucket < QSTATS_LATENCY_BUCKETS; ++bucket)
+      if (elapsed <= qStatsLatencyBucketMs[bucket])
+	break;
+    pthread_mutex_lock(&statsMutex);
+    stats.latencyHist[bucket]++;
+    stats.searches++;
+    stats.searchMs += elapsed;
+    stats.budgetMs += max_time;
+    if ((max_time > 0) && (elapsed > static_cast<guint32>(max_time)))
+      stats.overruns++;
+    pthread_mutex_unlock(&statsMutex);
+  }
+
   // Update position/bgPlayerToMove with latest move
   //  bgPos.applyMove(player2move, move);
   //
@@ -154,18 +226,117 @@ qSearcher::search
   return move;
 }
 
+qMove
+qSearcher::searchPositions
+(qPlayer player2move,
+ guint8  max_complexity,
+ guint8  min_depth,
+ guint8  min_breadth,
+ guint8  slop,
+ guint32 max_positions)
+{
+  g_assert(max_positions);
+  return iSearch(player2move, max_complexity, min_depth, min_breadth, slop,
+		 0, 0, max_positions);
+}
+
 void
 qSearcher::applyMove
 (qMove mv,
  qPlayer p)
 {
+  // Did our background thinking see this coming?
+  if (ponderMove.exists() &&
+      (ponderPlayer.getPlayerId() == p.getPlayerId())) {
+    pthread_mutex_lock(&statsMutex);
+    stats.ponderPredictions++;
+    if (ponderMove.getEncoding() == mv.getEncoding())
+      stats.ponderHits++;
+    pthread_mutex_unlock(&statsMutex);
+  }
+  ponderMove = moveNull;
+
   moveStack.pushMove(p, mv);
 
-  // Keep a move count???
+  // Once enough walls are down to shorten the blocked-move lists, rebuild
+  // the wall move table for this position while the next player thinks
   if (mv.isWallMove())
     wallMovesSinceTableUpdate++;
+  if ((wallMovesSinceTableUpdate > WALL_TABLE_REBUILD_MOVES) &&
+      !wallTableBuilder.isBusy())
+    wallTableBuilder.start(moveStack.getPos());
+  sampleStats();
 }
 
+bool
+qSearcher::getLegalMoves
+(qMoveList *r_moves)
+{
+  return (getPlayableMoves(moveStack.getPos(), &moveStack, r_moves) != NULL);
+}
+
+bool
+qSearcher::getEvaluation
+(qPlayer              p,
+ qPositionEvaluation *r_eval)
+{
+  qPositionInfo *posInfo = posHash.getElt(moveStack.getPos());
+
+  if (!posInfo || !posInfo->evalExists(p))
+    return FALSE;
+  *r_eval = *posInfo->get(p);
+  return TRUE;
+}
+
+void
+qSearcher::setTraceRecorder
+(qTraceRecorder *tracer)
+{
+  moveStack.setTracer(tracer);
+  computationTree.setTracer(tracer);
+  posHash.setTraceFunc(tracer ? &qTraceRecorder::hashTraceFunc : NULL,
+		       tracer);
+  if (tracer)
+    tracer->stackBase(moveStack.getPos(), moveStack.getPlayer2Move());
+}
+
+bool
+qSearcher::undoMove
+(void)
+{
+  if (moveStack.getNumMoves() == 0)
+    return FALSE;
+
+  if (moveStack.peekLastMove().isWallMove() && wallMovesSinceTableUpdate)
+    wallMovesSinceTableUpdate--;
+
+  // Restores the wall move table from the popped frame (or rebuilds it,
+  // if the table was built after that move)
+  moveStack.popMove();
+
+  // Whatever think() predicted was for a position we've left
+  ponderMove = moveNull;
+  sampleStats();
+  return TRUE;
+}
+
+
+// Swap in a wall move table built in the background, if one is ready (or,
+// with wait, once it is) and the game hasn't moved on (or been taken back)
+// since it was started
+void
+qSearcher::useRebuiltWallTable
+(bool wait)
+{
+  qWallMoveTable *table = wallTableBuilder.collect(wait);
+
+  if (!table)
+    return;
+  if (moveStack.setWallMoveTable(table))
+    wallMovesSinceTableUpdate = 0;
+  else
+    delete table;
+}
 
 qMove
 qSearcher::iSearch
@@ -175,10 +346,15 @@ qSearcher::iSearch
  guint8  min_breadth,
  guint8  slop,
  gint32  max_time,
- gint32  suggested_time)
+ gint32  suggested_time,
+ guint32 max_positions)
 {
   gint8 current_depth = 0;
   guint32 positionsEvaluated = 0;
+  guint32 totalPositionsEvaluated = 0; // scanDeeper resets its counter arg
+  guint32 nextProgressMs = 0;
+  guint32 nextExport = treeExportEvery;
+  bool    cutShort = FALSE;
   milliSecondTimer msTimer;
 
   // Figure out how long to think
@@ -187,8 +363,10 @@ qSearcher::iSearch
   if ((!stop_time) || (max_time < stop_time))
     stop_time = max_time;
 
+  useRebuiltWallTable(max_positions != 0);
+
   computationTree.initializeTree();
-  currentTreeNode = computationTree.getRootNode();
+  const qComputationTreeNodeId currentTreeNode = computationTree.getRootNode();
 
   // Start off with a breadth first search up through some minimum number of
   // plies
@@ -205,6 +383,12 @@ qSearcher::iSearch
 	       player2move,
 	       -min_breadth,
 	       positionsEvaluated);
+    totalPositionsEvaluated += positionsEvaluated;
+  }
+  if (!computationTree.nodeHasChildList(currentTreeNode)) {
+    expandRoot(player2move, positionsEvaluated);
+    totalPositionsEvaluated += positionsEvaluated;
+    computationTree.noteNodeScanned(currentTreeNode, positionsEvaluated);
   }
 
 
@@ -219,15 +403,23 @@ qSearcher::iSearch
     // 1. Has time expired?
     // If hard limit has expired, return best chosen move
     // If soft limit has expired, loosen criteria & continue
-    {
+    // (Or, counting positions instead, have we evaluated enough?)
+    if (max_positions) {
+      if (totalPositionsEvaluated >= max_positions) {
+	cutShort = TRUE;
+	break;
+      }
+    } else {
       guint32 current_time = msTimer.getElapsed();
 
       if (current_time >= stop_time) {
 	stop_time = max_time;
 
 	// If we're beyond the hard max time, just return
-	if (current_time >= stop_time)
+	if (current_time >= stop_time) {
+	  cutShort = TRUE;
 	  break;
+	}
 
 	// We weren't beyond the max time; soften criteria
 	max_complexity = 255;
@@ -241,10 +433,27 @@ qSearcher::iSearch
     bestEval  = computationTree.getNodeEval(bestPosId);
     bestMove  = computationTree.getNodePrecedingMove(bestPosId);
 
+    // Tell anyone watching how it's going (and let them call a halt)
+    if (progressFunc && !max_positions &&
+	(msTimer.getElapsed() >= nextProgressMs)) {
+      qSearchProgress progress;
+
+      progress.elapsedMs          = msTimer.getElapsed();
+      progress.positionsEvaluated = totalPositionsEvaluated;
+      progress.bestMove           = bestMove;
+      progress.bestScore          = bestEval->score;
+      progress.bestComplexity     = bestEval->complexity;
+      nextProgressMs = progress.elapsedMs + SEARCH_PROGRESS_MS;
+      if (!progressFunc(&progress, progressArg)) {
+	cutShort = TRUE;
+	break;
+      }
+    }
+
     // 2. Is top move complexity 0 forced loss for opponent?
     // Yes: make best move
     if (bestEval->score == qScore_lost) {
-      return bestMove;
+      break;
     }
 
     // 3. Is our best option a win for opponent?
@@ -255,7 +464,7 @@ qSearcher::iSearch
       // Find move with most computations
       return move_with_most_computations;
 #endif
-      return bestMove;
+      break;
     }
 
     // 4. Keep thinking if we haven't achieved minimum complexity
@@ -263,10 +472,11 @@ qSearcher::iSearch
       goto analyzeMore;
 
     // 5. Keep thinking if we haven't achieved minimum depth
-    /* How do we test depth???
-     * if (bestEval->depthOfAnalysis < min_depth)
-     *   goto analyzeMore;
-     */
+    // (counting our move on top of the analysis of its result).  A settled
+    // evaluation is as deep as it needs to be; further dives skip it.
+    if (bestEval->complexity &&
+	(static_cast<guint32>(bestEval->depth) + 1 < min_depth))
+      goto analyzeMore;
 
     // 6. Is complexity of all contending moves below some minimum threshold?
     //   Yes: return bestmove; not worth further evaluation
@@ -311,10 +521,7 @@ qSearcher::iSearch
       }
 
       // 5. Among moves in contention, is bestMove only move left?
-      // Yes:
-      //   Have we met minimum depth yet? (How do we know???)
-      //   Yes: return bestMove
-      //   No: Further evaluate best move (How do we implement this???)
+      // Yes: return bestMove (check 5 above saw to minimum depth)
       if (n <= 1) // If we already know about >1 contendor, skip this check
       {  
         const qComputationTreeNodeList *c = computationTree.getNodeChildList(currentTreeNode);
@@ -334,17 +541,64 @@ qSearcher::iSearch
     // If we still didn't find a move to return, do some more thinkin'
   analyzeMore:
 
+    // Stay within the tree's node limit: drop what no longer contends, and
+    // if that isn't enough, settle for what we have
+    if (computationTree.isPruneDue()) {
+      guint32 pruned = computationTree.pruneColdSubtrees();
+
+      pthread_mutex_lock(&statsMutex);
+      stats.treeNodesPruned += pruned;
+      pthread_mutex_unlock(&statsMutex);
+    }
+    if (computationTree.isAtNodeLimit()) {
+      cutShort = TRUE;
+      break;
+    }
+
     /* Make this intelligently determined??? See comment at the
      * scanDeeper decl in qsearcher.h
      */
 #define POSITIONS_PER_DIVE 200
 
-    scanDeeper(moveStack.getPos(),
-	       player2move,
-	       POSITIONS_PER_DIVE,
-	       positionsEvaluated);
+    {
+      guint32 nodesBefore = computationTree.getNumNodes();
+
+      scanDeeper(moveStack.getPos(),
+		 player2move,
+		 POSITIONS_PER_DIVE,
+		 positionsEvaluated);
+      totalPositionsEvaluated += positionsEvaluated;
+
+      // A dive that found nothing new (e.g. the root's own evaluation is
+      // settled, so scanDeeper won't look past it) will find nothing the
+      // next time either; go with what we have rather than spin.
+      if (!positionsEvaluated &&
+	  (computationTree.getNumNodes() == nodesBefore))
+	break;
+    }
+
+    if (treeExporter && treeExportEvery &&
+	(totalPositionsEvaluated >= nextExport)) {
+      treeExporter->putSnapshot(&computationTree, moveStack.getPos(),
+				player2move, totalPositionsEvaluated,
+				msTimer.getElapsed(), FALSE);
+      nextExport = totalPositionsEvaluated + treeExportEvery;
+    }
   }
 
+  if (treeExporter)
+    treeExporter->putSnapshot(&computationTree, moveStack.getPos(),
+			      player2move, totalPositionsEvaluated,
+			      msTimer.getElapsed(), TRUE);
+
+  pthread_mutex_lock(&statsMutex);
+  stats.positionsEvaluated     += totalPositionsEvaluated;
+  stats.lastPositionsEvaluated  = totalPositionsEvaluated;
+  stats.lastElapsedMs           = msTimer.getElapsed();
+  stats.lastCutShort            = cutShort;
+  pthread_mutex_unlock(&statsMutex);
+  sampleStats();
+
   // Time to return our best move
   // Choose "best" move
   // If winning, favor conservative positions; if losing, favor complex
@@ -365,6 +619,86 @@ qSearcher::iSearch
   return bestMove;
 }
 
+void
+qSearcher::getStats
+(qSearcherStats *r_stats) const
+{
+  if (!r_stats)
+    return;
+
+  pthread_mutex_lock(&statsMutex);
+  *r_stats = stats;
+  pthread_mutex_unlock(&statsMutex);
+}
+
+// Only the searching thread may call this; getStats() never looks at the
+// hash or tree itself, since they change under it while a search runs
+void
+qSearcher::sampleStats
+(void)
+{
+  guint32 hashPositions = posHash.getNumElts();
+  guint32 hashBuckets   = posHash.getNumBuckets();
+  guint32 hashRemoved   = posHash.getNumRemoved();
+  guint32 treeNodes     = computationTree.getNumNodes();
+  guint32 treeCapacity  = computationTree.getNodeCapacity();
+
+  pthread_mutex_lock(&statsMutex);
+  stats.hashPositions = hashPositions;
+  stats.hashBuckets   = hashBuckets;
+  stats.hashRemoved   = hashRemoved;
+  stats.treeNodes     = treeNodes;
+  stats.treeCapacity  = treeCapacity;
+  pthread_mutex_unlock(&statsMutex);
+}
+
+void qSearcher::expandRoot
+(qPlayer  player2move,
+ guint32 &r_positionsEvaluated)
+{
+  const qPosition *pos = moveStack.getPos();
+  qPlayer          otherPlayer(player2move.getOtherPlayerId());
+  qPositionInfo   *posInfo;
+  guint32          childPositionsComputed;
+  qMoveList        possible_moves;
+  qMoveListReverseIterator i;
+  const qComputationTreeNodeId currentTreeNode =
+    computationTree.getCurrentNode();
+
+  r_positionsEvaluated = 0;
+  posInfo = findPosInfo(pos);
+  computationTree.setNodePosInfo(currentTreeNode, posInfo);
+
+  // Reverse order, as in iScanDeeper, to keep pawn moves in front
+  getPlayableMoves(pos, &moveStack, &possible_moves);
+  for (i  = possible_moves.rbegin();
+       i != possible_moves.rend();
+       i++)
+    computationTree.addNodeChild(currentTreeNode, *i, positionEval_none);
+
+  qComputationTreeNodeList
+    tmpList(*computationTree.getNodeChildList(currentTreeNode));
+  for (;
+       !tmpList.empty();
+       tmpList.pop_front()) {
+    qComputationTreeNodeId next_position_id = tmpList.front();
+    qMove possible_move =
+      computationTree.getNodePrecedingMove(next_position_id);
+    qPosition newPos = *pos;
+
+    newPos.applyMove(player2move, possible_move);
+    computationTree.setNodePosInfo(next_position_id, findPosInfo(&newPos));
+    moveStack.pushEval(posInfo,
+		       computationTree.getNodePosInfo(next_position_id),
+		       &posHash, player2move, possible_move, &newPos);
+    computationTree.walkDown(next_position_id);
+    scanDeeper(moveStack.getPos(), otherPlayer, 0, childPositionsComputed);
+    r_positionsEvaluated += childPositionsComputed;
+    computationTree.walkUp();
+    moveStack.popEval();
+  }
+}
+
 /* scanDeeper
  */
 const qPositionEvaluation *qSearcher::iScanDeeper
@@ -377,29 +711,46 @@ const qPositionEvaluation *qSearcher::iScanDeeper
   qPositionInfo *posInfo;
   guint32        childPositionsComputed;
   qPlayer otherPlayer=qPlayer(player2move.getOtherPlayerId());
+  // Dives below return the walker here
+  const qComputationTreeNodeId currentTreeNode =
+    computationTree.getCurrentNode();
 
   r_positionsEvaluated = 0;
 
-  // See if there's existing position info stored
+  // See if there's existing position info stored (the tree node carries
+  // it once found, so later visits needn't probe the posHash)
   if (!(posInfo = computationTree.getNodePosInfo(currentTreeNode))) {
-    if (posInfo = posHash.getElt(pos))
-      computationTree.setNodePosInfo(currentTreeNode, posInfo);
+    posInfo = findPosInfo(pos);
+    g_assert(posInfo);
+    computationTree.setNodePosInfo(currentTreeNode, posInfo);
   }
 
-  // Check that we have a posInfo, and that it's not a repeat
-  if (!posInfo)
-    {
-      posInfo = posHash.addElt(pos);
-      g_assert(posInfo);
-      computationTree.setNodePosInfo(currentTreeNode, posInfo);
-    }
-  else
-    {
-      // Check if this position is already in the move stack
-      if (moveStack.isInEvalStack(posInfo, player2move)) {
-	return positionEval_even;
-      }
+  // Check if this position is already in the move stack
+  if (moveStack.isInEvalStack(posInfo, player2move)) {
+    return positionEval_even;
+  }
+
+  // Once at most one player has walls, try solving the position outright
+  // rather than searching it as an ordinary two-player game
+  if (qEndgameSolver::applies(pos) &&
+      !(posInfo->evalExists(player2move) &&
+	(posInfo->getComplexity(player2move) == 0))) {
+    qPositionEvaluation solved;
+    bool                isSolved;
+
+    isSolved = endgameSolver.solve(pos, player2move, &solved);
+    pthread_mutex_lock(&statsMutex);
+    stats.endgameNodes += endgameSolver.getLastNodes();
+    if (isSolved)
+      stats.endgamesSolved++;
+    pthread_mutex_unlock(&statsMutex);
+    if (isSolved) {
+      ++r_positionsEvaluated;
+      posInfo->set(player2move, &solved);
+      publishEval(pos, posInfo, player2move, r_positionsEvaluated);
+      return posInfo->get(player2move);
     }
+  }
 
   // If we're at the end of a search, return the position's existing
   // evalutation (or make one if necessary)
@@ -416,7 +767,8 @@ const qPositionEvaluation *qSearcher::iScanDeeper
 	return positionEval_lost;
       }
       qPositionEvaluation const *rval =
-	ratePositionByComputation(*pos, player2move, posInfo);
+	ratePositionByComputation(*pos, player2move, posInfo,
+				  evalNet, moveStack.getEvalAcc());
       return rval;
     }
   }
@@ -452,16 +804,18 @@ const qPositionEvaluation *qSearcher::iScanDeeper
       // Make sure we've stored the list of moves in computationTree
       if (!computationTree.nodeHasChildList(currentTreeNode)) {
 	qMoveList possible_moves; // Initially empty
+	qWallImpact impact(pos);  // One set of BFS passes for all three
 
 	// Maybe we don't need to verify what moves give legal positions.
 	// ratePositionByComputation does that for us (but is slightly
 	// more costly)
-	getPlayableMoves(pos, &moveStack, &possible_moves);
+	getPlayableMoves(pos, &moveStack, &possible_moves, &impact);
 
 	// Should we prune when doing brute force search???
 	// Doing so blocks us from being 100% thorough for "analysis modes"
 	// We probably won't be using brute force for analysis anyway.
-	pruneUselessMoves(pos, &possible_moves);
+	pruneUselessMoves(pos, &possible_moves, &impact);
+	orderWallMoves(pos, player2move, &possible_moves, &impact);
 
 	// For tied scores addNodeChild adds to the beginning, thus reversing
 	// The order of moves.  Process our moveList in reverse to preserve
@@ -487,18 +841,26 @@ const qPositionEvaluation *qSearcher::iScanDeeper
 	next_position_id = tmpList.front();
 
 	qMove possible_move = computationTree.getNodePrecedingMove(next_position_id);
+	qPositionInfo *nextPosInfo = computationTree.getNodePosInfo(next_position_id);
+	qPosition newPos = *pos;
 
-	moveStack.pushEval(posInfo, computationTree.getNodePosInfo(next_position_id), &posHash, player2move, possible_move, NULL);
-	currentTreeNode = next_position_id;
+	newPos.applyMove(player2move, possible_move);
+	if (!nextPosInfo) {
+	  nextPosInfo = findPosInfo(&newPos);
+	  computationTree.setNodePosInfo(next_position_id, nextPosInfo);
+	}
+	moveStack.pushEval(posInfo, nextPosInfo, &posHash, player2move, possible_move, &newPos);
+	computationTree.walkDown(next_position_id);
 	scanDeeper(moveStack.getPos(), otherPlayer, depth+1, childPositionsComputed);
 	r_positionsEvaluated += childPositionsComputed;
-	currentTreeNode = computationTree.getNodeParent(currentTreeNode);
+	computationTree.walkUp();
 	moveStack.popEval();
       }
       {
 	qCompTreeChildEdgeEvalIterator itor(&computationTree, currentTreeNode);
 	ratePositionFromNeighbors(pos, player2move, posInfo, &itor);
       }
+      publishEval(pos, posInfo, player2move, r_positionsEvaluated);
       return posInfo->get(player2move);
     }
 
@@ -519,12 +881,14 @@ const qPositionEvaluation *qSearcher::iScanDeeper
 	}
 #endif
 	qMoveList possible_moves; // Initially empty
+	qWallImpact impact(pos);
 
 	getCandidateMoves(pos, &moveStack, &possible_moves);
 	g_assert(possible_moves.size() > 0);
 
 	// There should be a way to bypass pruning for analysis mode
-	pruneUselessMoves(pos, &possible_moves);
+	pruneUselessMoves(pos, &possible_moves, &impact);
+	orderWallMoves(pos, player2move, &possible_moves, &impact);
 
 	qMoveListIterator i;
 	for (i  = possible_moves.begin();
@@ -536,17 +900,24 @@ const qPositionEvaluation *qSearcher::iScanDeeper
 	    newPos.applyMove(player2move, possible_move);
 
 	    qPositionEvaluation const *newposEval;
-	    qPositionInfo *newposInfo = posHash.getElt(&newPos);
+	    qPositionInfo *newposInfo = findPosInfo(&newPos);
 
 	    // See if we need to compute an evaluation.
 	    // Use existing evaluations; use even_evaluation for
 	    // cycling back to repeated positions (i.e. positions with
 	    // corresponding player-to-move already in the move stack);
 	    // or compute an evaluation.
-	    if (((newposInfo==NULL) && (newposInfo=posHash.addElt(&newPos))) ||
-		(!newposInfo->evalExists(otherPlayer)))
+	    if (!newposInfo->evalExists(otherPlayer))
 	      {
-		newposEval = ratePositionByComputation(newPos, otherPlayer, newposInfo);
+		qEvalAccumulator newAcc;
+		if (evalNet) {
+		  g_assert(*pos == *moveStack.getPos());
+		  newAcc = *moveStack.getEvalAcc();
+		  evalNet->applyMove(&newAcc, pos, player2move, possible_move);
+		}
+		newposEval = ratePositionByComputation(newPos, otherPlayer,
+						       newposInfo, evalNet,
+						       evalNet ? &newAcc : NULL);
 		if (!newposEval)
 		  continue; // Don't add this position--it wasn't legal
 
@@ -651,11 +1022,11 @@ const qPositionEvaluation *qSearcher::iScanDeeper
 	qMove possible_move =
 	  computationTree.getNodePrecedingMove(contendingMoveId);
 	moveStack.pushEval(posInfo, computationTree.getNodePosInfo(contendingMoveId), &posHash, player2move, possible_move, NULL);
-	currentTreeNode = contendingMoveId;
+	computationTree.walkDown(contendingMoveId);
 	scanDeeper(moveStack.getPos(), otherPlayer, scan_depth, childPositionsComputed);
 	r_positionsEvaluated += childPositionsComputed;
 	depth -= childPositionsComputed;
-	currentTreeNode = computationTree.getNodeParent(currentTreeNode);
+	computationTree.walkUp();
 	moveStack.popEval();
 
 	// Now loop back and re-evaluate the current position's options
@@ -668,6 +1039,7 @@ const qPositionEvaluation *qSearcher::iScanDeeper
     posInfo = ratePositionFromNeighbors(pos, player2move, posInfo,
 			      &itor);
   }
+  publishEval(pos, posInfo, player2move, r_positionsEvaluated);
 
   return posInfo->get(player2move);
 }
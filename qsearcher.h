@@ -11,12 +11,70 @@
 #define INCLUDE_searcher_h 1
 
 
+#include <pthread.h>
 #include "qtypes.h"
 #include "qposition.h"
 #include "qmovstack.h"
 #include "qposinfo.h"
 #include "qposhash.h"
 #include "qcomptree.h"
+#include "qshmtable.h"
+#include "qevaljournal.h"
+#include "qtrace.h"
+#include "qtreeexport.h"
+#include "qendgame.h"
+
+/* qSearcherStats
+ * Running totals kept by each qSearcher, so a long-running engine can be
+ * monitored (see qmetrics.h).  Counters only ever increase over the life
+ * of the searcher; the hash & tree figures are sampled by the searching
+ * thread whenever it finishes a search, think, or move (see getStats()).
+ */
+#define QSTATS_LATENCY_BUCKETS 11
+extern const guint32 qStatsLatencyBucketMs[QSTATS_LATENCY_BUCKETS];
+
+typedef struct _qSearcherStats {
+  guint32 searches;           // calls to search()
+  guint32 thinks;             // calls to think()
+  guint32 overruns;           // searches that took longer than max_time
+  guint64 positionsEvaluated; // new positions examined by search & think
+  guint64 searchMs;           // total time spent in search()
+  guint64 budgetMs;           // total max_time handed to search()
+  guint32 latencyHist[QSTATS_LATENCY_BUCKETS+1]; // search() times; last=+Inf
+  guint32 lastElapsedMs;          // Of the most recent search or think
+  guint32 lastPositionsEvaluated; // Ditto
+  bool    lastCutShort;           // Ditto stopped on time or was halted,
+                                  // not because its criteria were met
+
+  guint32 ponderPredictions;  // moves applied for a player we think()'d for
+  guint32 ponderHits;         // ...which matched the move think() liked best
+  guint64 treeNodesPruned;    // computation tree nodes freed to stay in limit
+  guint32 endgamesSolved;     // positions settled by the endgame solver
+  guint64 endgameNodes;       // positions the endgame solver searched
+
+  // Sampled as of the end of the last search, think, or move
+  guint32 hashPositions;
+  guint32 hashBuckets;
+  guint32 hashRemoved;
+  guint32 treeNodes;
+  guint32 treeCapacity;
+} qSearcherStats;
+
+/* qSearchProgress
+ * Handed to a qSearcher's progress callback every SEARCH_PROGRESS_MS or
+ * so while it searches.  The callback returns FALSE to stop the search
+ * early (which then returns bestMove).
+ */
+typedef struct _qSearchProgress {
+  guint32 elapsedMs;
+  guint32 positionsEvaluated;
+  qMove   bestMove;        // As things stand
+  gint16  bestScore;       // bestMove's evaluation, from the mover's side
+  guint16 bestComplexity;
+} qSearchProgress;
+
+typedef bool (*qSearchProgressFunc)(const qSearchProgress *progress,
+				    void                  *arg);
 
 /* Given a position, searches, within specified constraints, for the
  * best possible move.
@@ -52,22 +110,125 @@ public:
                gint32  max_time,        // Hard limit on our avail. time
 	       gint32  suggested_time); // Start relaxing criteria after this
 
+  // As search(), but stopping after about max_positions new positions
+  // rather than on time.  No clock is consulted (a wall move table being
+  // rebuilt in the background is waited for, & progress isn't reported),
+  // so the same searcher state & arguments always give the same move.
+  // With a shared table, other processes' evaluations can still vary it.
+  qMove searchPositions(qPlayer player2move,
+			guint8  max_complexity,
+			guint8  min_depth,
+			guint8  min_breadth,
+			guint8  slop,
+			guint32 max_positions);
+
   // Adjust qSearcher's stored position with this move
   void applyMove(qMove mv, qPlayer p);
 
+  // Start a "what-if" branch from the current position.  The fork has its
+  // own move stack (with our history, so it can take moves back too) and
+  // computation tree, and sees everything in our posHash copy-on-write: a
+  // position is only copied into the fork's own hash when the fork first
+  // touches it.  Any number of forks may search concurrently, and forks
+  // may themselves be forked, but we must not search or applyMove() while
+  // any of our forks might be searching, and must outlive them all.
+  // The caller deletes the fork.  On multi-socket hosts, fork from the
+  // thread that will search with it, after placing it (see qnuma.h).
+  qSearcher *fork() const;
+
+  // The current position, and whose turn it is, after the moves applied
+  const qPosition *getPos(void) const   { return moveStack.getPos(); };
+  qPlayer          getPlayer2Move(void) const
+    { return moveStack.getPlayer2Move(); };
+
+  // Append the legal moves in the current position to r_moves
+  bool getLegalMoves(qMoveList *r_moves);
+
+  // What we think of the current position with p to move, e.g. after a
+  // search.  Returns FALSE if we've no evaluation for it yet.
+  bool getEvaluation(qPlayer p, qPositionEvaluation *r_eval);
+
+  // Log the search's container operations to tracer (NULL to stop), for
+  // replaying against other implementations; see qtrace.h
+  void setTraceRecorder(qTraceRecorder *tracer);
+
+  // Write the computation tree to exporter (NULL to stop) as each search
+  // (or think()) finishes, and if everyPositions is set, after the first
+  // dive past every everyPositions positions as well; see qtreeexport.h.
+  // The exporter must outlive its use here.  Forks don't inherit it.
+  void setTreeExporter(qTreeExporter *exporter, guint32 everyPositions = 0)
+    { treeExporter = exporter; treeExportEvery = everyPositions; };
+
+  // Cap the computation tree (COMPTREE_MAX_NODES by default); see qcomptree.h
+  void setTreeNodeLimit(guint32 n) { computationTree.setNodeLimit(n); };
+
+  // Have func(progress, arg) called periodically during searches & thinks
+  // (NULL func to stop).  It runs on the searching thread.
+  void setProgressCallback(qSearchProgressFunc func, void *arg)
+    { progressFunc = func; progressArg = arg; };
+
+  // Take back the last move applied.  Everything learned about positions
+  // is kept, so searching again after a takeback starts out warm.
+  // Returns FALSE if there's no move to take back.
+  bool undoMove(void);
+
   // Do a "unit" of thinking (used for bg thinking); use as a service call
   // If specified, "thinkAmount" specifies approximately how many new positions
   // to evaluate.
   void think(qPlayer player2move, gint32 thinkAmount = 10);
 
+  // Copy out running totals.  Safe to call from another thread while a
+  // search is in progress; the hash & tree figures are as of the end of
+  // the last search, think, or move applied or taken back.
+  void getStats(qSearcherStats *r_stats) const;
+
+  // Pool evaluations with other processes through a shared table (or stop,
+  // with NULL).  The table must already be attached, and must outlive its
+  // use here; several qSearchers may share one table object.
+  void setSharedTable(qSharedPositionTable *table) { sharedTable = table; };
+
+  // Persist evaluations worth keeping to a journal, and/or look up
+  // positions new to us in a snapshot compacted from earlier journals
+  // (NULL for neither).  As above, these must outlive their use here.
+  void setEvalJournal(qEvalJournal *journal)  { evalJournal = journal; };
+  void setEvalSnapshot(const qEvalSnapshot *snapshot)
+    { evalSnapshot = snapshot; };
+
+  // Score new positions with net's help as well (NULL to stop); see
+  // qevalnet.h.  It must outlive its use here.  Evaluations already made
+  // are kept, so set it before searching.
+  void setEvalNet(const qEvalNet *net)
+    { evalNet = net; moveStack.setEvalNet(net); };
+
 private:
+  qSearcher(const qSearcher *parent); // For fork()
+
   qPositionInfoHash posHash; // Where we store everything we've thought about
+  qSharedPositionTable *sharedTable; // What other processes thought, or NULL
+  qEvalJournal        *evalJournal;  // Where to persist evaluations, or NULL
+  const qEvalSnapshot *evalSnapshot; // What earlier runs thought, or NULL
+  const qEvalNet      *evalNet;      // Learned eval terms, or NULL
 
    // Where we store what we're thinking about
   qMoveStack   moveStack;
   qComputationTree computationTree;
-  qComputationTreeNodeId currentTreeNode;
   guint8       wallMovesSinceTableUpdate;
+  qWallTableBuilder wallTableBuilder;
+  qEndgameSolver endgameSolver; // For positions w/ at most 1 side's walls
+
+  qSearchProgressFunc progressFunc;
+  void               *progressArg;
+
+  qTreeExporter *treeExporter;    // Where to write the tree, or NULL
+  guint32        treeExportEvery; // Positions between snapshots, or 0
+
+  qSearcherStats stats;        // Guarded by statsMutex
+  mutable pthread_mutex_t statsMutex;
+  qMove          ponderMove;   // What think() last expected ponderPlayer to do
+  qPlayer        ponderPlayer;
+
+  void useRebuiltWallTable(bool wait = FALSE);
+  void sampleStats(void); // Refresh the hash & tree figures in stats
 
   // Internal search routine used by both search() and background searches
   qMove iSearch(qPlayer player2move,     // Which player to find a move for
@@ -76,7 +237,8 @@ private:
 		guint8  min_breadth,     // brute force search this many plies
 		guint8  slop,            // don't need to refine beyond this
 		gint32  max_time,        // Hard limit on our avail. time
-		gint32  suggested_time); // Start relaxing criteria after this
+		gint32  suggested_time,  // Start relaxing criteria after this
+		guint32 max_positions = 0); // If set, instead of the times
 
 
   /* scanDeeper
@@ -103,13 +265,53 @@ private:
                                                      player2move,
                                                      depth,
                                                      r_positionsEvaluated);
-    computationTree.setNodeEval(currentTreeNode, posEval);
+    computationTree.noteNodeScanned(computationTree.getCurrentNode(),
+				    r_positionsEvaluated);
+    computationTree.setNodeEval(computationTree.getCurrentNode(), posEval);
     return posEval;
   };
+  // Seed a posInfo new to posHash from other processes & earlier runs
+  void lookupElsewhere(const qPosition *pos, qPositionInfo *posInfo)
+  {
+    if (evalSnapshot)
+      evalSnapshot->probe(pos, posInfo);
+    if (sharedTable)
+      sharedTable->probe(pos, posInfo);
+  };
+
+  // pos's posInfo, added (and seeded from elsewhere) if it's new.  One
+  // probe of posHash; keep the result (e.g. in the tree node) rather than
+  // calling this again for the same position.
+  qPositionInfo *findPosInfo(const qPosition *pos)
+  {
+    bool           isNew;
+    qPositionInfo *posInfo = posHash.findOrAddElt(pos, &isNew);
+
+    if (isNew)
+      lookupElsewhere(pos, posInfo);
+    return posInfo;
+  };
+
+  // Share & persist a posInfo whose evaluation was just backed up
+  void publishEval(const qPosition *pos, const qPositionInfo *posInfo,
+		   qPlayer player, guint32 effort)
+  {
+    if (sharedTable)
+      sharedTable->store(pos, posInfo);
+    if (evalJournal &&
+	qEvalJournal::isWorthKeeping(posInfo, player, effort))
+      evalJournal->submit(pos, posInfo);
+  };
+
   const qPositionEvaluation *iScanDeeper(const qPosition *pos,
 					qPlayer          player2move,
 					gint32           depth,
 					guint32         &r_positionsEvaluated);
+
+  // Give the root a child (with an evaluation) for every playable move.
+  // scanDeeper won't expand a position posHash already has settled, but
+  // search() still needs the moves to choose from.
+  void expandRoot(qPlayer player2move, guint32 &r_positionsEvaluated);
 };
 
 
@@ -119,8 +321,10 @@ private:
 // It is not an error that an actual pos is put on the stack.
 // ratePositionByComputation() wants a copy on the stack that it can
 // safely alter during its work.
+// With a net, acc is its sums for pos (or NULL to work them out).
 qPositionEvaluation const *ratePositionByComputation
-(qPosition pos, qPlayer player2move, qPositionInfo *posInfo);
+(qPosition pos, qPlayer player2move, qPositionInfo *posInfo,
+ const qEvalNet *net = NULL, const qEvalAccumulator *acc = NULL);
 
 // This is a simple virtual iterator useful for passing around eval iterators
 // corresponding to container classes that hold various types.
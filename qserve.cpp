@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+/* qserve - a minimal engine server for the game protocol (see WIRE_PROTOCOL)
+ *
+ * usage: qserve [-j workers] [-t ms] [-a address] port
+ *   Listens on address (default 127.0.0.1) and plays every connection's
+ *   game, with a qSearcher each, on one qSearchScheduler of workers
+ *   (default 1) search threads.  Each connection gets a thread of its
+ *   own, which does nothing but read, write & wait for the scheduler.
+ *   Moves take up to ms (default 1000), or what the other side asks for
+ *   with "FEATURE,MOVETIME,ms".  The other side picks its color with
+ *   WHITE or BLACK, and NEW starts a game (again).  MOVEs it shouldn't
+ *   have sent get MVERROR.  GETBOARD, SETBOARD and the rest aren't
+ *   handled (CMDERROR).  A line longer than QSERVE_MAX_LINE gets CMDERROR
+ *   and a hang-up.
+ *
+ *   It's what qloadgen is meant to be pointed at, e.g.
+ *     qserve -j 4 -t 200 5555 &
+ *     qloadgen -c 50 -d 30 -T 200 127.0.0.1 5555
+ *   On SIGINT or SIGTERM it prints the scheduler's statistics and exits.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "qio.h"
+#include "qsched.h"
+#include "qsearcher.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+#define QSERVE_NAME           "qserve"
+#define QSERVE_BACKLOG        128
+#define QSERVE_STACK_SIZE     (256*1024) /* Connection threads just do I/O */
+#define QSERVE_MAX_MOVETIME   600000
+#define QSERVE_MAX_LINE       1024 /* Longer, & we hang up */
+#define QSERVE_DEADLINE_SLACK 100  /* ms past the move time we may answer */
+
+// search() criteria other than time
+#define QSERVE_MAX_COMPLEXITY 20
+#define QSERVE_MIN_DEPTH      4
+#define QSERVE_MIN_BREADTH    1
+#define QSERVE_SLOP           3
+
+typedef struct _qServeConn {
+  int          fd;
+  std::string  in, out;
+  qPlayer      ours;      // The color we play
+  qPlayer      toMove;
+  qPosition    pos;
+  bool         playing;   // Since NEW, until someone wins
+  gint32       moveMs;
+  qSearcher   *searcher;
+  qSchedGame  *game;
+  _qServeConn() : pos(&qInitialPosition), searcher(NULL), game(NULL) { ; };
+} qServeConn;
+
+static qSearchScheduler *sched;
+static gint32            defaultMoveMs = 1000;
+static volatile sig_atomic_t stopping = 0;
+
+static void usage()
+{
+  fprintf(stderr, "usage: qserve [-j workers] [-t ms] [-a address] port\n");
+}
+
+static void onSignal
+(int sig)
+{
+  stopping = 1;
+}
+
+/*****
+ * One connection *
+ *****/
+
+static void sendCmd
+(qServeConn *c, const char *name, const char *arg1 = NULL,
+ const char *arg2 = NULL, const char *arg3 = NULL)
+{
+  qWireCommand cmd;
+
+  cmd.push_back(name);
+  if (arg1) cmd.push_back(arg1);
+  if (arg2) cmd.push_back(arg2);
+  if (arg3) cmd.push_back(arg3);
+  qWireFormat(cmd, &c->out);
+}
+
+// Write everything queued; returns FALSE if the connection is gone
+static bool flush
+(qServeConn *c)
+{
+  ssize_t n;
+
+  while (!c->out.empty()) {
+    n = send(c->fd, c->out.data(), c->out.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+	continue;
+      return FALSE;
+    }
+    c->out.erase(0, n);
+  }
+  return TRUE;
+}
+
+static void endGame
+(qServeConn *c)
+{
+  if (c->game)
+    sched->cancel(c->game);
+  delete c->game;
+  delete c->searcher;
+  c->game     = NULL;
+  c->searcher = NULL;
+  c->playing  = FALSE;
+}
+
+static void newGame
+(qServeConn *c)
+{
+  endGame(c);
+  c->pos      = qInitialPosition;
+  c->toMove   = qPlayer_white;
+  c->searcher = new qSearcher(&c->pos, c->toMove);
+  c->game     = new qSchedGame(c->searcher);
+  c->playing  = TRUE;
+}
+
+static bool gameOver
+(qServeConn *c)
+{
+  return c->pos.isWhiteWon() || c->pos.isBlackWon();
+}
+
+// Search for & send our move.  Returns FALSE if we've none to send.
+static bool sendMove
+(qServeConn *c)
+{
+  char  notation[QWIRE_MOVE_LEN], walls[4];
+  qMove mv;
+
+  // Send what we have first, e.g. a NEW,CONFIRMED, so it isn't timed
+  // against our move
+  if (!flush(c) ||
+      !sched->request(c->game, c->ours, QSERVE_MAX_COMPLEXITY,
+		      QSERVE_MIN_DEPTH, QSERVE_MIN_BREADTH, QSERVE_SLOP,
+		      c->moveMs, c->moveMs / 2,
+		      c->moveMs + QSERVE_DEADLINE_SLACK))
+    return FALSE;
+  mv = sched->wait(c->game);
+  if (!qWireMoveToNotation(&c->pos, c->ours, mv, notation) ||
+      !qWireIsLegal(&c->pos, c->ours, mv)) {
+    sendCmd(c, "ERROR", "no move found");
+    return FALSE;
+  }
+
+  c->searcher->applyMove(mv, c->ours);
+  c->pos.applyMove(c->ours, mv);
+  c->toMove.changePlayer();
+  snprintf(walls, sizeof(walls), "%u", c->pos.numWallsLeft(c->ours));
+  sendCmd(c, "MOVE", qWirePlayerName(c->ours), notation, walls);
+  if (gameOver(c))
+    c->playing = FALSE;
+  return TRUE;
+}
+
+// Returns FALSE to hang up
+static bool handleCmd
+(qServeConn *c, const qWireCommand &cmd)
+{
+  const std::string &name = cmd[0];
+  const char        *arg1 = (cmd.size() > 1) ? cmd[1].c_str() : "";
+
+  if (name == "MOVE") {
+    qPlayer theirs = c->ours.otherPlayer();
+    const char *notation = (cmd.size() > 2) ? cmd[2].c_str() : "";
+    qMove   mv;
+
+    if (!c->playing || (cmd.size() < 3) ||
+	(cmd[1] != qWirePlayerName(theirs)) ||
+	(c->toMove.isWhite() != theirs.isWhite()) ||
+	!qWireNotationToMove(&c->pos, theirs, notation, &mv) ||
+	!qWireIsLegal(&c->pos, theirs, mv)) {
+      sendCmd(c, "MVERROR", "illegal move", notation);
+      return TRUE;
+    }
+    c->searcher->applyMove(mv, theirs);
+    c->pos.applyMove(theirs, mv);
+    c->toMove.changePlayer();
+    if (gameOver(c)) {
+      c->playing = FALSE;
+      return TRUE;
+    }
+    return sendMove(c);
+  }
+
+  if (name == "NEW") {
+    if (!strcmp(arg1, "CONFIRMED")) // Ours was confirmed; nothing to do
+      return TRUE;
+    newGame(c);
+    sendCmd(c, "NEW", "CONFIRMED");
+    if (c->ours.isWhite())
+      return sendMove(c);
+    return TRUE;
+  }
+
+  if (name == "WHITE" || name == "BLACK") {
+    // They pick their color; we take the other
+    c->ours = qPlayer((name == "WHITE") ? qPlayer::BlackPlayer :
+		      qPlayer::WhitePlayer);
+    return TRUE;
+  }
+
+  if (name == "FEATURE") {
+    long ms = (cmd.size() > 2) ? strtol(cmd[2].c_str(), NULL, 10) : 0;
+
+    if (!strcmp(arg1, "MOVETIME") && (ms > 0) && (ms <= QSERVE_MAX_MOVETIME)) {
+      c->moveMs = ms;
+      sendCmd(c, "ACCEPTED", arg1);
+    } else
+      sendCmd(c, "REJECTED", arg1);
+    return TRUE;
+  }
+
+  if (name == "HELLO") {
+    sendCmd(c, "HELLO", QSERVE_NAME);
+    return TRUE;
+  }
+  if (name == "PROTOVER") {
+    sendCmd(c, "PROTOVER", QWIRE_PROTOVER);
+    return TRUE;
+  }
+  if (name == "PING") {
+    sendCmd(c, "PONG", arg1);
+    return TRUE;
+  }
+  if (name == "QUIT")
+    return FALSE;
+  if ((name == "ACCEPTED") || (name == "REJECTED") || (name == "PONG") ||
+      (name == "MVERROR") || (name == "ERROR") || (name == "CMDERROR") ||
+      (name == "GAMESTATE"))
+    return TRUE;
+
+  sendCmd(c, "CMDERROR", "unknown command", name.c_str());
+  return TRUE;
+}
+
+static void *connMain
+(void *arg)
+{
+  qServeConn  *c = (qServeConn *)arg;
+  char         buf[4096];
+  ssize_t      n;
+  size_t       start, nl;
+  qWireCommand cmd;
+  bool         ok = TRUE;
+
+  while (ok && ((n = recv(c->fd, buf, sizeof(buf), 0)) != 0)) {
+    if (n < 0) {
+      if (errno == EINTR)
+	continue;
+      break;
+    }
+    c->in.append(buf, n);
+    for (start = 0;
+	 ok && ((nl = c->in.find('\n', start)) != std::string::npos);
+	 start = nl + 1) {
+      if (!qWireParse(c->in.data() + start, nl - start, &cmd)) {
+	if (nl != start) // Blank lines (or a '\0' separator) are nothing
+	  sendCmd(c, "CMDERROR", "unreadable command");
+	continue;
+      }
+      ok = handleCmd(c, cmd);
+    }
+    c->in.erase(0, start);
+    // No command comes close, so a peer that never ends its line is
+    // only filling our memory
+    if (ok && (c->in.size() > QSERVE_MAX_LINE)) {
+      sendCmd(c, "CMDERROR", "line too long");
+      ok = FALSE;
+    }
+    ok = flush(c) && ok;
+  }
+
+  endGame(c);
+  close(c->fd);
+  delete c;
+  return NULL;
+}
+
+/*****
+ * Listening *
+ *****/
+
+static int listenOn
+(const char *address, const char *port)
+{
+  struct addrinfo hints, *addr;
+  int             fd, one = 1, rval;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags    = AI_PASSIVE;
+  if ((rval = getaddrinfo(address, port, &hints, &addr))) {
+    fprintf(stderr, "qserve: %s port %s: %s\n",
+	    address, port, gai_strerror(rval));
+    return -1;
+  }
+  fd = socket(addr->ai_family, SOCK_STREAM, 0);
+  if ((fd < 0) ||
+      (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0) ||
+      (bind(fd, addr->ai_addr, addr->ai_addrlen) < 0) ||
+      (listen(fd, QSERVE_BACKLOG) < 0)) {
+    perror("qserve: listen");
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addr);
+  return fd;
+}
+
+int main(int argc, char **argv)
+{
+  const char        *address = "127.0.0.1";
+  struct sigaction   sa;
+  pthread_attr_t     attr;
+  pthread_t          tid;
+  qSchedStats        st;
+  int                c, fd, lfd, numWorkers = 1, one = 1;
+
+  while ((c = getopt(argc, argv, "j:t:a:")) != -1) {
+    switch (c) {
+    case 'j': numWorkers    = atoi(optarg);                 break;
+    case 't': defaultMoveMs = strtol(optarg, NULL, 10);     break;
+    case 'a': address       = optarg;                       break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if ((optind + 1 != argc) || (numWorkers < 1) || (defaultMoveMs <= 0) ||
+      (defaultMoveMs > QSERVE_MAX_MOVETIME)) {
+    usage();
+    return 2;
+  }
+
+  if ((lfd = listenOn(address, argv[optind])) < 0)
+    return 1;
+
+  // No SA_RESTART, so accept() comes back to see we're stopping
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onSignal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  sched = new qSearchScheduler(numWorkers);
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, QSERVE_STACK_SIZE);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  while (!stopping) {
+    if ((fd = accept(lfd, NULL, NULL)) < 0) {
+      if ((errno != EINTR) && (errno != ECONNABORTED))
+	perror("qserve: accept");
+      continue;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    qServeConn *conn = new qServeConn;
+    conn->fd      = fd;
+    conn->ours    = qPlayer_black;
+    conn->toMove  = qPlayer_white;
+    conn->playing = FALSE;
+    conn->moveMs  = defaultMoveMs;
+    if (pthread_create(&tid, &attr, connMain, conn)) {
+      perror("qserve: pthread_create");
+      close(fd);
+      delete conn;
+    }
+  }
+
+  // Connections still open are dropped with the process
+  close(lfd);
+  sched->getStats(&st);
+  printf("%u requests  %u answered  %u late  %u cut  %u slices  "
+	 "%u overloaded  %.1f s CPU\n",
+	 st.requests, st.answered, st.late, st.cut, st.slices,
+	 st.overloads, st.cpuUs / 1e6);
+  return 0;
+}
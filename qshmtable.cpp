@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+
+#include "qshmtable.h"
+#include <string.h>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+IDSTR("$Id$");
+
+
+/****/
+
+#define QSHM_MAGIC   0x71736874 /* "qsht" */
+#define QSHM_VERSION 1
+
+// How long to wait for whoever created a segment to finish setting it up
+#define QSHM_ATTACH_RETRIES 200
+#define QSHM_ATTACH_SLEEP_US 5000
+
+static inline void packKey
+(const qPosition *pos, guint32 *key)
+{
+  key[QSHM_KEY_WORDS-1] = 0; // Zero the padding past the position's end
+  memcpy(key, pos, sizeof(*pos));
+}
+
+// Packed form of positionEval_none, meaning "no evaluation for this player"
+static inline guint32 packedNone()
+{ return qPackEval(positionEval_none); }
+
+// The check word for an entry whose words XOR to x.  0 is reserved for
+// "unused", so an entry that happens to XOR to 0 is checked as 1; store and
+// probe must both fold it the same way or such an entry could never be read.
+static inline guint32 checkWord(guint32 x)
+{ return x ? x : 1; }
+
+
+/******************************
+ * class qSharedPositionTable *
+ ******************************/
+qSharedPositionTable::qSharedPositionTable()
+  :header(NULL), entries(NULL), numEntries(0), mapSize(0)
+{ ; }
+
+qSharedPositionTable::~qSharedPositionTable()
+{
+  detach();
+}
+
+bool qSharedPositionTable::attach
+(const char *name, guint32 nEntries)
+{
+  bool   created = FALSE;
+  int    fd;
+  struct stat st;
+
+  if (isAttached() || !name)
+    return FALSE;
+
+  // Round down to a whole number of buckets
+  nEntries -= nEntries % QSHM_BUCKET_ENTRIES;
+
+  fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+  if (fd >= 0) {
+    // (Divided, not multiplied, so a 32-bit size_t can't wrap)
+    if ((nEntries == 0) ||
+	(nEntries > (static_cast<size_t>(-1) - sizeof(qShmHeader)) /
+	 sizeof(qShmEntry))) {
+      close(fd);
+      shm_unlink(name);
+      return FALSE;
+    }
+    mapSize = sizeof(qShmHeader) + nEntries*sizeof(qShmEntry);
+    if (ftruncate(fd, mapSize) < 0) { // Zero-fills, so all entries unused
+      close(fd);
+      shm_unlink(name);
+      return FALSE;
+    }
+    created = TRUE;
+  } else if (errno == EEXIST) {
+    int tries;
+
+    if ((fd = shm_open(name, O_RDWR, 0600)) < 0)
+      return FALSE;
+
+    // The creator may still be sizing it
+    for (tries = 0; tries < QSHM_ATTACH_RETRIES; ++tries) {
+      if ((fstat(fd, &st) == 0) &&
+	  (st.st_size > static_cast<off_t>(sizeof(qShmHeader))))
+	break;
+      usleep(QSHM_ATTACH_SLEEP_US);
+    }
+    if (tries == QSHM_ATTACH_RETRIES) {
+      close(fd);
+      return FALSE;
+    }
+    mapSize = st.st_size;
+  } else
+    return FALSE;
+
+  void *map = mmap(NULL, mapSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return FALSE;
+  header = static_cast<qShmHeader*>(map);
+
+  if (created) {
+    header->version    = QSHM_VERSION;
+    header->numEntries = nEntries;
+    header->entrySize  = sizeof(qShmEntry);
+    __sync_synchronize();
+    header->magic      = QSHM_MAGIC; // Last, so attachers know we're ready
+  } else {
+    int tries;
+    for (tries = 0; tries < QSHM_ATTACH_RETRIES; ++tries) {
+      if (*(volatile guint32*)&header->magic == QSHM_MAGIC)
+	break;
+      usleep(QSHM_ATTACH_SLEEP_US);
+    }
+    __sync_synchronize();
+    if ((header->magic      != QSHM_MAGIC)        ||
+	(header->version    != QSHM_VERSION)      ||
+	(header->entrySize  != sizeof(qShmEntry)) ||
+	(header->numEntries >
+	 (mapSize - sizeof(qShmHeader)) / sizeof(qShmEntry))) {
+      munmap(map, mapSize);
+      header = NULL;
+      return FALSE;
+    }
+  }
+
+  numEntries = header->numEntries;
+  entries    = reinterpret_cast<volatile qShmEntry*>(header + 1);
+  return TRUE;
+}
+
+void qSharedPositionTable::detach()
+{
+  if (header)
+    munmap(header, mapSize);
+  header     = NULL;
+  entries    = NULL;
+  numEntries = 0;
+  mapSize    = 0;
+}
+
+bool qSharedPositionTable::destroy
+(const char *name)
+{
+  return (shm_unlink(name) == 0);
+}
+
+volatile qShmEntry *qSharedPositionTable::getBucket
+(const guint32 *key) const
+{
+  // FNV-1a over the key words.  qPosition::hashFunc() is tuned for a
+  // 16-bit bucket count, and we want every bit of a 32-bit index.
+  guint32 h = 2166136261U;
+  unsigned int i;
+  for (i = 0; i < QSHM_KEY_WORDS; ++i) {
+    h ^= key[i];
+    h *= 16777619U;
+  }
+  h ^= h>>15;
+  return &entries[(h % (numEntries/QSHM_BUCKET_ENTRIES)) * QSHM_BUCKET_ENTRIES];
+}
+
+bool qSharedPositionTable::probe
+(const qPosition *pos, qPositionInfo *posInfo) const
+{
+  guint32 key[QSHM_KEY_WORDS];
+  guint32 data[QSHM_DATA_WORDS];
+  int     e;
+  unsigned int i;
+
+  if (!entries || !pos || !posInfo)
+    return FALSE;
+
+  packKey(pos, key);
+  volatile qShmEntry *bucket = getBucket(key);
+
+  for (e = 0; e < QSHM_BUCKET_ENTRIES; ++e) {
+    volatile qShmEntry *ent = &bucket[e];
+    guint32 check = 0;
+    bool    match = TRUE;
+
+    // Copy out first, then validate the copy
+    for (i = 0; i < QSHM_KEY_WORDS; ++i) {
+      guint32 w = ent->key[i];
+      check ^= w;
+      if (w != key[i])
+	match = FALSE;
+    }
+    if (!match)
+      continue;
+    for (i = 0; i < QSHM_DATA_WORDS; ++i)
+      check ^= (data[i] = ent->data[i]);
+    if (checkWord(check) != ent->check)
+      continue; // Torn or unused
+
+    bool copied = FALSE;
+    for (gint8 p = qPlayer::WhitePlayer; p <= qPlayer::BlackPlayer; ++p) {
+      qPlayer player(p);
+      qPositionEvaluation shared;
+
+      if (data[p] == packedNone())
+	continue;
+      qUnpackEval(data[p], &shared);
+      if (!posInfo->evalExists(player) ||
+	  (shared.complexity < posInfo->getComplexity(player))) {
+	posInfo->set(player, &shared);
+	copied = TRUE;
+      }
+    }
+    return copied;
+  }
+  return FALSE;
+}
+
+void qSharedPositionTable::store
+(const qPosition *pos, const qPositionInfo *posInfo)
+{
+  guint32 key[QSHM_KEY_WORDS];
+  guint32 data[QSHM_DATA_WORDS];
+  volatile qShmEntry *victim = NULL;
+  guint32 victimComplexity = 0;
+  int     e;
+  unsigned int i;
+
+  if (!entries || !pos || !posInfo || !posInfo->isPosLegal())
+    return;
+
+  packKey(pos, key);
+  for (gint8 p = qPlayer::WhitePlayer; p <= qPlayer::BlackPlayer; ++p) {
+    qPositionEvaluation eval;
+    eval.score      = posInfo->getScore(qPlayer(p));
+    eval.complexity = posInfo->getComplexity(qPlayer(p));
+    data[p] = qPackEval(&eval);
+  }
+  if ((data[0] == packedNone()) && (data[1] == packedNone()))
+    return;
+
+  volatile qShmEntry *bucket = getBucket(key);
+
+  // Pick a slot: ours, else an empty one, else the least settled
+  for (e = 0; e < QSHM_BUCKET_ENTRIES; ++e) {
+    volatile qShmEntry *ent = &bucket[e];
+    bool match = TRUE;
+
+    for (i = 0; i < QSHM_KEY_WORDS; ++i)
+      if (ent->key[i] != key[i]) {
+	match = FALSE;
+	break;
+      }
+    if (match && ent->check) {
+      // Keep the other player's eval if we don't have one for him
+      for (i = 0; i < QSHM_DATA_WORDS; ++i)
+	if (data[i] == packedNone())
+	  data[i] = ent->data[i];
+      victim = ent;
+      break;
+    }
+    if (!ent->check) {
+      if (!victim || victimComplexity != G_MAXUINT32) {
+	victim = ent;
+	victimComplexity = G_MAXUINT32; // Unused beats anything in use
+      }
+      continue;
+    }
+    if (victimComplexity == G_MAXUINT32)
+      continue;
+
+    guint32 c = std::min(ent->data[0] & 0xffff, ent->data[1] & 0xffff);
+    if (!victim || (c > victimComplexity)) {
+      victim = ent;
+      victimComplexity = c;
+    }
+  }
+
+  // Write everything, then the check word.  Anyone reading meanwhile will
+  // see the check fail and call it a miss.
+  guint32 check = 0;
+  for (i = 0; i < QSHM_KEY_WORDS; ++i)
+    check ^= (victim->key[i] = key[i]);
+  for (i = 0; i < QSHM_DATA_WORDS; ++i)
+    check ^= (victim->data[i] = data[i]);
+  victim->check = checkWord(check);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_shmtable_h
+#define INCLUDE_shmtable_h 1
+
+#include "qtypes.h"
+#include "qposition.h"
+#include "qposinfo.h"
+
+/* qSharedPositionTable
+ * A fixed-size table of position evaluations living in a POSIX shared
+ * memory segment, so several engine processes on one host can pool what
+ * they've learned.  It sits beside each process's qPositionInfoHash rather
+ * than replacing it: the hash still holds per-process state (such as the
+ * "under evaluation" flags qMoveStack sets), and the shared table is only
+ * consulted when a position is new to the hash, and fed whenever a
+ * position's evaluation gets backed up from its neighbors.
+ *
+ * There are no pointers in the segment and no locks.  Each entry carries a
+ * check word that is the XOR of all its other words (or 1, should that
+ * come out as 0, which marks an unused entry).  Writers just write
+ * the words and then the check word; a reader that catches an entry half
+ * written (or written by two processes at once) sees the check fail and
+ * treats it as a miss.  Losing the odd entry this way is harmless.
+ *
+ * Entries are grouped into buckets of QSHM_BUCKET_ENTRIES.  A store goes
+ * to the entry already holding the position, else an empty one, else it
+ * evicts the entry whose evaluations are least settled (highest
+ * complexity).
+ */
+#define QSHM_BUCKET_ENTRIES 4
+#define QSHM_KEY_WORDS      ((sizeof(qPosition)+3)/4)
+#define QSHM_DATA_WORDS     2
+
+typedef struct _qShmEntry {
+  guint32 key[QSHM_KEY_WORDS];   // The qPosition, byte for byte
+  guint32 data[QSHM_DATA_WORDS]; // [player]: score<<16 | complexity
+  guint32 check;                 // XOR of all the above (never 0); 0 if unused
+} qShmEntry;
+
+class qSharedPositionTable {
+ public:
+  qSharedPositionTable();
+  ~qSharedPositionTable(); // Detaches, but leaves the segment for others
+
+  // Attach to the named segment (e.g. "/deepquor"), creating it with room
+  // for numEntries positions if it doesn't exist yet.  numEntries is
+  // ignored when attaching to an existing segment.
+  bool attach(const char *name, guint32 numEntries);
+  void detach();
+  bool isAttached() const { return (entries != NULL); };
+
+  // Remove the named segment once every process has detached
+  static bool destroy(const char *name);
+
+  // Copy into posInfo any shared evaluation that is better settled (lower
+  // complexity) than what posInfo has.  Returns TRUE if anything was copied.
+  bool probe(const qPosition *pos, qPositionInfo *posInfo) const;
+
+  // Publish whatever evaluations posInfo has for pos.
+  void store(const qPosition *pos, const qPositionInfo *posInfo);
+
+  guint32 getNumEntries() const { return numEntries; };
+
+ private:
+  typedef struct _qShmHeader {
+    guint32 magic;
+    guint32 version;
+    guint32 numEntries;
+    guint32 entrySize;
+  } qShmHeader;
+
+  qShmHeader         *header;
+  volatile qShmEntry *entries;
+  guint32             numEntries;
+  size_t              mapSize;
+
+  volatile qShmEntry *getBucket(const guint32 *key) const;
+};
+
+#endif // INCLUDE_shmtable_h
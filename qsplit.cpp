@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+/* qsplit - search with several engine processes (see qrootsplit.h)
+ *
+ * usage: qsplit serve socket-path
+ *   Be a worker, listening on a UNIX-domain socket at socket-path, e.g.
+ *   in a container that shares the socket's directory with the
+ *   coordinator's.  Serves one coordinator at a time, forever.
+ *
+ * usage: qsplit analyze [-w workers] [-s socket-path]... [-t ms] [-n moves]
+ *   Play n moves (default 4) from the starting position, searching each
+ *   for up to ms (default 10000) with the given number of forked workers
+ *   (default 2, unless -s is given) plus a worker at each socket-path, and
+ *   report how each search went.
+ *
+ * usage: qsplit repro [-j threads] [-N positions] [-n moves]
+ *   As analyze, but with a qThreadSplitter (see qthreadsplit.h) on the
+ *   given number of threads (default 2), each search stopping after about
+ *   positions (default 200000) new positions.  The report, down to the
+ *   digest of every move & evaluation at the end, is the same whatever the
+ *   number of threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "qrootsplit.h"
+#include "qthreadsplit.h"
+#include "qnuma.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+// search() criteria other than time
+#define QSPLIT_MAX_COMPLEXITY 20
+#define QSPLIT_MIN_DEPTH      4
+#define QSPLIT_MIN_BREADTH    1
+#define QSPLIT_SLOP           3
+
+static void usage()
+{
+  fprintf(stderr,
+	  "usage: qsplit serve socket-path\n"
+	  "       qsplit analyze [-w workers] [-s socket-path]... [-t ms] [-n moves]\n"
+	  "       qsplit repro [-j threads] [-N positions] [-n moves]\n");
+}
+
+static int serve
+(int argc, char **argv)
+{
+  if (argc != 2) {
+    usage();
+    return 2;
+  }
+  qRootSplitListen(argv[1]);
+  fprintf(stderr, "qsplit: can't listen on %s\n", argv[1]);
+  return 1;
+}
+
+static int analyze
+(int argc, char **argv)
+{
+  std::vector<const char *> paths;
+  qRootSplitter splitter;
+  qPosition     pos(&qInitialPosition);
+  qPlayer       player(qPlayer_white);
+  int           numWorkers = -1, c;
+  gint32        ms = 10000;
+  guint32       moves = 4, n, i;
+
+  while ((c = getopt(argc, argv, "w:s:t:n:")) != -1) {
+    switch (c) {
+    case 'w': numWorkers = atoi(optarg);              break;
+    case 's': paths.push_back(optarg);                break;
+    case 't': ms         = atoi(optarg);              break;
+    case 'n': moves      = strtoul(optarg, NULL, 10); break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if (optind != argc) {
+    usage();
+    return 2;
+  }
+  if (numWorkers < 0)
+    numWorkers = paths.empty() ? 2 : 0;
+
+  // Fork before anything else starts a thread
+  if (splitter.startWorkers(numWorkers) != numWorkers) {
+    fprintf(stderr, "qsplit: couldn't start %d workers\n", numWorkers);
+    return 1;
+  }
+  for (i = 0; i < paths.size(); ++i)
+    if (!splitter.connectWorker(paths[i])) {
+      fprintf(stderr, "qsplit: can't reach a worker at %s\n", paths[i]);
+      return 1;
+    }
+  printf("%d workers\n", splitter.getNumWorkers());
+
+  for (n = 0; n < moves; ++n) {
+    qMove mv = splitter.search(&pos, player,
+			       QSPLIT_MAX_COMPLEXITY,
+			       QSPLIT_MIN_DEPTH,
+			       QSPLIT_MIN_BREADTH,
+			       QSPLIT_SLOP,
+			       ms);
+    const qPositionEvaluation *eval = splitter.getBestEval();
+
+    printf("%2u: move %02x  score %6d  complexity %5u  depth %3u  "
+	   "%3u rounds  %8llu positions\n",
+	   n, mv.getEncoding(), eval->score, eval->complexity, eval->depth,
+	   splitter.getNumRounds(),
+	   static_cast<unsigned long long>(splitter.getPositionsEvaluated()));
+    pos.applyMove(player, mv);
+    player.changePlayer();
+    if (pos.isWon(qPlayer_white) || pos.isWon(qPlayer_black))
+      break;
+  }
+  return 0;
+}
+
+static int repro
+(int argc, char **argv)
+{
+  // Every lane reads through to root's hash, so spread it over the nodes
+  // rather than have them all reach into this one's
+  qNuma::interleaveThreadMemory();
+
+  qSearcher root;
+  qPlayer   player(qPlayer_white);
+  int       numThreads = 2, c;
+  guint64   positions = 200000;
+  guint64   digest = 14695981039346656037ULL; // FNV-1a
+  guint32   moves = 4, n;
+
+  while ((c = getopt(argc, argv, "j:N:n:")) != -1) {
+    switch (c) {
+    case 'j': numThreads = atoi(optarg);                break;
+    case 'N': positions  = strtoull(optarg, NULL, 10); break;
+    case 'n': moves      = strtoul(optarg, NULL, 10);  break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if ((optind != argc) || !positions) {
+    usage();
+    return 2;
+  }
+
+  qThreadSplitter splitter(numThreads);
+
+  for (n = 0; n < moves; ++n) {
+    qMove mv = splitter.search(&root, player,
+			       QSPLIT_MAX_COMPLEXITY,
+			       QSPLIT_MIN_DEPTH,
+			       QSPLIT_MIN_BREADTH,
+			       QSPLIT_SLOP,
+			       positions);
+    const qPositionEvaluation *eval = splitter.getBestEval();
+    guint32 fields[4];
+
+    printf("%2u: move %02x  score %6d  complexity %5u  depth %3u  "
+	   "%3u rounds  %8llu positions\n",
+	   n, mv.getEncoding(), eval->score, eval->complexity, eval->depth,
+	   splitter.getNumRounds(),
+	   static_cast<unsigned long long>(splitter.getPositionsEvaluated()));
+    fields[0] = mv.getEncoding();
+    fields[1] = eval->score;
+    fields[2] = eval->complexity;
+    fields[3] = eval->depth;
+    for (c = 0; c < 4 * 4; ++c) {
+      digest ^= (fields[c / 4] >> (8 * (c % 4))) & 0xff;
+      digest *= 1099511628211ULL;
+    }
+
+    if (!mv.exists())
+      break;
+    root.applyMove(mv, player);
+    player.changePlayer();
+    if (root.getPos()->isWon(qPlayer_white) ||
+	root.getPos()->isWon(qPlayer_black))
+      break;
+  }
+  printf("digest %016llx\n", static_cast<unsigned long long>(digest));
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+
+  // Let getopt see the subcommand's options
+  if (!strcmp(argv[1], "serve"))
+    return serve(argc - 1, argv + 1);
+  if (!strcmp(argv[1], "analyze"))
+    return analyze(argc - 1, argv + 1);
+  if (!strcmp(argv[1], "repro"))
+    return repro(argc - 1, argv + 1);
+
+  usage();
+  return 2;
+}
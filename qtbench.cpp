@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+/* qtbench - record search traces, and time the containers replaying them
+ *
+ * usage: qtbench record [-t ms] [-n moves] [-c corpus [-m max]] trace-file
+ *   Searches for ms (default 2000) per move and records every container
+ *   operation to trace-file.  Without a corpus, it plays itself for n moves
+ *   (default 4) from the starting position; with one (see qgencorpus), it
+ *   searches once from each of the first max positions (default 10).
+ *
+ * usage: qtbench replay [-r repeats] trace-file
+ *   Replays the trace against our own containers, each on its own and then
+ *   all together, and reports the best time of repeats (default 3) runs.
+ *   To benchmark a rewrite, give qTraceReplayer a qTraceTarget built on it
+ *   and compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "qsearcher.h"
+#include "qcorpus.h"
+#include "qtrace.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+// search() criteria other than time
+#define QTBENCH_MAX_COMPLEXITY 20
+#define QTBENCH_MIN_DEPTH      4
+#define QTBENCH_MIN_BREADTH    1
+#define QTBENCH_SLOP           3
+
+static void usage()
+{
+  fprintf(stderr,
+	  "usage: qtbench record [-t ms] [-n moves] [-c corpus [-m max]] trace-file\n"
+	  "       qtbench replay [-r repeats] trace-file\n");
+}
+
+static qMove searchFor
+(qSearcher *s, gint32 ms)
+{
+  return s->search(s->getPlayer2Move(),
+		   QTBENCH_MAX_COMPLEXITY,
+		   QTBENCH_MIN_DEPTH,
+		   QTBENCH_MIN_BREADTH,
+		   QTBENCH_SLOP,
+		   ms,
+		   ms);
+}
+
+static int record
+(int argc, char **argv)
+{
+  qTraceRecorder tracer;
+  const char    *corpusPath = NULL;
+  gint32         ms = 2000;
+  guint32        moves = 4, max = 10, n;
+  int            c;
+
+  while ((c = getopt(argc, argv, "t:n:c:m:")) != -1) {
+    switch (c) {
+    case 't': ms         = atoi(optarg);              break;
+    case 'n': moves      = strtoul(optarg, NULL, 10); break;
+    case 'c': corpusPath = optarg;                    break;
+    case 'm': max        = strtoul(optarg, NULL, 10); break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    usage();
+    return 2;
+  }
+  if (!tracer.open(argv[optind])) {
+    fprintf(stderr, "qtbench: can't create %s\n", argv[optind]);
+    return 1;
+  }
+
+  if (!corpusPath) {
+    qSearcher searcher;
+
+    searcher.setTraceRecorder(&tracer);
+    for (n = 0; n < moves; ++n) {
+      qPlayer p = searcher.getPlayer2Move();
+      searcher.applyMove(searchFor(&searcher, ms), p);
+    }
+    searcher.setTraceRecorder(NULL);
+  } else {
+    qCorpusReader corpus;
+    qPosition     pos(&qInitialPosition);
+    qPlayer       player;
+
+    if (!corpus.open(corpusPath)) {
+      fprintf(stderr, "qtbench: can't read corpus %s\n", corpusPath);
+      return 1;
+    }
+    for (n = 0; (n < max) && corpus.next(&pos, &player, NULL); ++n) {
+      qSearcher searcher(&pos, player);
+
+      searcher.setTraceRecorder(&tracer);
+      searchFor(&searcher, ms);
+      searcher.setTraceRecorder(NULL);
+    }
+    moves = n;
+  }
+
+  printf("%s: %llu operations over %u searches\n", argv[optind],
+	 static_cast<unsigned long long>(tracer.getNumOps()), moves);
+  if (!tracer.close()) {
+    fprintf(stderr, "qtbench: error writing %s\n", argv[optind]);
+    return 1;
+  }
+  return 0;
+}
+
+static const char *opNames[qTrace_numOps] = {
+  NULL, "hashGet", "hashAdd", "hashRm", "treeInit", "treeAdd", "treeSetEval",
+  "treeRemove", "treeSort", "treePrune", "stackBase", "stackPush", "stackPop"
+};
+
+static int replay
+(int argc, char **argv)
+{
+  static const struct {
+    const char *name;
+    int         containers;
+  } runs[] = {
+    { "hash",  QTRACE_HASH },
+    { "tree",  QTRACE_TREE },
+    { "stack", QTRACE_STACK },
+    { "all",   QTRACE_ALL }
+  };
+  std::vector<qTraceOp> ops;
+  qTraceReader reader;
+  int          repeats = 3, c, r, t;
+  unsigned int i;
+
+  while ((c = getopt(argc, argv, "r:")) != -1) {
+    switch (c) {
+    case 'r': repeats = atoi(optarg); break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if ((optind != argc - 1) || (repeats < 1)) {
+    usage();
+    return 2;
+  }
+  if (!reader.open(argv[optind])) {
+    fprintf(stderr, "qtbench: can't read trace %s\n", argv[optind]);
+    return 1;
+  }
+  reader.readAll(&ops);
+  printf("%s: %lu operations\n", argv[optind],
+	 static_cast<unsigned long>(ops.size()));
+
+  for (i = 0; i < sizeof(runs)/sizeof(runs[0]); ++i) {
+    guint64 best = 0;
+    guint32 played = 0, mismatches = 0;
+
+    for (r = 0; r < repeats; ++r) {
+      qTraceStdTarget target;
+      qTraceReplayer  replayer(&target);
+      guint64         us = replayer.replay(ops, runs[i].containers);
+
+      if (!r || (us < best))
+	best = us;
+      played = 0;
+      for (t = 1; t < qTrace_numOps; ++t)
+	played += replayer.getNumOps(t);
+      mismatches = replayer.getNumMismatches();
+
+      if ((r == 0) && (runs[i].containers == QTRACE_ALL))
+	for (t = 1; t < qTrace_numOps; ++t)
+	  if (replayer.getNumOps(t))
+	    printf("  %-12s %10u\n", opNames[t], replayer.getNumOps(t));
+    }
+    printf("%-6s %10u ops %10.3f ms %8.1f ns/op", runs[i].name, played,
+	   best / 1000.0, played ? (best * 1000.0) / played : 0.0);
+    if (mismatches)
+      printf("  (%u hash results differed)", mismatches);
+    printf("\n");
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+
+  // Let getopt see the subcommand's options
+  if (!strcmp(argv[1], "record"))
+    return record(argc - 1, argv + 1);
+  if (!strcmp(argv[1], "replay"))
+    return replay(argc - 1, argv + 1);
+
+  usage();
+  return 2;
+}
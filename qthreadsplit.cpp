@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+#include "qthreadsplit.h"
+#include "getmoves.h"
+#include "qnuma.h"
+
+IDSTR("$Id$");
+
+
+/*************************
+ * class qThreadSplitter *
+ *************************/
+qThreadSplitter::qThreadSplitter
+(int n)
+  :numThreads((n > 0) ? n : 1), lanes(THREADSPLIT_LANES), numRounds(0),
+   positionsEvaluated(0), nextThread(0), root(NULL)
+{
+  unsigned int k;
+
+  for (k = 0; k < lanes.size(); ++k) {
+    lanes[k].searcher = NULL;
+    lanes[k].node     = qNuma::nodeForWorker(k);
+  }
+  bestEval = *positionEval_none;
+  pthread_mutex_init(&mutex, NULL);
+}
+
+qThreadSplitter::~qThreadSplitter()
+{
+  pthread_mutex_destroy(&mutex);
+}
+
+// Give the lanes the contenders most in need of refining, as
+// qRootSplitter::assignWorkers() does but by a fixed count rather than by
+// time.  Returns FALSE if there's nothing to refine.
+bool qThreadSplitter::assignLanes
+(void)
+{
+  std::vector<int>               wanted;
+  std::vector<std::vector<int>*> jobs;
+  unsigned int                   k;
+
+  for (k = 0; k < lanes.size(); ++k) {
+    lanes[k].jobs.clear();
+    jobs.push_back(&lanes[k].jobs);
+  }
+
+  if (!moves.pickWanted(minBreadth, slop, &wanted) &&
+      (wanted.size() > THREADSPLIT_JOBS_PER_ROUND))
+    wanted.resize(THREADSPLIT_JOBS_PER_ROUND);
+  if (wanted.empty())
+    return FALSE;
+  return moves.assign(wanted, jobs);
+}
+
+// Refine each of lane's moves in turn, forking root for it if this is its
+// first work.  Only lane's moves are touched, so lanes can run at once.
+void qThreadSplitter::runLane
+(qThreadSplitLane *lane)
+{
+  qPlayer        opponent = player2move.otherPlayer();
+  qSearcherStats stats;
+  unsigned int   i;
+
+  // Forked here, not when assigned, so the fork's memory comes from the
+  // node of the thread that will go on using it
+  if (!lane->searcher) {
+    lane->searcher = root->fork();
+    lane->searcher->setSharedTable(NULL);
+  }
+
+  lane->positions = 0;
+  for (i = 0; i < lane->jobs.size(); ++i) {
+    qRootMoves::qRootMove *m = &moves[lane->jobs[i]];
+    qPositionEvaluation    eval;
+
+    lane->searcher->applyMove(m->move, player2move);
+    lane->searcher->searchPositions(opponent, maxComplexity,
+				    qLessOnePly(minDepth),
+				    qLessOnePly(minBreadth), slop,
+				    THREADSPLIT_JOB_POSITIONS);
+    lane->searcher->getStats(&stats);
+    lane->positions += stats.lastPositionsEvaluated;
+    if (lane->searcher->getEvaluation(opponent, &eval))
+      m->eval = eval;
+    lane->searcher->undoMove();
+  }
+}
+
+// A lane with work that no thread has taken yet, preferring those homed
+// on node; NULL once there are none left
+qThreadSplitter::qThreadSplitLane *qThreadSplitter::takeLane
+(int node)
+{
+  qThreadSplitLane *lane = NULL;
+  unsigned int      k;
+
+  pthread_mutex_lock(&mutex);
+  for (k = 0; k < lanes.size(); ++k)
+    if (!lanes[k].taken && !lanes[k].jobs.empty() &&
+	(!lane || ((lanes[k].node == node) && (lane->node != node))))
+      lane = &lanes[k];
+  if (lane)
+    lane->taken = TRUE;
+  pthread_mutex_unlock(&mutex);
+  return lane;
+}
+
+void qThreadSplitter::runLanes
+(int node)
+{
+  qThreadSplitLane *lane;
+
+  while ((lane = takeLane(node)) != NULL)
+    runLane(lane);
+}
+
+void *qThreadSplitter::threadMain
+(void *arg)
+{
+  qThreadSplitter *s = static_cast<qThreadSplitter*>(arg);
+  int              node;
+
+  pthread_mutex_lock(&s->mutex);
+  node = qNuma::nodeForWorker(s->nextThread++);
+  pthread_mutex_unlock(&s->mutex);
+
+  qNuma::bindThreadToNode(node);
+  s->runLanes(node);
+  return NULL;
+}
+
+// Run every lane with work, on up to numThreads threads, and total what
+// they evaluated once they're all done.  With one thread it's this one,
+// left where it is; otherwise they're all new, each pinned to a node.
+void qThreadSplitter::runRound
+(void)
+{
+  std::vector<pthread_t> threads;
+  pthread_t              t;
+  int                    busy = 0;
+  unsigned int           k;
+
+  for (k = 0; k < lanes.size(); ++k) {
+    lanes[k].taken = FALSE;
+    if (!lanes[k].jobs.empty())
+      ++busy;
+  }
+
+  nextThread = 0;
+  if ((numThreads > 1) && (busy > 1))
+    for (k = 0; (k < static_cast<unsigned int>(numThreads)) &&
+	   (k < static_cast<unsigned int>(busy)); ++k)
+      if (!pthread_create(&t, NULL, &qThreadSplitter::threadMain, this))
+	threads.push_back(t);
+  if (threads.empty())
+    runLanes(qNuma::nodeForWorker(0));
+  for (k = 0; k < threads.size(); ++k)
+    pthread_join(threads[k], NULL);
+
+  for (k = 0; k < lanes.size(); ++k)
+    if (!lanes[k].jobs.empty())
+      positionsEvaluated += lanes[k].positions;
+}
+
+qMove qThreadSplitter::search
+(qSearcher *root_,
+ qPlayer    player,
+ guint8     max_complexity,
+ guint8     min_depth,
+ guint8     min_breadth,
+ guint8     slop_,
+ guint64    max_positions)
+{
+  qMoveList    legalMoves;
+  qMove        winner;
+  unsigned int k;
+
+  root               = root_;
+  numRounds          = 0;
+  positionsEvaluated = 0;
+  bestEval           = *positionEval_none;
+  player2move        = player;
+  maxComplexity      = max_complexity;
+  minDepth           = min_depth;
+  minBreadth         = min_breadth;
+  slop               = slop_;
+
+  // Rate every move's result to begin with, as qRootSplitter does
+  root->getLegalMoves(&legalMoves);
+  if (moves.rate(root->getPos(), player, legalMoves, &winner)) {
+    bestEval = *positionEval_won;
+    return winner;
+  }
+  if (!moves.size())
+    return qMove();
+
+  for (;;) {
+    moves.sort();
+    if (moves.isDone(max_complexity, min_depth, slop))
+      break;
+    if (max_positions && (positionsEvaluated >= max_positions))
+      break;
+    if (!assignLanes())
+      break; // Nothing left to refine
+    runRound();
+    ++numRounds;
+  }
+
+  for (k = 0; k < lanes.size(); ++k) {
+    delete lanes[k].searcher;
+    lanes[k].searcher = NULL;
+  }
+
+  return moves.getBest(&bestEval);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_threadsplit_h
+#define INCLUDE_threadsplit_h 1
+
+#include <pthread.h>
+#include <vector>
+#include "qtypes.h"
+#include "qposition.h"
+#include "qposinfo.h"
+#include "qsearcher.h"
+#include "qrootmoves.h"
+#include "parameters.h"
+
+/* Searching one position on several threads, reproducibly.
+ *
+ * A qRootSplitter's rounds are measured in time and its moves go to
+ * whichever worker is free, so no two runs search alike.  That's fine for
+ * play, but regression tests & audits need the same move for the same
+ * input.  A qThreadSplitter splits the root the same way (see
+ * qrootsplit.h) but fixes everything that decides what gets searched:
+ *   - The work is done in THREADSPLIT_LANES lanes, each a fork of the
+ *     root's qSearcher.  Threads only carry out the lanes' work, so the
+ *     number of threads changes how soon the answer comes, not what it is.
+ *   - Each round, up to THREADSPLIT_JOBS_PER_ROUND contenders go to lanes
+ *     by qRootMoves' fixed rule (see qrootmoves.h).  A lane
+ *     refines its moves in order, with qSearcher::searchPositions(), for
+ *     THREADSPLIT_JOB_POSITIONS new positions each.
+ *   - Results are merged only once every lane is done, by a stable sort
+ *     of the moves in the order the root generated them.
+ *   - The search ends on qSearcher::search()'s criteria or once a budget
+ *     of positions (not time) is spent.
+ * The lanes don't use the root's shared table, if it has one; what other
+ * processes put there would vary the results.
+ *
+ * With more than one thread, each is pinned to a NUMA node in turn (see
+ * qnuma.h), and lanes are homed on nodes the same way.  A thread takes
+ * lanes homed on its own node before any other, and a lane is forked by
+ * the first thread to run it, so its memory is usually local to whoever
+ * runs it.  Which thread runs a lane never changes what it does.
+ */
+
+class qThreadSplitter {
+ public:
+  // Run lanes on up to numThreads threads at once
+  qThreadSplitter(int numThreads);
+  ~qThreadSplitter();
+
+  // Find the best move for player2move at root's position, with the
+  // criteria of qSearcher::search(), stopping once the lanes have
+  // evaluated max_positions between them (0 for no limit).  The lanes see
+  // what root has learned, so root must not be searched or moved while
+  // this runs.  Returns qMove() if there's no legal move.
+  qMove search(qSearcher *root,
+	       qPlayer    player2move,
+	       guint8     max_complexity,
+	       guint8     min_depth,
+	       guint8     min_breadth,
+	       guint8     slop,
+	       guint64    max_positions);
+
+  // Of the last search: the best move's evaluation (from the mover's
+  // side), how many rounds it took, and the positions the lanes evaluated
+  // between them
+  const qPositionEvaluation *getBestEval(void) const { return &bestEval; };
+  guint32 getNumRounds(void) const             { return numRounds; };
+  guint64 getPositionsEvaluated(void) const    { return positionsEvaluated; };
+
+ private:
+  struct qThreadSplitLane {
+    qSearcher       *searcher;  // NULL until it's first run
+    std::vector<int> jobs;      // Moves it's refining this round, in order
+    guint64          positions; // Evaluated this round
+    int              node;      // Home NUMA node
+    bool             taken;     // A thread has it this round
+  };
+
+  int                           numThreads;
+  std::vector<qThreadSplitLane> lanes;
+  qRootMoves                    moves;
+  qPositionEvaluation           bestEval;
+  guint32                       numRounds;
+  guint64                       positionsEvaluated;
+
+  // The round under way
+  pthread_mutex_t mutex;
+  int             nextThread; // Index of the next thread to start
+  qSearcher      *root;
+  qPlayer         player2move;
+  guint8          maxComplexity, minDepth, minBreadth, slop;
+
+  bool         assignLanes(void);
+  void         runRound(void);
+  void         runLane(qThreadSplitLane *lane);
+  qThreadSplitLane *takeLane(int node);
+  void         runLanes(int node);
+  static void *threadMain(void *splitter);
+
+  // We own the lanes' searchers while searching
+  qThreadSplitter(const qThreadSplitter&);
+  qThreadSplitter &operator=(const qThreadSplitter&);
+};
+
+#endif // INCLUDE_threadsplit_h
@@ -0,0 +1,545 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+
+#include "qtrace.h"
+#include "qposhash.h"
+#include "qcomptree.h"
+#include "qmovstack.h"
+#include <string.h>
+#include <sys/time.h>
+
+IDSTR("$Id$");
+
+
+/****/
+
+#define QTRACE_MAGIC   0x71747263 /* "qtrc" */
+#define QTRACE_VERSION 2
+#define QTRACE_FOUND   0x80       // Or'd into a hashGet opcode on a hit
+
+#define QTRACE_BUFSIZ  (1<<20)
+
+typedef struct _qTraceHeader {
+  guint32 magic;
+  guint32 version;
+  guint32 posBytes;  // QPOSITION_PACKED_BYTES; differs with QBOARD_SIZE
+} qTraceHeader;
+
+
+/************************
+ * class qTraceRecorder *
+ ************************/
+qTraceRecorder::qTraceRecorder()
+  :f(NULL), numOps(0)
+{ ; }
+
+qTraceRecorder::~qTraceRecorder()
+{
+  close();
+}
+
+bool qTraceRecorder::open
+(const char *path)
+{
+  qTraceHeader hdr = { QTRACE_MAGIC, QTRACE_VERSION,
+		       QPOSITION_PACKED_BYTES };
+
+  close();
+  if (!(f = fopen(path, "wb")))
+    return FALSE;
+  setvbuf(f, NULL, _IOFBF, QTRACE_BUFSIZ);
+  numOps = 0;
+  return (fwrite(&hdr, sizeof(hdr), 1, f) == 1);
+}
+
+bool qTraceRecorder::close
+(void)
+{
+  bool ok;
+
+  if (!f)
+    return FALSE;
+  ok = !ferror(f);
+  ok = (fclose(f) == 0) && ok;
+  f  = NULL;
+  return ok;
+}
+
+void qTraceRecorder::putVarint
+(guint32 n)
+{
+  while (n >= 0x80) {
+    putc((n & 0x7f) | 0x80, f);
+    n >>= 7;
+  }
+  putc(n, f);
+}
+
+void qTraceRecorder::putEval
+(const qPositionEvaluation *eval)
+{
+  guint16 score = static_cast<guint16>(eval->score);
+
+  putc(score & 0xff, f);
+  putc(score >> 8, f);
+  putc(eval->complexity & 0xff, f);
+  putc(eval->complexity >> 8, f);
+}
+
+void qTraceRecorder::putPos
+(const qPosition *pos)
+{
+  guint8 buf[QPOSITION_PACKED_BYTES];
+
+  pos->pack(buf);
+  fwrite(buf, sizeof(buf), 1, f);
+}
+
+void qTraceRecorder::hashTraceFunc
+(void *arg, int op, const qPosition *pos, bool found)
+{
+  qTraceRecorder *r = static_cast<qTraceRecorder*>(arg);
+
+  if (!r->f)
+    return;
+  switch (op) {
+  case qPositionInfoHash::TraceGet:
+    r->putOp(qTrace_hashGet | (found ? QTRACE_FOUND : 0));
+    break;
+  case qPositionInfoHash::TraceAdd:
+    r->putOp(qTrace_hashAdd);
+    break;
+  default:
+    r->putOp(qTrace_hashRm);
+  }
+  r->putPos(pos);
+}
+
+void qTraceRecorder::treeInit
+(guint32 root)
+{
+  if (!f)
+    return;
+  putOp(qTrace_treeInit);
+  putVarint(root);
+}
+
+void qTraceRecorder::treeAdd
+(guint32 parent, qMove mv, const qPositionEvaluation *eval, guint32 result)
+{
+  if (!f)
+    return;
+  putOp(qTrace_treeAdd);
+  putVarint(parent);
+  putc(mv.getEncoding(), f);
+  putEval(eval);
+  putVarint(result);
+}
+
+void qTraceRecorder::treeSetEval
+(guint32 node, const qPositionEvaluation *eval)
+{
+  if (!f)
+    return;
+  putOp(eval ? qTrace_treeSetEval : qTrace_treeRemove);
+  putVarint(node);
+  if (eval)
+    putEval(eval);
+}
+
+void qTraceRecorder::treeSort
+(guint32 node)
+{
+  if (!f)
+    return;
+  putOp(qTrace_treeSort);
+  putVarint(node);
+}
+
+void qTraceRecorder::treePrune
+(void)
+{
+  if (f)
+    putOp(qTrace_treePrune);
+}
+
+void qTraceRecorder::stackBase
+(const qPosition *pos, qPlayer player2move)
+{
+  if (!f)
+    return;
+  putOp(qTrace_stackBase);
+  putc(player2move.getPlayerId(), f);
+  putPos(pos);
+}
+
+void qTraceRecorder::stackPush
+(qPlayer whoMoved, qMove mv)
+{
+  if (!f)
+    return;
+  putOp(qTrace_stackPush);
+  putc(whoMoved.getPlayerId(), f);
+  putc(mv.getEncoding(), f);
+}
+
+void qTraceRecorder::stackPop
+(void)
+{
+  if (f)
+    putOp(qTrace_stackPop);
+}
+
+
+/**********************
+ * class qTraceReader *
+ **********************/
+qTraceReader::qTraceReader()
+  :f(NULL)
+{ ; }
+
+qTraceReader::~qTraceReader()
+{
+  close();
+}
+
+bool qTraceReader::open
+(const char *path)
+{
+  qTraceHeader hdr;
+
+  close();
+  if (!(f = fopen(path, "rb")))
+    return FALSE;
+  setvbuf(f, NULL, _IOFBF, QTRACE_BUFSIZ);
+  if ((fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+      (hdr.magic   != QTRACE_MAGIC) ||
+      (hdr.version != QTRACE_VERSION) ||
+      (hdr.posBytes != QPOSITION_PACKED_BYTES)) {
+    close();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void qTraceReader::close
+(void)
+{
+  if (f)
+    fclose(f);
+  f = NULL;
+}
+
+bool qTraceReader::getVarint
+(guint32 *r_n)
+{
+  guint32 n = 0;
+  int     shift, c;
+
+  for (shift = 0; shift < 35; shift += 7) {
+    if ((c = getc(f)) == EOF)
+      return FALSE;
+    n |= static_cast<guint32>(c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      *r_n = n;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+bool qTraceReader::getEval
+(qPositionEvaluation *r_eval)
+{
+  guint8 buf[4];
+
+  if (fread(buf, sizeof(buf), 1, f) != 1)
+    return FALSE;
+  r_eval->score      = static_cast<gint16>(buf[0] | (buf[1] << 8));
+  r_eval->complexity = buf[2] | (buf[3] << 8);
+  r_eval->depth      = 0; // Not traced; nothing we replay looks at it
+  return TRUE;
+}
+
+bool qTraceReader::getPos
+(qPosition *r_pos)
+{
+  guint8 buf[QPOSITION_PACKED_BYTES];
+
+  if (fread(buf, sizeof(buf), 1, f) != 1)
+    return FALSE;
+  *r_pos = qPosition::unpack(buf);
+  return TRUE;
+}
+
+bool qTraceReader::next
+(qTraceOp *r_op)
+{
+  int c;
+
+  if (!f || ((c = getc(f)) == EOF))
+    return FALSE;
+
+  r_op->type  = c & ~QTRACE_FOUND;
+  r_op->found = ((c & QTRACE_FOUND) != 0);
+
+  switch (r_op->type) {
+  case qTrace_hashGet:
+  case qTrace_hashAdd:
+  case qTrace_hashRm:
+    return getPos(&r_op->pos);
+
+  case qTrace_treeInit:
+  case qTrace_treeRemove:
+  case qTrace_treeSort:
+    return getVarint(&r_op->node);
+
+  case qTrace_treeAdd:
+    if (!getVarint(&r_op->node) || ((c = getc(f)) == EOF))
+      return FALSE;
+    r_op->mv = qMove(static_cast<guint8>(c));
+    return (getEval(&r_op->eval) && getVarint(&r_op->result));
+
+  case qTrace_treeSetEval:
+    return (getVarint(&r_op->node) && getEval(&r_op->eval));
+
+  case qTrace_treePrune:
+  case qTrace_stackPop:
+    return TRUE;
+
+  case qTrace_stackBase:
+    if ((c = getc(f)) == EOF)
+      return FALSE;
+    r_op->player = qPlayer(c ? qPlayer::BlackPlayer : qPlayer::WhitePlayer);
+    return getPos(&r_op->pos);
+
+  case qTrace_stackPush:
+    if ((c = getc(f)) == EOF)
+      return FALSE;
+    r_op->player = qPlayer(c ? qPlayer::BlackPlayer : qPlayer::WhitePlayer);
+    if ((c = getc(f)) == EOF)
+      return FALSE;
+    r_op->mv = qMove(static_cast<guint8>(c));
+    return TRUE;
+  }
+  return FALSE; // Not a trace we understand
+}
+
+guint32 qTraceReader::readAll
+(std::vector<qTraceOp> *r_ops)
+{
+  qTraceOp op;
+  guint32  n = 0;
+
+  while (next(&op)) {
+    r_ops->push_back(op);
+    ++n;
+  }
+  return n;
+}
+
+
+/*************************
+ * class qTraceStdTarget *
+ *************************/
+static void stdTargetEltInit
+(qPositionInfo *posInfo, const qPosition *)
+{
+  posInfo->initEval();
+}
+
+struct qTraceStdContainers {
+  qPositionInfoHash *hash;
+  qComputationTree   tree;
+  qMoveStack        *stack;
+
+  qTraceStdContainers()
+    : hash(new qPositionInfoHash(&stdTargetEltInit)), stack(NULL) { ; };
+  ~qTraceStdContainers() { delete hash; delete stack; };
+};
+
+qTraceStdTarget::qTraceStdTarget()
+  :c(new qTraceStdContainers)
+{ ; }
+
+qTraceStdTarget::~qTraceStdTarget()
+{
+  delete c;
+}
+
+void qTraceStdTarget::stackBase
+(const qPosition *pos, qPlayer player2move)
+{
+  delete c->hash;
+  delete c->stack;
+  c->hash  = new qPositionInfoHash(&stdTargetEltInit);
+  c->stack = new qMoveStack(pos, player2move);
+  c->tree.initializeTree();
+}
+
+void qTraceStdTarget::stackPush
+(qPlayer whoMoved, qMove mv)
+{
+  c->stack->pushMove(whoMoved, mv);
+}
+
+void qTraceStdTarget::stackPop
+(void)
+{
+  c->stack->popMove();
+}
+
+bool qTraceStdTarget::hashGet
+(const qPosition *pos)
+{
+  return (c->hash->getElt(pos) != NULL);
+}
+
+void qTraceStdTarget::hashAdd
+(const qPosition *pos)
+{
+  c->hash->addElt(pos);
+}
+
+void qTraceStdTarget::hashRm
+(const qPosition *pos)
+{
+  c->hash->rmElt(pos);
+}
+
+guint32 qTraceStdTarget::treeInit
+(void)
+{
+  c->tree.initializeTree();
+  return c->tree.getRootNode();
+}
+
+guint32 qTraceStdTarget::treeAdd
+(guint32 parent, qMove mv, const qPositionEvaluation *eval)
+{
+  return c->tree.addNodeChild(parent, mv, eval);
+}
+
+void qTraceStdTarget::treeSetEval
+(guint32 node, const qPositionEvaluation *eval)
+{
+  c->tree.setNodeEval(node, eval);
+}
+
+void qTraceStdTarget::treeSort
+(guint32 node)
+{
+  c->tree.sortNodeChildList(node);
+}
+
+void qTraceStdTarget::treePrune
+(void)
+{
+  c->tree.pruneColdSubtrees();
+}
+
+
+/************************
+ * class qTraceReplayer *
+ ************************/
+guint64 qTraceReplayer::replay
+(const std::vector<qTraceOp> &ops, int containers)
+{
+  std::vector<qTraceOp>::const_iterator op;
+  struct timeval start, end;
+
+  memset(numOps, 0, sizeof(numOps));
+  numMismatches = 0;
+  nodeMap.clear();
+  evals.clear();
+
+  gettimeofday(&start, NULL);
+  for (op = ops.begin(); op != ops.end(); ++op) {
+    switch (op->type) {
+    case qTrace_hashGet:
+      if (!(containers & QTRACE_HASH))
+	continue;
+      if (target->hashGet(&op->pos) != op->found) {
+	++numMismatches;
+	if (op->found)
+	  target->hashAdd(&op->pos);
+      }
+      break;
+    case qTrace_hashAdd:
+      if (!(containers & QTRACE_HASH))
+	continue;
+      target->hashAdd(&op->pos);
+      break;
+    case qTrace_hashRm:
+      if (!(containers & QTRACE_HASH))
+	continue;
+      target->hashRm(&op->pos);
+      break;
+
+    case qTrace_treeInit:
+      if (!(containers & QTRACE_TREE))
+	continue;
+      nodeMap.clear();
+      evals.clear();
+      nodeMap.resize(op->node + 1, 0);
+      nodeMap[op->node] = target->treeInit();
+      break;
+    case qTrace_treeAdd:
+      if (!(containers & QTRACE_TREE) || nodeMap.empty())
+	continue;
+      evals.push_back(op->eval);
+      if (op->result >= nodeMap.size())
+	nodeMap.resize(op->result + COMPTREE_GROW_SIZE, 0);
+      nodeMap[op->result] = target->treeAdd(mapNode(op->node), op->mv,
+					    &evals.back());
+      break;
+    case qTrace_treeSetEval:
+      if (!(containers & QTRACE_TREE) || nodeMap.empty())
+	continue;
+      evals.push_back(op->eval);
+      target->treeSetEval(mapNode(op->node), &evals.back());
+      break;
+    case qTrace_treeRemove:
+      if (!(containers & QTRACE_TREE) || nodeMap.empty())
+	continue;
+      target->treeSetEval(mapNode(op->node), NULL);
+      break;
+    case qTrace_treeSort:
+      if (!(containers & QTRACE_TREE) || nodeMap.empty())
+	continue;
+      target->treeSort(mapNode(op->node));
+      break;
+    case qTrace_treePrune:
+      if (!(containers & QTRACE_TREE) || nodeMap.empty())
+	continue;
+      target->treePrune();
+      break;
+
+    case qTrace_stackBase: // Resets everything, so always delivered
+      target->stackBase(&op->pos, op->player);
+      break;
+    case qTrace_stackPush:
+      if (!(containers & QTRACE_STACK))
+	continue;
+      target->stackPush(op->player, op->mv);
+      break;
+    case qTrace_stackPop:
+      if (!(containers & QTRACE_STACK))
+	continue;
+      target->stackPop();
+      break;
+    default:
+      continue;
+    }
+    ++numOps[op->type];
+  }
+  gettimeofday(&end, NULL);
+
+  return ((end.tv_sec - start.tv_sec) * 1000000ULL +
+	  end.tv_usec - start.tv_usec);
+}
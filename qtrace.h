@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_trace_h
+#define INCLUDE_trace_h 1
+
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include "qtypes.h"
+#include "qposition.h"
+#include "qposinfo.h"
+
+/* Search traces, for benchmarking the search's containers on their own.
+ *
+ * Hand a qSearcher a qTraceRecorder (setTraceRecorder()) and it logs every
+ * operation the search makes on its qPositionInfoHash (getElt, addElt,
+ * rmElt), qComputationTree (initializeTree, addNodeChild, setNodeEval,
+ * sortNodeChildList, pruneColdSubtrees) and qMoveStack (pushMove, popMove,
+ * which pushEval & popEval go through).  A trace is a header followed by
+ * variable-length records: an opcode byte, then positions packed as in
+ * qPosition::pack() and node ids as base-128 varints.
+ *
+ * qTraceReplayer plays a trace back against a qTraceTarget, so another
+ * hash, tree or stack can be timed on exactly the accesses a real search
+ * made, without the evaluation work in between.  qTraceStdTarget is the
+ * target built on the containers we have; a rewrite implements its own
+ * and is compared with it by the qtbench tool.
+ */
+
+typedef enum {
+  qTrace_hashGet = 1,
+  qTrace_hashAdd,
+  qTrace_hashRm,
+  qTrace_treeInit,
+  qTrace_treeAdd,
+  qTrace_treeSetEval,
+  qTrace_treeRemove,   // setNodeEval(node, NULL): an illegal move
+  qTrace_treeSort,
+  qTrace_treePrune,
+  qTrace_stackBase,    // Tracing began; where the move stack was
+  qTrace_stackPush,
+  qTrace_stackPop,
+  qTrace_numOps
+} qTraceOpType;
+
+// Decoded record.  Which fields mean anything depends on type.
+typedef struct _qTraceOp {
+  guint8              type;
+  bool                found;  // hashGet: did the recording hash have it?
+  qPosition           pos;    // hash ops & stackBase
+  qPlayer             player; // stackBase (to move) & stackPush (moving)
+  qMove               mv;     // treeAdd & stackPush
+  guint32             node;   // tree ops: the node operated on (or parent)
+  guint32             result; // treeAdd: the new node
+  qPositionEvaluation eval;   // treeAdd & treeSetEval
+
+  _qTraceOp() : pos(&qInitialPosition) { ; };
+} qTraceOp;
+
+class qTraceRecorder {
+ public:
+  qTraceRecorder();
+  ~qTraceRecorder();
+
+  // Create (or truncate) path.  Returns FALSE on failure.
+  bool open(const char *path);
+
+  // Returns FALSE if anything failed to be written
+  bool close(void);
+
+  guint64 getNumOps(void) const { return numOps; };
+
+  // Hooks called by the containers
+  static void hashTraceFunc(void *arg, int op, const qPosition *pos,
+			    bool found);
+  void treeInit(guint32 root);
+  void treeAdd(guint32 parent, qMove mv, const qPositionEvaluation *eval,
+	       guint32 result);
+  void treeSetEval(guint32 node, const qPositionEvaluation *eval);
+  void treeSort(guint32 node);
+  void treePrune(void);
+  void stackBase(const qPosition *pos, qPlayer player2move);
+  void stackPush(qPlayer whoMoved, qMove mv);
+  void stackPop(void);
+
+ private:
+  FILE   *f;
+  guint64 numOps;
+
+  void putOp(guint8 op) { putc(op, f); ++numOps; };
+  void putVarint(guint32 n);
+  void putEval(const qPositionEvaluation *eval);
+  void putPos(const qPosition *pos);
+};
+
+class qTraceReader {
+ public:
+  qTraceReader();
+  ~qTraceReader();
+
+  // Returns FALSE if path can't be read or isn't a trace
+  bool open(const char *path);
+  void close(void);
+
+  // Fetch the next record; FALSE at the end of the trace (or at a record
+  // cut short, as a crashed recording might leave)
+  bool next(qTraceOp *r_op);
+
+  // Read the rest of the trace, appending to r_ops
+  guint32 readAll(std::vector<qTraceOp> *r_ops);
+
+ private:
+  FILE *f;
+
+  bool getVarint(guint32 *r_n);
+  bool getEval(qPositionEvaluation *r_eval);
+  bool getPos(qPosition *r_pos);
+};
+
+/* qTraceTarget
+ * The containers under test, as seen by qTraceReplayer.  Node ids are the
+ * target's own; the replayer maps the trace's ids onto them.
+ */
+class qTraceTarget {
+ public:
+  virtual ~qTraceTarget() {;};
+
+  // A searcher's trace begins: start afresh, with the move stack at pos
+  // and player2move to move.  (Traces can hold several searchers', e.g.
+  // one per corpus position.)
+  virtual void    stackBase(const qPosition *pos, qPlayer player2move) = 0;
+  virtual void    stackPush(qPlayer whoMoved, qMove mv) = 0;
+  virtual void    stackPop(void) = 0;
+
+  // Returns whether pos was found
+  virtual bool    hashGet(const qPosition *pos) = 0;
+  virtual void    hashAdd(const qPosition *pos) = 0;
+  virtual void    hashRm(const qPosition *pos) = 0;
+
+  // Returns the root's id
+  virtual guint32 treeInit(void) = 0;
+  // Returns the new node's id.  eval stays valid until the next treeInit.
+  virtual guint32 treeAdd(guint32 parent, qMove mv,
+			  const qPositionEvaluation *eval) = 0;
+  // eval NULL means remove the node (and anything below it)
+  virtual void    treeSetEval(guint32 node,
+			      const qPositionEvaluation *eval) = 0;
+  virtual void    treeSort(guint32 node) = 0;
+  virtual void    treePrune(void) = 0;
+};
+
+class qTraceStdTarget : public qTraceTarget {
+ public:
+  qTraceStdTarget();
+  ~qTraceStdTarget();
+
+  void    stackBase(const qPosition *pos, qPlayer player2move);
+  void    stackPush(qPlayer whoMoved, qMove mv);
+  void    stackPop(void);
+  bool    hashGet(const qPosition *pos);
+  void    hashAdd(const qPosition *pos);
+  void    hashRm(const qPosition *pos);
+  guint32 treeInit(void);
+  guint32 treeAdd(guint32 parent, qMove mv, const qPositionEvaluation *eval);
+  void    treeSetEval(guint32 node, const qPositionEvaluation *eval);
+  void    treeSort(guint32 node);
+  void    treePrune(void);
+
+ private:
+  // Opaque so qtrace.h needn't pull in every container's header
+  struct qTraceStdContainers *c;
+};
+
+// Which containers a replay exercises; ops on the others are skipped
+#define QTRACE_HASH  0x01
+#define QTRACE_TREE  0x02
+#define QTRACE_STACK 0x04
+#define QTRACE_ALL   (QTRACE_HASH | QTRACE_TREE | QTRACE_STACK)
+
+class qTraceReplayer {
+ public:
+  qTraceReplayer(qTraceTarget *t) : target(t) { ; };
+
+  // Play ops against the target.  Returns the time taken, in microseconds.
+  guint64 replay(const std::vector<qTraceOp> &ops, int containers=QTRACE_ALL);
+
+  // Of the last replay: ops of each qTraceOpType played, and hashGets
+  // whose result differed from the recording.  (A recording begun on a
+  // searcher with a warm hash hits positions the target never saw; the
+  // replayer adds those on first sight so later gets match.)
+  guint32 getNumOps(int type) const { return numOps[type]; };
+  guint32 getNumMismatches() const  { return numMismatches; };
+
+ private:
+  qTraceTarget *target;
+  guint32       numOps[qTrace_numOps];
+  guint32       numMismatches;
+
+  std::vector<guint32>            nodeMap; // trace's node id -> target's
+  std::deque<qPositionEvaluation> evals;   // Stable storage for treeAdd etc.
+
+  guint32 mapNode(guint32 node) const
+    { return (node < nodeMap.size()) ? nodeMap[node] : 0; };
+};
+
+#endif // INCLUDE_trace_h
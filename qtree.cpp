@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+/* qtree - record search tree exports & look into them (see qtreeexport.h)
+ *
+ * usage: qtree record [-t ms] [-n moves] [-i positions] export-file
+ *   Plays itself for n moves (default 4) from the starting position,
+ *   searching for ms (default 2000) per move, and exports the tree as each
+ *   search finishes and, with -i, every so many positions during it.
+ *
+ * usage: qtree list export-file
+ *   One line per snapshot: its number, when it was taken, & its size.
+ *
+ * usage: qtree dot [-s snapshot] [-d depth] [-p positions] export-file
+ *   Write a snapshot (by default the last) as a Graphviz digraph, down to
+ *   depth plies (default 2), leaving out nodes that took fewer than
+ *   positions to scan.  Moves no longer contending at their parent are
+ *   grey.
+ *
+ * usage: qtree json [-s snapshot] [-d depth] export-file
+ *   Write a snapshot as JSON: its particulars, then its nodes (down to
+ *   depth plies, if given) in preorder, each naming its parent.
+ *
+ * usage: qtree summary [-s snapshot] export-file
+ *   Where a snapshot's effort went: by depth, by kind of move, and among
+ *   the root's moves.  "Self" positions are those a node's scans evaluated
+ *   other than in its children's; "cold" positions are those spent below
+ *   moves that (by the end) don't contend at their parent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "qsearcher.h"
+#include "qtreeexport.h"
+#include "qio.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+// search() criteria other than time
+#define QTREE_MAX_COMPLEXITY 20
+#define QTREE_MIN_DEPTH      4
+#define QTREE_MIN_BREADTH    1
+#define QTREE_SLOP           3
+
+#define QTREE_TOP_MOVES      10 // Root moves summary lists
+
+enum { KIND_ROOT, KIND_STEP, KIND_JUMP, KIND_WALL, NUM_KINDS };
+static const char *kindNames[NUM_KINDS] = { "root", "step", "jump", "wall" };
+
+// What we work out about each node of a snapshot
+typedef struct _nodeInfo {
+  std::string name;   // The move's notation
+  guint32     self;   // Positions not counted at a child
+  bool        cold;   // Out of contention at its parent
+  int         kind;
+} nodeInfo;
+
+static void usage()
+{
+  fprintf(stderr,
+	  "usage: qtree record [-t ms] [-n moves] [-i positions] export-file\n"
+	  "       qtree list export-file\n"
+	  "       qtree dot [-s snapshot] [-d depth] [-p positions] export-file\n"
+	  "       qtree json [-s snapshot] [-d depth] export-file\n"
+	  "       qtree summary [-s snapshot] export-file\n");
+}
+
+static int record
+(int argc, char **argv)
+{
+  qTreeExporter exporter;
+  qSearcher     searcher;
+  gint32        ms = 2000;
+  guint32       moves = 4, every = 0, n;
+  int           c;
+
+  while ((c = getopt(argc, argv, "t:n:i:")) != -1) {
+    switch (c) {
+    case 't': ms    = atoi(optarg);              break;
+    case 'n': moves = strtoul(optarg, NULL, 10); break;
+    case 'i': every = strtoul(optarg, NULL, 10); break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    usage();
+    return 2;
+  }
+  if (!exporter.open(argv[optind])) {
+    fprintf(stderr, "qtree: can't create %s\n", argv[optind]);
+    return 1;
+  }
+
+  searcher.setTreeExporter(&exporter, every);
+  for (n = 0; n < moves; ++n) {
+    qPlayer p = searcher.getPlayer2Move();
+
+    searcher.applyMove(searcher.search(p,
+				       QTREE_MAX_COMPLEXITY,
+				       QTREE_MIN_DEPTH,
+				       QTREE_MIN_BREADTH,
+				       QTREE_SLOP,
+				       ms,
+				       ms), p);
+    if (searcher.getPos()->isWon(qPlayer_white) ||
+	searcher.getPos()->isWon(qPlayer_black))
+      break;
+  }
+  searcher.setTreeExporter(NULL);
+
+  printf("%s: %u snapshots, %llu nodes\n", argv[optind],
+	 exporter.getNumSnapshots(),
+	 static_cast<unsigned long long>(exporter.getNumNodes()));
+  if (!exporter.close()) {
+    fprintf(stderr, "qtree: error writing %s\n", argv[optind]);
+    return 1;
+  }
+  return 0;
+}
+
+// Read snapshot number which (or the last, if which < 0) of path
+static bool readSnapshot
+(const char *path, int which, qTreeExportSnapshot *r_snap)
+{
+  qTreeExportReader   reader;
+  qTreeExportSnapshot snap;
+  int                 n;
+
+  if (!reader.open(path)) {
+    fprintf(stderr, "qtree: can't read %s\n", path);
+    return FALSE;
+  }
+
+  // One cut short may have overwritten part of snap
+  for (n = 0; ((which < 0) || (n <= which)) && reader.next(&snap); ++n)
+    *r_snap = snap;
+  if (!n || ((which >= 0) && (n <= which))) {
+    fprintf(stderr, "qtree: %s has no snapshot %d\n", path, which);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// Name each node's move, & work out its self positions, contention and
+// kind of move
+static void describeNodes
+(const qTreeExportSnapshot *snap, std::vector<nodeInfo> *r_info)
+{
+  const std::vector<qTreeExportNode> &nodes = snap->nodes;
+  std::vector<qPosition>  pos(nodes.size(), snap->pos);
+  std::vector<guint32>    childPositions(nodes.size(), 0);
+  std::vector<guint32>    best(nodes.size(), 0); // Lowest scoring child
+  char                    buf[QWIRE_MOVE_LEN];
+  guint32                 k;
+
+  r_info->resize(nodes.size());
+  for (k = 1; k < nodes.size(); ++k) {
+    const qTreeExportNode *n = &nodes[k];
+    qPlayer                mover = snap->player2move;
+    nodeInfo              *i = &(*r_info)[k];
+
+    if (!(n->depth & 1))
+      mover.changePlayer(); // Our parent's player moved here
+
+    pos[k] = pos[n->parent];
+    if (qWireMoveToNotation(&pos[k], mover, n->mv, buf))
+      i->name = buf;
+    pos[k].applyMove(mover, n->mv);
+
+    if (n->mv.isWallMove())
+      i->kind = KIND_WALL;
+    else {
+      guint8 e = n->mv.getEncoding();
+      i->kind = ((e == moveUp.getEncoding()) ||
+		 (e == moveDown.getEncoding()) ||
+		 (e == moveLeft.getEncoding()) ||
+		 (e == moveRight.getEncoding())) ? KIND_STEP : KIND_JUMP;
+    }
+
+    childPositions[n->parent] += n->positions;
+    if (!best[n->parent] ||
+	(n->eval.score < nodes[best[n->parent]].eval.score))
+      best[n->parent] = k;
+  }
+  (*r_info)[0].kind = KIND_ROOT;
+
+  for (k = 0; k < nodes.size(); ++k) {
+    const qTreeExportNode *n = &nodes[k];
+    nodeInfo              *i = &(*r_info)[k];
+
+    i->self = (n->positions > childPositions[k]) ?
+      n->positions - childPositions[k] : 0;
+
+    // The test qComputationTree::pruneNode() frees by
+    i->cold = FALSE;
+    if (k && (best[n->parent] != k)) {
+      const qPositionEvaluation *b = &nodes[best[n->parent]].eval;
+      i->cold = (static_cast<gint32>(n->eval.score) >
+		 static_cast<gint32>(b->score) + b->complexity +
+		 n->eval.complexity);
+    }
+  }
+}
+
+static int listSnapshots
+(int argc, char **argv)
+{
+  qTreeExportReader   reader;
+  qTreeExportSnapshot snap;
+  int                 n;
+
+  if (argc != 2) {
+    usage();
+    return 2;
+  }
+  if (!reader.open(argv[1])) {
+    fprintf(stderr, "qtree: can't read %s\n", argv[1]);
+    return 1;
+  }
+  for (n = 0; reader.next(&snap); ++n)
+    printf("%4d: %s to move  %7u ms  %9u positions  %6u nodes%s\n",
+	   n, qWirePlayerName(snap.player2move), snap.elapsedMs,
+	   snap.positionsEvaluated, static_cast<guint32>(snap.nodes.size()),
+	   snap.final ? "  (final)" : "");
+  return 0;
+}
+
+// Get the options dot, json & summary share, leaving optind at the path
+static bool snapshotOpts
+(int argc, char **argv, const char *opts, int *r_which, int *r_depth,
+ guint32 *r_minPositions)
+{
+  int c;
+
+  while ((c = getopt(argc, argv, opts)) != -1) {
+    switch (c) {
+    case 's': *r_which        = atoi(optarg);              break;
+    case 'd': *r_depth        = atoi(optarg);              break;
+    case 'p': *r_minPositions = strtoul(optarg, NULL, 10); break;
+    default:
+      usage();
+      return FALSE;
+    }
+  }
+  if (optind != argc - 1) {
+    usage();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static int dot
+(int argc, char **argv)
+{
+  qTreeExportSnapshot   snap;
+  std::vector<nodeInfo> info;
+  std::vector<bool>     shown;
+  int                   which = -1, depth = 2;
+  guint32               minPositions = 0, k;
+
+  if (!snapshotOpts(argc, argv, "s:d:p:", &which, &depth, &minPositions))
+    return 2;
+  if (!readSnapshot(argv[optind], which, &snap))
+    return 1;
+  describeNodes(&snap, &info);
+
+  printf("digraph tree {\n"
+	 "  node [shape=box, fontname=\"Helvetica\", fontsize=10];\n"
+	 "  n0 [label=\"%s to move\\n%u positions, %u ms\"];\n",
+	 qWirePlayerName(snap.player2move), snap.positionsEvaluated,
+	 snap.elapsedMs);
+  shown.resize(snap.nodes.size(), FALSE);
+  shown[0] = TRUE;
+  for (k = 1; k < snap.nodes.size(); ++k) {
+    const qTreeExportNode *n = &snap.nodes[k];
+
+    if (!shown[n->parent] || (n->depth > static_cast<guint32>(depth)) ||
+	(n->positions < minPositions))
+      continue;
+    shown[k] = TRUE;
+    printf("  n%u [label=\"%s\\n%d / %u\\nv%u e%u p%u\"%s];\n"
+	   "  n%u -> n%u;\n",
+	   k, info[k].name.c_str(), n->eval.score, n->eval.complexity,
+	   n->visits, n->expansions, n->positions,
+	   info[k].cold ? ", color=grey, fontcolor=grey" : "",
+	   n->parent, k);
+  }
+  printf("}\n");
+  return 0;
+}
+
+static int json
+(int argc, char **argv)
+{
+  qTreeExportSnapshot   snap;
+  std::vector<nodeInfo> info;
+  int                   which = -1, depth = -1;
+  guint32               minPositions = 0, k;
+  const char           *sep = "";
+
+  if (!snapshotOpts(argc, argv, "s:d:", &which, &depth, &minPositions))
+    return 2;
+  if (!readSnapshot(argv[optind], which, &snap))
+    return 1;
+  describeNodes(&snap, &info);
+
+  printf("{\"player\":\"%s\",\"final\":%s,\"positionsEvaluated\":%u,"
+	 "\"elapsedMs\":%u,\"nodes\":[",
+	 qWirePlayerName(snap.player2move), snap.final ? "true" : "false",
+	 snap.positionsEvaluated, snap.elapsedMs);
+  for (k = 0; k < snap.nodes.size(); ++k) {
+    const qTreeExportNode *n = &snap.nodes[k];
+
+    if ((depth >= 0) && (n->depth > static_cast<guint32>(depth)))
+      continue;
+    printf("%s\n{\"id\":%u,", sep, k);
+    if (k)
+      printf("\"parent\":%u,\"move\":\"%s\",\"kind\":\"%s\",",
+	     n->parent, info[k].name.c_str(), kindNames[info[k].kind]);
+    printf("\"depth\":%u,\"score\":%d,\"complexity\":%u,\"evalDepth\":%u,"
+	   "\"visits\":%u,\"expansions\":%u,\"positions\":%u,\"self\":%u,"
+	   "\"children\":%u,\"cold\":%s}",
+	   n->depth, n->eval.score, n->eval.complexity, n->eval.depth,
+	   n->visits, n->expansions, n->positions, info[k].self,
+	   n->numChildren, info[k].cold ? "true" : "false");
+    sep = ",";
+  }
+  printf("\n]}\n");
+  return 0;
+}
+
+typedef struct _effort {
+  guint32 nodes, visits, expansions;
+  guint64 self, cold;
+} effort;
+
+static void printEffort
+(const char *label, const effort *e, guint64 total)
+{
+  printf("  %-6s %7u %8u %7u %10llu %5.1f%% %10llu %5.1f%%\n",
+	 label, e->nodes, e->visits, e->expansions,
+	 static_cast<unsigned long long>(e->self),
+	 total ? 100.0 * e->self / total : 0.0,
+	 static_cast<unsigned long long>(e->cold),
+	 total ? 100.0 * e->cold / total : 0.0);
+}
+
+static bool morePositions
+(const std::pair<guint32, guint32> &a, const std::pair<guint32, guint32> &b)
+{
+  return a.first > b.first;
+}
+
+static int summary
+(int argc, char **argv)
+{
+  qTreeExportSnapshot   snap;
+  std::vector<nodeInfo> info;
+  std::vector<effort>   byDepth;
+  std::vector<bool>     inCold;
+  effort                byKind[NUM_KINDS];
+  std::vector< std::pair<guint32, guint32> > rootMoves;
+  int                   which = -1, depth = -1;
+  guint32               minPositions = 0, k;
+  guint64               total, cold = 0;
+  char                  label[16];
+
+  if (!snapshotOpts(argc, argv, "s:", &which, &depth, &minPositions))
+    return 2;
+  if (!readSnapshot(argv[optind], which, &snap))
+    return 1;
+  describeNodes(&snap, &info);
+
+  memset(byKind, 0, sizeof(byKind));
+  inCold.resize(snap.nodes.size(), FALSE);
+  total = snap.nodes[0].positions;
+  for (k = 0; k < snap.nodes.size(); ++k) {
+    const qTreeExportNode *n = &snap.nodes[k];
+    effort                *e[2];
+    int                    i;
+
+    if (n->depth >= byDepth.size()) {
+      effort zero = { 0, 0, 0, 0, 0 };
+      byDepth.resize(n->depth + 1, zero);
+    }
+    e[0] = &byDepth[n->depth];
+    e[1] = &byKind[info[k].kind];
+
+    // Self positions below a cold move were spent for nothing, in the end
+    inCold[k] = k && (inCold[n->parent] || info[k].cold);
+    if (k && info[k].cold && !inCold[n->parent])
+      cold += n->positions;
+    for (i = 0; i < 2; ++i) {
+      e[i]->nodes++;
+      e[i]->visits     += n->visits;
+      e[i]->expansions += n->expansions;
+      e[i]->self       += info[k].self;
+      if (inCold[k])
+	e[i]->cold     += info[k].self;
+    }
+    if (n->depth == 1)
+      rootMoves.push_back(std::make_pair(n->positions, k));
+  }
+
+  printf("%s to move%s: %u positions in %u ms, %u nodes, %u deep\n",
+	 qWirePlayerName(snap.player2move), snap.final ? "" : " (mid-search)",
+	 snap.positionsEvaluated, snap.elapsedMs,
+	 static_cast<guint32>(snap.nodes.size()),
+	 static_cast<guint32>(byDepth.size() - 1));
+  printf("  %llu positions below moves out of contention (%.1f%%)\n",
+	 static_cast<unsigned long long>(cold),
+	 total ? 100.0 * cold / total : 0.0);
+
+  printf("\nBy depth:\n"
+	 "  %-6s %7s %8s %7s %10s %6s %10s %6s\n",
+	 "depth", "nodes", "visits", "expands", "self", "", "cold", "");
+  for (k = 0; k < byDepth.size(); ++k) {
+    snprintf(label, sizeof(label), "%u", k);
+    printEffort(label, &byDepth[k], total);
+  }
+
+  printf("\nBy kind of move:\n"
+	 "  %-6s %7s %8s %7s %10s %6s %10s %6s\n",
+	 "kind", "nodes", "visits", "expands", "self", "", "cold", "");
+  for (k = 0; k < NUM_KINDS; ++k)
+    printEffort(kindNames[k], &byKind[k], total);
+
+  std::stable_sort(rootMoves.begin(), rootMoves.end(), morePositions);
+  printf("\nRoot moves, most effort first (of %u):\n"
+	 "  %-8s %6s %6s %5s %8s %10s %6s\n",
+	 static_cast<guint32>(rootMoves.size()),
+	 "move", "score", "cmplx", "depth", "visits", "positions", "");
+  for (k = 0; (k < rootMoves.size()) && (k < QTREE_TOP_MOVES); ++k) {
+    const qTreeExportNode *n = &snap.nodes[rootMoves[k].second];
+
+    printf("  %-8s %6d %6u %5u %8u %10u %5.1f%%%s\n",
+	   info[rootMoves[k].second].name.c_str(), n->eval.score,
+	   n->eval.complexity, n->eval.depth, n->visits, n->positions,
+	   total ? 100.0 * n->positions / total : 0.0,
+	   info[rootMoves[k].second].cold ? "  cold" : "");
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+
+  // Let getopt see the subcommand's options
+  if (!strcmp(argv[1], "record"))
+    return record(argc - 1, argv + 1);
+  if (!strcmp(argv[1], "list"))
+    return listSnapshots(argc - 1, argv + 1);
+  if (!strcmp(argv[1], "dot"))
+    return dot(argc - 1, argv + 1);
+  if (!strcmp(argv[1], "json"))
+    return json(argc - 1, argv + 1);
+  if (!strcmp(argv[1], "summary"))
+    return summary(argc - 1, argv + 1);
+
+  usage();
+  return 2;
+}
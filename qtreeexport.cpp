@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+
+#include "qtreeexport.h"
+#include "qcomptree.h"
+
+IDSTR("$Id$");
+
+
+/****/
+
+#define QTREEEXPORT_MAGIC    0x71747865 /* "qtxe" */
+#define QTREEEXPORT_VERSION  1
+#define QTREEEXPORT_SNAPSHOT 0x01
+#define QTREEEXPORT_FINAL    0x80       // Or'd into the snapshot opcode
+
+#define QTREEEXPORT_BUFSIZ   (1<<20)
+
+typedef struct _qTreeExportHeader {
+  guint32 magic;
+  guint32 version;
+  guint32 posBytes;  // QPOSITION_PACKED_BYTES; differs with QBOARD_SIZE
+} qTreeExportHeader;
+
+
+/***********************
+ * class qTreeExporter *
+ ***********************/
+qTreeExporter::qTreeExporter()
+  :f(NULL), numSnapshots(0), numNodes(0)
+{ ; }
+
+qTreeExporter::~qTreeExporter()
+{
+  close();
+}
+
+bool qTreeExporter::open
+(const char *path)
+{
+  qTreeExportHeader hdr = { QTREEEXPORT_MAGIC, QTREEEXPORT_VERSION,
+			    QPOSITION_PACKED_BYTES };
+
+  close();
+  if (!(f = fopen(path, "wb")))
+    return FALSE;
+  setvbuf(f, NULL, _IOFBF, QTREEEXPORT_BUFSIZ);
+  numSnapshots = 0;
+  numNodes     = 0;
+  return (fwrite(&hdr, sizeof(hdr), 1, f) == 1);
+}
+
+bool qTreeExporter::close
+(void)
+{
+  bool ok;
+
+  if (!f)
+    return FALSE;
+  ok = !ferror(f);
+  ok = (fclose(f) == 0) && ok;
+  f  = NULL;
+  return ok;
+}
+
+void qTreeExporter::putVarint
+(guint32 n)
+{
+  while (n >= 0x80) {
+    putc((n & 0x7f) | 0x80, f);
+    n >>= 7;
+  }
+  putc(n, f);
+}
+
+void qTreeExporter::putSnapshot
+(const qComputationTree *tree,
+ const qPosition        *pos,
+ qPlayer                 player2move,
+ guint32                 positionsEvaluated,
+ guint32                 elapsedMs,
+ bool                    final)
+{
+  std::vector<qComputationTreeNodeId> pending, order;
+  guint8  packed[QPOSITION_PACKED_BYTES];
+  guint32 k;
+
+  if (!f)
+    return;
+
+  // Preorder, children in the order the tree keeps them
+  pending.push_back(tree->getRootNode());
+  while (!pending.empty()) {
+    qComputationTreeNodeId           node = pending.back();
+    const qComputationTreeNodeList  *c = tree->getNodeChildList(node);
+    qComputationTreeNodeList::const_reverse_iterator i;
+
+    pending.pop_back();
+    order.push_back(node);
+    for (i = c->rbegin(); i != c->rend(); ++i)
+      pending.push_back(*i);
+  }
+
+  putc(QTREEEXPORT_SNAPSHOT | (final ? QTREEEXPORT_FINAL : 0), f);
+  putc(player2move.getPlayerId(), f);
+  pos->pack(packed);
+  fwrite(packed, sizeof(packed), 1, f);
+  putVarint(positionsEvaluated);
+  putVarint(elapsedMs);
+  putVarint(order.size());
+
+  for (k = 0; k < order.size(); ++k) {
+    const qPositionEvaluation *eval = tree->getNodeEval(order[k]);
+    guint16                    score;
+
+    if (!eval)
+      eval = positionEval_none;
+    score = static_cast<guint16>(eval->score);
+    putc(tree->getNodePrecedingMove(order[k]).getEncoding(), f);
+    putc(score & 0xff, f);
+    putc(score >> 8, f);
+    putc(eval->complexity & 0xff, f);
+    putc(eval->complexity >> 8, f);
+    putc(eval->depth, f);
+    putVarint(tree->getNodeVisits(order[k]));
+    putVarint(tree->getNodeExpansions(order[k]));
+    putVarint(tree->getNodePositions(order[k]));
+    putVarint(tree->getNodeChildList(order[k])->size());
+  }
+
+  // So a search still running can be looked at
+  fflush(f);
+  ++numSnapshots;
+  numNodes += order.size();
+}
+
+
+/***************************
+ * class qTreeExportReader *
+ ***************************/
+qTreeExportReader::qTreeExportReader()
+  :f(NULL)
+{ ; }
+
+qTreeExportReader::~qTreeExportReader()
+{
+  close();
+}
+
+bool qTreeExportReader::open
+(const char *path)
+{
+  qTreeExportHeader hdr;
+
+  close();
+  if (!(f = fopen(path, "rb")))
+    return FALSE;
+  setvbuf(f, NULL, _IOFBF, QTREEEXPORT_BUFSIZ);
+  if ((fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+      (hdr.magic   != QTREEEXPORT_MAGIC) ||
+      (hdr.version != QTREEEXPORT_VERSION) ||
+      (hdr.posBytes != QPOSITION_PACKED_BYTES)) {
+    close();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void qTreeExportReader::close
+(void)
+{
+  if (f)
+    fclose(f);
+  f = NULL;
+}
+
+bool qTreeExportReader::getVarint
+(guint32 *r_n)
+{
+  guint32 n = 0;
+  int     shift, c;
+
+  for (shift = 0; shift < 35; shift += 7) {
+    if ((c = getc(f)) == EOF)
+      return FALSE;
+    n |= static_cast<guint32>(c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      *r_n = n;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+bool qTreeExportReader::next
+(qTreeExportSnapshot *r_snap)
+{
+  std::vector<guint32> parents, owed; // Nodes still owed children, & how many
+  guint8  packed[QPOSITION_PACKED_BYTES];
+  guint8  buf[6];
+  guint32 numNodes, k;
+  int     c, p;
+
+  if (!f || ((c = getc(f)) == EOF))
+    return FALSE;
+  if ((c & ~QTREEEXPORT_FINAL) != QTREEEXPORT_SNAPSHOT)
+    return FALSE; // Not an export we understand
+  r_snap->final = ((c & QTREEEXPORT_FINAL) != 0);
+
+  if (((p = getc(f)) == EOF) ||
+      (fread(packed, sizeof(packed), 1, f) != 1) ||
+      !getVarint(&r_snap->positionsEvaluated) ||
+      !getVarint(&r_snap->elapsedMs) ||
+      !getVarint(&numNodes) || !numNodes)
+    return FALSE;
+  r_snap->player2move =
+    qPlayer(p ? qPlayer::BlackPlayer : qPlayer::WhitePlayer);
+  r_snap->pos = qPosition::unpack(packed);
+
+  r_snap->nodes.resize(numNodes);
+  for (k = 0; k < numNodes; ++k) {
+    qTreeExportNode *n = &r_snap->nodes[k];
+
+    if ((fread(buf, sizeof(buf), 1, f) != 1) ||
+	!getVarint(&n->visits) ||
+	!getVarint(&n->expansions) ||
+	!getVarint(&n->positions) ||
+	!getVarint(&n->numChildren))
+      return FALSE;
+    n->mv              = qMove(buf[0]);
+    n->eval.score      = static_cast<gint16>(buf[1] | (buf[2] << 8));
+    n->eval.complexity = buf[3] | (buf[4] << 8);
+    n->eval.depth      = buf[5];
+
+    // Our parent is the nearest node before us still owed a child
+    while (!owed.empty() && !owed.back()) {
+      parents.pop_back();
+      owed.pop_back();
+    }
+    if (k && owed.empty())
+      return FALSE; // More nodes than the tree has room for
+    n->parent = k ? parents.back() : 0;
+    n->depth  = k ? r_snap->nodes[n->parent].depth + 1 : 0;
+    if (k)
+      --owed.back();
+    if (n->numChildren) {
+      parents.push_back(k);
+      owed.push_back(n->numChildren);
+    }
+  }
+  return TRUE;
+}
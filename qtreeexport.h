@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_treeexport_h
+#define INCLUDE_treeexport_h 1
+
+#include <stdio.h>
+#include <vector>
+#include "qtypes.h"
+#include "qposition.h"
+#include "qposinfo.h"
+
+class qComputationTree;
+
+/* Search tree exports, for seeing where a search's effort went.
+ *
+ * Hand a qSearcher a qTreeExporter (setTreeExporter()) and it writes its
+ * qComputationTree to the export once each search is done, and if asked,
+ * every so many positions along the way.  Each snapshot is the whole tree
+ * as it stood between dives: the root position, then every node in
+ * preorder with its move, evaluation (from the side to move there), how
+ * many times it was scanned, how many times its moves were generated (more
+ * than once if a prune freed them), the positions evaluated in scanning it
+ * (those below it included), and how many children follow.  Counts are
+ * base-128 varints, so a full tree takes a few hundred KB.  Nodes pruned
+ * before a snapshot are gone from it, but their positions still count at
+ * the nodes above them.
+ *
+ * qTreeExportReader reads the snapshots back, working out each node's
+ * parent & depth; the qtree tool ("make tools") turns them into DOT or
+ * JSON, or summarizes effort by depth and by kind of move.
+ */
+
+// A node as read back.  Nodes are in preorder, so a node's children
+// follow it (each with its own subtree) and the root is node 0.
+typedef struct _qTreeExportNode {
+  qMove               mv;         // The move leading here (none at the root)
+  qPositionEvaluation eval;       // positionEval_none if there wasn't one
+  guint32             visits;
+  guint32             expansions;
+  guint32             positions;  // Below it included
+  guint32             numChildren;
+  guint32             parent;     // Index; 0 for the root as well
+  guint32             depth;      // Plies from the root
+} qTreeExportNode;
+
+typedef struct _qTreeExportSnapshot {
+  bool                         final;   // Taken as the search finished
+  qPosition                    pos;     // At the root
+  qPlayer                      player2move;
+  guint32                      positionsEvaluated; // By the search so far
+  guint32                      elapsedMs;
+  std::vector<qTreeExportNode> nodes;
+
+  _qTreeExportSnapshot() : pos(&qInitialPosition) { ; };
+} qTreeExportSnapshot;
+
+class qTreeExporter {
+ public:
+  qTreeExporter();
+  ~qTreeExporter();
+
+  // Create (or truncate) path.  Returns FALSE on failure.
+  bool open(const char *path);
+
+  // Returns FALSE if anything failed to be written
+  bool close(void);
+
+  // Write tree (with the walker at its root) as it stands; pos &
+  // player2move are the root's
+  void putSnapshot(const qComputationTree *tree,
+		   const qPosition        *pos,
+		   qPlayer                 player2move,
+		   guint32                 positionsEvaluated,
+		   guint32                 elapsedMs,
+		   bool                    final);
+
+  guint32 getNumSnapshots(void) const { return numSnapshots; };
+  guint64 getNumNodes(void) const     { return numNodes; };
+
+ private:
+  FILE   *f;
+  guint32 numSnapshots;
+  guint64 numNodes;
+
+  void putVarint(guint32 n);
+};
+
+class qTreeExportReader {
+ public:
+  qTreeExportReader();
+  ~qTreeExportReader();
+
+  // Returns FALSE if path can't be read or isn't a tree export
+  bool open(const char *path);
+  void close(void);
+
+  // Fetch the next snapshot; FALSE at the end of the export (or at a
+  // snapshot cut short, as a crashed search might leave)
+  bool next(qTreeExportSnapshot *r_snap);
+
+ private:
+  FILE *f;
+
+  bool getVarint(guint32 *r_n);
+};
+
+#endif // INCLUDE_treeexport_h
@@ -25,6 +25,8 @@ typedef int16_t gint16;
 typedef uint16_t guint16;
 typedef int32_t gint32;
 typedef uint32_t guint32;
+typedef int64_t  gint64;
+typedef uint64_t guint64;
 #define G_MININT8       ((gint8)  0x80)
 #define G_MAXINT8       ((gint8)  0x7f)
 #define G_MAXUINT8      ((guint8) 0xff)
@@ -62,14 +64,36 @@ typedef uint32_t guint32;
 
 /* Basic global types and values for Brent's quoridor prog */
 
+/* Board geometry.  The real game is 9x9 with 10 walls a side; building with
+ * e.g. -DQBOARD_SIZE=5 gives a board small enough to search exhaustively.
+ * Everything below that depends on the size is derived from these.
+ * Wall rows & cols are bytes and qMove has 3 bits for each wall coordinate,
+ * so 9 is also the largest board we can represent.
+ */
+#ifndef QBOARD_SIZE
+#define QBOARD_SIZE 9
+#endif
+#ifndef QBOARD_WALLS     /* Walls each player starts with */
+#define QBOARD_WALLS ((QBOARD_SIZE*10)/9)
+#endif
+#define QBOARD_LAST  (QBOARD_SIZE-1) /* Highest x or y; the goal rows */
+#define QWALL_LINES  (QBOARD_SIZE-1) /* Rows (cols) of walls, & slots in each */
+
+#if (QBOARD_SIZE < 3) || (QBOARD_SIZE > 9)
+#error QBOARD_SIZE must be from 3 to 9
+#endif
+#if (QBOARD_WALLS < 0) || (QBOARD_WALLS > 14)
+#error QBOARD_WALLS must fit in a qPosition nibble
+#endif
+
 /* The idea here is to choose values that can be added together to form
  * relative moves from any square to any other
  */
 typedef gint8 qDirection;
 #define  LEFT  (qDirection(-1))
 #define  RIGHT (qDirection(1))
-#define  DOWN  (qDirection(-9))
-#define  UP    (qDirection(9))
+#define  DOWN  (qDirection(-QBOARD_SIZE))
+#define  UP    (qDirection(QBOARD_SIZE))
 
 #undef  FALSE
 #define FALSE 0
@@ -82,13 +106,13 @@ typedef gint8 qDirection;
 class qSquare {
  public:
   guint8 squareNum;
-  enum { maxSquareNum = 80, undefSquareNum };
+  enum { maxSquareNum = QBOARD_SIZE*QBOARD_SIZE-1, undefSquareNum };
 
   // SQUARE_VAL macro included to assist defining qInitialPosition in qpos.cpp
-#define SQUARE_VAL(x,y) ((x)+9*(y))
+#define SQUARE_VAL(x,y) ((x)+QBOARD_SIZE*(y))
   qSquare(guint8 x, guint8 y)
     {
-      assert((x<=8) && (y<=8));
+      assert((x<=QBOARD_LAST) && (y<=QBOARD_LAST));
       squareNum = SQUARE_VAL(x,y);
     }
 
@@ -105,13 +129,13 @@ class qSquare {
   // No need for destructor???
 
   // OPERATORS:
-  guint8 x() const { return squareNum%9; }
-  guint8 y() const { return squareNum/9; }
+  guint8 x() const { return squareNum%QBOARD_SIZE; }
+  guint8 y() const { return squareNum/QBOARD_SIZE; }
 
   /* Rather than do this, we'll make the squareNum public & modifiable.
   guint8 getSquareId() const
     {
-      assert(squareNum <= 80);
+      assert(squareNum <= maxSquareNum);
       return(squareNum);
     }
   */
@@ -125,7 +149,7 @@ class qSquare {
     { g_assert(squareNum+vector <= maxSquareNum); return qSquare(squareNum + vector); }
 
 
-  bool isWhiteWon() const { return ((y())==8); }
+  bool isWhiteWon() const { return ((y())==QBOARD_LAST); }
   bool isBlackWon() const { return ((y())==0); }
 };
 
@@ -186,7 +210,7 @@ class qMove {
   qMove(gint8 deltaX, gint8 deltaY)
     {
       assert((-3 < deltaX) && (deltaX < 3) && (-3 < deltaY) && (deltaY < 3));
-      move = encodeDir(deltaX+9*deltaY);
+      move = encodeDir(deltaX+QBOARD_SIZE*deltaY);
     };
 
   qMove(qDirection d)    { move = encodeDir(d); };
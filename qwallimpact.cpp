@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+
+#include "qwallimpact.h"
+#include "qdijkstra.h"
+#include <string.h>
+#include <deque>
+
+IDSTR("$Id$");
+
+
+/****/
+
+static const qDirection allDirections[] = { UP, DOWN, LEFT, RIGHT };
+
+static inline bool isGoal
+(qPlayer p, qSquare sq)
+{
+  return p.isWhite() ? sq.isWhiteWon() : sq.isBlackWon();
+}
+
+qWallImpact::qWallImpact
+(const qPosition *p)
+  :pos(p)
+{
+  memset(impactCache, IMPACT_UNKNOWN, sizeof(impactCache));
+  computeFields(qPlayer_white);
+  computeFields(qPlayer_black);
+}
+
+void qWallImpact::computeFields
+(qPlayer p)
+{
+  int                 id = p.getPlayerId();
+  qSquare             pawn = pos.getPawn(p);
+  std::deque<qSquare> frontier;
+  int                 i, d;
+  guint8              sq;
+
+  for (sq = 0; sq <= qSquare::maxSquareNum; ++sq) {
+    fromPawn[id][sq]       = toGoal[id][sq]       = NO_ROUTE;
+    routesFromPawn[id][sq] = routesToGoal[id][sq] = 0;
+  }
+
+  // Out from the pawn.  As in qDijkstra(), routes end on reaching goal.
+  fromPawn[id][pawn.squareNum]       = 0;
+  routesFromPawn[id][pawn.squareNum] = 1;
+  frontier.push_back(pawn);
+  while (!frontier.empty()) {
+    qSquare from = frontier.front();
+    frontier.pop_front();
+    if (isGoal(p, from))
+      continue;
+
+    for (i = 0; i < 4; ++i) {
+      if (pos.isBlockedByWall(from, allDirections[i]))
+	continue;
+      qSquare to = from.newSquare(allDirections[i]);
+      d = fromPawn[id][from.squareNum] + 1;
+      if (fromPawn[id][to.squareNum] == NO_ROUTE) {
+	fromPawn[id][to.squareNum] = d;
+	frontier.push_back(to);
+      }
+      if (fromPawn[id][to.squareNum] == d)
+	routesFromPawn[id][to.squareNum] += routesFromPawn[id][from.squareNum];
+    }
+  }
+
+  // Back from the goal row
+  for (sq = 0; sq <= qSquare::maxSquareNum; ++sq)
+    if (isGoal(p, qSquare(sq))) {
+      toGoal[id][sq]       = 0;
+      routesToGoal[id][sq] = 1;
+      frontier.push_back(qSquare(sq));
+    }
+  while (!frontier.empty()) {
+    qSquare from = frontier.front();
+    frontier.pop_front();
+
+    for (i = 0; i < 4; ++i) {
+      if (pos.isBlockedByWall(from, allDirections[i]))
+	continue;
+      qSquare to = from.newSquare(allDirections[i]);
+      d = toGoal[id][from.squareNum] + 1;
+      if (toGoal[id][to.squareNum] == NO_ROUTE) {
+	toGoal[id][to.squareNum] = d;
+	frontier.push_back(to);
+      }
+      if (toGoal[id][to.squareNum] == d)
+	routesToGoal[id][to.squareNum] += routesToGoal[id][from.squareNum];
+    }
+  }
+
+  dist[id] = toGoal[id][pawn.squareNum];
+}
+
+// The two pairs of squares a wall separates: sq[0]|sq[1] & sq[2]|sq[3]
+void qWallImpact::wallEdges
+(qMove wall, guint8 sq[4]) const
+{
+  guint8 rc = wall.wallRowOrColNo(), at = wall.wallPosition();
+
+  g_assert(wall.isWallMove());
+  if (wall.wallMoveIsRow()) {
+    sq[0] = SQUARE_VAL(at,   rc);  sq[1] = SQUARE_VAL(at,   rc+1);
+    sq[2] = SQUARE_VAL(at+1, rc);  sq[3] = SQUARE_VAL(at+1, rc+1);
+  } else {
+    sq[0] = SQUARE_VAL(rc, at);    sq[1] = SQUARE_VAL(rc+1, at);
+    sq[2] = SQUARE_VAL(rc, at+1);  sq[3] = SQUARE_VAL(rc+1, at+1);
+  }
+}
+
+// Shortest routes crossing between two adjacent squares, either way
+double qWallImpact::edgeRoutes
+(int playerId, guint8 sq1, guint8 sq2) const
+{
+  double routes = 0;
+
+  if ((fromPawn[playerId][sq1] != NO_ROUTE) &&
+      (toGoal[playerId][sq2] != NO_ROUTE) &&
+      (fromPawn[playerId][sq1] + 1 + toGoal[playerId][sq2] == dist[playerId]))
+    routes += routesFromPawn[playerId][sq1] * routesToGoal[playerId][sq2];
+
+  if ((fromPawn[playerId][sq2] != NO_ROUTE) &&
+      (toGoal[playerId][sq1] != NO_ROUTE) &&
+      (fromPawn[playerId][sq2] + 1 + toGoal[playerId][sq1] == dist[playerId]))
+    routes += routesFromPawn[playerId][sq2] * routesToGoal[playerId][sq1];
+
+  return routes;
+}
+
+// Whether a route at most slack moves longer than the shortest crosses
+// between two adjacent squares
+bool qWallImpact::edgeNearRoute
+(int playerId, guint8 sq1, guint8 sq2, gint16 slack) const
+{
+  return (((fromPawn[playerId][sq1] != NO_ROUTE) &&
+	   (toGoal[playerId][sq2] != NO_ROUTE) &&
+	   (fromPawn[playerId][sq1] + 1 + toGoal[playerId][sq2] <=
+	    dist[playerId] + slack)) ||
+	  ((fromPawn[playerId][sq2] != NO_ROUTE) &&
+	   (toGoal[playerId][sq1] != NO_ROUTE) &&
+	   (fromPawn[playerId][sq2] + 1 + toGoal[playerId][sq1] <=
+	    dist[playerId] + slack)));
+}
+
+guint16 qWallImpact::getCutShare
+(qPlayer p, qMove wall) const
+{
+  int    id = p.getPlayerId();
+  guint8 sq[4];
+  double cut, total;
+  guint16 share;
+
+  if (dist[id] == NO_ROUTE)
+    return QWALLIMPACT_ALL; // Let getImpact() find there's no route
+  if (dist[id] == 0)
+    return 0;               // Already there
+
+  wallEdges(wall, sq);
+  cut = edgeRoutes(id, sq[0], sq[1]) + edgeRoutes(id, sq[2], sq[3]);
+
+  // A route can cross both edges, so this can overcount; that only costs
+  // getImpact() a needless recheck.
+  total = routesToGoal[id][pos.getPawn(p).squareNum];
+  if (cut >= total)
+    return QWALLIMPACT_ALL;
+  if (cut <= 0)
+    return 0;
+
+  share = (guint16)((cut * QWALLIMPACT_ALL) / total);
+  if (share == 0)
+    share = 1;
+  else if (share >= QWALLIMPACT_ALL)
+    share = QWALLIMPACT_ALL - 1;
+  return share;
+}
+
+gint8 qWallImpact::getImpact
+(qPlayer p, qMove wall) const
+{
+  if (!cutsAllRoutes(p, wall))
+    return 0;
+
+  gint8 *cached = &impactCache[p.getPlayerId()][wall.getEncoding()];
+  if (*cached != IMPACT_UNKNOWN)
+    return *cached;
+
+  // Every shortest route is cut; find the new distance the slow way.
+  // (applyMove() won't drop a wall for a player who has none left.)
+  qPosition    testPos(&pos);
+  qDijkstraArg dArg;
+
+  testPos.setWhiteWallsLeft(1);
+  testPos.applyMove(qPlayer_white, wall);
+  dArg.pos          = &testPos;
+  dArg.player       = p;
+  dArg.getAllRoutes = FALSE;
+  if (!qDijkstra(&dArg))
+    *cached = -1;
+  else
+    *cached = dArg.dist[0] - getDistance(p);
+  return *cached;
+}
+
+bool qWallImpact::isUseless
+(qMove wall, gint16 slack) const
+{
+  guint8 sq[4];
+  int    id;
+
+  wallEdges(wall, sq);
+  for (id = 0; id < 2; ++id) {
+    if (dist[id] == NO_ROUTE)
+      return FALSE;
+    if (edgeNearRoute(id, sq[0], sq[1], slack) ||
+	edgeNearRoute(id, sq[2], sq[3], slack))
+      return FALSE;
+  }
+  return TRUE;
+}
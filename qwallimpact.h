@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2006
+ *    Brent Miller and Charles Morrey.  All rights reserved.
+ *
+ * See the COPYRIGHT_NOTICE file for terms.
+ */
+
+// $Id$
+
+#ifndef INCLUDE_qwallimpact_h
+#define INCLUDE_qwallimpact_h 1
+
+#include "qtypes.h"
+#include "qposition.h"
+
+/* qWallImpact
+ * How much each wall drop would lengthen each player's route to goal,
+ * without applying every wall and rerunning qDijkstra().
+ *
+ * For each player we run two breadth-first passes: one out from the pawn
+ * and one back from the goal row, each counting the shortest routes that
+ * reach every square.  An edge between two squares lies on a shortest route
+ * exactly when (distance from pawn) + 1 + (distance to goal) across it is
+ * the route length, and the number of routes using it is the product of
+ * the two counts.  A wall blocks two edges, so summing their route counts
+ * tells us, for all the walls at once, what share of a player's shortest
+ * routes each one cuts.
+ *
+ * A wall that leaves even one shortest route can't lengthen that route at
+ * all.  Only walls that cut every shortest route can change the distance
+ * (or leave no route), and only those get an exact recheck with qDijkstra().
+ * Like qDijkstra(), this ignores pawns; jumps aren't part of the distance.
+ */
+
+// getCutShare() of a wall cutting all of a player's shortest routes
+#define QWALLIMPACT_ALL 256
+
+class qWallImpact {
+ public:
+  qWallImpact(const qPosition *pos);
+
+  // Moves for p to reach goal, as qDijkstra() counts them (-1 if it can't)
+  gint8   getDistance(qPlayer p) const
+    { return (dist[p.getPlayerId()] == NO_ROUTE) ? -1
+	                                           : dist[p.getPlayerId()]; };
+
+  // Share of p's shortest routes that wall cuts, in 256ths.  0 only if the
+  // wall touches none of them; QWALLIMPACT_ALL if it cuts them all.
+  guint16 getCutShare(qPlayer p, qMove wall) const;
+
+  bool    cutsAllRoutes(qPlayer p, qMove wall) const
+    { return getCutShare(p, wall) >= QWALLIMPACT_ALL; };
+
+  // Exactly how many moves wall adds to p's route; -1 if it leaves none.
+  // Runs qDijkstra() only for walls that cut every shortest route, and
+  // only once per wall, so legality checks, pruning and ordering can all
+  // share one qWallImpact.
+  gint8   getImpact(qPlayer p, qMove wall) const;
+
+  // Whether dropping wall leaves both players a route to goal.  This
+  // doesn't check that the wall fits among those already down.
+  bool    isLegal(qMove wall) const
+    { return ((getImpact(qPlayer_white, wall) >= 0) &&
+	      (getImpact(qPlayer_black, wall) >= 0)); };
+
+  // A wall touching no route of either player that is within slack moves
+  // of the shortest (so with slack 0, one that cuts no shortest route)
+  bool    isUseless(qMove wall, gint16 slack) const;
+
+ private:
+  enum { NO_ROUTE = 0x7fff };
+
+  qPosition pos;
+  gint16    dist[2];
+
+  // Per player & square: distance from the pawn & to the goal row, and
+  // how many shortest routes arrive from each direction
+  gint16    fromPawn[2][qSquare::maxSquareNum+1];
+  gint16    toGoal[2][qSquare::maxSquareNum+1];
+  double    routesFromPawn[2][qSquare::maxSquareNum+1];
+  double    routesToGoal[2][qSquare::maxSquareNum+1];
+
+  // getImpact() results so far, by player & wall encoding
+  enum { IMPACT_UNKNOWN = -128 };
+  mutable gint8 impactCache[2][256];
+
+  void   computeFields(qPlayer p);
+  void   wallEdges(qMove wall, guint8 sq[4]) const;
+  double edgeRoutes(int playerId, guint8 sq1, guint8 sq2) const;
+  bool   edgeNearRoute(int playerId, guint8 sq1, guint8 sq2,
+		       gint16 slack) const;
+};
+
+#endif // INCLUDE_qwallimpact_h
@@ -3,7 +3,9 @@
 #CFLAGS="-g -mcmodel=medium"
 #CFLAGS="-g -fpic -DMALLOC_CHECK_=1"
 DEBUGFLAGS="-g -O0 -m32 -DDEBUG"
-CFLAGS="-fpic $DEBUGFLAGS"
+# Must match what the library was built with, e.g. BOARDFLAGS=-DQBOARD_SIZE=4
+# for testendgame, which is only quick on a small board
+CFLAGS="-fpic $DEBUGFLAGS $BOARDFLAGS"
 
 
 #g++ -I.. ./testmovstack.cpp -L.. -Bdynamic -ldeepquor -o movstack
@@ -13,10 +15,34 @@ CFLAGS="-fpic $DEBUGFLAGS"
 #g++ -g -c ../qposition.cpp
 #g++ -g -c ../qtypes.cpp
 g++ $CFLAGS -c -I.. testmovstack.cpp
-g++ $CFLAGS -o movstack testmovstack.o ../qposinfo.o ../qmovstack.o ../qposhash.o ../qposition.o ../qtypes.o
+g++ $CFLAGS -o movstack testmovstack.o -L.. -ldeepquor -lpthread
 
 g++ $CFLAGS -c -I.. testthink.cpp
-g++ $CFLAGS -o think testthink.o ../qcomptree.o ../qsearcher.o ../eval.o ../qdijkstra.o ../getmoves.o ../qposinfo.o ../qmovstack.o ../qposhash.o ../qposition.o ../qtypes.o
+g++ $CFLAGS -o think testthink.o -L.. -ldeepquor -lpthread
+
+g++ $CFLAGS -c -I.. testfork.cpp
+g++ $CFLAGS -o fork testfork.o -L.. -ldeepquor -lpthread
+
+g++ $CFLAGS -c -I.. testshmtable.cpp
+g++ $CFLAGS -o shmtable testshmtable.o -L.. -ldeepquor -lpthread -lrt
+
+g++ $CFLAGS -c -I.. testjournal.cpp
+g++ $CFLAGS -o journal testjournal.o -L.. -ldeepquor -lpthread -lrt
+
+g++ $CFLAGS -c -I.. testposhash.cpp
+g++ $CFLAGS -o poshash testposhash.o -L.. -ldeepquor -lpthread
+
+g++ $CFLAGS -c -I.. testcomptree.cpp
+g++ $CFLAGS -o comptree testcomptree.o -L.. -ldeepquor -lpthread
+
+g++ $CFLAGS -c -I.. testarchive.cpp
+g++ $CFLAGS -o archive testarchive.o -L.. -ldeepquor -lpthread
+
+g++ $CFLAGS -c -I.. testendgame.cpp
+g++ $CFLAGS -o endgame testendgame.o -L.. -ldeepquor -lpthread
+
+g++ $CFLAGS -c -I.. testevalnet.cpp
+g++ $CFLAGS -o evalnet testevalnet.o -L.. -ldeepquor -lpthread
 
 # -Wl,--stack,128000000
 
@@ -0,0 +1,28 @@
+// $Id$
+
+#ifndef INCLUDE_testcheck_h
+#define INCLUDE_testcheck_h 1
+
+#include <stdio.h>
+
+/* For the testing/ programs that check results rather than dump them.
+ * Each check() prints ok or FAIL beside what it checked; main() ends with
+ * "return checksDone();", which sums up and gives the exit status.
+ */
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok)
+		failures++;
+}
+
+static int checksDone(void)
+{
+	printf("\n%s\n", failures ? "FAILED" : "PASSED");
+	return failures ? 1 : 0;
+}
+
+#endif // INCLUDE_testcheck_h
@@ -0,0 +1,112 @@
+#include "qtypes.h"
+#include "qarchive.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+
+// Checks that archived games replay and are indexed, that a game with an
+// illegal move stops there, and that an archive whose game table points
+// outside the file (or whose games run past it) won't open.
+
+// Copy from to to, with len bytes at offset replaced by bytes (or, with
+// bytes NULL, cut short at offset)
+bool copyDamaged(const char *from, const char *to, long offset,
+		 const void *bytes, size_t len)
+{
+	char  buf[65536];
+	FILE *in = fopen(from, "rb"), *out = fopen(to, "wb");
+	size_t n;
+
+	if (!in || !out)
+		return FALSE;
+	n = fread(buf, 1, sizeof(buf), in);
+	if (bytes)
+		memcpy(buf + offset, bytes, len);
+	else
+		n = offset;
+	fwrite(buf, 1, n, out);
+	fclose(in);
+	return (fclose(out) == 0);
+}
+
+int main
+(int argc, char **argv)
+{
+	qGameArchiveWriter writer;
+	qGameArchive archive, damaged;
+	qGameArchiveIndex index;
+	qPlayer white(qPlayer::WhitePlayer), black(qPlayer::BlackPlayer);
+	qPosition pos(&qInitialPosition), expect(&qInitialPosition);
+	const qArchivePosting *postings;
+	const guint8 *moves;
+	char path[64], idxPath[64], badPath[64];
+	guint64 tableOffset, offset;
+	guint32 n;
+	guint16 numMoves;
+
+	// Up, down, up, and (black) a wall at a time; then the same wall again
+	qMove legal[] = { moveUp, moveDown, moveUp, qMove(TRUE, 3, 3) };
+	qMove illegal[] = { moveUp, qMove(TRUE, 3, 3), qMove(TRUE, 3, 3),
+			    moveDown };
+
+	snprintf(path, sizeof(path), "/tmp/deepquor-archive-%d", (int)getpid());
+	snprintf(idxPath, sizeof(idxPath), "%s.idx", path);
+	snprintf(badPath, sizeof(badPath), "%s.bad", path);
+
+	printf("\nREPLAY\n");
+	check(writer.open(path) && writer.add(legal, 4) &&
+	      writer.add(illegal, 4) && writer.close(),
+	      "write 2 games");
+	check(archive.open(path) && (archive.getNumGames() == 2),
+	      "open the archive");
+	check((archive.getGame(0, &moves) == 4) &&
+	      (moves[3] == qMove(TRUE, 3, 3).getEncoding()),
+	      "game 0 reads back");
+
+	expect.applyMove(white, moveUp);
+	expect.applyMove(black, moveDown);
+	check(archive.positionAt(0, 2, &pos) && (pos == expect),
+	      "replay game 0 to ply 2");
+	check(archive.positionAt(1, 2, &pos),
+	      "replay game 1 up to its illegal move");
+	check(!archive.positionAt(1, 3, &pos) && !archive.positionAt(1, 4, &pos),
+	      "but not past it");
+	check(!archive.positionAt(2, 0, &pos), "there's no game 2");
+
+	printf("\nINDEX\n");
+	check(qGameArchiveIndex::build(&archive, idxPath, 2) &&
+	      index.open(idxPath),
+	      "index the archive");
+	check(index.getNumPostings() == 5 + 3,
+	      "game 1's postings stop at its illegal move");
+	archive.positionAt(1, 2, &pos);
+	n = index.lookup(&pos, white, &postings);
+	check((n == 1) && (postings[0].game == 1) && (postings[0].move == 0),
+	      "where it stops, no move is recorded");
+
+	printf("\nDAMAGE\n");
+	// The table follows game 1; each game is a 3-byte header & its moves
+	tableOffset = 24 + 2 * (3 + 4);
+	offset = tableOffset + 100;
+	check(copyDamaged(path, badPath, tableOffset + 8, &offset,
+			  sizeof(offset)) && !damaged.open(badPath),
+	      "an offset past the table won't open");
+	numMoves = 200;
+	check(copyDamaged(path, badPath, 24, &numMoves, sizeof(numMoves)) &&
+	      !damaged.open(badPath),
+	      "a game running into the table won't open");
+	check(copyDamaged(path, badPath, tableOffset + 8, NULL, 0) &&
+	      !damaged.open(badPath),
+	      "a table cut short won't open");
+	check(damaged.open(path), "the undamaged archive still opens");
+
+	index.close();
+	archive.close();
+	damaged.close();
+	unlink(path);
+	unlink(idxPath);
+	unlink(badPath);
+
+	return checksDone();
+}
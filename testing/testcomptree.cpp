@@ -0,0 +1,177 @@
+#include "qtypes.h"
+#include "qcomptree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <vector>
+#include "check.h"
+
+// Checks that sorting the walker's current node gives its lowest scoring
+// child and leaves the child list in order, while evals change under
+// random walks.  Some nodes share an eval, as transposed positions share
+// a qPositionInfo, so a change made down one branch moves a node on
+// another without setNodeEval() being called for it.
+
+#define FANOUT 5
+#define DEPTH  3
+#define SHARED 8 // Evals the leaves share between them
+
+qComputationTree tree;
+std::map<qComputationTreeNodeId, qPositionEvaluation> evals;
+qPositionEvaluation shared[SHARED];
+std::vector<qComputationTreeNodeId> leaves;
+
+void randomEval(qPositionEvaluation *e)
+{
+	e->score = (rand() % 201) - 100;
+	e->complexity = rand() % 21;
+	e->depth = 0;
+}
+
+// The eval node points at: a leaf's is one of shared[], anyone else's
+// its own
+qPositionEvaluation *evalFor(qComputationTreeNodeId node, int depth)
+{
+	return (depth == DEPTH) ? &shared[node % SHARED] : &evals[node];
+}
+
+void grow(qComputationTreeNodeId node, int depth)
+{
+	qPositionEvaluation e;
+	qComputationTreeNodeId child;
+	int i;
+
+	for (i = 0; (depth < DEPTH) && (i < FANOUT); ++i) {
+		randomEval(&e);
+		// The tree keeps a pointer to the eval; parked in the map
+		// first, it has to be repointed once the child's id is known
+		evals[0] = e;
+		child = tree.addNodeChild(node, moveUp, &evals[0]);
+		if (depth + 1 < DEPTH)
+			evals[child] = e;
+		tree.setNodeEval(child, evalFor(child, depth + 1));
+		if (depth + 1 == DEPTH)
+			leaves.push_back(child);
+		grow(child, depth + 1);
+	}
+}
+
+// Is node's child list in order, and best one of its lowest scoring?
+bool isSorted(qComputationTreeNodeId node, qComputationTreeNodeId best)
+{
+	const qComputationTreeNodeList *l = tree.getNodeChildList(node);
+	qComputationTreeNodeListConstIterator itr;
+	const qPositionEvaluation *e;
+	gint32 prev = G_MININT32, s;
+
+	for (itr = l->begin(); itr != l->end(); ++itr) {
+		e = tree.getNodeEval(*itr);
+		s = e->score - e->complexity;
+		if (s < prev)
+			return FALSE;
+		prev = s;
+	}
+	return (tree.getNodeEval(best)->score ==
+		tree.getNodeEval(tree.getBestScoringChild(node))->score);
+}
+
+// The root's child that node is under
+qComputationTreeNodeId topOf(qComputationTreeNodeId node)
+{
+	while (tree.getNodeParent(node) != tree.getRootNode())
+		node = tree.getNodeParent(node);
+	return node;
+}
+
+// The nth child (from the front) of node
+qComputationTreeNodeId nthChild(qComputationTreeNodeId node, int n)
+{
+	qComputationTreeNodeListConstIterator itr =
+		tree.getNodeChildList(node)->begin();
+
+	while (n--)
+		++itr;
+	return *itr;
+}
+
+// Walk down to a leaf whose eval another leaf shares, under another of
+// the root's children, returning that leaf's parent in *r_other
+qComputationTreeNodeId findTransposedLeaf(qComputationTreeNodeId *r_other)
+{
+	qComputationTreeNodeId l, m;
+	unsigned int i, j;
+
+	for (i = 0; i < leaves.size(); ++i)
+		for (j = 0; j < leaves.size(); ++j) {
+			l = leaves[i];
+			m = leaves[j];
+			if ((tree.getNodeEval(l) != tree.getNodeEval(m)) ||
+			    (topOf(l) == topOf(m)))
+				continue;
+			tree.walkDown(topOf(l));
+			tree.walkDown(tree.getNodeParent(l));
+			tree.walkDown(l);
+			*r_other = tree.getNodeParent(m);
+			return l;
+		}
+	return qComputationTreeNodeId(qComputationTreeNode_invalid);
+}
+
+int main
+(int argc, char **argv)
+{
+	qComputationTreeNodeId best, node, root, other;
+	qPositionEvaluation *e;
+	bool ok;
+	int walk, d;
+
+	srand(1);
+	tree.initializeTree();
+	root = tree.getRootNode();
+	for (d = 0; d < SHARED; ++d)
+		randomEval(&shared[d]);
+	grow(root, 0);
+
+	printf("\nRANDOM WALKS\n");
+	// Follow the best child mostly, as the searcher does, but branch off
+	// now and then; change the leaf's eval and back new ones up the path
+	ok = TRUE;
+	for (walk = 0; walk < 2000; ++walk) {
+		for (d = 0; d < DEPTH; ++d) {
+			best = tree.sortNodeChildList(tree.getCurrentNode());
+			ok &= isSorted(tree.getCurrentNode(), best);
+			tree.walkDown((rand() % 4) ? best :
+				      nthChild(tree.getCurrentNode(),
+					       rand() % FANOUT));
+		}
+		for (d = DEPTH; d > 0; --d) {
+			node = tree.getCurrentNode();
+			e = evalFor(node, d);
+			randomEval(e);
+			tree.setNodeEval(node, e);
+			tree.walkUp();
+		}
+	}
+	check(ok, "every sort finds the best child, in a sorted list");
+	check(tree.getCurrentNode() == root, "the walks end at the root");
+
+	printf("\nTRANSPOSITIONS\n");
+	node = findTransposedLeaf(&other);
+	check(node != qComputationTreeNodeId(qComputationTreeNode_invalid),
+	      "two branches share a leaf's eval");
+
+	// Make the shared eval the worst there is, so it's best in both
+	// parents, but tell only the one we walked through
+	e = evalFor(node, DEPTH);
+	e->score = -200;
+	e->complexity = 0;
+	tree.setNodeEval(node, e);
+	tree.walkUp();
+	tree.walkUp();
+	tree.walkUp();
+	best = tree.sortNodeChildList(other);
+	check((tree.getNodeEval(best) == e) && isSorted(other, best),
+	      "the other branch sees the change when next sorted");
+
+	return checksDone();
+}
@@ -0,0 +1,174 @@
+#include "qtypes.h"
+#include "qposition.h"
+#include "qposinfo.h"
+#include "qendgame.h"
+#include "qio.h"
+#include "getmoves.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include "check.h"
+
+// Checks every endgame the solver settles against a brute-force search of
+// all legal moves: a win it reports must be forced within the plies it
+// says, and a loss must be forced on us within them.  Brute force is only
+// quick on a small board, so this wants the library & itself built with
+// e.g. BOARDFLAGS=-DQBOARD_SIZE=4 (see build.sh).
+
+#define NUM_POSITIONS 300
+#define MAX_BRUTE_NODES 2000000
+
+enum { UNKNOWN, WON, LOST };
+
+static std::map<std::string, int> memo;
+static guint32 bruteNodes;
+
+// Every legal move for player at pos
+void allMoves(const qPosition *pos, qPlayer player, qMoveList *r_moves)
+{
+	int roc, rc, x;
+
+	getPossiblePawnMoves(pos, player, r_moves);
+	if (!pos->numWallsLeft(player))
+		return;
+	for (roc = 0; roc <= 1; ++roc)
+		for (rc = 0; rc < QWALL_LINES; ++rc)
+			for (x = 0; x < QWALL_LINES; ++x) {
+				qMove wall((bool)roc, rc, x);
+				if (qWireIsLegal(pos, player, wall))
+					r_moves->push_back(wall);
+			}
+}
+
+// WON if player to move at pos can force a win within depth plies, LOST if
+// the opponent can, else UNKNOWN
+int brute(const qPosition *pos, qPlayer player, int depth)
+{
+	guint8 packed[QPOSITION_PACKED_BYTES];
+	qMoveList moves;
+	qMoveListIterator m;
+	int result = LOST;
+
+	if (pos->isLost(player))
+		return LOST;
+	if (pos->isWon(player))
+		return WON;
+	if (!depth)
+		return UNKNOWN;
+
+	pos->pack(packed);
+	std::string key((char *)packed, sizeof(packed));
+	key += (char)player.getPlayerId();
+	key += (char)depth;
+	std::map<std::string, int>::iterator hit = memo.find(key);
+	if (hit != memo.end())
+		return hit->second;
+	if (++bruteNodes > MAX_BRUTE_NODES)
+		return UNKNOWN;
+
+	allMoves(pos, player, &moves);
+	if (moves.empty())
+		result = UNKNOWN;
+	for (m = moves.begin(); m != moves.end(); ++m) {
+		qPosition next(pos);
+		int r;
+
+		next.applyMove(player, *m);
+		r = brute(&next, player.otherPlayer(), depth - 1);
+		if (r == LOST) {
+			result = WON;
+			break;
+		}
+		if (r == UNKNOWN)
+			result = UNKNOWN;
+	}
+	if (bruteNodes <= MAX_BRUTE_NODES)
+		memo[key] = result;
+	return result;
+}
+
+// A random endgame: pawns anywhere short of their goals, a wall or two
+// down already, and walls left for one side only
+qPosition randomEndgame(void)
+{
+	qPlayer white(qPlayer::WhitePlayer);
+	guint8 w, b;
+	int i;
+
+	do {
+		w = rand() % (QBOARD_SIZE * QBOARD_LAST);
+		b = QBOARD_SIZE + rand() % (QBOARD_SIZE * QBOARD_LAST);
+	} while (w == b);
+
+	qPosition pos(NULL, NULL,
+		      qSquare(w % QBOARD_SIZE, w / QBOARD_SIZE),
+		      qSquare(b % QBOARD_SIZE, b / QBOARD_SIZE),
+		      2, 0);
+	for (i = rand() % 3; i > 0; --i) {
+		qMove wall((bool)(rand() & 1), rand() % QWALL_LINES,
+			   rand() % QWALL_LINES);
+		if (qWireIsLegal(&pos, white, wall))
+			pos.applyMove(white, wall);
+	}
+	pos.setWhiteWallsLeft(1 + rand() % 2);
+	if (rand() & 1) { // Black's the one with walls
+		pos.setBlackWallsLeft(pos.numWhiteWallsLeft());
+		pos.setWhiteWallsLeft(0);
+	}
+	return pos;
+}
+
+int main
+(int argc, char **argv)
+{
+	qEndgameSolver solver;
+	qPositionEvaluation eval;
+	int i, solved = 0, won = 0, lost = 0, wrong = 0, unchecked = 0;
+	int expect, r;
+
+#if QBOARD_SIZE > 5
+	printf("SKIPPED: brute force wants a small board (QBOARD_SIZE <= 5)\n");
+	return 0;
+#endif
+
+	srand(1);
+	for (i = 0; i < NUM_POSITIONS; ++i) {
+		qPosition pos = randomEndgame();
+		qPlayer player((rand() & 1) ? qPlayer::WhitePlayer :
+			       qPlayer::BlackPlayer);
+
+		if (pos.isWon(player) || pos.isLost(player) ||
+		    !solver.solve(&pos, player, &eval))
+			continue;
+		solved++;
+		expect = (eval.score == positionEval_won->score) ? WON : LOST;
+		if (expect == WON)
+			won++;
+		else
+			lost++;
+
+		memo.clear();
+		bruteNodes = 0;
+		r = brute(&pos, player, eval.depth);
+		if (bruteNodes > MAX_BRUTE_NODES)
+			unchecked++;
+		else if (r != expect) {
+			wrong++;
+			printf("position %d: solver says %s in %u plies, "
+			       "brute force says %s\n", i,
+			       (expect == WON) ? "won" : "lost", eval.depth,
+			       (r == WON) ? "won" : (r == LOST) ? "lost" :
+			       "neither");
+		}
+	}
+	printf("%d of %d solved: %d won, %d lost; %d too big to check\n",
+	       solved, NUM_POSITIONS, won, lost, unchecked);
+
+	check(won && lost, "the solver settles both wins & losses");
+	check(solved - unchecked > solved / 2, "most can be checked");
+	check(!wrong, "every one checked agrees with brute force");
+
+	return checksDone();
+}
@@ -0,0 +1,130 @@
+#include "qtypes.h"
+#include "qposition.h"
+#include "qmovstack.h"
+#include "qevalnet.h"
+#include "qio.h"
+#include "getmoves.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+
+// Checks that the sums qMoveStack keeps up to date move by move match
+// what qEvalNet::refresh() makes from scratch, over random play with
+// pushes & pops mixed in.  applyMove() must see the position before the
+// move, and a wall move with no walls left changes nothing (as in
+// qPosition::applyMove()), so both get a check of their own.
+
+#define NUM_OPS   6000
+#define MAX_MOVES 40
+
+// Random weights, small enough that load() takes them
+bool writeWeights(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	int i, n;
+
+	if (!f)
+		return FALSE;
+	fprintf(f, "qevalnet %d %d %d\n", qEvalFeature_num, EVALNET_HIDDEN,
+		EVALNET_DIST_BUCKETS);
+	n = EVALNET_HIDDEN * (qEvalFeature_num + 2);
+	for (i = 0; i < n; ++i)
+		fprintf(f, "%d\n", (rand() % 41) - 20);
+	fprintf(f, "%d\n", (rand() % 41) - 20);
+	return (fclose(f) == 0);
+}
+
+bool sameSums(const qEvalAccumulator *a, const qEvalAccumulator *b)
+{
+	return (memcmp(a->sum, b->sum, sizeof(a->sum)) == 0);
+}
+
+// A random move for player at pos, walls about a third of the time
+bool randomMove(const qMoveStack *stack, qPlayer player, qMove *r_mv)
+{
+	qMoveList moves, walls;
+	qMoveListIterator i;
+
+	getPossiblePawnMoves(stack->getPos(), player, &moves);
+	if (rand() % 3 == 0) {
+		stack->getPossibleWallMoves(&walls);
+		for (i = walls.begin(); i != walls.end(); ++i)
+			if (qWireIsLegal(stack->getPos(), player, *i))
+				moves.push_back(*i);
+	}
+	if (moves.empty())
+		return FALSE;
+	*r_mv = moves[rand() % moves.size()];
+	return TRUE;
+}
+
+int main
+(int argc, char **argv)
+{
+	qEvalNet net;
+	qMoveStack stack;
+	qEvalAccumulator fresh, acc;
+	qPlayer white(qPlayer::WhitePlayer), black(qPlayer::BlackPlayer);
+	qPosition pos(&qInitialPosition);
+	qMove mv;
+	char path[64];
+	int op, pushes = 0, pops = 0, wrong = 0;
+
+	srand(1);
+	snprintf(path, sizeof(path), "/tmp/deepquor-evalnet-%d", (int)getpid());
+	check(writeWeights(path) && net.load(path) && !net.isZero(),
+	      "load random weights");
+	unlink(path);
+
+	printf("\nRANDOM PLAY\n");
+	stack.setEvalNet(&net);
+	for (op = 0; op < NUM_OPS; ++op) {
+		qPlayer player = stack.getPlayer2Move();
+
+		if (stack.getNumMoves() &&
+		    ((stack.getNumMoves() >= MAX_MOVES) ||
+		     stack.getPos()->isWon(player.otherPlayer()) ||
+		     (rand() % 3 == 0))) {
+			stack.popMove();
+			pops++;
+		} else if (randomMove(&stack, player, &mv)) {
+			stack.pushMove(player, mv);
+			pushes++;
+		} else
+			continue;
+		net.refresh(stack.getPos(), &fresh);
+		if (!sameSums(stack.getEvalAcc(), &fresh))
+			wrong++;
+	}
+	printf("%d pushes, %d pops\n", pushes, pops);
+	check((pushes > NUM_OPS / 3) && (pops > NUM_OPS / 3),
+	      "play mixes pushes & pops");
+	check(!wrong, "the kept sums match a refresh after every one");
+
+	printf("\nSINGLE MOVES\n");
+	net.refresh(&pos, &acc);
+	net.applyMove(&acc, &pos, white, qMove(ROW, 2, 3));
+	pos.applyMove(white, qMove(ROW, 2, 3));
+	net.refresh(&pos, &fresh);
+	check(sameSums(&acc, &fresh), "a wall, applied before the move");
+
+	net.refresh(&pos, &acc);
+	pos.applyMove(black, moveDown);
+	net.applyMove(&acc, &pos, black, moveDown);
+	net.refresh(&pos, &fresh);
+	check(!sameSums(&acc, &fresh),
+	      "a pawn move applied after the move comes out wrong, "
+	      "so the order matters");
+
+	pos.setWhiteWallsLeft(0);
+	net.refresh(&pos, &acc);
+	net.applyMove(&acc, &pos, white, qMove(COL, 5, 5));
+	pos.applyMove(white, qMove(COL, 5, 5));
+	net.refresh(&pos, &fresh);
+	check(sameSums(&acc, &fresh) && !pos.wallAt(COL, 5, 5),
+	      "a wall with none left changes nothing");
+
+	return checksDone();
+}
@@ -0,0 +1,111 @@
+#include "qtypes.h"
+#include "qposhash.h"
+#include "qsearcher.h"
+#include <stdio.h>
+#include "check.h"
+
+// Checks that a fork never writes through to its parent, and that what it
+// doesn't have yet it reads from the parent: first on a bare hash overlay,
+// then on a forked qSearcher.
+
+void testHashOverlay(void)
+{
+	qPositionInfoHash parent, child;
+	qPlayer   white(qPlayer::WhitePlayer), black(qPlayer::BlackPlayer);
+	qPosition start(&qInitialPosition), up(&qInitialPosition);
+	qPosition left(&qInitialPosition);
+	qPositionInfo *pInfo, *cInfo;
+
+	up.applyMove(white, moveUp);
+	left.applyMove(white, moveLeft);
+
+	pInfo = parent.addElt(&start);
+	pInfo->initEval();
+	pInfo->setScore(white, 7);
+	pInfo->setComplexity(white, 3);
+	pInfo = parent.addElt(&up);
+	pInfo->initEval();
+	pInfo->setScore(black, -2);
+
+	child.setParent(&parent);
+
+	printf("\nHASH OVERLAY\n");
+	cInfo = child.getElt(&start);
+	check(cInfo && (cInfo->getScore(white) == 7) &&
+	      (cInfo->getComplexity(white) == 3),
+	      "child reads the parent's elt");
+	check(cInfo != parent.getElt(&start),
+	      "child's copy is its own");
+
+	cInfo->setScore(white, 99);
+	check(parent.getElt(&start)->getScore(white) == 7,
+	      "writing the copy leaves the parent alone");
+	check(child.getElt(&start)->getScore(white) == 99,
+	      "child keeps what it wrote");
+
+	check(child.findOrAddElt(&up)->getScore(black) == -2,
+	      "findOrAddElt reads through too");
+
+	cInfo = child.addElt(&left);
+	cInfo->initEval();
+	check(!parent.getElt(&left),
+	      "child's new elt is not in the parent");
+	check(child.rmElt(&start) && (parent.getElt(&start) != NULL),
+	      "removing from the child leaves the parent's elt");
+	check(parent.getNumElts() == 2, "parent still holds 2 elts");
+}
+
+void testSearcherFork(void)
+{
+	qPlayer   white(qPlayer::WhitePlayer), black(qPlayer::BlackPlayer);
+	qSearcher parent;
+	qSearcher *fork;
+	qSearcherStats before, after, forkStats;
+	qPositionEvaluation pEval, fEval, pEvalAfter;
+	bool pHas, fHas;
+
+	printf("\nSEARCHER FORK\n");
+	parent.searchPositions(white, 0, 2, 1, 0, 2000);
+	parent.getStats(&before);
+	pHas = parent.getEvaluation(white, &pEval);
+
+	fork = parent.fork();
+	fHas = fork->getEvaluation(white, &fEval);
+	check(pHas && fHas && (pEval.score == fEval.score) &&
+	      (pEval.complexity == fEval.complexity) &&
+	      (pEval.depth == fEval.depth),
+	      "fork sees the parent's evaluation of the root");
+
+	fork->applyMove(moveUp, white);
+	fork->searchPositions(black, 0, 3, 1, 0, 5000);
+	fork->applyMove(moveLeft, black);
+	fork->searchPositions(white, 0, 3, 1, 0, 5000);
+	fork->undoMove();
+	fork->undoMove();
+	fork->getStats(&forkStats);
+	check(forkStats.positionsEvaluated > 0, "fork searched");
+
+	parent.getStats(&after);
+	check(after.hashPositions == before.hashPositions,
+	      "fork's searches add nothing to the parent's hash");
+	check(after.positionsEvaluated == before.positionsEvaluated,
+	      "nor to the parent's counts");
+	check(parent.getEvaluation(white, &pEvalAfter) &&
+	      (pEvalAfter.score == pEval.score) &&
+	      (pEvalAfter.complexity == pEval.complexity) &&
+	      (pEvalAfter.depth == pEval.depth),
+	      "parent's evaluation of the root is unchanged");
+	check(*parent.getPos() == qInitialPosition,
+	      "parent's position is unchanged");
+
+	delete fork;
+}
+
+int main
+(int argc, char **argv)
+{
+	testHashOverlay();
+	testSearcherFork();
+
+	return checksDone();
+}
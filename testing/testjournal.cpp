@@ -0,0 +1,128 @@
+#include "qtypes.h"
+#include "qposhash.h"
+#include "qevaljournal.h"
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "check.h"
+
+// Checks that a journal replays what was submitted to it, that a write cut
+// short (here by a file size limit) doesn't misalign the records written
+// after it, and that a snapshot compacted from the journal answers probes.
+
+// Submit an evaluation for the position n pawn moves from the start
+void submitNth(qEvalJournal *journal, qPositionInfoHash *posHash, int n)
+{
+	qPlayer   white(qPlayer::WhitePlayer);
+	qPosition pos(&qInitialPosition);
+	qPositionInfo *info;
+
+	pos.applyMove(white, (n & 1) ? moveLeft : moveRight);
+	pos.applyMove(white, (n & 2) ? moveUp : moveLeft);
+	pos.applyMove(white, (n & 4) ? moveRight : moveUp);
+	info = posHash->findOrAddElt(&pos);
+	info->initEval();
+	info->setScore(white, n);
+	info->setComplexity(white, 100 + n);
+	journal->submit(&pos, info);
+}
+
+// Count the journal's valid records, & the bad ones skipped along the way
+int replay(const char *path, guint32 *r_numBad)
+{
+	qEvalJournalReader reader;
+	qEvalRecord r;
+	int n = 0;
+
+	if (!reader.open(path))
+		return -1;
+	while (reader.next(&r))
+		n++;
+	*r_numBad = reader.getNumBad();
+	return n;
+}
+
+int main
+(int argc, char **argv)
+{
+	qPositionInfoHash posHash;
+	qEvalJournal journal;
+	struct rlimit lim, saved;
+	guint32 numBad;
+	int i, n, tries;
+	char path[64], snapPath[64];
+
+	snprintf(path, sizeof(path), "/tmp/deepquor-journal-%d",
+		 (int)getpid());
+	snprintf(snapPath, sizeof(snapPath), "%s.snap", path);
+	unlink(path);
+
+	printf("\nREPLAY\n");
+	check(journal.open(path), "create the journal");
+	for (i = 0; i < 4; ++i)
+		submitNth(&journal, &posHash, i);
+	journal.close();
+	n = replay(path, &numBad);
+	check((n == 4) && (numBad == 0) && (journal.getNumWritten() == 4),
+	      "4 records written and read back");
+
+	printf("\nSHORT WRITE\n");
+	// Let the file grow by only half a record more, so the next batch's
+	// write comes up short
+	signal(SIGXFSZ, SIG_IGN);
+	getrlimit(RLIMIT_FSIZE, &saved);
+	lim = saved;
+	lim.rlim_cur = 16 + 4 * sizeof(qEvalRecord) + sizeof(qEvalRecord) / 2;
+	setrlimit(RLIMIT_FSIZE, &lim);
+
+	check(journal.open(path), "reopen the journal");
+	submitNth(&journal, &posHash, 4);
+	for (tries = 0; (tries < 500) && !journal.getNumDropped(); ++tries)
+		usleep(10000);
+	check(journal.getNumDropped() == 1, "the cut-short record is dropped");
+
+	setrlimit(RLIMIT_FSIZE, &saved);
+	submitNth(&journal, &posHash, 5);
+	submitNth(&journal, &posHash, 6);
+	journal.close();
+	n = replay(path, &numBad);
+	check((n == 6) && (numBad == 0),
+	      "records after it replay, none garbled");
+
+	printf("\nSNAPSHOT\n");
+	{
+		std::vector<qEvalRecord> records;
+		qEvalJournalReader reader;
+		qEvalSnapshot snap;
+		qEvalRecord r;
+		qPositionInfo *info;
+		qPlayer   white(qPlayer::WhitePlayer);
+		qPosition pos(&qInitialPosition);
+
+		reader.open(path);
+		while (reader.next(&r))
+			records.push_back(r);
+		check(qEvalSnapshot::write(snapPath, &records) &&
+		      snap.open(snapPath) && (snap.getNumRecords() == 6),
+		      "compact the journal into a snapshot");
+
+		// Position 6 was right, up, right
+		pos.applyMove(white, moveRight);
+		pos.applyMove(white, moveUp);
+		pos.applyMove(white, moveRight);
+		posHash.rmElt(&pos);
+		info = posHash.addElt(&pos);
+		info->initEval();
+		check(snap.probe(&pos, info) &&
+		      (info->getScore(white) == 6) &&
+		      (info->getComplexity(white) == 106),
+		      "the snapshot finds a replayed position");
+		snap.close();
+	}
+
+	unlink(path);
+	unlink(snapPath);
+
+	return checksDone();
+}
@@ -0,0 +1,135 @@
+#include "qtypes.h"
+#include "qposhash.h"
+#include <stdio.h>
+#include "check.h"
+
+// Checks that a qPositionInfoHash finds everything while it's part way
+// through doubling its buckets: plain lookups, removals, and a child
+// hash reading through to a parent that's mid-rehash.
+
+#define NUM_SQUARES (QBOARD_SIZE*QBOARD_SIZE)
+
+// The nth of a run of distinct positions (pawn squares & walls left)
+qPosition nthPosition(int n)
+{
+	guint8 w = n % NUM_SQUARES;
+	guint8 b = (n / NUM_SQUARES) % NUM_SQUARES;
+	guint8 walls = n / (NUM_SQUARES * NUM_SQUARES);
+
+	return qPosition(NULL, NULL,
+			 qSquare(w % QBOARD_SIZE, w / QBOARD_SIZE),
+			 qSquare(b % QBOARD_SIZE, b / QBOARD_SIZE),
+			 walls, 0);
+}
+
+// Add positions 0, 1, ... until a doubling starts; return how many
+int fillUntilRehashing(qPositionInfoHash *h)
+{
+	qPlayer white(qPlayer::WhitePlayer);
+	qPositionInfo *info;
+	qPosition pos(&qInitialPosition);
+	int n;
+
+	for (n = 0; !h->isRehashing() && (n < 15 * NUM_SQUARES * NUM_SQUARES);
+	     ++n) {
+		pos = nthPosition(n);
+		info = h->addElt(&pos);
+		info->initEval();
+		info->setScore(white, n % 1000);
+	}
+	return n;
+}
+
+// Is position n in h, with the score it was added with?
+bool hasNth(qPositionInfoHash *h, int n)
+{
+	qPlayer white(qPlayer::WhitePlayer);
+	qPosition pos = nthPosition(n);
+	qPositionInfo *info = h->getElt(&pos);
+
+	return info && (info->getScore(white) == n % 1000);
+}
+
+int main
+(int argc, char **argv)
+{
+	qPlayer white(qPlayer::WhitePlayer);
+	qPosition pos(&qInitialPosition);
+	qPositionInfo *info;
+	bool isNew, ok;
+	int n, i, midRehash;
+
+	printf("\nLOOKUPS\n");
+	{
+		qPositionInfoHash h;
+		guint32 startBuckets = h.getNumBuckets();
+
+		n = fillUntilRehashing(&h);
+		check(h.isRehashing(), "a doubling starts as the hash fills");
+
+		// Each lookup moves a few more buckets, so these span the rehash
+		ok = TRUE;
+		midRehash = 0;
+		for (i = 0; i < n; ++i) {
+			midRehash += h.isRehashing();
+			ok &= hasNth(&h, i);
+		}
+		check(ok, "every position is found");
+		check(midRehash > 100, "... many of them while it's under way");
+		check(!h.isRehashing() && (h.getNumBuckets() == 2 * startBuckets),
+		      "the rehash finishes with twice the buckets");
+		check(ok && hasNth(&h, 0) && hasNth(&h, n - 1),
+		      "and everything is still found after it");
+	}
+
+	printf("\nREMOVALS\n");
+	{
+		qPositionInfoHash h;
+
+		n = fillUntilRehashing(&h);
+		ok = TRUE;
+		for (i = 0; i < n; i += 16)
+			ok &= h.rmElt(&(pos = nthPosition(i)));
+		check(ok, "every 16th position is removed");
+		check(h.isRehashing(), "... while the rehash is still going");
+		check(!h.rmElt(&(pos = nthPosition(0))),
+		      "a removed position can't be removed again");
+
+		ok = TRUE;
+		for (i = 0; i < n; ++i)
+			ok &= ((i % 16 != 0) == hasNth(&h, i));
+		check(ok, "removed positions are gone, the rest are found");
+		check(h.getNumElts() == (guint32)(n - (n + 15) / 16),
+		      "the count is right");
+	}
+
+	printf("\nPARENT\n");
+	{
+		qPositionInfoHash parent, child;
+
+		n = fillUntilRehashing(&parent);
+		child.setParent(&parent);
+
+		ok = TRUE;
+		for (i = 0; i < n - 1; ++i)
+			ok &= hasNth(&child, i);
+		check(ok, "the child finds the parent's positions");
+		check(parent.isRehashing(),
+		      "... without moving the parent's rehash along");
+		check(child.getNumElts() == (guint32)n - 1, "and has copied each");
+
+		pos = nthPosition(n / 3);
+		child.getElt(&pos)->setScore(white, -1);
+		pos = nthPosition(n - 1);
+		info = child.findOrAddElt(&pos, &isNew);
+		check(info && !isNew && (info->getScore(white) == (n - 1) % 1000),
+		      "findOrAddElt inherits a parent position");
+		pos = nthPosition(n);
+		info = child.findOrAddElt(&pos, &isNew);
+		check(info && isNew, "and adds a new one to the child");
+		check(hasNth(&parent, n / 3) && !parent.getElt(&pos),
+		      "the parent's positions aren't modified");
+	}
+
+	return checksDone();
+}
@@ -0,0 +1,97 @@
+#include "qtypes.h"
+#include "qposhash.h"
+#include "qshmtable.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+
+// Checks that evaluations stored in the shared table come back out,
+// including through a second attachment to the same segment, and that an
+// entry whose words happen to XOR to 0 isn't lost.
+
+// XOR of the position's key words, as qSharedPositionTable packs them
+guint32 keyXor(const qPosition *pos)
+{
+	guint32 key[QSHM_KEY_WORDS];
+	guint32 x = 0;
+	unsigned int i;
+
+	memset(key, 0, sizeof(key));
+	memcpy(key, pos, sizeof(*pos));
+	for (i = 0; i < QSHM_KEY_WORDS; ++i)
+		x ^= key[i];
+	return x;
+}
+
+int main
+(int argc, char **argv)
+{
+	qPositionInfoHash posHash;
+	qSharedPositionTable table, other;
+	qPlayer   white(qPlayer::WhitePlayer), black(qPlayer::BlackPlayer);
+	qPosition start(&qInitialPosition), up(&qInitialPosition);
+	qPosition left(&qInitialPosition);
+	qPositionInfo *info, *fresh;
+	qPositionEvaluation e;
+	char name[64];
+
+	snprintf(name, sizeof(name), "/deepquor-test-%d", (int)getpid());
+	qSharedPositionTable::destroy(name);
+	check(table.attach(name, 64), "create the segment");
+	check(other.attach(name, 0), "attach to it again");
+
+	up.applyMove(white, moveUp);
+	left.applyMove(white, moveLeft);
+
+	printf("\nROUND TRIP\n");
+	info = posHash.addElt(&start);
+	info->initEval();
+	info->setScore(white, 12);
+	info->setComplexity(white, 40);
+	table.store(&start, info);
+
+	fresh = posHash.addElt(&up);
+	fresh->initEval();
+	check(!table.probe(&up, fresh), "a position never stored misses");
+
+	posHash.rmElt(&start);
+	fresh = posHash.addElt(&start);
+	fresh->initEval();
+	check(other.probe(&start, fresh) &&
+	      (fresh->getScore(white) == 12) &&
+	      (fresh->getComplexity(white) == 40) &&
+	      !fresh->evalExists(black),
+	      "the other attachment reads back what was stored");
+	check(!other.probe(&start, fresh),
+	      "nothing better settled to copy the second time");
+
+	printf("\nZERO CHECK WORD\n");
+	// Pick black's eval so every word of the entry XORs to 0
+	e.score = 5;
+	e.complexity = 10;
+	e.depth = 0;
+	qUnpackEval(keyXor(&left) ^ qPackEval(&e), &e);
+	info = posHash.addElt(&left);
+	info->initEval();
+	info->setScore(white, 5);
+	info->setComplexity(white, 10);
+	info->set(black, &e);
+	check(info->evalExists(black), "black's eval is one we can store");
+	table.store(&left, info);
+
+	posHash.rmElt(&left);
+	fresh = posHash.addElt(&left);
+	fresh->initEval();
+	check(table.probe(&left, fresh) &&
+	      (fresh->getScore(white) == 5) &&
+	      (fresh->getScore(black) == e.score) &&
+	      (fresh->getComplexity(black) == e.complexity),
+	      "an entry that XORs to 0 reads back");
+
+	other.detach();
+	table.detach();
+	check(qSharedPositionTable::destroy(name), "remove the segment");
+
+	return checksDone();
+}